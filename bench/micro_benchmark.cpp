@@ -0,0 +1,392 @@
+#include "common/config.h"
+#include "common/types.h"
+#include "mapper/hilbert_mapper.h"
+#include "node/leaf_node.h"
+#include "node/node.h"
+#include "node/node_soa.h"
+#include "sort/sorter.h"
+#include "transformer/transformer.h"
+#include "tree/tree.h"
+
+#include <benchmark/benchmark.h>
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <vector>
+
+namespace ursus {
+namespace bench {
+
+//===--------------------------------------------------------------------===//
+// Data
+//===--------------------------------------------------------------------===//
+// distribution of the generated points, the second argument of every
+// benchmark that takes data
+enum Distribution {
+  DISTRIBUTION_UNIFORM = 0,
+  // gaussian clusters around a few random centers
+  DISTRIBUTION_CLUSTERED = 1,
+  // most points close to the origin
+  DISTRIBUTION_SKEWED = 2
+};
+
+static const char* DistributionToString(int distribution) {
+  switch(distribution) {
+    case DISTRIBUTION_UNIFORM: return "uniform";
+    case DISTRIBUTION_CLUSTERED: return "clustered";
+    case DISTRIBUTION_SKEWED: return "skewed";
+  }
+  return "invalid";
+}
+
+// number_of_data points of number_of_dims in [0, 1), always the same ones for
+// the same arguments
+static std::vector<Point> GeneratePoints(ul number_of_data, ui number_of_dims,
+                                         int distribution) {
+  std::mt19937_64 generator(number_of_data*31+number_of_dims*7+distribution);
+  std::uniform_real_distribution<Point> uniform(0.f, 1.f);
+  std::normal_distribution<Point> normal(0.f, 0.05f);
+
+  std::vector<Point> centers(16*number_of_dims);
+  for(auto& center : centers) {
+    center = uniform(generator);
+  }
+
+  std::vector<Point> points(number_of_data*number_of_dims);
+  for(ul point_itr = 0; point_itr < number_of_data; point_itr++) {
+    auto cluster = generator()%16;
+    for(ui dim = 0; dim < number_of_dims; dim++) {
+      Point point;
+      switch(distribution) {
+        case DISTRIBUTION_CLUSTERED:
+          point = centers[cluster*number_of_dims+dim]+normal(generator);
+          break;
+        case DISTRIBUTION_SKEWED:
+          point = std::pow(uniform(generator), 4.f);
+          break;
+        default:
+          point = uniform(generator);
+          break;
+      }
+      points[point_itr*number_of_dims+dim] = std::min(std::max(point, 0.f), 0.999999f);
+    }
+  }
+  return points;
+}
+
+// branches of points in GetNumberOfDims(), indexed from 1 in data order
+static std::vector<node::Branch> GenerateBranches(ul number_of_data, int distribution) {
+  auto points = GeneratePoints(number_of_data, GetNumberOfDims(), distribution);
+
+  std::vector<node::Branch> branches(number_of_data);
+  for(ul branch_itr = 0; branch_itr < number_of_data; branch_itr++) {
+    branches[branch_itr].SetRect(&points[branch_itr*GetNumberOfDims()]);
+    branches[branch_itr].SetIndex(branch_itr+1);
+    branches[branch_itr].SetChildOffset(0);
+  }
+  return branches;
+}
+
+// query boxes whose sides are 'extent' long, lower corners from the same
+// distribution as the data
+static std::vector<Point> GenerateQueries(ui number_of_queries, int distribution,
+                                          Point extent) {
+  auto lower = GeneratePoints(number_of_queries, GetNumberOfDims(), distribution);
+
+  std::vector<Point> queries(number_of_queries*GetNumberOfDims()*2);
+  for(ui query_itr = 0; query_itr < number_of_queries; query_itr++) {
+    for(ui dim = 0; dim < GetNumberOfDims(); dim++) {
+      auto query = &queries[query_itr*GetNumberOfDims()*2];
+      query[dim] = lower[query_itr*GetNumberOfDims()+dim];
+      query[dim+GetNumberOfDims()] = query[dim]+extent;
+    }
+  }
+  return queries;
+}
+
+static void SetLabel(benchmark::State& state, int distribution) {
+  state.SetLabel(std::string(DistributionToString(distribution))+
+                 "/dims:"+std::to_string(GetNumberOfDims()));
+}
+
+//===--------------------------------------------------------------------===//
+// Bench Tree
+//===--------------------------------------------------------------------===//
+// gives the benchmarks the build steps of a tree without building or
+// searching a whole index
+class BenchTree : public tree::Tree {
+ public:
+  ~BenchTree() {
+    delete[] b_node_ptr;
+  }
+
+  bool Build(std::shared_ptr<io::DataSet> input_data_set) { return false; }
+
+  bool DumpFromFile(std::string index_name) { return false; }
+
+  bool DumpToFile(std::string index_name) { return false; }
+
+  int Search(std::shared_ptr<io::DataSet> query_data_set,
+             ui number_of_search, ui number_of_repeat) { return -1; }
+
+  // leaf nodes of the bottom-up tree filled with the branches, upper levels
+  // left for BottomUpBuildonCPU
+  void CopyLeafNodes(std::vector<node::Branch>& branches) {
+    level_node_count = GetLevelNodeCount(branches);
+    device_node_count = 0;
+    GetDeviceNodeCount(level_node_count);
+
+    delete[] b_node_ptr;
+    b_node_ptr = new node::LeafNode[device_node_count];
+    CopyBranchToLeafNode(branches, NODE_TYPE_LEAF, level_node_count.size()-1,
+                         device_node_count-level_node_count.back(), b_node_ptr);
+  }
+
+  // the upper levels on a single thread, the way Bottom_Up does on CPU
+  void BuildUpperLevels(void) {
+    ul current_offset = device_node_count;
+    for(ui level_itr = level_node_count.size()-1; level_itr > 0; level_itr--) {
+      current_offset -= level_node_count[level_itr];
+      ul parent_offset = current_offset-level_node_count[level_itr-1];
+      BottomUpBuildonCPU(current_offset, parent_offset, b_node_ptr,
+                         0, level_node_count[level_itr]);
+    }
+  }
+
+  node::LeafNode* GetLeafNodes(void) const { return b_node_ptr; }
+
+  ui GetNodeCount(void) const { return device_node_count; }
+
+ private:
+  std::vector<ui> level_node_count;
+};
+
+//===--------------------------------------------------------------------===//
+// Node
+//===--------------------------------------------------------------------===//
+// args: # of queries, distribution
+static void BM_Node_IsOverlap(benchmark::State& state) {
+  auto number_of_queries = state.range(0);
+  int distribution = state.range(1);
+
+  auto branches = GenerateBranches(GetNumberOfUpperTreeDegrees(), distribution);
+  node::Node node;
+  for(ui branch_itr = 0; branch_itr < branches.size(); branch_itr++) {
+    node.SetBranch(branches[branch_itr], branch_itr);
+  }
+  node.SetBranchCount(branches.size());
+  node.SetNodeType(NODE_TYPE_LEAF);
+
+  auto queries = GenerateQueries(number_of_queries, distribution, 0.1f);
+
+  for(auto _ : state) {
+    ui hit = 0;
+    for(ui query_itr = 0; query_itr < number_of_queries; query_itr++) {
+      auto query = &queries[query_itr*GetNumberOfDims()*2];
+      for(ui branch_itr = 0; branch_itr < node.GetBranchCount(); branch_itr++) {
+        hit += node.IsOverlap(query, branch_itr);
+      }
+    }
+    benchmark::DoNotOptimize(hit);
+  }
+  state.SetItemsProcessed(state.iterations()*number_of_queries*node.GetBranchCount());
+  SetLabel(state, distribution);
+}
+
+// args: # of queries, distribution
+static void BM_Node_SOA_IsOverlap(benchmark::State& state) {
+  auto number_of_queries = state.range(0);
+  int distribution = state.range(1);
+
+  auto branches = GenerateBranches(GetNumberOfLeafNodeDegrees(), distribution);
+  node::Node_SOA node_soa;
+  for(ui branch_itr = 0; branch_itr < branches.size(); branch_itr++) {
+    for(ui dim = 0; dim < GetNumberOfDims()*2; dim++) {
+      node_soa.SetBranchPoint(branch_itr, branches[branch_itr].GetPoint(dim), dim);
+    }
+    node_soa.SetIndex(branch_itr, branches[branch_itr].GetIndex());
+    node_soa.SetChildOffset(branch_itr, 0);
+  }
+  node_soa.SetBranchCount(branches.size());
+  node_soa.SetNodeType(NODE_TYPE_LEAF);
+  node_soa.SetLevel(0);
+
+  auto queries = GenerateQueries(number_of_queries, distribution, 0.1f);
+
+  for(auto _ : state) {
+    ui hit = 0;
+    for(ui query_itr = 0; query_itr < number_of_queries; query_itr++) {
+      auto query = &queries[query_itr*GetNumberOfDims()*2];
+      for(ui branch_itr = 0; branch_itr < node_soa.GetBranchCount(); branch_itr++) {
+        hit += node_soa.IsOverlap(query, branch_itr);
+      }
+    }
+    benchmark::DoNotOptimize(hit);
+  }
+  state.SetItemsProcessed(state.iterations()*number_of_queries*node_soa.GetBranchCount());
+  SetLabel(state, distribution);
+}
+
+//===--------------------------------------------------------------------===//
+// Mapper
+//===--------------------------------------------------------------------===//
+// args: # of data, distribution, # of dims
+static void BM_HilbertMapper_MappingIntoSingle(benchmark::State& state) {
+  auto number_of_data = state.range(0);
+  int distribution = state.range(1);
+  ui number_of_dims = state.range(2);
+  ui number_of_bits = mapper::HilbertMapper::GetNumberOfBits(number_of_dims);
+
+  auto points = GeneratePoints(number_of_data, number_of_dims, distribution);
+  std::vector<ll> indexes(number_of_data);
+
+  for(auto _ : state) {
+    mapper::HilbertMapper::MappingIntoSingle(number_of_dims, number_of_bits,
+                                             points.data(), number_of_data,
+                                             indexes.data());
+    benchmark::ClobberMemory();
+  }
+  state.SetItemsProcessed(state.iterations()*number_of_data);
+  state.SetLabel(std::string(DistributionToString(distribution))+
+                 "/dims:"+std::to_string(number_of_dims));
+}
+
+//===--------------------------------------------------------------------===//
+// Sort
+//===--------------------------------------------------------------------===//
+// args: # of data, distribution
+static void BM_Sorter_Sort(benchmark::State& state) {
+  auto number_of_data = state.range(0);
+  int distribution = state.range(1);
+
+  // sorted by their Hilbert index as in a build
+  auto branches = GenerateBranches(number_of_data, distribution);
+  std::vector<Point> points(number_of_data*GetNumberOfDims());
+  for(ul branch_itr = 0; branch_itr < branches.size(); branch_itr++) {
+    for(ui dim = 0; dim < GetNumberOfDims(); dim++) {
+      points[branch_itr*GetNumberOfDims()+dim] = branches[branch_itr].GetPoint(dim);
+    }
+  }
+  std::vector<ll> indexes(number_of_data);
+  mapper::HilbertMapper::MappingIntoSingle(GetNumberOfDims(), (GetNumberOfDims()>2) ? 20:31,
+                                           points.data(), number_of_data, indexes.data());
+  for(ul branch_itr = 0; branch_itr < branches.size(); branch_itr++) {
+    branches[branch_itr].SetIndex(indexes[branch_itr]);
+  }
+
+  for(auto _ : state) {
+    state.PauseTiming();
+    auto unsorted_branches = branches;
+    state.ResumeTiming();
+
+    sort::Sorter::Sort(unsorted_branches);
+    benchmark::ClobberMemory();
+  }
+  state.SetItemsProcessed(state.iterations()*number_of_data);
+  SetLabel(state, distribution);
+}
+
+//===--------------------------------------------------------------------===//
+// Tree
+//===--------------------------------------------------------------------===//
+// args: # of data, distribution
+static void BM_Transformer_Transform(benchmark::State& state) {
+  auto number_of_data = state.range(0);
+  int distribution = state.range(1);
+
+  auto branches = GenerateBranches(number_of_data, distribution);
+  BenchTree tree;
+  tree.CopyLeafNodes(branches);
+  tree.BuildUpperLevels();
+
+  for(auto _ : state) {
+    auto node_soa = transformer::Transformer::Transform(tree.GetLeafNodes(),
+                                                        tree.GetNodeCount());
+    state.PauseTiming();
+    delete[] node_soa;
+    state.ResumeTiming();
+  }
+  state.SetItemsProcessed(state.iterations()*tree.GetNodeCount());
+  state.counters["nodes"] = tree.GetNodeCount();
+  SetLabel(state, distribution);
+}
+
+// args: # of data, distribution
+static void BM_Tree_BottomUpBuildonCPU(benchmark::State& state) {
+  auto number_of_data = state.range(0);
+  int distribution = state.range(1);
+
+  auto branches = GenerateBranches(number_of_data, distribution);
+  BenchTree tree;
+  tree.CopyLeafNodes(branches);
+
+  // only parents are written, so the leaves stay the same across iterations
+  for(auto _ : state) {
+    tree.BuildUpperLevels();
+    benchmark::ClobberMemory();
+  }
+  state.SetItemsProcessed(state.iterations()*number_of_data);
+  state.counters["nodes"] = tree.GetNodeCount();
+  SetLabel(state, distribution);
+}
+
+// args: # of data, distribution
+static void BM_Tree_CreateNode(benchmark::State& state) {
+  auto number_of_data = state.range(0);
+  int distribution = state.range(1);
+
+  auto branches = GenerateBranches(number_of_data, distribution);
+  BenchTree tree;
+
+  for(auto _ : state) {
+    std::vector<ui> level_node_count;
+    auto root = tree.CreateNode(branches, 0, number_of_data-1, level_node_count);
+
+    state.PauseTiming();
+    delete[] root;
+    state.ResumeTiming();
+  }
+  state.SetItemsProcessed(state.iterations()*number_of_data);
+  SetLabel(state, distribution);
+}
+
+//===--------------------------------------------------------------------===//
+// Arguments
+//===--------------------------------------------------------------------===//
+static void QueryArguments(benchmark::internal::Benchmark* benchmark) {
+  for(int distribution = DISTRIBUTION_UNIFORM; distribution <= DISTRIBUTION_SKEWED; distribution++) {
+    benchmark->Args({1<<10, distribution});
+  }
+}
+
+static void DataArguments(benchmark::internal::Benchmark* benchmark) {
+  for(int distribution = DISTRIBUTION_UNIFORM; distribution <= DISTRIBUTION_SKEWED; distribution++) {
+    for(int number_of_data = 1<<14; number_of_data <= 1<<20; number_of_data <<= 3) {
+      benchmark->Args({number_of_data, distribution});
+    }
+  }
+}
+
+static void MappingArguments(benchmark::internal::Benchmark* benchmark) {
+  for(int distribution = DISTRIBUTION_UNIFORM; distribution <= DISTRIBUTION_SKEWED; distribution++) {
+    for(int number_of_data = 1<<14; number_of_data <= 1<<20; number_of_data <<= 3) {
+      for(int number_of_dims : {2, 3, 4, 8}) {
+        benchmark->Args({number_of_data, distribution, number_of_dims});
+      }
+    }
+  }
+}
+
+BENCHMARK(BM_Node_IsOverlap)->Apply(QueryArguments);
+BENCHMARK(BM_Node_SOA_IsOverlap)->Apply(QueryArguments);
+BENCHMARK(BM_HilbertMapper_MappingIntoSingle)->Apply(MappingArguments);
+BENCHMARK(BM_Sorter_Sort)->Apply(DataArguments)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_Transformer_Transform)->Apply(DataArguments)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_Tree_BottomUpBuildonCPU)->Apply(DataArguments)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_Tree_CreateNode)->Apply(DataArguments)->Unit(benchmark::kMillisecond);
+
+} // End of bench namespace
+} // End of ursus namespace
+
+BENCHMARK_MAIN();
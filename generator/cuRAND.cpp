@@ -56,13 +56,8 @@ int main(int argc, char *argv[]) {
   /* Copy device memory to host */ 
   CUDA_CALL(cudaMemcpy(hostData, devData, nData*nDims*sizeof(float), cudaMemcpyDeviceToHost)); 
 
-  /* Show result */ 
-  for(int i=1; i<=nData*nDims; i++) { 
-    //printf("%1.4f ", hostData[i]); 
-    fwrite(&hostData[i], sizeof(float), 1, fp);
-    //if( i%nDims == 0 ) printf("\n");
-  } 
-  printf("\n"); 
+  /* Write result */ 
+  fwrite(hostData, sizeof(float), (size_t)nData*nDims, fp);
 
 
   /* Cleanup */ 
@@ -0,0 +1,470 @@
+#include "generator.h"
+
+#include "common/macro.h"
+#include "common/thread_pool.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdio>
+#include <limits>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace ursus {
+namespace generator {
+
+//===--------------------------------------------------------------------===//
+// DistributionType <--> String Utilities
+//===--------------------------------------------------------------------===//
+
+std::string DistributionTypeToString(DistributionType type) {
+  switch (type) {
+    case (DISTRIBUTION_TYPE_UNIFORM):
+      return "uniform";
+    case (DISTRIBUTION_TYPE_CLUSTERED):
+      return "clustered";
+    case (DISTRIBUTION_TYPE_ZIPF):
+      return "zipf";
+    case (DISTRIBUTION_TYPE_RESAMPLE):
+      return "resample";
+    default:
+      return "invalid";
+  }
+}
+
+DistributionType StringToDistributionType(std::string str) {
+  if (str == "uniform" || str == "u") {
+    return DISTRIBUTION_TYPE_UNIFORM;
+  } else if (str == "clustered" || str == "c" || str == "gaussian") {
+    return DISTRIBUTION_TYPE_CLUSTERED;
+  } else if (str == "zipf" || str == "z") {
+    return DISTRIBUTION_TYPE_ZIPF;
+  } else if (str == "resample" || str == "r" || str == "real") {
+    return DISTRIBUTION_TYPE_RESAMPLE;
+  }
+  return DISTRIBUTION_TYPE_INVALID;
+}
+
+//===--------------------------------------------------------------------===//
+// Random
+//===--------------------------------------------------------------------===//
+
+static ull SplitMix64(ull& x) {
+  ull z = (x += 0x9E3779B97F4A7C15ull);
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+  return z ^ (z >> 31);
+}
+
+static inline ull RotateLeft(const ull x, int k) {
+  return (x << k) | (x >> (64 - k));
+}
+
+Random::Random(ull seed, ull stream) {
+  ull x = seed ^ SplitMix64(stream);
+  for(ui range(state_itr, 0, 4)) {
+    state[state_itr] = SplitMix64(x);
+  }
+}
+
+ull Random::Next(void) {
+  const ull result = RotateLeft(state[1] * 5, 7) * 9;
+  const ull t = state[1] << 17;
+
+  state[2] ^= state[0];
+  state[3] ^= state[1];
+  state[1] ^= state[2];
+  state[0] ^= state[3];
+  state[2] ^= t;
+  state[3] = RotateLeft(state[3], 45);
+
+  return result;
+}
+
+double Random::NextDouble(void) {
+  return (Next() >> 11) * (1.0/(1ull << 53));
+}
+
+// Marsaglia's polar method, one of each pair is kept for the next call
+double Random::NextGaussian(void) {
+  if(has_gaussian) {
+    has_gaussian = false;
+    return next_gaussian;
+  }
+
+  double u, v, s;
+  do {
+    u = 2.0*NextDouble()-1.0;
+    v = 2.0*NextDouble()-1.0;
+    s = u*u+v*v;
+  } while(s >= 1.0 || s == 0.0);
+
+  double multiplier = std::sqrt(-2.0*std::log(s)/s);
+  next_gaussian = v*multiplier;
+  has_gaussian = true;
+  return u*multiplier;
+}
+
+//===--------------------------------------------------------------------===//
+// Zipf Distribution
+//===--------------------------------------------------------------------===//
+
+// log1p(x)/x, and its series near 0
+static double Helper1(double x) {
+  if(std::fabs(x) > 1e-8) {
+    return std::log1p(x)/x;
+  }
+  return 1.0-x*(0.5-x*(1.0/3.0-0.25*x));
+}
+
+// expm1(x)/x, and its series near 0
+static double Helper2(double x) {
+  if(std::fabs(x) > 1e-8) {
+    return std::expm1(x)/x;
+  }
+  return 1.0+x*0.5*(1.0+x*(1.0/3.0)*(1.0+0.25*x));
+}
+
+ZipfDistribution::ZipfDistribution(ul _number_of_elements, double _exponent)
+  : number_of_elements(_number_of_elements), exponent(_exponent) {
+  assert(number_of_elements > 0);
+  h_integral_x1 = HIntegral(1.5)-1.0;
+  h_integral_number_of_elements = HIntegral(number_of_elements+0.5);
+  s = 2.0-HIntegralInverse(HIntegral(2.5)-H(2.0));
+}
+
+ul ZipfDistribution::Sample(Random& random) const {
+  while(true) {
+    double u = h_integral_number_of_elements +
+               random.NextDouble()*(h_integral_x1-h_integral_number_of_elements);
+    double x = HIntegralInverse(u);
+
+    ul k = (x < 1.0) ? 1 : (ul)(x+0.5);
+    k = std::min(std::max(k, 1ul), number_of_elements);
+
+    if(k-x <= s || u >= HIntegral(k+0.5)-H(k)) {
+      return k;
+    }
+  }
+}
+
+double ZipfDistribution::H(double x) const {
+  return std::exp(-exponent*std::log(x));
+}
+
+double ZipfDistribution::HIntegral(double x) const {
+  double log_x = std::log(x);
+  return Helper2((1.0-exponent)*log_x)*log_x;
+}
+
+double ZipfDistribution::HIntegralInverse(double x) const {
+  double t = x*(1.0-exponent);
+  if(t < -1.0) {
+    t = -1.0;
+  }
+  return std::exp(Helper1(t)*x);
+}
+
+//===--------------------------------------------------------------------===//
+// Data Generator
+//===--------------------------------------------------------------------===//
+
+// streams of samples are far away from the ones of data sets
+static constexpr ull GetSampleStreamBase() { return 1ull << 62; }
+
+DataGenerator::DataGenerator(const DistributionParameters& _parameters)
+  : parameters(_parameters) {
+  if(parameters.number_of_dims == 0) {
+    valid = false;
+    return;
+  }
+
+  switch(parameters.type) {
+    case DISTRIBUTION_TYPE_UNIFORM:
+      break;
+
+    case DISTRIBUTION_TYPE_CLUSTERED: {
+      if(parameters.number_of_clusters == 0) {
+        valid = false;
+        break;
+      }
+      // centers come from a stream of their own
+      Random random(parameters.seed, std::numeric_limits<ull>::max());
+      cluster_centers.resize(parameters.number_of_clusters*parameters.number_of_dims);
+      for(auto& center : cluster_centers) {
+        center = random.NextDouble();
+      }
+      break;
+    }
+
+    case DISTRIBUTION_TYPE_ZIPF:
+      if(parameters.number_of_zipf_cells == 0 || parameters.zipf_exponent < 0.0) {
+        valid = false;
+        break;
+      }
+      zipf = new ZipfDistribution(parameters.number_of_zipf_cells, parameters.zipf_exponent);
+      break;
+
+    case DISTRIBUTION_TYPE_RESAMPLE:
+      valid = LoadInput();
+      break;
+
+    default:
+      valid = false;
+  }
+}
+
+DataGenerator::~DataGenerator() {
+  delete zipf;
+  if(input_points != nullptr) {
+    munmap((void*)input_points, mapped_size);
+  }
+}
+
+bool DataGenerator::LoadInput(void) {
+  int fd = open(parameters.input_path.c_str(), O_RDONLY);
+  if(fd == -1) {
+    return false;
+  }
+
+  struct stat file_stat;
+  if(fstat(fd, &file_stat) == -1) {
+    close(fd);
+    return false;
+  }
+
+  ul bytes_per_point = sizeof(Point)*parameters.number_of_dims;
+  number_of_input_points = file_stat.st_size/bytes_per_point;
+  mapped_size = number_of_input_points*bytes_per_point;
+  if(number_of_input_points == 0) {
+    close(fd);
+    return false;
+  }
+
+  void* data = mmap(nullptr, mapped_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if(data == MAP_FAILED) {
+    return false;
+  }
+  input_points = static_cast<const Point*>(data);
+
+  // range of each dimension to scale the jitter with
+  lower_bounds.assign(parameters.number_of_dims, std::numeric_limits<Point>::max());
+  upper_bounds.assign(parameters.number_of_dims, std::numeric_limits<Point>::lowest());
+  if(parameters.jitter > 0.0) {
+    for(ul range(point_itr, 0, number_of_input_points)) {
+      for(ui range(dim, 0, parameters.number_of_dims)) {
+        auto point = input_points[point_itr*parameters.number_of_dims+dim];
+        lower_bounds[dim] = std::min(lower_bounds[dim], point);
+        upper_bounds[dim] = std::max(upper_bounds[dim], point);
+      }
+    }
+  }
+  return true;
+}
+
+bool DataGenerator::IsValid(void) const {
+  return valid;
+}
+
+ui DataGenerator::GetNumberOfDims(void) const {
+  return parameters.number_of_dims;
+}
+
+void DataGenerator::GenerateChunk(ull stream, Point* points, ul number_of_points) const {
+  assert(valid);
+  assert(number_of_points <= GetChunkSize());
+
+  Random random(parameters.seed, stream);
+  auto number_of_dims = parameters.number_of_dims;
+
+  switch(parameters.type) {
+    case DISTRIBUTION_TYPE_UNIFORM:
+      for(ul range(offset, 0, number_of_points*number_of_dims)) {
+        points[offset] = random.NextDouble();
+      }
+      break;
+
+    case DISTRIBUTION_TYPE_CLUSTERED:
+      for(ul range(point_itr, 0, number_of_points)) {
+        auto center = &cluster_centers[(random.Next()%parameters.number_of_clusters)*number_of_dims];
+        for(ui range(dim, 0, number_of_dims)) {
+          // redrawn until it lands in [0, 1) so clusters near a border
+          // aren't piled up on it
+          double point;
+          do {
+            point = center[dim]+random.NextGaussian()*parameters.cluster_stddev;
+          } while(point < 0.0 || point >= 1.0);
+          points[point_itr*number_of_dims+dim] = point;
+        }
+      }
+      break;
+
+    case DISTRIBUTION_TYPE_ZIPF: {
+      // ranks are scattered over the cells by an odd multiplier so the hot
+      // cells aren't all next to the origin
+      auto number_of_cells = parameters.number_of_zipf_cells;
+      for(ul range(offset, 0, number_of_points*number_of_dims)) {
+        ull rank = zipf->Sample(random)-1;
+        ull cell = (rank*0x9E3779B1ull+offset%number_of_dims*0x85EBCA6Bull)%number_of_cells;
+        points[offset] = (cell+random.NextDouble())/number_of_cells;
+      }
+      break;
+    }
+
+    case DISTRIBUTION_TYPE_RESAMPLE:
+      for(ul range(point_itr, 0, number_of_points)) {
+        auto input_point = &input_points[(random.Next()%number_of_input_points)*number_of_dims];
+        for(ui range(dim, 0, number_of_dims)) {
+          double point = input_point[dim];
+          if(parameters.jitter > 0.0) {
+            double extent = (upper_bounds[dim]-lower_bounds[dim])*parameters.jitter;
+            point += (2.0*random.NextDouble()-1.0)*extent;
+            point = std::min(std::max(point, (double)lower_bounds[dim]), (double)upper_bounds[dim]);
+          }
+          points[point_itr*number_of_dims+dim] = point;
+        }
+      }
+      break;
+
+    default:
+      assert(0);
+  }
+}
+
+std::vector<Point> DataGenerator::GenerateSample(ul number_of_points, ull stream_offset) const {
+  std::vector<Point> sample(number_of_points*parameters.number_of_dims);
+
+  ul number_of_chunks = (number_of_points+GetChunkSize()-1)/GetChunkSize();
+  auto& thread_pool = ThreadPool::GetInstance();
+  thread_pool.ParallelFor(0, number_of_chunks, [&](ul start_offset, ul end_offset) {
+    for(ul range(chunk_itr, start_offset, end_offset)) {
+      ul chunk_start = chunk_itr*GetChunkSize();
+      ul chunk_size = std::min(GetChunkSize(), number_of_points-chunk_start);
+      GenerateChunk(GetSampleStreamBase()+stream_offset+chunk_itr,
+                    &sample[chunk_start*parameters.number_of_dims], chunk_size);
+    }
+  }, 0, 1);
+
+  return sample;
+}
+
+bool DataGenerator::WriteToFile(std::string path, ul number_of_data, ui number_of_threads) const {
+  FILE* file = fopen(path.c_str(), "wb");
+  if(file == nullptr) {
+    return false;
+  }
+
+  auto& thread_pool = ThreadPool::GetInstance();
+  // a few chunks per thread are generated while the previous block is on
+  // its way to the file
+  ul chunks_per_block = std::max(thread_pool.GetNumberOfThreads(), 1u)*4;
+  ul number_of_chunks = (number_of_data+GetChunkSize()-1)/GetChunkSize();
+  std::vector<Point> block(chunks_per_block*GetChunkSize()*parameters.number_of_dims);
+
+  bool ret = true;
+  for(ul range(block_start, 0, number_of_chunks, chunks_per_block)) {
+    ul block_end = std::min(block_start+chunks_per_block, number_of_chunks);
+
+    thread_pool.ParallelFor(block_start, block_end, [&](ul start_offset, ul end_offset) {
+      for(ul range(chunk_itr, start_offset, end_offset)) {
+        ul chunk_start = chunk_itr*GetChunkSize();
+        ul chunk_size = std::min(GetChunkSize(), number_of_data-chunk_start);
+        GenerateChunk(chunk_itr, &block[(chunk_itr-block_start)*GetChunkSize()*parameters.number_of_dims],
+                      chunk_size);
+      }
+    }, number_of_threads, 1);
+
+    ul number_of_points = std::min(block_end*GetChunkSize(), number_of_data)-block_start*GetChunkSize();
+    ul number_of_floats = number_of_points*parameters.number_of_dims;
+    if(fwrite(block.data(), sizeof(Point), number_of_floats, file) != number_of_floats) {
+      ret = false;
+      break;
+    }
+  }
+
+  if(fclose(file) != 0) {
+    ret = false;
+  }
+  return ret;
+}
+
+//===--------------------------------------------------------------------===//
+// Query Generator
+//===--------------------------------------------------------------------===//
+
+QueryGenerator::QueryGenerator(std::vector<Point> _sample, ui _number_of_dims)
+  : sample(std::move(_sample)), number_of_dims(_number_of_dims) {
+  assert(number_of_dims);
+  number_of_samples = sample.size()/number_of_dims;
+  assert(number_of_samples);
+}
+
+std::vector<Point> QueryGenerator::Generate(const std::vector<Point>& centers,
+                                            double selectivity, ui number_of_threads) const {
+  ul number_of_queries = centers.size()/number_of_dims;
+  std::vector<Point> queries(number_of_queries*number_of_dims*2);
+
+  // k-th closest sample point, at least one
+  ul k = std::llround(selectivity/100.0*number_of_samples);
+  k = std::min(std::max(k, 1ul), number_of_samples);
+
+  auto& thread_pool = ThreadPool::GetInstance();
+  thread_pool.ParallelFor(0, number_of_queries, [&](ul start_offset, ul end_offset) {
+    std::vector<Point> distances(number_of_samples);
+
+    for(ul range(query_itr, start_offset, end_offset)) {
+      auto center = &centers[query_itr*number_of_dims];
+
+      for(ul range(sample_itr, 0, number_of_samples)) {
+        Point distance = 0.f;
+        for(ui range(dim, 0, number_of_dims)) {
+          distance = std::max(distance, std::fabs(sample[sample_itr*number_of_dims+dim]-center[dim]));
+        }
+        distances[sample_itr] = distance;
+      }
+      std::nth_element(distances.begin(), distances.begin()+(k-1), distances.end());
+      auto half_side = distances[k-1];
+
+      auto query = &queries[query_itr*number_of_dims*2];
+      for(ui range(dim, 0, number_of_dims)) {
+        query[dim] = center[dim]-half_side;
+        query[dim+number_of_dims] = center[dim]+half_side;
+      }
+    }
+  }, number_of_threads);
+
+  return queries;
+}
+
+double QueryGenerator::GetSelectivity(const Point* query) const {
+  ul hit = 0;
+  for(ul range(sample_itr, 0, number_of_samples)) {
+    bool overlap = true;
+    for(ui range(dim, 0, number_of_dims)) {
+      auto point = sample[sample_itr*number_of_dims+dim];
+      if(point < query[dim] || point > query[dim+number_of_dims]) {
+        overlap = false;
+        break;
+      }
+    }
+    hit += overlap;
+  }
+  return hit*100.0/number_of_samples;
+}
+
+bool QueryGenerator::WriteToFile(std::string path, const std::vector<Point>& queries) {
+  FILE* file = fopen(path.c_str(), "wb");
+  if(file == nullptr) {
+    return false;
+  }
+  bool ret = (fwrite(queries.data(), sizeof(Point), queries.size(), file) == queries.size());
+  return (fclose(file) == 0) && ret;
+}
+
+} // End of generator namespace
+} // End of ursus namespace
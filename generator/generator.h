@@ -0,0 +1,193 @@
+#pragma once
+
+#include "common/types.h"
+
+#include <string>
+#include <vector>
+
+namespace ursus {
+namespace generator {
+
+//===--------------------------------------------------------------------===//
+// Distribution
+//===--------------------------------------------------------------------===//
+enum DistributionType {
+  DISTRIBUTION_TYPE_INVALID = -1,
+  DISTRIBUTION_TYPE_UNIFORM = 1,
+  // gaussian clusters around uniformly placed centers
+  DISTRIBUTION_TYPE_CLUSTERED = 2,
+  // each coordinate falls into a cell picked with a Zipf distribution
+  DISTRIBUTION_TYPE_ZIPF = 3,
+  // points drawn from a real data file with replacement, optionally jittered
+  DISTRIBUTION_TYPE_RESAMPLE = 4
+};
+
+std::string DistributionTypeToString(DistributionType type);
+
+DistributionType StringToDistributionType(std::string str);
+
+struct DistributionParameters {
+  DistributionType type = DISTRIBUTION_TYPE_UNIFORM;
+
+  ui number_of_dims = 3;
+
+  ull seed = 1234;
+
+  // clustered
+  ui number_of_clusters = 16;
+  double cluster_stddev = 0.05;
+
+  // zipf, exponent 0 is uniform over the cells
+  double zipf_exponent = 1.0;
+  ui number_of_zipf_cells = 1 << 20;
+
+  // resample, jitter is a fraction of the range of each dimension
+  std::string input_path;
+  double jitter = 0.0;
+};
+
+//===--------------------------------------------------------------------===//
+// Random
+//===--------------------------------------------------------------------===//
+// xoshiro256** seeded through splitmix64. Every chunk of a data set has a
+// stream of its own derived from the seed and the chunk number, so a data
+// set comes out the same no matter how many threads generate it.
+class Random {
+ public:
+  Random(ull seed, ull stream);
+
+  ull Next(void);
+
+  // [0, 1)
+  double NextDouble(void);
+
+  // mean 0, stddev 1
+  double NextGaussian(void);
+
+ private:
+  ull state[4];
+
+  bool has_gaussian = false;
+
+  double next_gaussian = 0.0;
+};
+
+// rejection-inversion sampler of Hörmann and Derflinger, ranks in
+// [1, number_of_elements] with P(k) proportional to k^-exponent, O(1) per
+// sample for any number of elements
+class ZipfDistribution {
+ public:
+  ZipfDistribution(ul number_of_elements, double exponent);
+
+  ul Sample(Random& random) const;
+
+ private:
+  double H(double x) const;
+
+  double HIntegral(double x) const;
+
+  double HIntegralInverse(double x) const;
+
+  ul number_of_elements;
+
+  double exponent;
+
+  double h_integral_x1;
+
+  double h_integral_number_of_elements;
+
+  double s;
+};
+
+//===--------------------------------------------------------------------===//
+// Data Generator
+//===--------------------------------------------------------------------===//
+// points in the DataSet binary layout, number_of_dims floats per point
+class DataGenerator {
+ public:
+  explicit DataGenerator(const DistributionParameters& parameters);
+
+  DataGenerator(const DataGenerator &) = delete;
+  DataGenerator &operator=(const DataGenerator &) = delete;
+  DataGenerator(DataGenerator &&) = delete;
+  DataGenerator &operator=(DataGenerator &&) = delete;
+
+  ~DataGenerator();
+
+  // false if the parameters can't be used, e.g. the input file is missing
+  bool IsValid(void) const;
+
+  ui GetNumberOfDims(void) const;
+
+  // # of points generated from one stream
+  static constexpr ul GetChunkSize() { return 1ul << 16; }
+
+  // the points of a chunk, number_of_points <= GetChunkSize()
+  void GenerateChunk(ull stream, Point* points, ul number_of_points) const;
+
+  // number_of_points points taken from streams no data set uses, e.g. to
+  // calibrate queries against
+  std::vector<Point> GenerateSample(ul number_of_points, ull stream_offset) const;
+
+  /**
+   * write number_of_data points to the file, chunks are generated on
+   * number_of_threads threads(0 means all of them) and written in order
+   * @return false if the file can't be written
+   */
+  bool WriteToFile(std::string path, ul number_of_data, ui number_of_threads=0) const;
+
+ private:
+  bool LoadInput(void);
+
+  DistributionParameters parameters;
+
+  bool valid = true;
+
+  // clustered
+  std::vector<Point> cluster_centers;
+
+  // zipf
+  ZipfDistribution* zipf = nullptr;
+
+  // resample, the input file is mapped read-only
+  const Point* input_points = nullptr;
+  ul number_of_input_points = 0;
+  ul mapped_size = 0;
+  std::vector<Point> lower_bounds;
+  std::vector<Point> upper_bounds;
+};
+
+//===--------------------------------------------------------------------===//
+// Query Generator
+//===--------------------------------------------------------------------===//
+// range queries in the layout the evaluator reads, the lower corner followed
+// by the upper corner of each query box
+class QueryGenerator {
+ public:
+  // sample of number_of_dims floats per point the queries are calibrated on
+  QueryGenerator(std::vector<Point> sample, ui number_of_dims);
+
+  /**
+   * one query box around each center, a cube whose half side is the
+   * Chebyshev distance from the center to its k-th closest sample point,
+   * k = selectivity(%) of the sample. So every query covers the target
+   * fraction of the sample, and of the data the sample is drawn from
+   */
+  std::vector<Point> Generate(const std::vector<Point>& centers, double selectivity,
+                              ui number_of_threads=0) const;
+
+  // fraction(%) of the sample in the query box
+  double GetSelectivity(const Point* query) const;
+
+  static bool WriteToFile(std::string path, const std::vector<Point>& queries);
+
+ private:
+  std::vector<Point> sample;
+
+  ui number_of_dims;
+
+  ul number_of_samples;
+};
+
+} // End of generator namespace
+} // End of ursus namespace
@@ -0,0 +1,163 @@
+#include "generator.h"
+
+#include "common/thread_pool.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+#include <unistd.h>
+
+using namespace ursus;
+
+static void PrintUsage(const char* program) {
+  printf("Usage: %s -d <# of data> [options]\n"
+         "       %s -q <# of queries> -s <selectivity(%%)> [options]\n"
+         "  -d  # of data points to generate (a trailing m means millions)\n"
+         "  -q  # of range queries to generate instead of data\n"
+         "  -s  target selectivity of each query in percent of the data (default 0.01)\n"
+         "  -n  # of dims (default 3)\n"
+         "  -t  distribution: uniform, clustered, zipf or resample (default uniform)\n"
+         "  -i  data file to resample from (resample, and queries on a real data set)\n"
+         "  -c  # of clusters (default 16)\n"
+         "  -v  stddev of the clusters (default 0.05)\n"
+         "  -z  zipf exponent (default 1.0)\n"
+         "  -j  jitter of resampled points, a fraction of each dimension's range (default 0)\n"
+         "  -e  # of sample points queries are calibrated against (default 1000000)\n"
+         "  -r  seed (default 1234)\n"
+         "  -p  # of threads (default all)\n"
+         "  -o  output file (default follows the names the evaluator looks for)\n",
+         program, program);
+}
+
+static ul ParseCount(std::string str) {
+  size_t position = str.find("m");
+  if(position == std::string::npos) {
+    return std::stoul(str);
+  }
+  return std::stoul(str.erase(position, 1))*1000000;
+}
+
+int main(int argc, char **argv) {
+  static const char *options="d:D:q:Q:s:S:n:N:t:T:i:I:c:C:v:V:z:Z:j:J:e:E:r:R:p:P:o:O:h";
+
+  generator::DistributionParameters parameters;
+  std::string number_of_data_str;
+  ul number_of_queries = 0;
+  std::string selectivity = "0.01";
+  ul number_of_samples = 1000000;
+  ui number_of_threads = 0;
+  std::string output_path;
+  int current_option;
+
+  while ((current_option = getopt(argc, argv, options)) != -1) {
+    switch (current_option) {
+      case 'd':
+      case 'D': number_of_data_str = std::string(optarg); break;
+      case 'q':
+      case 'Q': number_of_queries = ParseCount(optarg); break;
+      case 's':
+      case 'S': selectivity = std::string(optarg); break;
+      case 'n':
+      case 'N': parameters.number_of_dims = atoi(optarg); break;
+      case 't':
+      case 'T': parameters.type = generator::StringToDistributionType(optarg); break;
+      case 'i':
+      case 'I': parameters.input_path = std::string(optarg); break;
+      case 'c':
+      case 'C': parameters.number_of_clusters = atoi(optarg); break;
+      case 'v':
+      case 'V': parameters.cluster_stddev = atof(optarg); break;
+      case 'z':
+      case 'Z': parameters.zipf_exponent = atof(optarg); break;
+      case 'j':
+      case 'J': parameters.jitter = atof(optarg); break;
+      case 'e':
+      case 'E': number_of_samples = ParseCount(optarg); break;
+      case 'r':
+      case 'R': parameters.seed = std::stoull(optarg); break;
+      case 'p':
+      case 'P': number_of_threads = atoi(optarg); break;
+      case 'o':
+      case 'O': output_path = std::string(optarg); break;
+      default:
+        PrintUsage(argv[0]);
+        return 1;
+    }
+  }
+
+  if(number_of_data_str.empty() == (number_of_queries == 0)) {
+    PrintUsage(argv[0]);
+    return 1;
+  }
+
+  // queries on a real data set are calibrated against the data set itself
+  if(number_of_queries && !parameters.input_path.empty()) {
+    parameters.type = generator::DISTRIBUTION_TYPE_RESAMPLE;
+    parameters.jitter = 0.0;
+  }
+
+  generator::DataGenerator data_generator(parameters);
+  if(!data_generator.IsValid()) {
+    std::cerr << "Invalid " << generator::DistributionTypeToString(parameters.type)
+              << " distribution parameters" << std::endl;
+    return 1;
+  }
+
+  auto start_time = std::chrono::steady_clock::now();
+  auto number_of_dims = std::to_string(parameters.number_of_dims);
+
+  if(!number_of_data_str.empty()) {
+    //===--------------------------------------------------------------------===//
+    // Data
+    //===--------------------------------------------------------------------===//
+    ul number_of_data = ParseCount(number_of_data_str);
+    if(output_path.empty()) {
+      output_path = "synthetic_"+number_of_data_str+"_"+number_of_dims+"d_data.bin";
+    }
+
+    if(!data_generator.WriteToFile(output_path, number_of_data, number_of_threads)) {
+      std::cerr << "Failed to write a file(" << output_path << ")\n";
+      return 1;
+    }
+
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now()-start_time;
+    printf("%lu %s points of %s dims written to %s in %.3fs\n", number_of_data,
+           generator::DistributionTypeToString(parameters.type).c_str(),
+           number_of_dims.c_str(), output_path.c_str(), elapsed.count());
+  } else {
+    //===--------------------------------------------------------------------===//
+    // Query
+    //===--------------------------------------------------------------------===//
+    if(output_path.empty()) {
+      output_path = "synthetic_dim_query."+number_of_dims+".bin."+selectivity+"s";
+    }
+
+    generator::QueryGenerator query_generator(data_generator.GenerateSample(number_of_samples, 0),
+                                              parameters.number_of_dims);
+
+    // centers follow the data, drawn from streams after the sample's
+    auto sample_streams = number_of_samples/generator::DataGenerator::GetChunkSize()+1;
+    auto centers = data_generator.GenerateSample(number_of_queries, sample_streams);
+    auto queries = query_generator.Generate(centers, std::stod(selectivity), number_of_threads);
+
+    if(!generator::QueryGenerator::WriteToFile(output_path, queries)) {
+      std::cerr << "Failed to write a file(" << output_path << ")\n";
+      return 1;
+    }
+
+    double total_selectivity = 0.0;
+    for(ul query_itr = 0; query_itr < number_of_queries; query_itr++) {
+      total_selectivity += query_generator.GetSelectivity(&queries[query_itr*parameters.number_of_dims*2]);
+    }
+
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now()-start_time;
+    printf("%lu queries of %s%% selectivity (%.4f%% on average over %lu samples) written to %s in %.3fs\n",
+           number_of_queries, selectivity.c_str(), total_selectivity/number_of_queries,
+           number_of_samples, output_path.c_str(), elapsed.count());
+  }
+
+  return 0;
+}
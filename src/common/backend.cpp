@@ -0,0 +1,42 @@
+#include "common/backend.h"
+
+#include "common/logger.h"
+
+#include <cstdlib>
+
+namespace ursus {
+namespace backend {
+
+bool IsDeviceAvailable(void) {
+  static const bool device_available = []() {
+    int number_of_gpus = 0;
+    return cudaGetDeviceCount(&number_of_gpus) == cudaSuccess && number_of_gpus > 0;
+  }();
+  return device_available;
+}
+
+bool GetDeviceMemory(size_t& avail, size_t& total) {
+  avail = 0;
+  total = 0;
+  if(!IsDeviceAvailable()) {
+    return false;
+  }
+  return cudaMemGetInfo(&avail, &total) == cudaSuccess;
+}
+
+const char* GetBackendName(void) {
+#ifdef __CUDACC__
+  return "cuda";
+#else
+  return "host";
+#endif
+}
+
+void NoDevice(const char* kernel_name) {
+  LOG_INFO("%s can't be launched, no CUDA device is available (%s backend)",
+           kernel_name, GetBackendName());
+  abort();
+}
+
+} // End of backend namespace
+} // End of ursus namespace
@@ -0,0 +1,153 @@
+#pragma once
+
+#include <cstddef>
+
+//===--------------------------------------------------------------------===//
+// Compute Backend
+//===--------------------------------------------------------------------===//
+// Built by nvcc, the CUDA backend uses the CUDA runtime as it is.
+// Built by a host compiler (make BACKEND=host), the host backend defines the
+// CUDA qualifiers and the part of the runtime this tree uses, so the same
+// sources compile without the CUDA toolkit. Kernels are compiled but never
+// emitted or launched, device memory can't be allocated, and
+// backend::IsDeviceAvailable() is false so that builds and searches take
+// their host paths. The CUDA backend takes the same paths on machines
+// without a GPU.
+
+#ifdef __CUDACC__
+
+#include "cuda_profiler_api.h"
+
+#define LaunchKernel(kernel, grid, block, ...) \
+        kernel<<<(grid), (block)>>>(__VA_ARGS__)
+
+#define LaunchKernelWithSharedMemory(kernel, grid, block, shared_size, ...) \
+        kernel<<<(grid), (block), (shared_size)>>>(__VA_ARGS__)
+
+#else
+
+#define __host__
+#define __device__
+// unused static inline functions are never emitted
+#define __global__ static inline
+#define __shared__
+#define __forceinline__ inline
+
+// callers check backend::IsDeviceAvailable() before launching a kernel
+#define LaunchKernel(kernel, grid, block, ...) \
+        ursus::backend::NoDevice(#kernel)
+
+#define LaunchKernelWithSharedMemory(kernel, grid, block, shared_size, ...) \
+        ursus::backend::NoDevice(#kernel)
+
+//===--------------------------------------------------------------------===//
+// Device built-ins used in kernels
+//===--------------------------------------------------------------------===//
+struct uint3 {
+  unsigned int x, y, z;
+};
+
+struct dim3 {
+  unsigned int x, y, z;
+  dim3(unsigned int x=1, unsigned int y=1, unsigned int z=1) : x(x), y(y), z(z) {}
+};
+
+static const uint3 threadIdx = {0, 0, 0};
+static const uint3 blockIdx = {0, 0, 0};
+static const dim3 blockDim;
+static const dim3 gridDim;
+
+inline void __syncthreads(void) {}
+
+template <typename T>
+inline T atomicAdd(T* address, T value) {
+  T old = *address;
+  *address += value;
+  return old;
+}
+
+//===--------------------------------------------------------------------===//
+// Runtime
+//===--------------------------------------------------------------------===//
+// everything touching device memory fails with cudaErrorNoDevice, the rest
+// does nothing
+enum cudaError_t {
+  cudaSuccess = 0,
+  cudaErrorNoDevice = 100
+};
+
+enum cudaMemcpyKind {
+  cudaMemcpyHostToHost = 0,
+  cudaMemcpyHostToDevice = 1,
+  cudaMemcpyDeviceToHost = 2,
+  cudaMemcpyDeviceToDevice = 3
+};
+
+struct cudaDeviceProp {
+  char name[256];
+};
+
+typedef void* cudaEvent_t;
+
+inline const char* cudaGetErrorString(cudaError_t error) {
+  return (error == cudaSuccess) ? "no error" : "no CUDA-capable device is detected";
+}
+
+inline cudaError_t cudaGetDeviceCount(int* count) { *count = 0; return cudaErrorNoDevice; }
+
+inline cudaError_t cudaSetDevice(int) { return cudaErrorNoDevice; }
+
+inline cudaError_t cudaGetDeviceProperties(cudaDeviceProp*, int) { return cudaErrorNoDevice; }
+
+inline cudaError_t cudaMemGetInfo(size_t* avail, size_t* total) {
+  *avail = 0;
+  *total = 0;
+  return cudaErrorNoDevice;
+}
+
+template <typename T>
+inline cudaError_t cudaMalloc(T** ptr, size_t) { *ptr = nullptr; return cudaErrorNoDevice; }
+
+template <typename T>
+inline cudaError_t cudaMallocHost(T** ptr, size_t) { *ptr = nullptr; return cudaErrorNoDevice; }
+
+inline cudaError_t cudaFree(void*) { return cudaErrorNoDevice; }
+
+inline cudaError_t cudaMemcpy(void*, const void*, size_t, cudaMemcpyKind) { return cudaErrorNoDevice; }
+
+inline cudaError_t cudaDeviceSynchronize(void) { return cudaSuccess; }
+
+inline cudaError_t cudaEventCreate(cudaEvent_t*) { return cudaErrorNoDevice; }
+
+inline cudaError_t cudaEventRecord(cudaEvent_t, int=0) { return cudaErrorNoDevice; }
+
+inline cudaError_t cudaEventSynchronize(cudaEvent_t) { return cudaErrorNoDevice; }
+
+inline cudaError_t cudaEventElapsedTime(float* elapsed_time, cudaEvent_t, cudaEvent_t) {
+  *elapsed_time = 0.f;
+  return cudaErrorNoDevice;
+}
+
+inline cudaError_t cudaProfilerStart(void) { return cudaSuccess; }
+
+inline cudaError_t cudaProfilerStop(void) { return cudaSuccess; }
+
+#endif
+
+namespace ursus {
+namespace backend {
+
+// true if a CUDA device can be used, checked once
+bool IsDeviceAvailable(void);
+
+// 0 and false without a device
+bool GetDeviceMemory(size_t& avail, size_t& total);
+
+// name of the backend the binary is built with, "cuda" or "host"
+const char* GetBackendName(void);
+
+// a kernel launch was reached without a device, print out and abort
+void NoDevice(const char* kernel_name);
+
+} // End of backend namespace
+} // End of ursus namespace
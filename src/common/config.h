@@ -1,17 +1,49 @@
 #pragma once
 
+#include "common/backend.h"
+
+// geometry of the nodes, a binary is built for one geometry.
+// e.g. make DIMS=4 LEAF_DEGREES=256 UPPER_DEGREES=64
+#ifndef URSUS_NUMBER_OF_DIMS
+#define URSUS_NUMBER_OF_DIMS 3
+#endif
+
+#ifndef URSUS_UPPER_TREE_DEGREES
+#define URSUS_UPPER_TREE_DEGREES 128
+#endif
+
+#ifndef URSUS_LEAF_NODE_DEGREES
+#define URSUS_LEAF_NODE_DEGREES 192
+#endif
+
+// bits of a quantized leaf coordinate(8 or 16),
+// e.g. make OPTION=-DURSUS_LEAF_CODE_BITS=8
+#ifndef URSUS_LEAF_CODE_BITS
+#define URSUS_LEAF_CODE_BITS 16
+#endif
+
 namespace ursus {
-  __host__ __device__ constexpr unsigned int GetNumberOfDims() { return 3; }
+  __host__ __device__ constexpr unsigned int GetNumberOfDims() { return URSUS_NUMBER_OF_DIMS; }
 
-  __host__ __device__ constexpr unsigned int GetNumberOfUpperTreeDegrees() { return 128; }
+  __host__ __device__ constexpr unsigned int GetNumberOfUpperTreeDegrees() { return URSUS_UPPER_TREE_DEGREES; }
 
-  __host__ __device__ constexpr unsigned int GetNumberOfLeafNodeDegrees() { return 192; }
+  __host__ __device__ constexpr unsigned int GetNumberOfLeafNodeDegrees() { return URSUS_LEAF_NODE_DEGREES; }
   
-  __host__ __device__ constexpr unsigned int GetNumberOfThreads() { return 192; }
+  // a thread per branch of the widest node
+  __host__ __device__ constexpr unsigned int GetNumberOfThreads() { 
+    return (GetNumberOfLeafNodeDegrees() > GetNumberOfUpperTreeDegrees()) ?
+            GetNumberOfLeafNodeDegrees() : GetNumberOfUpperTreeDegrees();
+  }
+
+  __host__ __device__ constexpr unsigned int GetNextPowerOfTwo(unsigned int n, unsigned int power=1) { 
+    return (power >= n) ? power : GetNextPowerOfTwo(n, power*2);
+  }
 
   // For parallel reduction
   // TODO Rename it 
-  __host__ __device__ constexpr unsigned int GetNumberOfThreads2() { return 256; }
+  __host__ __device__ constexpr unsigned int GetNumberOfThreads2() { return GetNextPowerOfTwo(GetNumberOfThreads()); }
+
+  static_assert(GetNumberOfThreads() <= 1024, "node degrees must fit in a thread block");
 
   __host__ __device__ constexpr unsigned int GetNumberOfMAXCPUThreads() { return 32; }
 
@@ -0,0 +1,142 @@
+#include "common/geometry.h"
+
+#include "common/config.h"
+#include "common/logger.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace ursus {
+
+bool operator==(const Geometry& lhs, const Geometry& rhs) {
+  return lhs.number_of_dims == rhs.number_of_dims &&
+         lhs.leaf_node_degrees == rhs.leaf_node_degrees &&
+         lhs.upper_tree_degrees == rhs.upper_tree_degrees;
+}
+
+Geometry GetBuildGeometry(void) {
+  return {GetNumberOfDims(), GetNumberOfLeafNodeDegrees(), GetNumberOfUpperTreeDegrees()};
+}
+
+std::string GeometryToString(const Geometry& geometry) {
+  return std::to_string(geometry.number_of_dims)+"d_"+
+         std::to_string(geometry.leaf_node_degrees)+"_"+
+         std::to_string(geometry.upper_tree_degrees);
+}
+
+bool StringToGeometry(std::string str, Geometry& geometry) {
+  geometry = GetBuildGeometry();
+
+  ui number_of_dims = 0, leaf_node_degrees = 0, upper_tree_degrees = 0;
+  char end;
+  if(sscanf(str.c_str(), "%ud_%u_%u%c", &number_of_dims, &leaf_node_degrees,
+            &upper_tree_degrees, &end) == 3 ||
+     sscanf(str.c_str(), "%u,%u,%u%c", &number_of_dims, &leaf_node_degrees,
+            &upper_tree_degrees, &end) == 3) {
+    geometry = {number_of_dims, leaf_node_degrees, upper_tree_degrees};
+  } else if(sscanf(str.c_str(), "%ud%c", &number_of_dims, &end) == 1) {
+    geometry.number_of_dims = number_of_dims;
+  } else {
+    return false;
+  }
+
+  return geometry.number_of_dims && geometry.leaf_node_degrees &&
+         geometry.upper_tree_degrees;
+}
+
+bool DispatchGeometry(int argc, char** argv) {
+  auto geometry_str = getenv("URSUS_GEOMETRY");
+  if(geometry_str == nullptr || !*geometry_str) {
+    return true;
+  }
+
+  Geometry geometry;
+  if(!StringToGeometry(geometry_str, geometry)) {
+    LOG_INFO("Invalid geometry URSUS_GEOMETRY=%s", geometry_str);
+    return false;
+  }
+
+  return DispatchGeometry(argc, argv, geometry);
+}
+
+bool DispatchGeometry(int argc, char** argv, const Geometry& geometry) {
+  if(geometry == GetBuildGeometry()) {
+    return true;
+  }
+
+  // a binary run for another geometry must be built with it
+  if(getenv("URSUS_GEOMETRY_DISPATCHED")) {
+    LOG_INFO("%s is built for %s, not for %s", argv[0],
+             GeometryToString(GetBuildGeometry()).c_str(),
+             GeometryToString(geometry).c_str());
+    return false;
+  }
+
+  // strip the suffix of this binary, then try the binary of the geometry and
+  // the default one
+  std::string binary = argv[0];
+  std::string suffix = "_"+GeometryToString(GetBuildGeometry());
+  if(binary.size() > suffix.size() &&
+     binary.compare(binary.size()-suffix.size(), suffix.size(), suffix) == 0) {
+    binary.erase(binary.size()-suffix.size());
+  }
+
+  std::vector<std::string> candidates = {binary+"_"+GeometryToString(geometry), binary};
+  for(auto& candidate : candidates) {
+    if(candidate == argv[0] || access(candidate.c_str(), X_OK) != 0) {
+      continue;
+    }
+
+    std::vector<char*> arguments(argv, argv+argc);
+    arguments[0] = const_cast<char*>(candidate.c_str());
+    arguments.emplace_back(nullptr);
+
+    setenv("URSUS_GEOMETRY_DISPATCHED", "1", 1);
+    execv(candidate.c_str(), arguments.data());
+  }
+
+  LOG_INFO("No binary for %s, build it with make DIMS=%u LEAF_DEGREES=%u UPPER_DEGREES=%u",
+           GeometryToString(geometry).c_str(), geometry.number_of_dims,
+           geometry.leaf_node_degrees, geometry.upper_tree_degrees);
+  return false;
+}
+
+// size of the file in bytes, 0 if it can't be read
+static ul GetFileSize(std::string path) {
+  struct stat file_stat;
+  if(stat(path.c_str(), &file_stat) != 0) {
+    return 0;
+  }
+  return (ul)file_stat.st_size;
+}
+
+bool DispatchGeometryOfFiles(int argc, char** argv, 
+                             std::string data_path, std::string query_path,
+                             ul number_of_queries, const Geometry* index_geometry) {
+  // the geometry asked for wins over the one of the index
+  auto geometry_str = getenv("URSUS_GEOMETRY");
+  if((geometry_str == nullptr || !*geometry_str) && index_geometry != nullptr &&
+     !(*index_geometry == GetBuildGeometry())) {
+    LOG_INFO("%s is indexed with %s", data_path.c_str(), GeometryToString(*index_geometry).c_str());
+    if(!DispatchGeometry(argc, argv, *index_geometry)) {
+      return false;
+    }
+  }
+
+  // files that hold more points than are read must still hold whole points
+  auto data_size = GetFileSize(data_path);
+  auto query_size = GetFileSize(query_path);
+  if(data_size%(GetNumberOfDims()*sizeof(Point)) ||
+     (number_of_queries && query_size%(GetNumberOfDims()*2*sizeof(Point)))) {
+    LOG_INFO("%s or %s doesn't hold %ud points, the dims of %s, set URSUS_GEOMETRY", 
+             data_path.c_str(), query_path.c_str(), GetNumberOfDims(), argv[0]);
+    return false;
+  }
+  return true;
+}
+
+} // End of ursus namespace
@@ -0,0 +1,55 @@
+#pragma once
+
+#include "common/types.h"
+
+#include <string>
+
+namespace ursus {
+
+//===--------------------------------------------------------------------===//
+// Geometry
+//===--------------------------------------------------------------------===//
+// # of dims and node degrees a binary is built with, see common/config.h.
+// Binaries of other geometries sit next to the default one with the
+// geometry as a suffix, e.g. ./bin/host_4d_192_128
+struct Geometry {
+  ui number_of_dims;
+  ui leaf_node_degrees;
+  ui upper_tree_degrees;
+};
+
+bool operator==(const Geometry& lhs, const Geometry& rhs);
+
+Geometry GetBuildGeometry(void);
+
+// "<dims>d_<leaf degrees>_<upper degrees>", the suffix of a binary
+std::string GeometryToString(const Geometry& geometry);
+
+// "<dims>d", "<dims>d_<leaf>_<upper>" or "<dims>,<leaf>,<upper>", degrees
+// left out are the ones of this binary
+bool StringToGeometry(std::string str, Geometry& geometry);
+
+/**
+ * run the binary of the geometry asked for with URSUS_GEOMETRY in place of
+ * this one, with the same arguments
+ * @return true if this binary is the one to run, false if the binary of the
+ *         geometry can't be run. It doesn't return when it runs another one
+ */
+bool DispatchGeometry(int argc, char** argv);
+
+// run the binary of the geometry in place of this one, same as above
+bool DispatchGeometry(int argc, char** argv, const Geometry& geometry);
+
+/**
+ * run the binary of the geometry of the index of the data, index_geometry
+ * unless it's null, in place of this one if no geometry is asked for with
+ * URSUS_GEOMETRY. Data and query files have no header, so their dims are
+ * never guessed from their sizes, they must hold whole points of the dims
+ * of the binary that runs
+ * @return true if this binary is the one to run
+ */
+bool DispatchGeometryOfFiles(int argc, char** argv, 
+                             std::string data_path, std::string query_path,
+                             ul number_of_queries, const Geometry* index_geometry);
+
+} // End of ursus namespace
@@ -0,0 +1,65 @@
+#include "common/hash.h"
+
+#include "common/macro.h"
+#include "common/thread_pool.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+namespace ursus {
+
+ull HashBlock(const void* data, ul size) {
+  auto bytes = static_cast<const char*>(data);
+  ull hash = 0xcbf29ce484222325ull^size;
+  ul offset = 0;
+  for(; offset+sizeof(ull) <= size; offset+=sizeof(ull)) {
+    ull word;
+    memcpy(&word, bytes+offset, sizeof(ull));
+    hash = (hash^word)*0x100000001b3ull;
+    hash ^= hash >> 29;
+  }
+  for(; offset < size; offset++) {
+    hash = (hash^(unsigned char)bytes[offset])*0x100000001b3ull;
+  }
+  return hash;
+}
+
+ull HashString(const std::string& str) {
+  return HashBlock(str.data(), str.size());
+}
+
+ull CombineHash(ull hash, ull block_hash) {
+  hash = (hash^block_hash)*0x9e3779b97f4a7c15ull;
+  return hash^(hash >> 32);
+}
+
+ull HashInParallel(const void* data, ul size) {
+  auto bytes = static_cast<const char*>(data);
+  auto number_of_blocks = (size+GetHashBlockSize()-1)/GetHashBlockSize();
+  std::vector<ull> block_hashes(number_of_blocks);
+
+  auto& thread_pool = ThreadPool::GetInstance();
+  thread_pool.ParallelFor(0, number_of_blocks, [&](ul start_offset, ul end_offset) {
+    for(ul range(block_itr, start_offset, end_offset)) {
+      auto offset = block_itr*GetHashBlockSize();
+      block_hashes[block_itr] = HashBlock(bytes+offset,
+                                          std::min(GetHashBlockSize(), size-offset));
+    }
+  }, 0, 1);
+
+  ull hash = 0;
+  for(auto block_hash : block_hashes) {
+    hash = CombineHash(hash, block_hash);
+  }
+  return hash;
+}
+
+std::string HashToString(ull hash) {
+  char buffer[17];
+  ::snprintf(buffer, sizeof(buffer), "%016llx", hash);
+  return std::string(buffer);
+}
+
+} // End of ursus namespace
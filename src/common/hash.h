@@ -0,0 +1,32 @@
+#pragma once
+
+#include "common/types.h"
+
+#include <string>
+
+namespace ursus {
+
+//===--------------------------------------------------------------------===//
+// Hash
+//===--------------------------------------------------------------------===//
+// Large buffers are hashed in blocks of this size and the block hashes are
+// folded in order, so the blocks can be hashed in parallel and a writer can
+// hash a stream block by block with the same result
+constexpr ul GetHashBlockSize() { return 1ul << 20; }
+
+// FNV-1a over 8-byte words with an extra shift to spread the high bits
+ull HashBlock(const void* data, ul size);
+
+ull HashString(const std::string& str);
+
+// fold the hash of the next block into hash
+ull CombineHash(ull hash, ull block_hash);
+
+// fold of the hashes of the GetHashBlockSize() blocks of data, the blocks
+// are hashed on the thread pool
+ull HashInParallel(const void* data, ul size);
+
+// 16 hex digits
+std::string HashToString(ull hash);
+
+} // End of ursus namespace
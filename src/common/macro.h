@@ -96,6 +96,7 @@
         } \
 
  
+#include "common/backend.h"
 #include <iostream>
 #define cudaErrCheck(ans) { gpuAssert((ans), __FILE__, __LINE__); }
 inline void gpuAssert(cudaError_t code, const char *file, int line, bool abort=true)
@@ -106,4 +107,3 @@ inline void gpuAssert(cudaError_t code, const char *file, int line, bool abort=t
     if (abort) exit(code);
   }
 }
- 
@@ -0,0 +1,271 @@
+#include "common/thread_pool.h"
+
+#include "common/macro.h"
+
+#include <algorithm>
+#include <cassert>
+
+namespace ursus {
+
+namespace {
+
+// see GetThreadId, workers set it once when they start
+thread_local ui thread_id = 0;
+
+} // End of anonymous namespace
+
+ThreadPool& ThreadPool::GetInstance(void) {
+  static ThreadPool thread_pool;
+  return thread_pool;
+}
+
+// the calling thread is one of the threads, so spawn one less
+ThreadPool::ThreadPool()
+  : work_queues(std::max(std::thread::hardware_concurrency(), 1u)-1) {
+  for(ui range(worker_itr, 0, work_queues.size())) {
+    workers.push_back(std::thread(&ThreadPool::Thread_Worker, this, worker_itr));
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(sleep_mutex);
+    stop = true;
+  }
+  sleep_condition.notify_all();
+
+  for(auto &worker : workers){
+    worker.join();
+  }
+}
+
+ui ThreadPool::GetNumberOfThreads(void) const {
+  return workers.size()+1;
+}
+
+ui ThreadPool::ClampNumberOfThreads(ui number_of_threads) const {
+  if(!number_of_threads || number_of_threads > GetNumberOfThreads()) {
+    return GetNumberOfThreads();
+  }
+  return number_of_threads;
+}
+
+ul ThreadPool::GetGrainSize(ul number_of_items, ui number_of_threads) const {
+  // 8 chunks per thread
+  ul number_of_chunks = ClampNumberOfThreads(number_of_threads)*8;
+  return std::max((number_of_items+number_of_chunks-1)/number_of_chunks, 1ul);
+}
+
+ul ThreadPool::GetNumberOfChunks(ul number_of_items, ul grain_size) const {
+  assert(grain_size);
+  return (number_of_items+grain_size-1)/grain_size;
+}
+
+ui ThreadPool::GetThreadId(void) const {
+  return thread_id;
+}
+
+/**
+ * @brief run the body over the range in chunks, blocks until all chunks
+ *        are done
+ * @param start_offset
+ * @param end_offset
+ * @param body called with [chunk_start, chunk_end) of each chunk
+ * @param number_of_threads upper bound of threads working on this loop
+ * @param grain_size # of items in a chunk, the last one may be shorter
+ */
+void ThreadPool::ParallelFor(ul start_offset, ul end_offset,
+                             const std::function<void(ul, ul)>& body,
+                             ui number_of_threads, ul grain_size) {
+  if(start_offset >= end_offset) {
+    return;
+  }
+
+  number_of_threads = ClampNumberOfThreads(number_of_threads);
+  if(!grain_size) {
+    grain_size = GetGrainSize(end_offset-start_offset, number_of_threads);
+  }
+
+  auto number_of_chunks = GetNumberOfChunks(end_offset-start_offset, grain_size);
+
+  // nothing to share, run the chunks on the calling thread
+  if(number_of_threads == 1 || number_of_chunks == 1) {
+    for(ul range(chunk_start, start_offset, end_offset, grain_size)) {
+      body(chunk_start, std::min(chunk_start+grain_size, end_offset));
+    }
+    return;
+  }
+
+  Job job;
+  job.body = &body;
+  job.pending = number_of_chunks;
+  job.number_of_workers = number_of_threads-1;
+
+  // a worker calling ParallelFor looks at its own queue first
+  ui caller_id = (thread_id) ? thread_id-1 : workers.size();
+
+  // deal the chunks out round-robin, neighbouring chunks land on
+  // different workers so a skewed region is split up from the start
+  for(ul range(chunk_itr, 0, number_of_chunks)) {
+    ui worker_id = chunk_itr%job.number_of_workers;
+    Task task;
+    task.job = &job;
+    task.start_offset = start_offset+chunk_itr*grain_size;
+    task.end_offset = std::min(task.start_offset+grain_size, end_offset);
+
+    std::lock_guard<std::mutex> lock(work_queues[worker_id].mutex);
+    work_queues[worker_id].tasks.push_back(task);
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(sleep_mutex);
+    generation++;
+  }
+  sleep_condition.notify_all();
+
+  // help out until every chunk is done, taking chunks of this job only
+  while(job.pending.load(std::memory_order_acquire)) {
+    Task task;
+    bool found = false;
+    for(ui range(victim_itr, 0, job.number_of_workers)) {
+      ui victim_id = (caller_id+victim_itr)%job.number_of_workers;
+      if(StealTask(victim_id, caller_id, &job, task)) {
+        found = true;
+        break;
+      }
+    }
+
+    if(found) {
+      RunTask(task);
+    } else {
+      std::this_thread::yield();
+    }
+  }
+}
+
+void ThreadPool::RunInBackground(std::function<void()> task) {
+  if(workers.empty()) {
+    task();
+    return;
+  }
+
+  auto job = new Job;
+  job->background_body = [task](ul, ul) { task(); };
+  job->body = &job->background_body;
+  job->pending = 1;
+  job->number_of_workers = workers.size();
+
+  Task background_task;
+  background_task.job = job;
+  background_task.start_offset = 0;
+  background_task.end_offset = 1;
+
+  // spread over the workers like the chunks of a loop
+  auto& work_queue = work_queues[next_background_worker_id++%workers.size()];
+  {
+    std::lock_guard<std::mutex> lock(work_queue.mutex);
+    work_queue.tasks.push_back(background_task);
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(sleep_mutex);
+    generation++;
+  }
+  sleep_condition.notify_all();
+}
+
+void ThreadPool::Thread_Worker(ui worker_id) {
+  thread_id = worker_id+1;
+
+  while(true) {
+    ul seen_generation;
+    {
+      std::lock_guard<std::mutex> lock(sleep_mutex);
+      if(stop) {
+        return;
+      }
+      seen_generation = generation;
+    }
+
+    Task task;
+    if(PopTask(worker_id, task)) {
+      RunTask(task);
+      continue;
+    }
+
+    // sleep until someone pushes new chunks
+    std::unique_lock<std::mutex> lock(sleep_mutex);
+    sleep_condition.wait(lock, [&]{
+      return stop || generation != seen_generation;
+    });
+  }
+}
+
+bool ThreadPool::PopTask(ui worker_id, Task& task) {
+  {
+    auto& work_queue = work_queues[worker_id];
+    std::lock_guard<std::mutex> lock(work_queue.mutex);
+    if(!work_queue.tasks.empty()) {
+      task = work_queue.tasks.back();
+      work_queue.tasks.pop_back();
+      return true;
+    }
+  }
+
+  for(ui range(victim_itr, 1, work_queues.size())) {
+    ui victim_id = (worker_id+victim_itr)%work_queues.size();
+    if(StealTask(victim_id, worker_id, nullptr, task)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+/**
+ * @brief take the oldest chunk of the victim
+ * @param victim_id
+ * @param worker_id thief, it must be allowed to work on the job of the chunk
+ * @param job if not null, the oldest chunk of this job is taken
+ * @return true if a chunk is taken
+ */
+bool ThreadPool::StealTask(ui victim_id, ui worker_id, Job* job, Task& task) {
+  auto& work_queue = work_queues[victim_id];
+  std::lock_guard<std::mutex> lock(work_queue.mutex);
+  if(work_queue.tasks.empty()) {
+    return false;
+  }
+
+  // a thread waiting on its own loop looks past chunks of other loops,
+  // otherwise nested loops could all wait behind each other's chunks
+  if(job) {
+    for(auto task_itr = work_queue.tasks.begin(); task_itr != work_queue.tasks.end(); task_itr++) {
+      if(task_itr->job == job) {
+        task = *task_itr;
+        work_queue.tasks.erase(task_itr);
+        return true;
+      }
+    }
+    return false;
+  }
+
+  auto& front = work_queue.tasks.front();
+  if(worker_id >= front.job->number_of_workers) {
+    return false;
+  }
+
+  task = front;
+  work_queue.tasks.pop_front();
+  return true;
+}
+
+void ThreadPool::RunTask(Task& task) {
+  (*task.job->body)(task.start_offset, task.end_offset);
+  if(task.job->background_body) {
+    delete task.job;
+    return;
+  }
+  // the job may be gone once the last chunk is counted down
+  task.job->pending.fetch_sub(1, std::memory_order_release);
+}
+
+} // End of ursus namespace
@@ -0,0 +1,171 @@
+#pragma once
+
+#include "common/types.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace ursus {
+
+//===--------------------------------------------------------------------===//
+// Thread Pool
+//===--------------------------------------------------------------------===//
+// Process-wide pool of worker threads created once at first use.
+// A parallel loop is cut into chunks which are spread over per-worker
+// deques, a worker pops its own chunks from the back and steals from the
+// front of the others when it runs dry. The calling thread also runs chunks
+// until the loop is done, so nested loops can't deadlock. A task run in the
+// background is a job of one chunk nobody waits for
+class ThreadPool {
+ public:
+ //===--------------------------------------------------------------------===//
+ // Consteructor/Destructor
+ //===--------------------------------------------------------------------===//
+  static ThreadPool& GetInstance(void);
+
+  ThreadPool(const ThreadPool &) = delete;
+  ThreadPool &operator=(const ThreadPool &) = delete;
+  ThreadPool(ThreadPool &&) = delete;
+  ThreadPool &operator=(ThreadPool &&) = delete;
+
+  ~ThreadPool();
+
+ //===--------------------------------------------------------------------===//
+ // Main Function
+ //===--------------------------------------------------------------------===//
+  /**
+   * run body(chunk_start, chunk_end) over [start_offset, end_offset).
+   * at most number_of_threads threads (including the caller) take part,
+   * 0 means all of them. grain_size 0 picks one with GetGrainSize
+   */
+  void ParallelFor(ul start_offset, ul end_offset,
+                   const std::function<void(ul, ul)>& body,
+                   ui number_of_threads=0, ul grain_size=0);
+
+  /**
+   * same chunking as ParallelFor, partial results of the chunks are combined
+   * with reduce in chunk order so the result does not depend on scheduling
+   */
+  template <typename T>
+  T ParallelReduce(ul start_offset, ul end_offset, T identity,
+                   const std::function<T(ul, ul)>& body,
+                   const std::function<T(const T&, const T&)>& reduce,
+                   ui number_of_threads=0, ul grain_size=0);
+
+  /**
+   * run task on a worker and return right away, on the calling thread if
+   * there are no workers. Tasks that haven't started when the pool is
+   * destroyed are dropped
+   */
+  void RunInBackground(std::function<void()> task);
+
+ //===--------------------------------------------------------------------===//
+ // Accessor
+ //===--------------------------------------------------------------------===//
+  // # of worker threads plus the calling thread
+  ui GetNumberOfThreads(void) const;
+
+  // default chunk size, a few chunks per thread to even out skewed chunks
+  ul GetGrainSize(ul number_of_items, ui number_of_threads=0) const;
+
+  ul GetNumberOfChunks(ul number_of_items, ul grain_size) const;
+
+  /**
+   * stable id of the calling thread, 0 outside the pool and 1 + the worker
+   * index for workers. Ids are in [0, GetNumberOfThreads()) and never change,
+   * so they don't collide even across nested loops as long as one thread
+   * outside the pool runs loops at a time. A loop with number_of_threads
+   * started outside the pool runs on ids below number_of_threads, so they
+   * can pick per-thread resources like a slice of CUDA blocks
+   */
+  ui GetThreadId(void) const;
+
+ //===--------------------------------------------------------------------===//
+ // Members
+ //===--------------------------------------------------------------------===//
+ private:
+  ThreadPool();
+
+  struct Job {
+    const std::function<void(ul, ul)>* body;
+    // # of chunks not finished yet
+    std::atomic<ul> pending;
+    // workers whose id is below this may run chunks of the job
+    ui number_of_workers;
+    // body of a job run in the background, which owns it and is
+    // deleted by the worker running it
+    std::function<void(ul, ul)> background_body;
+  };
+
+  struct Task {
+    Job* job;
+    ul start_offset;
+    ul end_offset;
+  };
+
+  struct WorkQueue {
+    std::mutex mutex;
+    std::deque<Task> tasks;
+  };
+
+  void Thread_Worker(ui worker_id);
+
+  bool PopTask(ui worker_id, Task& task);
+
+  bool StealTask(ui victim_id, ui worker_id, Job* job, Task& task);
+
+  void RunTask(Task& task);
+
+  ui ClampNumberOfThreads(ui number_of_threads) const;
+
+  std::vector<std::thread> workers;
+
+  std::vector<WorkQueue> work_queues;
+
+  // bumped whenever tasks are pushed so sleeping workers can tell
+  // new work from a spurious wake up
+  ul generation = 0;
+
+  bool stop = false;
+
+  // worker whose queue takes the next task run in the background
+  std::atomic<ui> next_background_worker_id{0};
+
+  std::mutex sleep_mutex;
+
+  std::condition_variable sleep_condition;
+};
+
+template <typename T>
+T ThreadPool::ParallelReduce(ul start_offset, ul end_offset, T identity,
+                             const std::function<T(ul, ul)>& body,
+                             const std::function<T(const T&, const T&)>& reduce,
+                             ui number_of_threads, ul grain_size) {
+  if(start_offset >= end_offset) {
+    return identity;
+  }
+
+  if(!grain_size) {
+    grain_size = GetGrainSize(end_offset-start_offset, number_of_threads);
+  }
+
+  std::vector<T> partials(GetNumberOfChunks(end_offset-start_offset, grain_size),
+                          identity);
+
+  ParallelFor(start_offset, end_offset, [&](ul chunk_start, ul chunk_end) {
+    partials[(chunk_start-start_offset)/grain_size] = body(chunk_start, chunk_end);
+  }, number_of_threads, grain_size);
+
+  T result = identity;
+  for(auto& partial : partials) {
+    result = reduce(result, partial);
+  }
+  return result;
+}
+
+} // End of ursus namespace
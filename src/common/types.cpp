@@ -170,6 +170,8 @@ std::string ClusterTypeToString(ClusterType type) {
       return "CLUSTER_TYPE_HILBERT";
     case (CLUSTER_TYPE_KMEANSHILBERT):
       return "CLUSTER_TYPE_KMEANSHILBERT";
+    case (CLUSTER_TYPE_STR):
+      return "CLUSTER_TYPE_STR";
     default: {
       char buffer[32];
       ::snprintf(buffer, 32, "UNKNOWN[%d] ", type);
@@ -188,9 +190,145 @@ ClusterType StringToClusterType(std::string str) {
     return CLUSTER_TYPE_HILBERT;
   } else if (str == "CLUSTER_TYPE_KMEANSHILBERT") {
     return CLUSTER_TYPE_KMEANSHILBERT;
+  } else if (str == "CLUSTER_TYPE_STR") {
+    return CLUSTER_TYPE_STR;
   }
   return CLUSTER_TYPE_INVALID;
 }
 
+//===--------------------------------------------------------------------===//
+// DeviceType <--> String Utilities
+//===--------------------------------------------------------------------===//
+
+std::string DeviceTypeToString(DeviceType type) {
+  std::string ret;
+
+  switch (type) {
+    case (DEVICE_TYPE_INVALID):
+      return "DEVICE_TYPE_INVALID";
+    case (DEVICE_TYPE_GPU):
+      return "DEVICE_TYPE_GPU";
+    case (DEVICE_TYPE_CPU):
+      return "DEVICE_TYPE_CPU";
+    default: {
+      char buffer[32];
+      ::snprintf(buffer, 32, "UNKNOWN[%d] ", type);
+      ret = buffer;
+    }
+  }
+  return (ret);
+}
+
+DeviceType StringToDeviceType(std::string str) {
+  if (str == "DEVICE_TYPE_INVALID") {
+    return DEVICE_TYPE_INVALID;
+  } else if (str == "DEVICE_TYPE_GPU") {
+    return DEVICE_TYPE_GPU;
+  } else if (str == "DEVICE_TYPE_CPU") {
+    return DEVICE_TYPE_CPU;
+  }
+  return DEVICE_TYPE_INVALID;
+}
+
+//===--------------------------------------------------------------------===//
+// LoadType <--> String Utilities
+//===--------------------------------------------------------------------===//
+
+std::string LoadTypeToString(LoadType type) {
+  std::string ret;
+
+  switch (type) {
+    case (LOAD_TYPE_INVALID):
+      return "LOAD_TYPE_INVALID";
+    case (LOAD_TYPE_READ):
+      return "LOAD_TYPE_READ";
+    case (LOAD_TYPE_MMAP):
+      return "LOAD_TYPE_MMAP";
+    case (LOAD_TYPE_POPULATE):
+      return "LOAD_TYPE_POPULATE";
+    default: {
+      char buffer[32];
+      ::snprintf(buffer, 32, "UNKNOWN[%d] ", type);
+      ret = buffer;
+    }
+  }
+  return (ret);
+}
+
+LoadType StringToLoadType(std::string str) {
+  if (str == "LOAD_TYPE_INVALID") {
+    return LOAD_TYPE_INVALID;
+  } else if (str == "LOAD_TYPE_READ") {
+    return LOAD_TYPE_READ;
+  } else if (str == "LOAD_TYPE_MMAP") {
+    return LOAD_TYPE_MMAP;
+  } else if (str == "LOAD_TYPE_POPULATE") {
+    return LOAD_TYPE_POPULATE;
+  }
+  return LOAD_TYPE_INVALID;
+}
+
+//===--------------------------------------------------------------------===//
+// StageType <--> String Utilities
+//===--------------------------------------------------------------------===//
+
+std::string StageTypeToString(StageType type) {
+  std::string ret;
+
+  switch (type) {
+    case (STAGE_TYPE_INVALID):
+      return "STAGE_TYPE_INVALID";
+    case (STAGE_TYPE_BRANCH_CREATION):
+      return "STAGE_TYPE_BRANCH_CREATION";
+    case (STAGE_TYPE_MAPPING):
+      return "STAGE_TYPE_MAPPING";
+    case (STAGE_TYPE_SORT):
+      return "STAGE_TYPE_SORT";
+    case (STAGE_TYPE_TOP_DOWN):
+      return "STAGE_TYPE_TOP_DOWN";
+    case (STAGE_TYPE_BOTTOM_UP):
+      return "STAGE_TYPE_BOTTOM_UP";
+    case (STAGE_TYPE_TRANSFORM):
+      return "STAGE_TYPE_TRANSFORM";
+    case (STAGE_TYPE_DUMP):
+      return "STAGE_TYPE_DUMP";
+    case (STAGE_TYPE_LOAD):
+      return "STAGE_TYPE_LOAD";
+    case (STAGE_TYPE_SEARCH):
+      return "STAGE_TYPE_SEARCH";
+    default: {
+      char buffer[32];
+      ::snprintf(buffer, 32, "UNKNOWN[%d] ", type);
+      ret = buffer;
+    }
+  }
+  return (ret);
+}
+
+StageType StringToStageType(std::string str) {
+  if (str == "STAGE_TYPE_INVALID") {
+    return STAGE_TYPE_INVALID;
+  } else if (str == "STAGE_TYPE_BRANCH_CREATION") {
+    return STAGE_TYPE_BRANCH_CREATION;
+  } else if (str == "STAGE_TYPE_MAPPING") {
+    return STAGE_TYPE_MAPPING;
+  } else if (str == "STAGE_TYPE_SORT") {
+    return STAGE_TYPE_SORT;
+  } else if (str == "STAGE_TYPE_TOP_DOWN") {
+    return STAGE_TYPE_TOP_DOWN;
+  } else if (str == "STAGE_TYPE_BOTTOM_UP") {
+    return STAGE_TYPE_BOTTOM_UP;
+  } else if (str == "STAGE_TYPE_TRANSFORM") {
+    return STAGE_TYPE_TRANSFORM;
+  } else if (str == "STAGE_TYPE_DUMP") {
+    return STAGE_TYPE_DUMP;
+  } else if (str == "STAGE_TYPE_LOAD") {
+    return STAGE_TYPE_LOAD;
+  } else if (str == "STAGE_TYPE_SEARCH") {
+    return STAGE_TYPE_SEARCH;
+  }
+  return STAGE_TYPE_INVALID;
+}
+
 } // End of ursus namespace
 
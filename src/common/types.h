@@ -1,5 +1,7 @@
 #pragma once
 
+#include "common/backend.h"
+
 #include <string>
 
 namespace ursus {
@@ -59,7 +61,49 @@ enum ClusterType  {
   CLUSTER_TYPE_INVALID = -1,
   CLUSTER_TYPE_NONE = 1,
   CLUSTER_TYPE_HILBERT = 2,
-  CLUSTER_TYPE_KMEANSHILBERT = 3
+  CLUSTER_TYPE_KMEANSHILBERT = 3,
+  // Sort-Tile-Recursive packing instead of Hilbert order
+  CLUSTER_TYPE_STR = 4
+};
+
+//===--------------------------------------------------------------------===//
+// DeviceType
+//===--------------------------------------------------------------------===//
+enum DeviceType  {
+  DEVICE_TYPE_INVALID = -1,
+  DEVICE_TYPE_GPU = 1,
+  DEVICE_TYPE_CPU = 2
+};
+
+//===--------------------------------------------------------------------===//
+// LoadType
+//===--------------------------------------------------------------------===//
+// how index files are loaded, read copies them into the heap, mmap uses the
+// nodes in place from the page cache and faults them in lazily, populate
+// does the same but prefaults the whole file up front
+enum LoadType  {
+  LOAD_TYPE_INVALID = -1,
+  LOAD_TYPE_READ = 1,
+  LOAD_TYPE_MMAP = 2,
+  LOAD_TYPE_POPULATE = 3
+};
+
+//===--------------------------------------------------------------------===//
+// StageType
+//===--------------------------------------------------------------------===//
+// stages of building and searching an index, the recorder sums up the time
+// spent in each of them
+enum StageType  {
+  STAGE_TYPE_INVALID = -1,
+  STAGE_TYPE_BRANCH_CREATION = 1,
+  STAGE_TYPE_MAPPING = 2,
+  STAGE_TYPE_SORT = 3,
+  STAGE_TYPE_TOP_DOWN = 4,
+  STAGE_TYPE_BOTTOM_UP = 5,
+  STAGE_TYPE_TRANSFORM = 6,
+  STAGE_TYPE_DUMP = 7,
+  STAGE_TYPE_LOAD = 8,
+  STAGE_TYPE_SEARCH = 9
 };
 
 //===--------------------------------------------------------------------===//
@@ -91,4 +135,13 @@ TreeType StringToTreeType(std::string str);
 std::string ClusterTypeToString(ClusterType type);
 ClusterType StringToClusterType(std::string str);
 
+std::string DeviceTypeToString(DeviceType type);
+DeviceType StringToDeviceType(std::string str);
+
+std::string LoadTypeToString(LoadType type);
+LoadType StringToLoadType(std::string str);
+
+std::string StageTypeToString(StageType type);
+StageType StringToStageType(std::string str);
+
 } // End of ursus namespace
@@ -0,0 +1,488 @@
+#include "evaluator/benchmark.h"
+
+#include "common/logger.h"
+#include "common/macro.h"
+
+#include <cctype>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <limits>
+
+namespace ursus {
+namespace evaluator {
+
+//===--------------------------------------------------------------------===//
+// Columns
+//===--------------------------------------------------------------------===//
+
+// fields naming what is measured, they make up the key of a record
+static const std::vector<std::string> key_columns = {
+  "kind", "backend", "tree_type", "device_type", "load_type", "data_type",
+  "cluster_type", "number_of_data", "number_of_search", "selectivity",
+  "build_parameters", "search_parameters", "materialize_result",
+  "data_hash", "query_hash"
+};
+
+// every column of a CSV row, in order
+static const std::vector<std::string> csv_columns = {
+  "kind", "timestamp", "git_revision", "backend", "tree_type", "device_type",
+  "load_type", "data_type", "cluster_type", "number_of_data", "number_of_search",
+  "number_of_repeat", "selectivity", "build_parameters", "search_parameters",
+  "materialize_result", "data_file", "data_hash", "query_file", "query_hash",
+  "build_ms", "branch_creation_ms", "mapping_ms", "sort_ms", "top_down_ms",
+  "bottom_up_ms", "transform_ms", "dump_ms", "load_ms",
+  "search_ms", "search_ms_mean", "throughput_qps_mean",
+  "latency_count", "latency_mean_ns", "latency_stddev_ns",
+  "latency_p50_ns", "latency_p99_ns", "latency_p999_ns"
+};
+
+static std::string NumberToString(double value) {
+  char buffer[32];
+  ::snprintf(buffer, sizeof(buffer), "%.9g", value);
+  return buffer;
+}
+
+static std::string EscapeJSON(const std::string& str) {
+  std::string escaped;
+  for(auto c : str) {
+    if(c == '"' || c == '\\') {
+      escaped += '\\';
+      escaped += c;
+    } else if((unsigned char)c < 0x20) {
+      char buffer[8];
+      ::snprintf(buffer, sizeof(buffer), "\\u%04x", c);
+      escaped += buffer;
+    } else {
+      escaped += c;
+    }
+  }
+  return escaped;
+}
+
+static std::string EscapeCSV(const std::string& str) {
+  if(str.find_first_of(",\"\n") == std::string::npos) {
+    return str;
+  }
+  std::string escaped = "\"";
+  for(auto c : str) {
+    if(c == '"') {
+      escaped += '"';
+    }
+    escaped += c;
+  }
+  return escaped+"\"";
+}
+
+//===--------------------------------------------------------------------===//
+// Benchmark Record
+//===--------------------------------------------------------------------===//
+
+void BenchmarkRecord::Set(std::string key, std::string value) {
+  strings[key] = value;
+}
+
+void BenchmarkRecord::Set(std::string key, double value) {
+  numbers[key] = value;
+}
+
+void BenchmarkRecord::SetSamples(std::string key, std::vector<double> values) {
+  samples[key] = values;
+}
+
+std::string BenchmarkRecord::GetString(std::string key) const {
+  auto itr = strings.find(key);
+  return (itr == strings.end()) ? "" : itr->second;
+}
+
+double BenchmarkRecord::GetNumber(std::string key) const {
+  auto itr = numbers.find(key);
+  return (itr == numbers.end()) ? 0.0 : itr->second;
+}
+
+std::vector<double> BenchmarkRecord::GetSamples(std::string key) const {
+  auto itr = samples.find(key);
+  return (itr == samples.end()) ? std::vector<double>() : itr->second;
+}
+
+// value of a field as text whatever its type, empty if the record doesn't
+// have it
+static std::string GetField(const BenchmarkRecord& record, const std::string& key) {
+  if(record.strings.count(key)) {
+    return record.strings.at(key);
+  }
+  if(record.numbers.count(key)) {
+    return NumberToString(record.numbers.at(key));
+  }
+  if(record.samples.count(key)) {
+    std::string joined;
+    for(auto value : record.samples.at(key)) {
+      joined += (joined.empty() ? "" : ";")+NumberToString(value);
+    }
+    return joined;
+  }
+  return "";
+}
+
+std::string BenchmarkRecord::GetKey(void) const {
+  std::string key;
+  for(auto& column : key_columns) {
+    key += column+"="+GetField(*this, column)+";";
+  }
+  return key;
+}
+
+std::string BenchmarkRecord::ToJSON(void) const {
+  std::string json;
+  auto append = [&](const std::string& key, const std::string& value) {
+    json += (json.empty() ? "{" : ",") + ("\""+EscapeJSON(key)+"\":") + value;
+  };
+
+  for(auto& field : strings) {
+    append(field.first, "\""+EscapeJSON(field.second)+"\"");
+  }
+  for(auto& field : numbers) {
+    append(field.first, NumberToString(field.second));
+  }
+  for(auto& field : samples) {
+    std::string values;
+    for(auto value : field.second) {
+      values += (values.empty() ? "" : ",")+NumberToString(value);
+    }
+    append(field.first, "["+values+"]");
+  }
+  return json.empty() ? "{}" : json+"}";
+}
+
+std::string BenchmarkRecord::ToCSV(void) const {
+  std::string row;
+  for(auto& column : csv_columns) {
+    row += (row.empty() ? "" : ",")+EscapeCSV(GetField(*this, column));
+  }
+  return row;
+}
+
+std::string BenchmarkRecord::GetCSVHeader(void) {
+  std::string header;
+  for(auto& column : csv_columns) {
+    header += (header.empty() ? "" : ",")+column;
+  }
+  return header;
+}
+
+bool BenchmarkRecord::FromJSON(const std::string& line, BenchmarkRecord& record) {
+  size_t position = 0;
+  auto skip_spaces = [&]() {
+    while(position < line.size() && isspace((unsigned char)line[position])) {
+      position++;
+    }
+  };
+  auto parse_string = [&](std::string& str) {
+    if(position >= line.size() || line[position] != '"') {
+      return false;
+    }
+    for(position++; position < line.size() && line[position] != '"'; position++) {
+      if(line[position] == '\\' && position+1 < line.size()) {
+        position++;
+        if(line[position] == 'u' && position+4 < line.size()) {
+          str += (char)strtol(line.substr(position+1, 4).c_str(), nullptr, 16);
+          position += 4;
+          continue;
+        }
+      }
+      str += line[position];
+    }
+    return position++ < line.size();
+  };
+  auto parse_number = [&](double& value) {
+    char* end;
+    value = strtod(line.c_str()+position, &end);
+    if(end == line.c_str()+position) {
+      return false;
+    }
+    position = end-line.c_str();
+    return true;
+  };
+
+  record = BenchmarkRecord();
+  skip_spaces();
+  if(position >= line.size() || line[position++] != '{') {
+    return false;
+  }
+
+  while(true) {
+    skip_spaces();
+    if(position < line.size() && line[position] == '}') {
+      return true;
+    }
+
+    std::string key;
+    if(!parse_string(key)) {
+      return false;
+    }
+    skip_spaces();
+    if(position >= line.size() || line[position++] != ':') {
+      return false;
+    }
+    skip_spaces();
+
+    if(position < line.size() && line[position] == '"') {
+      std::string value;
+      if(!parse_string(value)) {
+        return false;
+      }
+      record.strings[key] = value;
+    } else if(position < line.size() && line[position] == '[') {
+      std::vector<double> values;
+      position++;
+      skip_spaces();
+      while(position < line.size() && line[position] != ']') {
+        double value;
+        if(!parse_number(value)) {
+          return false;
+        }
+        values.push_back(value);
+        skip_spaces();
+        if(position < line.size() && line[position] == ',') {
+          position++;
+          skip_spaces();
+        }
+      }
+      if(position++ >= line.size()) {
+        return false;
+      }
+      record.samples[key] = values;
+    } else {
+      double value;
+      if(!parse_number(value)) {
+        return false;
+      }
+      record.numbers[key] = value;
+    }
+
+    skip_spaces();
+    if(position < line.size() && line[position] == ',') {
+      position++;
+    } else if(position >= line.size() || line[position] != '}') {
+      return false;
+    }
+  }
+}
+
+//===--------------------------------------------------------------------===//
+// Statistics
+//===--------------------------------------------------------------------===//
+
+// continued fraction of the incomplete beta function (modified Lentz)
+static double IncompleteBetaFraction(double a, double b, double x) {
+  const double epsilon = 1e-12;
+  const double tiny = 1e-300;
+
+  double c = 1.0;
+  double d = 1.0-(a+b)*x/(a+1.0);
+  if(std::fabs(d) < tiny) d = tiny;
+  d = 1.0/d;
+  double fraction = d;
+
+  for(int range(m, 1, 300)) {
+    double numerator = m*(b-m)*x/((a+2*m-1.0)*(a+2*m));
+    d = 1.0+numerator*d;
+    if(std::fabs(d) < tiny) d = tiny;
+    c = 1.0+numerator/c;
+    if(std::fabs(c) < tiny) c = tiny;
+    d = 1.0/d;
+    fraction *= d*c;
+
+    numerator = -(a+m)*(a+b+m)*x/((a+2*m)*(a+2*m+1.0));
+    d = 1.0+numerator*d;
+    if(std::fabs(d) < tiny) d = tiny;
+    c = 1.0+numerator/c;
+    if(std::fabs(c) < tiny) c = tiny;
+    d = 1.0/d;
+    double delta = d*c;
+    fraction *= delta;
+
+    if(std::fabs(delta-1.0) < epsilon) {
+      break;
+    }
+  }
+  return fraction;
+}
+
+static double RegularizedIncompleteBeta(double a, double b, double x) {
+  if(x <= 0.0) return 0.0;
+  if(x >= 1.0) return 1.0;
+
+  double front = std::exp(std::lgamma(a+b)-std::lgamma(a)-std::lgamma(b)+
+                          a*std::log(x)+b*std::log(1.0-x));
+  if(x < (a+1.0)/(a+b+2.0)) {
+    return front*IncompleteBetaFraction(a, b, x)/a;
+  }
+  return 1.0-front*IncompleteBetaFraction(b, a, 1.0-x)/b;
+}
+
+/**
+ * @brief two-sided p-value of Welch's t-test for equal means
+ * @return NaN if either side has less than two samples
+ */
+static double WelchTTest(double mean1, double stddev1, double n1,
+                         double mean2, double stddev2, double n2) {
+  if(n1 < 2 || n2 < 2) {
+    return std::numeric_limits<double>::quiet_NaN();
+  }
+
+  double v1 = stddev1*stddev1/n1;
+  double v2 = stddev2*stddev2/n2;
+  if(v1+v2 == 0.0) {
+    return (mean1 == mean2) ? 1.0 : 0.0;
+  }
+
+  double t = (mean1-mean2)/std::sqrt(v1+v2);
+  double df = (v1+v2)*(v1+v2)/(v1*v1/(n1-1)+v2*v2/(n2-1));
+  return RegularizedIncompleteBeta(df/2.0, 0.5, df/(df+t*t));
+}
+
+static void GetMeanAndStdDev(const std::vector<double>& values, double& mean, double& stddev) {
+  mean = 0.0;
+  stddev = 0.0;
+  if(values.empty()) {
+    return;
+  }
+  for(auto value : values) {
+    mean += value;
+  }
+  mean /= values.size();
+  if(values.size() < 2) {
+    return;
+  }
+  for(auto value : values) {
+    stddev += (value-mean)*(value-mean);
+  }
+  stddev = std::sqrt(stddev/(values.size()-1));
+}
+
+//===--------------------------------------------------------------------===//
+// Benchmark
+//===--------------------------------------------------------------------===//
+
+void Benchmark::SetResultFile(std::string _result_file) {
+  result_file = _result_file;
+}
+
+void Benchmark::Add(const BenchmarkRecord& record) {
+  records.push_back(record);
+  if(result_file.empty()) {
+    return;
+  }
+
+  bool csv = (result_file.size() >= 4 &&
+              result_file.compare(result_file.size()-4, 4, ".csv") == 0);
+  bool has_header = (std::ifstream(result_file).peek() != std::ifstream::traits_type::eof());
+
+  std::ofstream result_stream(result_file, std::ios::app);
+  if(!result_stream) {
+    LOG_INFO("Failed to open a result file(%s)", result_file.c_str());
+    return;
+  }
+  if(csv) {
+    if(!has_header) {
+      result_stream << BenchmarkRecord::GetCSVHeader() << std::endl;
+    }
+    result_stream << record.ToCSV() << std::endl;
+  } else {
+    result_stream << record.ToJSON() << std::endl;
+  }
+}
+
+const std::vector<BenchmarkRecord>& Benchmark::GetRecords(void) const {
+  return records;
+}
+
+int Benchmark::Compare(std::string baseline_file, double alpha, double min_change) const {
+  std::ifstream baseline_stream(baseline_file);
+  if(!baseline_stream) {
+    LOG_INFO("Failed to open a baseline file(%s)", baseline_file.c_str());
+    return -1;
+  }
+
+  // the latest record of each configuration
+  std::map<std::string, BenchmarkRecord> baseline;
+  std::string line;
+  while(std::getline(baseline_stream, line)) {
+    BenchmarkRecord record;
+    if(BenchmarkRecord::FromJSON(line, record)) {
+      baseline[record.GetKey()] = record;
+    }
+  }
+  LOG_INFO("Compare with %lu baseline records in %s", baseline.size(), baseline_file.c_str());
+
+  int number_of_regressions = 0;
+  for(auto& record : records) {
+    if(record.GetString("kind") != "search") {
+      continue;
+    }
+
+    auto title = record.GetString("tree_type")+" "+record.GetString("search_parameters");
+    auto itr = baseline.find(record.GetKey());
+    if(itr == baseline.end()) {
+      LOG_INFO("%s : no baseline", title.c_str());
+      continue;
+    }
+    auto& base = itr->second;
+    LOG_INFO("%s : %s -> %s", title.c_str(), base.GetString("git_revision").c_str(),
+             record.GetString("git_revision").c_str());
+
+    // throughput of each repeat
+    auto number_of_search = record.GetNumber("number_of_search");
+    auto get_throughput = [&](const BenchmarkRecord& r) {
+      std::vector<double> throughput;
+      for(auto search_ms : r.GetSamples("search_ms")) {
+        if(search_ms > 0.0) {
+          throughput.push_back(number_of_search*1000.0/search_ms);
+        }
+      }
+      return throughput;
+    };
+    double base_mean, base_stddev, mean, stddev;
+    auto base_throughput = get_throughput(base);
+    auto throughput = get_throughput(record);
+    GetMeanAndStdDev(base_throughput, base_mean, base_stddev);
+    GetMeanAndStdDev(throughput, mean, stddev);
+
+    if(base_mean > 0.0) {
+      double change = (mean-base_mean)/base_mean;
+      double p_value = WelchTTest(base_mean, base_stddev, base_throughput.size(),
+                                  mean, stddev, throughput.size());
+      bool regression = (p_value < alpha && change < -min_change);
+      number_of_regressions += regression;
+      LOG_INFO("  Throughput(qps)   %.1f -> %.1f (%+.2f%%), p = %.4f%s", base_mean, mean,
+               change*100.0, p_value, std::isnan(p_value) ? " (needs 2+ repeats)" :
+               (regression ? " REGRESSION" : ""));
+    }
+
+    // per-query latency, if both runs recorded it
+    auto base_count = base.GetNumber("latency_count");
+    auto count = record.GetNumber("latency_count");
+    if(base_count > 0 && count > 0) {
+      base_mean = base.GetNumber("latency_mean_ns");
+      mean = record.GetNumber("latency_mean_ns");
+      double change = (mean-base_mean)/base_mean;
+      double p_value = WelchTTest(base_mean, base.GetNumber("latency_stddev_ns"), base_count,
+                                  mean, record.GetNumber("latency_stddev_ns"), count);
+      bool regression = (p_value < alpha && change > min_change);
+      number_of_regressions += regression;
+      LOG_INFO("  Latency mean(us)  %.3f -> %.3f (%+.2f%%), p = %.4f%s", base_mean/1000.0,
+               mean/1000.0, change*100.0, p_value, regression ? " REGRESSION" : "");
+      LOG_INFO("  Latency p99(us)   %.3f -> %.3f", base.GetNumber("latency_p99_ns")/1000.0,
+               record.GetNumber("latency_p99_ns")/1000.0);
+    }
+  }
+
+  LOG_INFO("%d regressions (alpha %.3f, min change %.1f%%)", number_of_regressions,
+           alpha, min_change*100.0);
+  return number_of_regressions;
+}
+
+} // End of evaluator namespace
+} // End of ursus namespace
@@ -0,0 +1,87 @@
+#pragma once
+
+#include "common/types.h"
+
+#include <map>
+#include <string>
+#include <vector>
+
+// revision the binary is built from, passed in by the Makefile
+#ifndef GIT_REVISION
+#define GIT_REVISION "unknown"
+#endif
+
+namespace ursus {
+namespace evaluator {
+
+//===--------------------------------------------------------------------===//
+// Benchmark Record
+//===--------------------------------------------------------------------===//
+// metrics of one build or search of a tree with one configuration. Records
+// are written as flat JSON objects, one per line, so they can be read back
+// as a baseline, or as CSV rows with a fixed set of columns.
+struct BenchmarkRecord {
+  std::map<std::string, std::string> strings;
+
+  std::map<std::string, double> numbers;
+
+  // repeated measurements, e.g. the search time of each repeat
+  std::map<std::string, std::vector<double>> samples;
+
+  void Set(std::string key, std::string value);
+
+  void Set(std::string key, double value);
+
+  void SetSamples(std::string key, std::vector<double> values);
+
+  std::string GetString(std::string key) const;
+
+  // 0 if the record doesn't have it
+  double GetNumber(std::string key) const;
+
+  std::vector<double> GetSamples(std::string key) const;
+
+  // what the record measures, everything but the revision and the metrics;
+  // a baseline record is compared with the record of the same key
+  std::string GetKey(void) const;
+
+  std::string ToJSON(void) const;
+
+  std::string ToCSV(void) const;
+
+  static std::string GetCSVHeader(void);
+
+  // false if the line isn't a record written by ToJSON
+  static bool FromJSON(const std::string& line, BenchmarkRecord& record);
+};
+
+//===--------------------------------------------------------------------===//
+// Benchmark
+//===--------------------------------------------------------------------===//
+class Benchmark{
+ public:
+  // records are appended to the file as they are added, as CSV if the file
+  // name ends with .csv, otherwise as JSON lines
+  void SetResultFile(std::string result_file);
+
+  void Add(const BenchmarkRecord& record);
+
+  const std::vector<BenchmarkRecord>& GetRecords(void) const;
+
+  /**
+   * compare the search records of this run with the records of the same
+   * configuration in a baseline file. A throughput or latency regression is
+   * flagged if Welch's t-test rejects equal means at alpha and the mean got
+   * worse by more than min_change
+   * @return number of regressions, -1 if the baseline can't be read
+   */
+  int Compare(std::string baseline_file, double alpha=0.05, double min_change=0.05) const;
+
+ private:
+  std::string result_file;
+
+  std::vector<BenchmarkRecord> records;
+};
+
+} // End of evaluator namespace
+} // End of ursus namespace
@@ -1,7 +1,11 @@
 #include "evaluator/evaluator.h"
 
 #include "common/macro.h"
+#include "common/geometry.h"
+#include "common/hash.h"
 #include "common/logger.h"
+#include "evaluator/oracle.h"
+#include "evaluator/recorder.h"
 #include "tree/mphr.h"
 #include "tree/hybrid.h"
 #include "tree/bvh.h"
@@ -9,6 +13,13 @@
 #include "tree/rtree_ls.h"
 
 #include <cassert>
+#include <cerrno>
+#include <cstdlib>
+#include <ctime>
+#include <fstream>
+#include <limits>
+#include <map>
+#include <getopt.h>
 #include <unistd.h>
 #include <locale> 
 #include <thread> 
@@ -33,6 +44,17 @@ bool Evaluator::Initialize(int argc, char** argv){
     return false;
   }
 
+  // the data may be indexed with another geometry, the files must hold
+  // points of the dims of the binary that runs
+  Geometry index_geometry;
+  bool indexed = io::DataSet::GetIndexedGeometry(index_directory, GetDataPath(GetDataType()),
+                                                 index_geometry);
+  if( !DispatchGeometryOfFiles(argc, argv, GetDataPath(GetDataType()), 
+                               GetQueryPath(GetDataType()), number_of_search,
+                               (indexed) ? &index_geometry : nullptr)) {
+    return false;
+  }
+
   // Read dataset based on initialized variables
   ret=ReadDataSet();
   assert(ret);
@@ -72,6 +94,12 @@ bool Evaluator::ReadQuerySet(void){
 
 int Evaluator::SetDevice() {
 
+  if(!backend::IsDeviceAvailable()) {
+    LOG_INFO("No CUDA device is available (%s backend), indexes are built and searched on the CPU",
+             backend::GetBackendName());
+    return -1;
+  }
+
   int number_of_gpus;
   cudaGetDeviceCount(&number_of_gpus);
 
@@ -119,7 +147,16 @@ int Evaluator::SetDevice() {
  *  otherwise return false 
  */
 bool Evaluator::Build(void) {
+  auto& recorder = Recorder::GetInstance();
+
   for(auto& tree : trees) {
+    // some trees keep the host copy of nodes to materialize the results
+    tree->SetMaterializeResult(materialize_result);
+    tree->SetRecordQueryStats(!query_stats_file.empty());
+    tree->SetLoadType(GetLoadType());
+    tree->SetVerifyIndex(verify_index);
+    tree->SetIndexDirectory(index_directory);
+
     switch(tree->GetTreeType()){
       case TREE_TYPE_HYBRID:  {
         // Casting type from base class to derived class using dynamic_pointer_cast since it's shared_ptr
@@ -127,6 +164,8 @@ bool Evaluator::Build(void) {
         hybrid->SetUpperTreeType(UPPER_TREE_TYPE);
         hybrid->SetScanLevel(scan_level);
         hybrid->SetChunkSize(chunk_size);
+        hybrid->SetQuantizeLeafNodes(quantize_leaf_nodes);
+        hybrid->SetQueryBatchSize(query_batch_size);
         hybrid->SetNumberOfCUDABlocks(number_of_cuda_blocks);
         hybrid->SetNumberOfCPUThreads(number_of_cpu_threads);
         tree->Build(input_data_set);
@@ -134,16 +173,24 @@ bool Evaluator::Build(void) {
       case TREE_TYPE_RTREE_LS:  {
         // Casting type from base class to derived class using dynamic_pointer_cast since it's shared_ptr
         std::shared_ptr<tree::RTree_LS> rtree_ls = std::dynamic_pointer_cast<tree::RTree_LS>(tree);
-        rtree_ls->SetUpperTreeType(UPPER_TREE_TYPE);
+        // large leaves are always grouped by an R-tree
+        rtree_ls->SetUpperTreeType(TREE_TYPE_RTREE);
         rtree_ls->SetChunkSize(4);
         rtree_ls->SetNumberOfCUDABlocks(number_of_cuda_blocks);
         rtree_ls->SetNumberOfCPUThreads(number_of_cpu_threads);
         tree->Build(input_data_set);
         } break;
-      case  TREE_TYPE_MPHR: {
+      case  TREE_TYPE_MPHR:
+      case  TREE_TYPE_MPHR_PARTITION: {
         std::shared_ptr<tree::MPHR> mphr = std::dynamic_pointer_cast<tree::MPHR>(tree);
         mphr->SetNumberOfCUDABlocks(number_of_cuda_blocks);
-        mphr->SetNumberOfPartition(number_of_partition);
+        // a partitioned MPHR-tree keeps its partitions
+        if(mphr->GetNumberOfPartition() == 1) {
+          mphr->SetNumberOfPartition(number_of_partition);
+        }
+        mphr->SetNumberOfCPUThreads(number_of_cpu_threads);
+        // kNN search runs on the host copy of the tree
+        mphr->SetSearchDevice((knn) ? DEVICE_TYPE_CPU : GetDeviceType());
         tree->Build(input_data_set);
         } break;
       case  TREE_TYPE_BVH: {
@@ -160,6 +207,22 @@ bool Evaluator::Build(void) {
         assert(0);
         break;
     }
+
+    if(IsBenchmarkOn()) {
+      auto record = GetBenchmarkRecord("build", tree);
+      float build_time = 0.f;
+      for(auto stage : {STAGE_TYPE_BRANCH_CREATION, STAGE_TYPE_MAPPING, STAGE_TYPE_SORT,
+                        STAGE_TYPE_TOP_DOWN, STAGE_TYPE_BOTTOM_UP, STAGE_TYPE_TRANSFORM,
+                        STAGE_TYPE_DUMP, STAGE_TYPE_LOAD}) {
+        auto stage_name = ToLowerCase(StageTypeToString(stage).substr(std::string("STAGE_TYPE_").size()));
+        record.Set(stage_name+"_ms", recorder.GetStageTime(stage));
+        build_time += recorder.GetStageTime(stage);
+      }
+      record.Set("build_ms", build_time);
+      benchmark.Add(record);
+    }
+
+    recorder.PrintReport("Build "+TreeTypeToString(tree->GetTreeType()));
   }
   return true;
 }
@@ -177,6 +240,8 @@ bool Evaluator::Search(void) {
   //std::vector<ui> cuda_block_vec = {1, 2, 4, 8, 16, 32, 64, 128, 256};
   std::vector<ui> cuda_block_vec = {128};
 
+  auto& recorder = Recorder::GetInstance();
+
   for(auto& tree : trees) {
     switch(tree->GetTreeType()) {
       case TREE_TYPE_HYBRID: {
@@ -195,7 +260,7 @@ bool Evaluator::Search(void) {
                   hybrid->SetNumberOfCUDABlocks(128);
                   LOG_INFO("Evaluation Mode On CPU Thread %u CUDA Block %u Chunk Size %u", 
                   cpu_thread_itr, cuda_block_per_cpu,  cuda_block_per_cpu*4/*chunk_size_itr*/);
-                  tree->Search(query_data_set, number_of_search, number_of_repeat);
+                  SearchTree(tree);
                 //}
               //}
             }
@@ -212,13 +277,13 @@ bool Evaluator::Search(void) {
                   hybrid->SetNumberOfCPUThreads(cpu_thread);
                   hybrid->SetNumberOfCUDABlocks(cuda_block_itr);
                   LOG_INFO("Evaluation Mode On CPU Thread %u CUDA Block %u Chunk Size %u", 1, cuda_block_itr, chunk_size_itr);
-                  tree->Search(query_data_set, number_of_search, number_of_repeat);
+                  SearchTree(tree);
                 }
               }
             }
           }
         } else {
-          tree->Search(query_data_set, number_of_search, number_of_repeat);
+          SearchTree(tree);
         }
       }  break;
       case TREE_TYPE_MPHR:
@@ -226,14 +291,22 @@ bool Evaluator::Search(void) {
         if( EvaluationMode ) {
           std::shared_ptr<tree::MPHR> mphr = std::dynamic_pointer_cast<tree::MPHR>(tree);
 
-          for(auto cuda_block_itr : cuda_block_vec) {
-            mphr->SetNumberOfCUDABlocks(cuda_block_itr);
-            LOG_INFO("Evaluation Mode On CUDA Block %u", cuda_block_itr);
-            tree->Search(query_data_set, number_of_search, number_of_repeat);
+          if( GetDeviceType() == DEVICE_TYPE_CPU) {
+            for(auto cpu_thread_itr : cpu_thread_vec) {
+              mphr->SetNumberOfCPUThreads(cpu_thread_itr);
+              LOG_INFO("Evaluation Mode On CPU Thread %u", cpu_thread_itr);
+              SearchTree(tree);
+            }
+          } else {
+            for(auto cuda_block_itr : cuda_block_vec) {
+              mphr->SetNumberOfCUDABlocks(cuda_block_itr);
+              LOG_INFO("Evaluation Mode On CUDA Block %u", cuda_block_itr);
+              SearchTree(tree);
+            }
           }
         } else {
           LOG_INFO("");
-          tree->Search(query_data_set, number_of_search, number_of_repeat);
+          SearchTree(tree);
         }
       } break;
       case TREE_TYPE_BVH: {
@@ -243,10 +316,10 @@ bool Evaluator::Search(void) {
           for(auto cpu_thread_itr : cpu_thread_vec) {
             bvh->SetNumberOfCPUThreads(cpu_thread_itr);
             LOG_INFO("Evaluation Mode On CPU Thread %u", cpu_thread_itr);
-            tree->Search(query_data_set, number_of_search, number_of_repeat);
+            SearchTree(tree);
           }
         } else {
-          tree->Search(query_data_set, number_of_search, number_of_repeat);
+          SearchTree(tree);
         }
       } break;
       case TREE_TYPE_RTREE: {
@@ -255,10 +328,10 @@ bool Evaluator::Search(void) {
           for(auto cpu_thread_itr : cpu_thread_vec) {
             rtree->SetNumberOfCPUThreads(cpu_thread_itr);
             LOG_INFO("Evaluation Mode On CPU Thread %u", cpu_thread_itr);
-            tree->Search(query_data_set, number_of_search, number_of_repeat);
+            SearchTree(tree);
           }
         } else {
-          tree->Search(query_data_set, number_of_search, number_of_repeat);
+          SearchTree(tree);
         }
       } break;
       case TREE_TYPE_RTREE_LS: {
@@ -267,18 +340,147 @@ bool Evaluator::Search(void) {
           for(auto cpu_thread_itr : cpu_thread_vec) {
             rtree_ls->SetNumberOfCPUThreads(cpu_thread_itr);
             LOG_INFO("Evaluation Mode On CPU Thread %u", cpu_thread_itr);
-            tree->Search(query_data_set, number_of_search, number_of_repeat);
+            SearchTree(tree);
           }
         } else {
-          tree->Search(query_data_set, number_of_search, number_of_repeat);
+          SearchTree(tree);
         }
       } break;
     }
+
+    recorder.PrintReport("Search "+TreeTypeToString(tree->GetTreeType()));
   }
 
   return true;
 }
 
+void Evaluator::SearchTree(std::shared_ptr<tree::Tree>& tree) {
+  auto& recorder = Recorder::GetInstance();
+  auto& query_stats = tree->GetQueryStats();
+  query_stats.Reset();
+  auto previous_search_count = recorder.GetStageCount(STAGE_TYPE_SEARCH);
+
+  bool searched = true;
+  if(knn) {
+    for(ui range(repeat_itr, 0, number_of_repeat)) {
+      searched = tree->SearchKNN(query_data_set, number_of_search, knn);
+    }
+  } else {
+    tree->Search(query_data_set, number_of_search, number_of_repeat);
+  }
+
+  if(verify && searched) {
+    if(!oracle) {
+      oracle.reset(new Oracle(input_data_set, query_data_set, number_of_search));
+    }
+    if(knn) {
+      number_of_mismatches += oracle->VerifyKNN(tree, GetClusterType(), knn);
+    } else {
+      number_of_mismatches += oracle->Verify(tree, GetClusterType());
+    }
+  }
+
+  if(IsBenchmarkOn()) {
+    // search time of each repeat of this search
+    auto search_time = recorder.GetStageSamples(STAGE_TYPE_SEARCH);
+    std::vector<double> samples(search_time.begin()+previous_search_count, search_time.end());
+    double total_search_time = 0.0;
+    for(auto sample : samples) {
+      total_search_time += sample;
+    }
+
+    auto record = GetBenchmarkRecord("search", tree);
+    record.SetSamples("search_ms", samples);
+    if(!samples.empty()) {
+      record.Set("search_ms_mean", total_search_time/samples.size());
+      record.Set("throughput_qps_mean", (total_search_time > 0.0) ?
+                 number_of_search*samples.size()*1000.0/total_search_time : 0.0);
+    }
+    if(tree->IsRecordQueryStats() && query_stats.latency.GetCount()) {
+      record.Set("latency_count", (double)query_stats.latency.GetCount());
+      record.Set("latency_mean_ns", query_stats.latency.GetMean());
+      record.Set("latency_stddev_ns", query_stats.latency.GetStdDev());
+      record.Set("latency_p50_ns", (double)query_stats.latency.GetPercentile(50.0));
+      record.Set("latency_p99_ns", (double)query_stats.latency.GetPercentile(99.0));
+      record.Set("latency_p999_ns", (double)query_stats.latency.GetPercentile(99.9));
+    }
+    benchmark.Add(record);
+  }
+
+  if(!tree->IsRecordQueryStats()) {
+    return;
+  }
+
+  auto tree_type = TreeTypeToString(tree->GetTreeType());
+  query_stats.Print(tree_type);
+
+  auto json = "{\"tree_type\":\""+tree_type+"\""+
+              ",\"number_of_search\":"+std::to_string(number_of_search)+
+              ",\"number_of_repeat\":"+std::to_string(number_of_repeat)+
+              ",\"query_stats\":"+query_stats.ToJSON()+"}";
+
+  if(query_stats_file == "-") {
+    std::cout << json << std::endl;
+    return;
+  }
+
+  std::ofstream query_stats_stream(query_stats_file, std::ios::app);
+  if(!query_stats_stream) {
+    LOG_INFO("Failed to open a query stats file(%s)", query_stats_file.c_str());
+    return;
+  }
+  query_stats_stream << json << std::endl;
+}
+
+ui Evaluator::GetNumberOfMismatches(void) const {
+  return number_of_mismatches;
+}
+
+bool Evaluator::CompareWithBaseline(void) {
+  if(baseline_file.empty()) {
+    return true;
+  }
+  return benchmark.Compare(baseline_file) == 0;
+}
+
+BenchmarkRecord Evaluator::GetBenchmarkRecord(std::string kind, std::shared_ptr<tree::Tree>& tree) {
+  BenchmarkRecord record;
+
+  char timestamp[32];
+  auto now = time(nullptr);
+  strftime(timestamp, sizeof(timestamp), "%Y-%m-%dT%H:%M:%SZ", gmtime(&now));
+
+  record.Set("kind", kind);
+  record.Set("timestamp", std::string(timestamp));
+  record.Set("git_revision", std::string(GIT_REVISION));
+  record.Set("backend", std::string(backend::GetBackendName()));
+  record.Set("tree_type", TreeTypeToString(tree->GetTreeType()));
+  record.Set("device_type", DeviceTypeToString(GetDeviceType()));
+  record.Set("load_type", LoadTypeToString(GetLoadType()));
+  record.Set("data_type", DataTypeToString(GetDataType()));
+  record.Set("cluster_type", ClusterTypeToString(GetClusterType()));
+  record.Set("number_of_data", (double)number_of_data);
+  record.Set("selectivity", selectivity);
+  record.Set("build_parameters", tree->GetBuildParameters());
+  record.Set("data_file", input_data_set->GetDataSetPath());
+  record.Set("data_hash", HashToString(input_data_set->GetContentHash()));
+
+  if(kind == "search") {
+    record.Set("number_of_search", (double)number_of_search);
+    record.Set("number_of_repeat", (double)number_of_repeat);
+    record.Set("search_parameters", tree->GetSearchParameters()+
+               ((knn) ? "_KNN_"+std::to_string(knn) : ""));
+    record.Set("materialize_result", materialize_result ? "yes" : "no");
+    record.Set("query_file", query_data_set->GetDataSetPath());
+    record.Set("query_hash", HashToString(query_data_set->GetContentHash()));
+  }
+  return record;
+}
+
+bool Evaluator::IsBenchmarkOn(void) const {
+  return !result_file.empty() || !baseline_file.empty();
+}
+
 //TODO :: Need to fix?  scrub
 void Evaluator::PrintHelp(char **argv) const {
   std::cerr << "Usage:\n" << *argv << std::endl << 
@@ -289,14 +491,34 @@ void Evaluator::PrintHelp(char **argv) const {
   " [ -c chunk size(for hybrid), default : " << GetNumberOfLeafNodeDegrees() << "(number of degrees)]\n"
   " [ -s selection ratio(%), default : 0.01 (%) ]\n"
   " [ -l scan type(1: leaf, 2: extend leaf, 3: combine), default : leaf]\n"
-  " [ -i index type(should be last), default : Hybrid-tree]\n"
+  " [ -u leaf packing(hilbert, kmeans, str, original), default : hilbert ]\n"
+  " [ -i index type(should be last), default : Hybrid-tree, 'all' for every type]\n"
   " [ -r number of repeat of search]\n" 
   " [ -e evaluation mode ]\n" 
+  " [ -m materialize matching indexes of each query ]\n" 
+  " [ -h keep leaf nodes quantized on the CPU and the GPU, " << URSUS_LEAF_CODE_BITS << "-bit coordinates, only for Hybrid-tree ]\n" 
+  " [ -v verify the results of each search against a brute-force scan, exit with 2 on a mismatch ]\n" 
+  " [ -j append build and search records to the file, CSV if it ends with .csv, JSON lines otherwise ]\n" 
+  " [ -n compare searches with the JSON records of a baseline run, exit with 1 on a regression ]\n" 
+  " [ -w record per-query latency, node visits and hits, append them to the file as JSON('-' for stdout) ]\n" 
+  " [ -x search device(gpu, cpu), only for MPHR-tree, default : gpu, cpu without a device ]\n" 
+  " [ -z index loading(read, mmap, populate), default : read, mmap checks the checksums in the background ]\n" 
+  " [ -k index directory, or URSUS_INDEX_DIR ]\n" 
+  " [ -a data file, or URSUS_DATA_FILE, default : under URSUS_DATA_DIR ]\n" 
+  " [ -g query file, or URSUS_QUERY_FILE, default : under URSUS_DATA_DIR ]\n" 
+  " [ -o config file with index_dir, data_dir, data_file, query_file, knn, query_batch, verify_index, or URSUS_CONFIG ]\n" 
+  " [ --knn k, or URSUS_KNN or knn in the config file, k nearest neighbours of the query centers on the CPU instead of range search ]\n" 
+  " [ --query-batch size, or URSUS_QUERY_BATCH or query_batch in the config file, # of neighbouring queries whose leaf nodes are scanned together on the CPU, only for Hybrid-tree ]\n" 
+  " [ URSUS_VERIFY_INDEX=1 or verify_index in the config file, check the checksums of index files loaded with -z mmap before use, not in the background ]\n" 
   "\n e.g: ./bin/cuda -d 1000000 -q 1000 -s 0.5 -c 4\n" 
   << std::endl;
 }
 
 void Evaluator::PrintMemoryUsageOftheGPU() {
+  if(!backend::IsDeviceAvailable()) {
+    return;
+  }
+
   cudaDeviceSynchronize();
   size_t used = GetUsedMem();
   size_t total = GetTotalMem();
@@ -306,20 +528,20 @@ void Evaluator::PrintMemoryUsageOftheGPU() {
 
 size_t Evaluator::GetUsedMem(void) {
   size_t avail, total;
-  cudaMemGetInfo( &avail, &total );
+  backend::GetDeviceMemory( avail, total );
   size_t used = total-avail;
   return used;
 }
 
 size_t Evaluator::GetAvailMem(void) {
   size_t avail, total;
-  cudaMemGetInfo( &avail, &total );
+  backend::GetDeviceMemory( avail, total );
   return avail;
 }
 
 size_t Evaluator::GetTotalMem(void) {
   size_t avail, total;
-  cudaMemGetInfo( &avail, &total );
+  backend::GetDeviceMemory( avail, total );
   return total;
 }
 
@@ -328,11 +550,18 @@ size_t Evaluator::GetTotalMem(void) {
 bool Evaluator::ParseArgs(int argc, char **argv)  {
 
   // TODO scrubbing
-  static const char *options="c:C:i:I:d:D:q:Q:b:B:p:P:s:S:l:L:r:R:e:E:t:T:y:Y:u:U:f:F:";
+  static const char *options="c:C:i:I:d:D:q:Q:b:B:p:P:s:S:l:L:r:R:e:E:t:T:y:Y:u:U:f:F:mMvVhHx:X:z:Z:k:K:a:A:g:G:o:O:w:W:j:J:n:N:";
+  // every letter is taken, so newer options only have a long name
+  enum { OPTION_KNN = 256, OPTION_QUERY_BATCH };
+  static const struct option long_options[] = {
+    {"knn", required_argument, nullptr, OPTION_KNN},
+    {"query-batch", required_argument, nullptr, OPTION_QUERY_BATCH},
+    {nullptr, 0, nullptr, 0}
+  };
   std::string number_of_data_str;
   int current_option;
  
-  while ((current_option = getopt(argc, argv, options)) != -1) {
+  while ((current_option = getopt_long(argc, argv, options, long_options, nullptr)) != -1) {
     switch (current_option) {
       case 'i':
       case 'I': AddTrees(std::string(optarg)); break;
@@ -362,17 +591,53 @@ bool Evaluator::ParseArgs(int argc, char **argv)  {
       case 'U': s_cluster_type = std::string(optarg);  break;
       case 'f':
       case 'F': s_force_rebuild = "yes";  break;
+      case 'm':
+      case 'M': materialize_result = true;  break;
+      case 'v':
+      case 'V': verify = true;  break;
+      case 'h':
+      case 'H': quantize_leaf_nodes = true;  break;
+      case 'x':
+      case 'X': s_device_type = std::string(optarg);  break;
+      case 'z':
+      case 'Z': s_load_type = std::string(optarg);  break;
+      case 'k':
+      case 'K': index_directory = std::string(optarg);  break;
+      case 'a':
+      case 'A': data_file = std::string(optarg);  break;
+      case 'g':
+      case 'G': query_file = std::string(optarg);  break;
+      case 'o':
+      case 'O': config_file = std::string(optarg);  break;
+      case 'w':
+      case 'W': query_stats_file = std::string(optarg);  break;
+      case 'j':
+      case 'J': result_file = std::string(optarg);  break;
+      case 'n':
+      case 'N': baseline_file = std::string(optarg);  break;
+      case OPTION_KNN: s_knn = std::string(optarg);  break;
+      case OPTION_QUERY_BATCH: s_query_batch_size = std::string(optarg);  break;
      default: break;
     } // end of switch
   } // end of while
 
+  if(!SetPaths()) { return false; }
+
+  benchmark.SetResultFile(result_file);
+
+  // results are compared query by query
+  if(verify) {
+    materialize_result = true;
+  }
+
   // check # of cuda blocks
   assert(number_of_cuda_blocks <= GetNumberOfMAXBlocks());
 
   // try to get the gpu
   int ret = SetDevice();
   // if failed to set the device, terminate the program
-  if(ret == -1){ exit(1); }
+  // unless the search runs on the CPU, which it does without a device
+  if(ret == -1 && GetDeviceType() == DEVICE_TYPE_GPU){ exit(1); }
 
   // Set default tree as a hybrid
   if(trees.empty()){ 
@@ -412,6 +677,13 @@ void Evaluator::AddTrees(std::string _index_type) {
   // Make it lower case
   auto index_type = ToLowerCase(_index_type);
 
+  if( index_type == "all" ) {
+    for(auto type : {"hybrid", "mphr", "mphr_partition", "bvh", "rtree", "rtree_ls"}) {
+      AddTrees(type);
+    }
+    return;
+  }
+
   if( index_type == "hybrid" || index_type == "h" || 
       index_type == "hr" || index_type == "hb") {
 
@@ -425,13 +697,23 @@ void Evaluator::AddTrees(std::string _index_type) {
     std::shared_ptr<tree::Tree> tree (new tree::Hybrid());
     trees.push_back(tree);
   } else if( index_type == "rtree_ls" || index_type == "rls"){ 
-    UPPER_TREE_TYPE = TREE_TYPE_RTREE;
+    // the upper tree of large leaves needs at least two of them per node
+    if( GetNumberOfLeafNodeDegrees() < 2*GetNumberOfUpperTreeDegrees() ) {
+      LOG_INFO("RTree_LS needs leaf node degrees(%u) of at least twice the upper tree degrees(%u), skipped",
+               GetNumberOfLeafNodeDegrees(), GetNumberOfUpperTreeDegrees());
+      return;
+    }
     std::shared_ptr<tree::Tree> tree (new tree::RTree_LS());
     trees.push_back(tree);
   } else if ( index_type == "mphr" ||
               index_type == "m") {
     std::shared_ptr<tree::Tree> tree (new tree::MPHR());
     trees.push_back(tree);
+  } else if ( index_type == "mphr_partition" ||
+              index_type == "mp") {
+    std::shared_ptr<tree::MPHR> mphr (new tree::MPHR());
+    mphr->SetNumberOfPartition(4);
+    trees.push_back(mphr);
   } else if ( index_type == "bvh" ||
               index_type == "b") {
     std::shared_ptr<tree::Tree> tree (new tree::BVH());
@@ -468,6 +750,9 @@ ClusterType Evaluator::GetClusterType(void){
   } else if(s_cluster_type == "k" || s_cluster_type == "kmeans" ||
             s_cluster_type == "cluster_type_kmeanshilbert"){
      s_cluster_type = "CLUSTER_TYPE_KMEANSHILBERT";
+  } else if(s_cluster_type == "s" || s_cluster_type == "str" ||
+            s_cluster_type == "cluster_type_str"){
+     s_cluster_type = "CLUSTER_TYPE_STR";
   } else if(s_cluster_type == "o" || s_cluster_type == "original"||
             s_cluster_type == "cluster_type_none"){
      s_cluster_type = "CLUSTER_TYPE_NONE";
@@ -476,8 +761,119 @@ ClusterType Evaluator::GetClusterType(void){
   return StringToClusterType(s_cluster_type);
 }
 
+DeviceType Evaluator::GetDeviceType(void){
+  s_device_type = ToLowerCase(s_device_type);
+
+  if(s_device_type == "g" || s_device_type == "gpu" ||
+     s_device_type == "device_type_gpu"){
+     s_device_type = "DEVICE_TYPE_GPU";
+  } else if(s_device_type == "c" || s_device_type == "cpu" ||
+            s_device_type == "device_type_cpu"){
+     s_device_type = "DEVICE_TYPE_CPU";
+  }
+
+  // without a device everything runs on the CPU
+  if(s_device_type == "DEVICE_TYPE_GPU" && !backend::IsDeviceAvailable()) {
+     LOG_INFO("No CUDA device is available, search on the CPU");
+     s_device_type = "DEVICE_TYPE_CPU";
+  }
+
+  return StringToDeviceType(s_device_type);
+}
+
+LoadType Evaluator::GetLoadType(void){
+  s_load_type = ToLowerCase(s_load_type);
+
+  if(s_load_type == "r" || s_load_type == "read" ||
+     s_load_type == "load_type_read"){
+     s_load_type = "LOAD_TYPE_READ";
+  } else if(s_load_type == "m" || s_load_type == "mmap" ||
+            s_load_type == "load_type_mmap"){
+     s_load_type = "LOAD_TYPE_MMAP";
+  } else if(s_load_type == "p" || s_load_type == "populate" ||
+            s_load_type == "load_type_populate"){
+     s_load_type = "LOAD_TYPE_POPULATE";
+  }
+
+  return StringToLoadType(s_load_type);
+}
+
+bool Evaluator::SetPaths(void) {
+  if(config_file.empty() && getenv("URSUS_CONFIG")) {
+    config_file = getenv("URSUS_CONFIG");
+  }
+
+  std::map<std::string, std::string> config;
+  if(!config_file.empty()) {
+    std::ifstream config_stream(config_file);
+    if(!config_stream) {
+      LOG_INFO("Failed to open a config file(%s)", config_file.c_str());
+    }
+
+    std::string line;
+    while(std::getline(config_stream, line)) {
+      line = line.substr(0, line.find('#'));
+      auto position = line.find('=');
+      if(position == std::string::npos) {
+        continue;
+      }
+      auto key = Trim(line.substr(0, position));
+      auto value = Trim(line.substr(position+1));
+      if(!key.empty()) {
+        config[key] = value;
+      }
+    }
+  }
+
+  // an option given on the command line is already set
+  auto set_path = [&](std::string& path, const char* env, const char* key,
+                      std::string default_path) {
+    if(!path.empty()) {
+      return;
+    }
+    if(getenv(env) && *getenv(env)) {
+      path = getenv(env);
+    } else if(config.count(key)) {
+      path = config[key];
+    } else {
+      path = default_path;
+    }
+  };
+
+  set_path(index_directory, "URSUS_INDEX_DIR", "index_dir", io::GetDefaultIndexDirectory());
+  set_path(data_directory, "URSUS_DATA_DIR", "data_dir", "/home/jwkim/dataFiles");
+  set_path(data_file, "URSUS_DATA_FILE", "data_file", "");
+  set_path(query_file, "URSUS_QUERY_FILE", "query_file", "");
+
+  // numbers must be whole, non-negative and fit in ui
+  auto set_number = [&](ui& number, std::string s_number, const char* env, const char* key) {
+    set_path(s_number, env, key, "0");
+
+    char* end = nullptr;
+    errno = 0;
+    auto value = strtoul(s_number.c_str(), &end, 10);
+    if(s_number.empty() || *end != '\0' || s_number[0] == '-' ||
+       errno == ERANGE || value > std::numeric_limits<ui>::max()) {
+      LOG_INFO("Invalid %s(%s) given by the command line, %s or %s", key, s_number.c_str(), env, key);
+      return false;
+    }
+    number = value;
+    return true;
+  };
+
+  if(!set_number(knn, s_knn, "URSUS_KNN", "knn")) { return false; }
+  if(!set_number(query_batch_size, s_query_batch_size, "URSUS_QUERY_BATCH", "query_batch")) { return false; }
+  if(!set_number(verify_index, "", "URSUS_VERIFY_INDEX", "verify_index")) { return false; }
+
+  return true;
+}
+
 std::string Evaluator::GetDataPath(const DataType data_type) const {
- std::string data_path="/home/jwkim/dataFiles/input";
+  if(!data_file.empty()) {
+    return data_file;
+  }
+
+ std::string data_path=data_directory+"/input";
 
   if( data_type == DATA_TYPE_REAL) {
     data_path+="/real/NOAA0.bin";
@@ -490,9 +886,12 @@ std::string Evaluator::GetDataPath(const DataType data_type) const {
   return data_path;
 }
 
-
 std::string Evaluator::GetQueryPath(const DataType data_type) const {
- std::string data_path="/home/jwkim/dataFiles/query";
+  if(!query_file.empty()) {
+    return query_file;
+  }
+
+ std::string data_path=data_directory+"/query";
 
   if( data_type == DATA_TYPE_REAL) {
     data_path+="/real/real_dim_query.3.bin."+selectivity+"s."+query_size;
@@ -504,6 +903,15 @@ std::string Evaluator::GetQueryPath(const DataType data_type) const {
   return data_path;
 }
 
+std::string Evaluator::Trim(std::string str) {
+  auto start = str.find_first_not_of(" \t\r");
+  if(start == std::string::npos) {
+    return "";
+  }
+  auto end = str.find_last_not_of(" \t\r");
+  return str.substr(start, end-start+1);
+}
+
 std::string Evaluator::ToLowerCase(std::string str) {
  std::string lower_str;
  std::locale loc;
@@ -526,8 +934,20 @@ std::ostream &operator<<(std::ostream &os, const Evaluator &evaluator) {
      << " number of CPU threads = " << evaluator.number_of_cpu_threads << std::endl
      << " data type = " << evaluator.s_data_type << std::endl
      << " cluster type = " << evaluator.s_cluster_type << std::endl
+     << " device type = " << evaluator.s_device_type << std::endl
+     << " load type = " << evaluator.s_load_type << std::endl
+     << " verify index = " << evaluator.verify_index << std::endl
+     << " index directory = " << evaluator.index_directory << std::endl
+     << " data directory = " << evaluator.data_directory << std::endl
      << " scan level = " << evaluator.scan_level << std::endl
      << " chunk size = " << evaluator.chunk_size << std::endl
+     << " quantize leaf nodes = " << evaluator.quantize_leaf_nodes << std::endl
+     << " knn = " << evaluator.knn << std::endl
+     << " query batch size = " << evaluator.query_batch_size << std::endl
+     << " materialize result = " << evaluator.materialize_result << std::endl
+     << " query stats file = " << evaluator.query_stats_file << std::endl
+     << " result file = " << evaluator.result_file << std::endl
+     << " baseline file = " << evaluator.baseline_file << std::endl
      << " selectivity = " << evaluator.selectivity << std::endl
      << " query size = " << evaluator.query_size << std::endl;
   return os;
@@ -1,5 +1,7 @@
 #pragma once
 
+#include "evaluator/benchmark.h"
+#include "evaluator/oracle.h"
 #include "io/dataset.h"
 #include "tree/tree.h"
 
@@ -38,6 +40,22 @@ class Evaluator{
 
   bool Search(void);
 
+  // search with the current settings of the tree, report per-query stats if
+  // they are recorded
+  void SearchTree(std::shared_ptr<tree::Tree>& tree);
+
+  // true unless a search got slower than the same configuration in the
+  // baseline file
+  bool CompareWithBaseline(void);
+
+  // # of queries whose results didn't match the brute-force scan
+  ui GetNumberOfMismatches(void) const;
+
+  // parameters and data set identity of a build or search of the tree
+  BenchmarkRecord GetBenchmarkRecord(std::string kind, std::shared_ptr<tree::Tree>& tree);
+
+  bool IsBenchmarkOn(void) const;
+
   // Print out usage to users
   void PrintHelp(char **argv) const;
 
@@ -57,12 +75,24 @@ class Evaluator{
 
   ClusterType GetClusterType(void);
 
+  DeviceType GetDeviceType(void);
+
+  LoadType GetLoadType(void);
+
+  // index directory, data files, k of the kNN search, the query batch size
+  // and the index checks from the command line, the environment or a config
+  // file, in that order, returns false if a number is malformed
+  bool SetPaths(void);
+
   std::string GetDataPath(const DataType data_type) const;
  
   std::string GetQueryPath(const DataType data_type) const;
 
   std::string ToLowerCase(std::string str);
 
+  // without leading and trailing white spaces
+  std::string Trim(std::string str);
+
   // Get a string representation for debugging
   friend std::ostream &operator<<(std::ostream &os, const Evaluator &evaluator);
 
@@ -109,11 +139,71 @@ class Evaluator{
 
   std::string s_force_rebuild= "no";
 
+  std::string s_device_type= "gpu";
+
+  std::string s_load_type= "read";
+
+  // key = value lines, index_dir, data_dir, data_file and query_file
+  std::string config_file;
+
+  // cache of index files
+  std::string index_directory;
+
+  // default data and query files are looked up under it
+  std::string data_directory;
+
+  // override the default data and query files
+  std::string data_file;
+
+  std::string query_file;
+
   TreeType UPPER_TREE_TYPE=TREE_TYPE_BVH;
 
   // To control chunk_size in Hybrid indexing 
   ui chunk_size = 128;
 
+  // scan quantized leaf nodes in Hybrid indexing
+  bool quantize_leaf_nodes = false;
+
+  // if it's not 0, search k nearest neighbours of the query centers
+  ui knn = 0;
+
+  // given by --knn, URSUS_KNN or knn in the config file otherwise
+  std::string s_knn;
+
+  // # of queries scanned together on the CPU in Hybrid indexing
+  ui query_batch_size = 0;
+
+  // given by --query-batch, URSUS_QUERY_BATCH or query_batch in the config
+  // file otherwise
+  std::string s_query_batch_size;
+
+  // checksums of mapped index files are checked too if non-zero
+  ui verify_index = 0;
+
+  // store matching indexes of each query, not only the hit counts
+  bool materialize_result = false;
+
+  // check the results of every search against the oracle
+  bool verify = false;
+
+  std::unique_ptr<Oracle> oracle;
+
+  ui number_of_mismatches = 0;
+
+  // record per-query stats, their percentiles are printed out and appended
+  // to the file as JSON lines, '-' for stdout
+  std::string query_stats_file;
+
+  // build and search records of each configuration are appended to it,
+  // CSV if it ends with .csv, JSON lines otherwise
+  std::string result_file;
+
+  // JSON lines written by an earlier run to compare the searches with
+  std::string baseline_file;
+
+  Benchmark benchmark;
+
   std::shared_ptr<io::DataSet> input_data_set;
 
   std::shared_ptr<io::DataSet> query_data_set;
@@ -0,0 +1,182 @@
+#include "evaluator/histogram.h"
+
+#include "common/logger.h"
+#include "common/macro.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+namespace ursus {
+namespace evaluator {
+
+//===--------------------------------------------------------------------===//
+// Histogram
+//===--------------------------------------------------------------------===//
+
+constexpr ui Histogram::sub_bucket_count;
+constexpr ui Histogram::sub_bucket_half_count;
+constexpr ui Histogram::number_of_buckets;
+
+ui Histogram::GetBucketIndex(ull value) {
+  if(value < sub_bucket_count) {
+    return value;
+  }
+
+  // position of the highest bit, keep sub_bucket_bits bits from there
+  ui exponent = 63-__builtin_clzll(value);
+  ui shift = exponent-(sub_bucket_bits-1);
+  ui sub_bucket = value >> shift;
+
+  return sub_bucket_count + (exponent-sub_bucket_bits)*sub_bucket_half_count +
+         (sub_bucket-sub_bucket_half_count);
+}
+
+ull Histogram::GetBucketUpperBound(ui bucket_index) {
+  if(bucket_index < sub_bucket_count) {
+    return bucket_index;
+  }
+
+  ui offset = bucket_index-sub_bucket_count;
+  ui exponent = offset/sub_bucket_half_count + sub_bucket_bits;
+  ui shift = exponent-(sub_bucket_bits-1);
+  ull sub_bucket = offset%sub_bucket_half_count + sub_bucket_half_count;
+
+  return ((sub_bucket+1) << shift)-1;
+}
+
+void Histogram::Record(ull value) {
+  counts[GetBucketIndex(value)]++;
+  if(count == 0 || value < min) {
+    min = value;
+  }
+  if(value > max) {
+    max = value;
+  }
+  sum += value;
+  sum_of_squares += (double)value*value;
+  count++;
+}
+
+void Histogram::Merge(const Histogram& other) {
+  if(other.count == 0) {
+    return;
+  }
+
+  for(ui range(bucket_itr, 0, number_of_buckets)) {
+    counts[bucket_itr] += other.counts[bucket_itr];
+  }
+  min = (count == 0) ? other.min : std::min(min, other.min);
+  max = std::max(max, other.max);
+  sum += other.sum;
+  sum_of_squares += other.sum_of_squares;
+  count += other.count;
+}
+
+void Histogram::Reset(void) {
+  counts.fill(0);
+  count = 0;
+  min = 0;
+  max = 0;
+  sum = 0.0;
+  sum_of_squares = 0.0;
+}
+
+ull Histogram::GetCount(void) const {
+  return count;
+}
+
+ull Histogram::GetMin(void) const {
+  return min;
+}
+
+ull Histogram::GetMax(void) const {
+  return max;
+}
+
+double Histogram::GetMean(void) const {
+  return (count == 0) ? 0.0 : sum/count;
+}
+
+double Histogram::GetStdDev(void) const {
+  if(count < 2) {
+    return 0.0;
+  }
+  double mean = GetMean();
+  double variance = (sum_of_squares-count*mean*mean)/(count-1);
+  return (variance > 0.0) ? std::sqrt(variance) : 0.0;
+}
+
+ull Histogram::GetPercentile(double percentile) const {
+  if(count == 0) {
+    return 0;
+  }
+
+  percentile = std::min(std::max(percentile, 0.0), 100.0);
+  ull rank = std::max(1ULL, (ull)std::ceil(percentile/100.0*count));
+
+  ull cumulative_count = 0;
+  for(ui range(bucket_itr, 0, number_of_buckets)) {
+    cumulative_count += counts[bucket_itr];
+    if(cumulative_count >= rank) {
+      return std::min(GetBucketUpperBound(bucket_itr), max);
+    }
+  }
+  return max;
+}
+
+std::string Histogram::ToJSON(void) const {
+  char buffer[512];
+  ::snprintf(buffer, sizeof(buffer),
+             "{\"count\":%llu,\"min\":%llu,\"mean\":%.3f,\"stddev\":%.3f,\"p50\":%llu,"
+             "\"p90\":%llu,\"p99\":%llu,\"p999\":%llu,\"max\":%llu}",
+             count, min, GetMean(), GetStdDev(), GetPercentile(50.0), GetPercentile(90.0),
+             GetPercentile(99.0), GetPercentile(99.9), max);
+  return buffer;
+}
+
+//===--------------------------------------------------------------------===//
+// Query Stats
+//===--------------------------------------------------------------------===//
+
+void QueryStats::Merge(const QueryStats& other) {
+  latency.Merge(other.latency);
+  node_visit_count.Merge(other.node_visit_count);
+  hit.Merge(other.hit);
+}
+
+void QueryStats::Reset(void) {
+  latency.Reset();
+  node_visit_count.Reset();
+  hit.Reset();
+}
+
+void QueryStats::Print(std::string title) const {
+  LOG_INFO("%s Per-Query Stats (%llu queries)", title.c_str(), latency.GetCount());
+  if(latency.GetCount()) {
+    LOG_INFO("  Latency(us)      p50 %.3f p90 %.3f p99 %.3f p99.9 %.3f max %.3f",
+             latency.GetPercentile(50.0)/1000.0, latency.GetPercentile(90.0)/1000.0,
+             latency.GetPercentile(99.0)/1000.0, latency.GetPercentile(99.9)/1000.0,
+             latency.GetMax()/1000.0);
+  }
+  if(node_visit_count.GetCount()) {
+    LOG_INFO("  Node visit count p50 %llu p90 %llu p99 %llu p99.9 %llu max %llu",
+             node_visit_count.GetPercentile(50.0), node_visit_count.GetPercentile(90.0),
+             node_visit_count.GetPercentile(99.0), node_visit_count.GetPercentile(99.9),
+             node_visit_count.GetMax());
+  }
+  if(hit.GetCount()) {
+    LOG_INFO("  Hit              p50 %llu p90 %llu p99 %llu p99.9 %llu max %llu",
+             hit.GetPercentile(50.0), hit.GetPercentile(90.0), hit.GetPercentile(99.0),
+             hit.GetPercentile(99.9), hit.GetMax());
+  }
+}
+
+std::string QueryStats::ToJSON(void) const {
+  return "{\"latency_ns\":"+latency.ToJSON()+
+         ",\"node_visit_count\":"+node_visit_count.ToJSON()+
+         ",\"hit\":"+hit.ToJSON()+"}";
+}
+
+} // End of evaluator namespace
+} // End of ursus namespace
@@ -0,0 +1,152 @@
+#pragma once
+
+#include "common/types.h"
+
+#include <array>
+#include <chrono>
+#include <string>
+
+namespace ursus {
+namespace evaluator {
+
+//===--------------------------------------------------------------------===//
+// Histogram
+//===--------------------------------------------------------------------===//
+// log-linear histogram in the style of HdrHistogram. Values below 64 have
+// a bucket each, above that every power of two is split into 32 buckets, so
+// a percentile is off by less than 1/32 of its value. Recording is an index
+// computation and an increment; it isn't thread-safe, so each thread records
+// into its own histogram and they are merged afterwards.
+class Histogram{
+ public:
+  void Record(ull value);
+
+  void Merge(const Histogram& other);
+
+  void Reset(void);
+
+  ull GetCount(void) const;
+
+  ull GetMin(void) const;
+
+  ull GetMax(void) const;
+
+  double GetMean(void) const;
+
+  // standard deviation of the recorded values
+  double GetStdDev(void) const;
+
+  // highest value in the bucket holding the given percentile(0~100)
+  ull GetPercentile(double percentile) const;
+
+  // {"count":..,"min":..,"mean":..,"stddev":..,"p50":..,"p90":..,"p99":..,"p999":..,"max":..}
+  std::string ToJSON(void) const;
+
+ private:
+  static constexpr ui sub_bucket_bits = 6;
+  static constexpr ui sub_bucket_count = 1 << sub_bucket_bits;
+  static constexpr ui sub_bucket_half_count = sub_bucket_count/2;
+  static constexpr ui number_of_buckets = sub_bucket_count +
+                                          (64-sub_bucket_bits)*sub_bucket_half_count;
+
+  static ui GetBucketIndex(ull value);
+
+  static ull GetBucketUpperBound(ui bucket_index);
+
+  std::array<ull, number_of_buckets> counts{};
+
+  ull count = 0;
+
+  ull min = 0;
+
+  ull max = 0;
+
+  double sum = 0.0;
+
+  double sum_of_squares = 0.0;
+};
+
+//===--------------------------------------------------------------------===//
+// Query Stats
+//===--------------------------------------------------------------------===//
+// per-query latency, node visit count and hit count of a search. Search
+// functions only record them if the tree is told to, otherwise they pay
+// nothing. Latencies of queries processed in a batch on the GPU are the
+// time until the whole batch is done.
+struct QueryStats {
+  // nanoseconds
+  Histogram latency;
+
+  Histogram node_visit_count;
+
+  Histogram hit;
+
+  void Merge(const QueryStats& other);
+
+  void Reset(void);
+
+  // print out percentiles of each histogram
+  void Print(std::string title) const;
+
+  std::string ToJSON(void) const;
+};
+
+//===--------------------------------------------------------------------===//
+// Query Timer
+//===--------------------------------------------------------------------===//
+// records a query into stats when it goes out of scope, the hit and node
+// visit counts of the query are what the given counters grew by in the
+// meantime. It does nothing if stats is null. Queries scanned on the device
+// wait for it to finish, their hits are counted there and aren't recorded.
+class QueryTimer{
+ public:
+  QueryTimer(QueryStats* _stats, const ui& _hit, const ui& _node_visit_count,
+             bool _on_device=false)
+  : stats(_stats), hit(_hit), node_visit_count(_node_visit_count),
+    on_device(_on_device) {
+    if(stats) {
+      start_hit = hit;
+      start_node_visit_count = node_visit_count;
+      start_time = std::chrono::steady_clock::now();
+    }
+  }
+
+  ~QueryTimer() {
+    if(!stats) {
+      return;
+    }
+
+    if(on_device) {
+      cudaDeviceSynchronize();
+    }
+    auto elapsed = std::chrono::steady_clock::now()-start_time;
+    stats->latency.Record(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+    stats->node_visit_count.Record(node_visit_count-start_node_visit_count);
+    if(!on_device) {
+      stats->hit.Record(hit-start_hit);
+    }
+  }
+
+  QueryTimer(const QueryTimer &) = delete;
+  QueryTimer &operator=(const QueryTimer &) = delete;
+  QueryTimer(QueryTimer &&) = delete;
+  QueryTimer &operator=(QueryTimer &&) = delete;
+
+ private:
+  QueryStats* stats;
+
+  const ui& hit;
+
+  const ui& node_visit_count;
+
+  bool on_device;
+
+  ui start_hit = 0;
+
+  ui start_node_visit_count = 0;
+
+  std::chrono::steady_clock::time_point start_time;
+};
+
+} // End of evaluator namespace
+} // End of ursus namespace
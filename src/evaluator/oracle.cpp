@@ -0,0 +1,404 @@
+#include "evaluator/oracle.h"
+
+#include "common/logger.h"
+#include "common/macro.h"
+#include "common/thread_pool.h"
+#include "mapper/hilbert_mapper.h"
+#include "sort/str_sorter.h"
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cmath>
+
+namespace ursus {
+namespace evaluator {
+
+// mismatches printed out per tree
+static constexpr ui GetNumberOfPrintedMismatches() { return 8; }
+
+Oracle::Oracle(std::shared_ptr<io::DataSet> _input_data_set,
+               std::shared_ptr<io::DataSet> _query_data_set, ui _number_of_search)
+  : input_data_set(_input_data_set), query_data_set(_query_data_set),
+    number_of_search(_number_of_search) {
+}
+
+ul Oracle::GetHit(ui query) {
+  return GetOffsets(query).size();
+}
+
+const std::vector<ul>& Oracle::GetOffsets(ui query) {
+  if(!scanned) {
+    Scan();
+  }
+  assert(query < number_of_search);
+  return offsets[query];
+}
+
+void Oracle::Scan(void) {
+  auto start_time = std::chrono::steady_clock::now();
+
+  ul number_of_data = input_data_set->GetNumberOfData();
+  ul number_of_blocks = (number_of_data+GetBlockSize()-1)/GetBlockSize();
+
+  auto& thread_pool = ThreadPool::GetInstance();
+  auto grain_size = thread_pool.GetGrainSize(number_of_blocks);
+  auto number_of_chunks = thread_pool.GetNumberOfChunks(number_of_blocks, grain_size);
+
+  // each chunk collects offsets of its blocks, they are appended in chunk
+  // order so that offsets stay in data set order
+  std::vector<std::vector<std::vector<ul>>> chunk_offsets(number_of_chunks);
+
+  thread_pool.ParallelFor(0, number_of_blocks, [&](ul start_block, ul end_block) {
+    auto chunk_itr = start_block/grain_size;
+    chunk_offsets[chunk_itr].resize(number_of_search);
+    Thread_Scan(chunk_offsets[chunk_itr], start_block, end_block);
+  }, 0, grain_size);
+
+  offsets.assign(number_of_search, std::vector<ul>());
+  for(ui range(query_itr, 0, number_of_search)) {
+    for(auto& chunk : chunk_offsets) {
+      if(chunk.empty()) {
+        continue;
+      }
+      offsets[query_itr].insert(offsets[query_itr].end(),
+                                chunk[query_itr].begin(), chunk[query_itr].end());
+    }
+  }
+  scanned = true;
+
+  std::chrono::duration<float> elapsed = std::chrono::steady_clock::now()-start_time;
+  LOG_INFO("Brute-Force Oracle on CPU (%u threads) = %.6fs", thread_pool.GetNumberOfThreads(), elapsed.count());
+}
+
+void Oracle::Thread_Scan(std::vector<std::vector<ul>>& chunk_offsets,
+                         ul start_block, ul end_block) {
+  ul number_of_data = input_data_set->GetNumberOfData();
+  auto points = input_data_set->GetPoints();
+  auto queries = query_data_set->GetPoints();
+
+  Point columns[GetNumberOfDims()][GetBlockSize()];
+  unsigned char overlap[GetBlockSize()];
+
+  for(ul range(block_itr, start_block, end_block)) {
+    ul block_start = block_itr*GetBlockSize();
+    ui block_size = std::min((ul)GetBlockSize(), number_of_data-block_start);
+
+    for(ui range(point_itr, 0, block_size)) {
+      for(ui range(dim, 0, GetNumberOfDims())) {
+        columns[dim][point_itr] = points[(block_start+point_itr)*GetNumberOfDims()+dim];
+      }
+    }
+
+    for(ui range(query_itr, 0, number_of_search)) {
+      auto query = &queries[query_itr*GetNumberOfDims()*2];
+
+      // a point is in the query if it is within both boundaries in every
+      // dimension, as in IsOverlap of the nodes
+      std::fill(overlap, overlap+block_size, 1);
+      for(ui range(dim, 0, GetNumberOfDims())) {
+        auto lower = query[dim];
+        auto upper = query[dim+GetNumberOfDims()];
+        auto column = columns[dim];
+        for(ui range(point_itr, 0, block_size)) {
+          overlap[point_itr] &= (column[point_itr] >= lower) & (column[point_itr] <= upper);
+        }
+      }
+
+      for(ui range(point_itr, 0, block_size)) {
+        if(overlap[point_itr]) {
+          chunk_offsets[query_itr].emplace_back(block_start+point_itr);
+        }
+      }
+    }
+  }
+}
+
+void Oracle::AssignHilbertRank(void) {
+  ul number_of_data = input_data_set->GetNumberOfData();
+  auto points = input_data_set->GetPoints();
+  // same bits as Tree::Thread_Mapping
+  ui number_of_bits = mapper::HilbertMapper::GetNumberOfBits(GetNumberOfDims());
+
+  std::vector<ll> hilbert_indexes(number_of_data);
+  auto& thread_pool = ThreadPool::GetInstance();
+  thread_pool.ParallelFor(0, number_of_data, [&](ul start_offset, ul end_offset) {
+    mapper::HilbertMapper::MappingIntoSingle(GetNumberOfDims(), number_of_bits,
+                                             &points[start_offset*GetNumberOfDims()],
+                                             end_offset-start_offset,
+                                             &hilbert_indexes[start_offset]);
+  });
+
+  // the sorters are stable, data of the same Hilbert index stay in data set
+  // order
+  std::vector<ul> sorted_offsets(number_of_data);
+  for(ul range(offset, 0, number_of_data)) {
+    sorted_offsets[offset] = offset;
+  }
+  std::stable_sort(sorted_offsets.begin(), sorted_offsets.end(), [&](ul lhs, ul rhs) {
+    return hilbert_indexes[lhs] < hilbert_indexes[rhs];
+  });
+
+  hilbert_ranks.resize(number_of_data);
+  for(ul range(rank, 0, number_of_data)) {
+    hilbert_ranks[sorted_offsets[rank]] = rank+1;
+  }
+  hilbert_offsets = std::move(sorted_offsets);
+}
+
+void Oracle::AssignSTRRank(void) {
+  ul number_of_data = input_data_set->GetNumberOfData();
+  auto points = input_data_set->GetPoints();
+
+  // the child offset carries the position in the data set through the sort
+  std::vector<node::Branch> branches(number_of_data);
+  auto& thread_pool = ThreadPool::GetInstance();
+  thread_pool.ParallelFor(0, number_of_data, [&](ul start_offset, ul end_offset) {
+    for(ul range(offset, start_offset, end_offset)) {
+      branches[offset].SetRect(&points[offset*GetNumberOfDims()]);
+      branches[offset].SetChildOffset(offset);
+    }
+  });
+
+  // trees pack STR tiles of a leaf node each
+  sort::STR_Sorter::Sort(branches, GetNumberOfLeafNodeDegrees());
+
+  str_ranks.resize(number_of_data);
+  str_offsets.resize(number_of_data);
+  for(auto& branch : branches) {
+    str_ranks[branch.GetChildOffset()] = branch.GetIndex();
+    str_offsets[branch.GetIndex()-1] = branch.GetChildOffset();
+  }
+}
+
+std::vector<ll> Oracle::GetIndexes(ui query, ClusterType packing) {
+  auto& query_offsets = GetOffsets(query);
+  if(packing == CLUSTER_TYPE_HILBERT && hilbert_ranks.empty()) {
+    AssignHilbertRank();
+  }
+  if(packing == CLUSTER_TYPE_STR && str_ranks.empty()) {
+    AssignSTRRank();
+  }
+
+  std::vector<ll> indexes;
+  indexes.reserve(query_offsets.size());
+  for(auto offset : query_offsets) {
+    switch(packing) {
+      case CLUSTER_TYPE_HILBERT:
+        indexes.emplace_back(hilbert_ranks[offset]);
+        break;
+      case CLUSTER_TYPE_STR:
+        indexes.emplace_back(str_ranks[offset]);
+        break;
+      default:
+        indexes.emplace_back((ll)offset+1);
+        break;
+    }
+  }
+  std::sort(indexes.begin(), indexes.end());
+  return indexes;
+}
+
+ClusterType Oracle::GetPacking(std::shared_ptr<tree::Tree>& tree, ClusterType cluster_type,
+                               bool& compare_indexes) const {
+  // trees store the position of the data in the order their leaves are
+  // packed in, Hilbert order unless STR packing is asked for. The Hybrid
+  // tree keeps data set order without a cluster type. The R-tree inserts the
+  // data in Hilbert order and the R-tree with leaf scan in data set order,
+  // whatever the cluster type
+  ClusterType packing = CLUSTER_TYPE_HILBERT;
+  compare_indexes = true;
+  if(tree->GetTreeType() == TREE_TYPE_RTREE) {
+    packing = CLUSTER_TYPE_HILBERT;
+  } else if(tree->GetTreeType() == TREE_TYPE_RTREE_LS) {
+    packing = CLUSTER_TYPE_NONE;
+  } else if(cluster_type == CLUSTER_TYPE_STR) {
+    packing = CLUSTER_TYPE_STR;
+  } else if(tree->GetTreeType() == TREE_TYPE_HYBRID && cluster_type != CLUSTER_TYPE_HILBERT &&
+            cluster_type != CLUSTER_TYPE_KMEANSHILBERT) {
+    packing = CLUSTER_TYPE_NONE;
+  }
+  // k-means clustering reorders the data after it is sorted
+  if(tree->GetTreeType() == TREE_TYPE_HYBRID && cluster_type == CLUSTER_TYPE_KMEANSHILBERT) {
+    compare_indexes = false;
+  }
+  return packing;
+}
+
+ul Oracle::GetOffset(ll index, ClusterType packing) {
+  if(packing == CLUSTER_TYPE_HILBERT && hilbert_offsets.empty()) {
+    AssignHilbertRank();
+  }
+  if(packing == CLUSTER_TYPE_STR && str_offsets.empty()) {
+    AssignSTRRank();
+  }
+
+  switch(packing) {
+    case CLUSTER_TYPE_HILBERT:
+      return hilbert_offsets[index-1];
+    case CLUSTER_TYPE_STR:
+      return str_offsets[index-1];
+    default:
+      return index-1;
+  }
+}
+
+// squared MINDIST of a point to a box, the same sum in dimension order as
+// the leaf nodes compute
+static Point GetDistance(const Point* point, const Point* lower, const Point* upper) {
+  Point distance = 0;
+  for(ui range(dim, 0, GetNumberOfDims())) {
+    Point gap = std::max(std::max(lower[dim]-point[dim], point[dim]-upper[dim]), (Point)0);
+    distance += gap*gap;
+  }
+  return distance;
+}
+
+std::vector<Point> Oracle::GetNearestDistances(ui query, ui k) {
+  ul number_of_data = input_data_set->GetNumberOfData();
+  auto points = input_data_set->GetPoints();
+  auto query_box = &query_data_set->GetPoints()[query*GetNumberOfDims()*2];
+
+  Point center[GetNumberOfDims()];
+  for(ui range(dim, 0, GetNumberOfDims())) {
+    center[dim] = (query_box[dim]+query_box[dim+GetNumberOfDims()])/2;
+  }
+
+  std::vector<Point> distances(number_of_data);
+  for(ul range(offset, 0, number_of_data)) {
+    auto point = &points[offset*GetNumberOfDims()];
+    distances[offset] = GetDistance(center, point, point);
+  }
+
+  ul number_of_neighbors = std::min((ul)k, number_of_data);
+  std::nth_element(distances.begin(), distances.begin()+number_of_neighbors, distances.end());
+  distances.resize(number_of_neighbors);
+  std::sort(distances.begin(), distances.end());
+  return distances;
+}
+
+ui Oracle::VerifyKNN(std::shared_ptr<tree::Tree>& tree, ClusterType cluster_type, ui k) {
+  auto tree_type = TreeTypeToString(tree->GetTreeType());
+  auto& search_result = tree->GetSearchResult();
+
+  if(search_result.GetNumberOfQueries() != number_of_search) {
+    LOG_INFO("Verify %s : results of %u queries are materialized, expected %u",
+             tree_type.c_str(), search_result.GetNumberOfQueries(), number_of_search);
+    return number_of_search;
+  }
+
+  bool compare_indexes;
+  auto packing = GetPacking(tree, cluster_type, compare_indexes);
+  auto points = input_data_set->GetPoints();
+  auto queries = query_data_set->GetPoints();
+  ul expected_hit = std::min((ul)k, (ul)input_data_set->GetNumberOfData());
+
+  ui count_mismatches = 0;
+  ui result_mismatches = 0;
+  for(ui range(query_itr, 0, number_of_search)) {
+    auto hit = search_result.GetNumberOfResults(query_itr);
+
+    if(hit != expected_hit) {
+      if(count_mismatches+result_mismatches < GetNumberOfPrintedMismatches()) {
+        LOG_INFO("Verify %s : query %u found %lu neighbours, expected %lu",
+                 tree_type.c_str(), query_itr, hit, expected_hit);
+      }
+      count_mismatches++;
+      continue;
+    }
+
+    if(!compare_indexes) {
+      continue;
+    }
+
+    auto query_box = &queries[query_itr*GetNumberOfDims()*2];
+    Point center[GetNumberOfDims()];
+    for(ui range(dim, 0, GetNumberOfDims())) {
+      center[dim] = (query_box[dim]+query_box[dim+GetNumberOfDims()])/2;
+    }
+
+    auto indexes = search_result.GetResults(query_itr);
+    std::vector<Point> distances(hit);
+    for(ul range(result_itr, 0, hit)) {
+      auto point = &points[GetOffset(indexes[result_itr], packing)*GetNumberOfDims()];
+      distances[result_itr] = GetDistance(center, point, point);
+    }
+    std::sort(distances.begin(), distances.end());
+    auto expected_distances = GetNearestDistances(query_itr, k);
+
+    // vectorized distance kernels may round differently
+    for(ul range(result_itr, 0, hit)) {
+      auto tolerance = 1e-5f*std::max((Point)1, expected_distances[result_itr]);
+      if(std::fabs(distances[result_itr]-expected_distances[result_itr]) > tolerance) {
+        if(count_mismatches+result_mismatches < GetNumberOfPrintedMismatches()) {
+          LOG_INFO("Verify %s : query %u has its %luth neighbour at %f where %f is expected",
+                   tree_type.c_str(), query_itr, result_itr+1,
+                   distances[result_itr], expected_distances[result_itr]);
+        }
+        result_mismatches++;
+        break;
+      }
+    }
+  }
+
+  LOG_INFO("Verify %s : %u kNN queries, %u count mismatches, %u distance mismatches%s",
+           tree_type.c_str(), number_of_search, count_mismatches, result_mismatches,
+           compare_indexes ? "" : " (counts only)");
+  return count_mismatches+result_mismatches;
+}
+
+ui Oracle::Verify(std::shared_ptr<tree::Tree>& tree, ClusterType cluster_type) {
+  auto tree_type = TreeTypeToString(tree->GetTreeType());
+  auto& search_result = tree->GetSearchResult();
+
+  if(search_result.GetNumberOfQueries() != number_of_search) {
+    LOG_INFO("Verify %s : results of %u queries are materialized, expected %u",
+             tree_type.c_str(), search_result.GetNumberOfQueries(), number_of_search);
+    return number_of_search;
+  }
+
+  bool compare_indexes;
+  auto packing = GetPacking(tree, cluster_type, compare_indexes);
+
+  ui count_mismatches = 0;
+  ui result_mismatches = 0;
+  for(ui range(query_itr, 0, number_of_search)) {
+    auto expected_hit = GetHit(query_itr);
+    auto hit = search_result.GetNumberOfResults(query_itr);
+
+    if(hit != expected_hit) {
+      if(count_mismatches+result_mismatches < GetNumberOfPrintedMismatches()) {
+        LOG_INFO("Verify %s : query %u hit %lu, expected %lu",
+                 tree_type.c_str(), query_itr, hit, expected_hit);
+      }
+      count_mismatches++;
+      continue;
+    }
+
+    if(!compare_indexes) {
+      continue;
+    }
+
+    auto expected_indexes = GetIndexes(query_itr, packing);
+    std::vector<ll> indexes(search_result.GetResults(query_itr),
+                            search_result.GetResults(query_itr)+hit);
+    std::sort(indexes.begin(), indexes.end());
+
+    if(indexes != expected_indexes) {
+      if(count_mismatches+result_mismatches < GetNumberOfPrintedMismatches()) {
+        auto mismatch = std::mismatch(indexes.begin(), indexes.end(), expected_indexes.begin());
+        LOG_INFO("Verify %s : query %u returned index %lld where %lld is expected",
+                 tree_type.c_str(), query_itr, *mismatch.first, *mismatch.second);
+      }
+      result_mismatches++;
+    }
+  }
+
+  LOG_INFO("Verify %s : %u queries, %u hit count mismatches, %u result set mismatches%s",
+           tree_type.c_str(), number_of_search, count_mismatches, result_mismatches,
+           compare_indexes ? "" : " (hit counts only)");
+  return count_mismatches+result_mismatches;
+}
+
+} // End of evaluator namespace
+} // End of ursus namespace
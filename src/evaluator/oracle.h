@@ -0,0 +1,107 @@
+#pragma once
+
+#include "common/types.h"
+#include "io/dataset.h"
+#include "tree/tree.h"
+
+#include <memory>
+#include <vector>
+
+namespace ursus {
+namespace evaluator {
+
+//===--------------------------------------------------------------------===//
+// Oracle
+//===--------------------------------------------------------------------===//
+// answers of a query set found by scanning every point of the data set, the
+// results of each tree are checked against them. The data is scanned block
+// by block, a block is transposed into columns so that all queries test it
+// with branch-free loops the compiler vectorizes.
+class Oracle{
+ public:
+  Oracle(std::shared_ptr<io::DataSet> input_data_set,
+         std::shared_ptr<io::DataSet> query_data_set, ui number_of_search);
+
+  Oracle(const Oracle &) = delete;
+  Oracle &operator=(const Oracle &) = delete;
+  Oracle(Oracle &&) = delete;
+  Oracle &operator=(Oracle &&) = delete;
+
+  // # of data in the query, the data set is scanned on first use
+  ul GetHit(ui query);
+
+  // offsets of the data in the query, in data set order
+  const std::vector<ul>& GetOffsets(ui query);
+
+  /**
+   * compare the materialized results of the last search of the tree with
+   * the answers. Hit counts are always compared, result sets too unless the
+   * indexes of the tree can't be told from the data set alone (the R-trees
+   * and k-means clustered trees). The first mismatches are printed out
+   * @return # of queries whose hit count or result set doesn't match
+   */
+  ui Verify(std::shared_ptr<tree::Tree>& tree, ClusterType cluster_type);
+
+  /**
+   * compare the materialized results of the last kNN search of the tree
+   * with the k nearest data of each query center. The # of neighbours is
+   * always compared, their distances too where the indexes can be mapped
+   * back to the data set, as sets of distances since ties may be broken
+   * differently
+   * @return # of queries whose neighbours don't match
+   */
+  ui VerifyKNN(std::shared_ptr<tree::Tree>& tree, ClusterType cluster_type, ui k);
+
+ private:
+  static constexpr ui GetBlockSize() { return 1024; }
+
+  void Scan(void);
+
+  void Thread_Scan(std::vector<std::vector<ul>>& chunk_offsets,
+                   ul start_block, ul end_block);
+
+  // sorted indexes a tree stores for the data in the query, the positions
+  // of the data in the order the leaves are packed in, Hilbert order, STR
+  // tiles or the data set(CLUSTER_TYPE_NONE), starting from 1
+  std::vector<ll> GetIndexes(ui query, ClusterType packing);
+
+  // packing the indexes of the tree follow, false in compare_indexes if they
+  // can't be told from the data set alone
+  ClusterType GetPacking(std::shared_ptr<tree::Tree>& tree, ClusterType cluster_type,
+                         bool& compare_indexes) const;
+
+  // offset in the data set of an index a tree stores
+  ul GetOffset(ll index, ClusterType packing);
+
+  // sorted squared distances from the center of the query to its k nearest
+  // data
+  std::vector<Point> GetNearestDistances(ui query, ui k);
+
+  void AssignHilbertRank(void);
+
+  void AssignSTRRank(void);
+
+  std::shared_ptr<io::DataSet> input_data_set;
+
+  std::shared_ptr<io::DataSet> query_data_set;
+
+  ui number_of_search;
+
+  bool scanned = false;
+
+  std::vector<std::vector<ul>> offsets;
+
+  // position of each data in Hilbert order, starting from 1
+  std::vector<ll> hilbert_ranks;
+
+  // position of each data in STR order, starting from 1
+  std::vector<ll> str_ranks;
+
+  // offset of the data of each rank, the inverse of the ranks above
+  std::vector<ul> hilbert_offsets;
+
+  std::vector<ul> str_offsets;
+};
+
+} // End of evaluator namespace
+} // End of ursus namespace
@@ -1,8 +1,19 @@
 #include "evaluator/recorder.h"
 
+#include "common/logger.h"
+
 namespace ursus {
 namespace evaluator {
 
+// number of open scopes of each stage on this thread
+static thread_local std::map<StageType, ui> open_scopes;
+
+static void SynchronizeDevice(void) {
+  if(backend::IsDeviceAvailable()) {
+    cudaDeviceSynchronize();
+  }
+}
+
 /**
  * @brief Return the singleton recorder instance
  */
@@ -11,23 +22,85 @@ Recorder& Recorder::GetInstance(){
   return recorder;
 }
 
-void Recorder::TimeRecordStart(){
-  cudaEventCreate(&start_event);
-  cudaEventCreate(&stop_event);
-  cudaEventRecord(start_event, 0);
+void Recorder::AddStageTime(StageType stage, float elapsed_time) {
+  std::lock_guard<std::mutex> lock(stage_mutex);
+  auto& stage_time = stage_times[stage];
+  stage_time.elapsed_time += elapsed_time;
+  stage_time.count++;
+  stage_time.samples.push_back(elapsed_time);
 }
 
-float Recorder::TimeRecordEnd(){
-  cudaEventRecord(stop_event, 0) ;
+float Recorder::GetStageTime(StageType stage) const {
+  std::lock_guard<std::mutex> lock(stage_mutex);
+  auto itr = stage_times.find(stage);
+  return (itr == stage_times.end()) ? 0.f : itr->second.elapsed_time;
+}
 
-  // blocks CPU execution until the specified event is recorded.
-  cudaEventSynchronize(stop_event) ;
+ui Recorder::GetStageCount(StageType stage) const {
+  std::lock_guard<std::mutex> lock(stage_mutex);
+  auto itr = stage_times.find(stage);
+  return (itr == stage_times.end()) ? 0 : itr->second.count;
+}
 
-  // this value has a resolution of approximately one half microsecond.
-  cudaEventElapsedTime(&elapsed_time, start_event, stop_event);
-  return elapsed_time;
+std::vector<float> Recorder::GetStageSamples(StageType stage) const {
+  std::lock_guard<std::mutex> lock(stage_mutex);
+  auto itr = stage_times.find(stage);
+  return (itr == stage_times.end()) ? std::vector<float>() : itr->second.samples;
+}
+
+void Recorder::PrintReport(std::string title) {
+  std::lock_guard<std::mutex> lock(stage_mutex);
+  if(stage_times.empty()) {
+    return;
+  }
+
+  float total_time = 0.f;
+  LOG_INFO("%s Report", title.c_str());
+  for(auto& stage_time : stage_times) {
+    LOG_INFO("  %-28s %12.3f ms (%u)", StageTypeToString(stage_time.first).c_str(),
+             stage_time.second.elapsed_time, stage_time.second.count);
+    total_time += stage_time.second.elapsed_time;
+  }
+  LOG_INFO("  %-28s %12.3f ms", "TOTAL", total_time);
+
+  stage_times.clear();
 }
 
+void Recorder::Reset(void) {
+  std::lock_guard<std::mutex> lock(stage_mutex);
+  stage_times.clear();
+}
+
+//===--------------------------------------------------------------------===//
+// Time Scope
+//===--------------------------------------------------------------------===//
+
+TimeScope::TimeScope(StageType _stage) : stage(_stage) {
+  outermost = (open_scopes[stage]++ == 0);
+  SynchronizeDevice();
+  start_time = std::chrono::steady_clock::now();
+}
+
+TimeScope::~TimeScope() {
+  End();
+}
+
+float TimeScope::End(void) {
+  if(!running) {
+    return elapsed_time;
+  }
+  running = false;
+
+  SynchronizeDevice();
+  std::chrono::duration<float, std::milli> elapsed = std::chrono::steady_clock::now()-start_time;
+  elapsed_time = elapsed.count();
+
+  open_scopes[stage]--;
+  if(outermost) {
+    Recorder::GetInstance().AddStageTime(stage, elapsed_time);
+  }
+  return elapsed_time;
+}
 
 } // End of evaluator namespace
 } // End of ursus namespace
@@ -2,6 +2,11 @@
 
 #include "common/types.h"
 
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <vector>
+
 namespace ursus {
 namespace evaluator {
 
@@ -19,10 +24,22 @@ class Recorder{
   static Recorder& GetInstance(void);
 
  //===--------------------------------------------------------------------===//
- // Time Record
+ // Stage Times
  //===--------------------------------------------------------------------===//
-  void TimeRecordStart();
-  float TimeRecordEnd();
+  // called by TimeScope, safe from any thread
+  void AddStageTime(StageType stage, float elapsed_time);
+
+  // total time(ms) and number of scopes recorded for the stage
+  float GetStageTime(StageType stage) const;
+  ui GetStageCount(StageType stage) const;
+
+  // time(ms) of each scope recorded for the stage, in the order they ended
+  std::vector<float> GetStageSamples(StageType stage) const;
+
+  // print out the time of each stage recorded so far, then reset them
+  void PrintReport(std::string title);
+
+  void Reset(void);
 
  //===--------------------------------------------------------------------===//
  // Members
@@ -30,8 +47,14 @@ class Recorder{
  private:
   Recorder() {}
 
-  cudaEvent_t start_event, stop_event;
-  float elapsed_time = 0.f;
+  struct StageTime {
+    float elapsed_time = 0.f;
+    ui count = 0;
+    std::vector<float> samples;
+  };
+
+  mutable std::mutex stage_mutex;
+  std::map<StageType, StageTime> stage_times;
 
   ui hit;
 
@@ -46,6 +69,38 @@ class Recorder{
 //    bool METHOD[7];
 };
 
+//===--------------------------------------------------------------------===//
+// Time Scope
+//===--------------------------------------------------------------------===//
+// measures the wall-clock time from its construction until End() or its
+// destruction and adds it to the stage in the recorder. If a device is
+// available, pending kernels are waited for at both ends. Scopes can be
+// nested and used from several threads; a scope nested in another scope of
+// the same stage on the same thread isn't added again.
+class TimeScope{
+ public:
+  explicit TimeScope(StageType stage);
+  ~TimeScope();
+
+  TimeScope(const TimeScope &) = delete;
+  TimeScope &operator=(const TimeScope &) = delete;
+  TimeScope(TimeScope &&) = delete;
+  TimeScope &operator=(TimeScope &&) = delete;
+
+  // stop the scope early, return the elapsed time(ms)
+  float End(void);
+
+ private:
+  StageType stage;
+
+  bool outermost;
+
+  bool running = true;
+
+  std::chrono::steady_clock::time_point start_time;
+
+  float elapsed_time = 0.f;
+};
+
 } // End of evaluator namespace
 } // End of ursus namespace
-
@@ -1,12 +1,77 @@
 #include "io/dataset.h"
 
+#include "common/hash.h"
 #include "common/macro.h"
+#include "io/index_file.h"
 
+#include <algorithm>
 #include <cassert>
+#include <cstdio>
+#include <cstdlib>
+#include <sstream>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 namespace ursus {
 namespace io {
 
+namespace {
+
+// real path of the data file, and its path, size and modification time, the
+// first lines of a DATA_HASH_ file that are valid for it
+bool GetFileStamp(const std::string& data_set_path, std::string& path, std::string& stamp) {
+  struct stat file_stat;
+  char* real_path = realpath(data_set_path.c_str(), nullptr);
+  if(real_path == nullptr || stat(real_path, &file_stat) != 0) {
+    free(real_path);
+    return false;
+  }
+  path = real_path;
+  free(real_path);
+
+  stamp = path+"\n"+std::to_string(file_stat.st_size)+"\n"+
+    std::to_string(file_stat.st_mtim.tv_sec)+"."+std::to_string(file_stat.st_mtim.tv_nsec)+"\n";
+  return true;
+}
+
+std::string GetContentHashCacheName(const std::string& cache_directory, const std::string& path) {
+  std::string cache_name = cache_directory;
+  if(!cache_name.empty() && cache_name.back() != '/') {
+    cache_name += "/";
+  }
+  return cache_name+"DATA_HASH_"+HashToString(HashString(path));
+}
+
+// the stamp, then the # of dims, the # of bytes hashed and the hash
+bool ReadContentHashCache(const std::string& cache_name, const std::string& stamp,
+                          ui& number_of_dims, ul& size, ull& hash) {
+  std::ifstream cache_stream(cache_name);
+  if(!cache_stream) {
+    return false;
+  }
+  std::stringstream cache;
+  cache << cache_stream.rdbuf();
+  auto cached = cache.str();
+  if(cached.compare(0, stamp.size(), stamp) != 0) {
+    return false;
+  }
+
+  std::string hash_str;
+  std::istringstream values(cached.substr(stamp.size()));
+  if(!(values >> number_of_dims >> size >> hash_str) || hash_str.size() != 16) {
+    return false;
+  }
+  char* end = nullptr;
+  hash = strtoull(hash_str.c_str(), &end, 16);
+  return *end == '\0';
+}
+
+} // End of anonymous namespace
+
 DataSet::DataSet(unsigned int number_of_dimensions, unsigned int number_of_data,
                  std::string data_set_path, DataSetType data_set_type, DataType data_type,
                  ClusterType cluster_type, std::string force_rebuild)
@@ -14,34 +79,79 @@ DataSet::DataSet(unsigned int number_of_dimensions, unsigned int number_of_data,
     data_set_path(data_set_path), data_set_type(data_set_type), 
     data_type(data_type), cluster_type(cluster_type), force_rebuild(force_rebuild) {
 
-  // read data from data_set_path
-  std::ifstream input_stream; 
+  // use the file in place if possible, otherwise read it into the heap
+  if(!Map()) {
+    std::ifstream input_stream; 
 
-  switch(data_set_type) {
-    case DATASET_TYPE_BINARY:
-      input_stream.open(data_set_path, std::ios::in | std::ios::binary);
-      break;
+    switch(data_set_type) {
+      case DATASET_TYPE_BINARY:
+        input_stream.open(data_set_path, std::ios::in | std::ios::binary);
+        break;
+
+      default:
+        input_stream.open(data_set_path, std::ifstream::in);
+    }
 
-    default:
-      input_stream.open(data_set_path, std::ifstream::in);
+    // print out an error message when it was failed to be opened
+    if(!input_stream){
+      std::cerr << "Failed to open a file(" << data_set_path << ")\n";
+      exit(1);
+    } 
+
+    Read(input_stream);
+    input_stream.close();
   }
 
-  // print out an error message when it was failed to be opened
-  if(!input_stream){
-    std::cerr << "Failed to open a file(" << data_set_path << ")\n";
-    exit(1);
-  } 
- 
+  std::cout << *this << std::endl;
+}
 
-  points.resize(number_of_dimensions*number_of_data);
+DataSet::~DataSet() {
+  if(mapped_data != nullptr) {
+    munmap(mapped_data, mapped_size);
+    mapped_data = nullptr;
+  }
+}
 
-  input_stream.read(reinterpret_cast<char*>(&points[0]), 
-              sizeof(Point)*number_of_data*number_of_dimensions);
+bool DataSet::Map(void) {
+  int fd = open(data_set_path.c_str(), O_RDONLY);
+  if(fd == -1) {
+    return false;
+  }
 
-  std::cout << *this << std::endl;
-  input_stream.close();
+  ul size = sizeof(Point)*number_of_data*number_of_dimensions;
+
+  // touching a page past the end of the file would raise SIGBUS, a short
+  // file is read instead and the rest is left zero as before
+  struct stat file_stat;
+  if(size == 0 || fstat(fd, &file_stat) == -1 || (ul)file_stat.st_size < size) {
+    close(fd);
+    return false;
+  }
+
+  // private and writable so that points stay usable through non-const
+  // pointers, the file itself is never modified
+  void* data = mmap(nullptr, size, PROT_READ|PROT_WRITE, MAP_PRIVATE, fd, 0);
+  close(fd);
+
+  if(data == MAP_FAILED) {
+    return false;
+  }
+  mapped_data = static_cast<char*>(data);
+  mapped_size = size;
+  points = reinterpret_cast<Point*>(mapped_data);
+
+  // data is mostly consumed front to back, let the kernel read ahead
+  madvise(mapped_data, mapped_size, MADV_SEQUENTIAL);
+  return true;
 }
 
+void DataSet::Read(std::istream& input_stream) {
+  heap_points.resize(number_of_dimensions*number_of_data);
+  points = heap_points.data();
+
+  input_stream.read(reinterpret_cast<char*>(points), 
+              sizeof(Point)*number_of_data*number_of_dimensions);
+}
 
 unsigned int DataSet::GetNumberOfDims(void) const{ 
   return number_of_dimensions; 
@@ -67,10 +177,33 @@ ClusterType DataSet::GetClusterType(void) const{
   return cluster_type; 
 }
 
-std::vector<Point> DataSet::GetPoints(void) const{ 
+Point* DataSet::GetPoints(void) const{ 
   return points; 
 }
 
+void DataSet::ForEachChunk(const std::function<void(ul, ul)>& body,
+                           ul chunk_size) const{ 
+  assert(chunk_size);
+  ul bytes_per_data = sizeof(Point)*number_of_dimensions;
+
+  for(ul range(start_offset, 0, number_of_data, chunk_size)) {
+    ul end_offset = std::min(start_offset+chunk_size, (ul)number_of_data);
+
+    // ask for the next chunk before working on this one, the kernel reads
+    // it in the background
+    if(mapped_data != nullptr && end_offset < number_of_data) {
+      ul next_start = end_offset*bytes_per_data;
+      ul next_end = std::min(end_offset+chunk_size, (ul)number_of_data)*bytes_per_data;
+      // madvise needs a page aligned address
+      ul page_size = sysconf(_SC_PAGESIZE);
+      next_start = next_start/page_size*page_size;
+      madvise(mapped_data+next_start, next_end-next_start, MADV_WILLNEED);
+    }
+
+    body(start_offset, end_offset);
+  }
+}
+
 bool DataSet::IsRebuild(void) const{ 
   if(force_rebuild=="yes") {
     return true;
@@ -79,10 +212,99 @@ bool DataSet::IsRebuild(void) const{
   }
 }
 
+// only the points are hashed, not the path, so the same data gives the
+// same hash wherever the file lives
+ull DataSet::GetContentHash(void) const{ 
+  if(!content_hash_ready) {
+    content_hash = HashInParallel(points, sizeof(Point)*number_of_data*number_of_dimensions);
+    content_hash_ready = true;
+  }
+  return content_hash;
+}
+
+ull DataSet::GetContentHash(const std::string& cache_directory) const{ 
+  if(content_hash_ready) {
+    return content_hash;
+  }
+
+  std::string path, stamp;
+  if(!GetFileStamp(data_set_path, path, stamp)) {
+    return GetContentHash();
+  }
+  auto cache_name = GetContentHashCacheName(cache_directory, path);
+
+  ui cached_dims;
+  ul cached_size;
+  ull cached_hash;
+  ul size = sizeof(Point)*number_of_data*number_of_dimensions;
+  if(ReadContentHashCache(cache_name, stamp, cached_dims, cached_size, cached_hash) &&
+     cached_dims == number_of_dimensions && cached_size == size) {
+    content_hash = cached_hash;
+    content_hash_ready = true;
+    return content_hash;
+  }
+
+  // written aside and renamed, so a reader never sees half of it. A cache
+  // that can't be written only costs hashing the data again next time
+  GetContentHash();
+  MakeParentDirectories(cache_name);
+  std::string temp_cache_name = cache_name+".tmp."+std::to_string(getpid());
+  {
+    std::ofstream temp_cache(temp_cache_name, std::ios::trunc);
+    temp_cache << stamp << number_of_dimensions << "\n" << size << "\n" 
+               << HashToString(content_hash) << "\n";
+  }
+  if(rename(temp_cache_name.c_str(), cache_name.c_str()) != 0) {
+    unlink(temp_cache_name.c_str());
+  }
+  return content_hash;
+}
+
+bool DataSet::GetIndexedGeometry(const std::string& index_directory,
+                                 const std::string& data_set_path, Geometry& geometry) {
+  std::string path, stamp;
+  if(!GetFileStamp(data_set_path, path, stamp)) {
+    return false;
+  }
+
+  ui number_of_dims;
+  ul size;
+  ull data_hash;
+  if(!ReadContentHashCache(GetContentHashCacheName(index_directory, path), stamp,
+                           number_of_dims, size, data_hash)) {
+    return false;
+  }
+
+  auto directory = opendir(index_directory.c_str());
+  if(directory == nullptr) {
+    return false;
+  }
+
+  // any index of the data tells the geometry, names hold the # of dims
+  std::string directory_path = index_directory;
+  if(directory_path.back() != '/') {
+    directory_path += "/";
+  }
+  std::string dims_str = "_"+std::to_string(number_of_dims)+"DIMS_";
+  bool found = false;
+  while(auto entry = readdir(directory)) {
+    std::string name = entry->d_name;
+    ull index_data_hash;
+    if(name.find(dims_str) != std::string::npos && name.find(".tmp.") == std::string::npos &&
+       IndexFile::ReadGeometry(directory_path+name, geometry, index_data_hash) &&
+       index_data_hash == data_hash && geometry.number_of_dims == number_of_dims) {
+      found = true;
+      break;
+    }
+  }
+  closedir(directory);
+  return found;
+}
+
 Point* DataSet::GetDeviceQuery(ui number_of_search) const{ 
   Point* d_query;
   cudaErrCheck(cudaMalloc((void**) &d_query, sizeof(Point)*GetNumberOfDims()*2*number_of_search));
-  cudaErrCheck(cudaMemcpy(d_query, &points[0], sizeof(Point)*GetNumberOfDims()*2*number_of_search,
+  cudaErrCheck(cudaMemcpy(d_query, points, sizeof(Point)*GetNumberOfDims()*2*number_of_search,
                cudaMemcpyHostToDevice));
   return d_query; 
 }
@@ -1,7 +1,9 @@
 #pragma once
 
+#include "common/geometry.h"
 #include "common/types.h"
 
+#include <functional>
 #include <iostream>
 #include <fstream>
 #include <vector>
@@ -9,6 +11,16 @@
 namespace ursus {
 namespace io {
 
+// # of data handed to the body of DataSet::ForEachChunk at a time
+constexpr ul GetDataSetChunkSize() { return 1ul << 20; }
+
+/**
+ * Points of a data or query file.
+ * The file is mapped copy-on-write and used in place, so GetPoints() is a
+ * view without a copy and pages are read from the file as they are touched.
+ * If the file can't be mapped (or is shorter than expected) it is read into
+ * the heap as before
+ */
 class DataSet{
  public:
  //===--------------------------------------------------------------------===//
@@ -22,8 +34,13 @@ class DataSet{
           ClusterType cluster_type,
           std::string force_rebuild);
 
-  ~DataSet(){
-  }
+  DataSet(const DataSet &) = delete;
+  DataSet &operator=(const DataSet &) = delete;
+  DataSet(DataSet &&) = delete;
+  DataSet &operator=(DataSet &&) = delete;
+
+  // unmaps the file, pointers from GetPoints() are gone after this
+  ~DataSet();
 
  //===--------------------------------------------------------------------===//
  // Accessors
@@ -40,12 +57,43 @@ class DataSet{
 
   ClusterType GetClusterType(void) const;
 
-  std::vector<Point> GetPoints(void) const;
+  // number_of_data*number_of_dims points, owned by the data set
+  Point* GetPoints(void) const;
+
+  /**
+   * call body with [start_offset, end_offset) of data, chunk by chunk in
+   * order. The next chunk is read ahead while the body works on the current
+   * one, so it can overlap processing with reading the file
+   */
+  void ForEachChunk(const std::function<void(ul, ul)>& body,
+                    ul chunk_size=GetDataSetChunkSize()) const;
 
   Point* GetDeviceQuery(ui number_of_search) const;
 
   bool IsRebuild(void) const;
 
+  // hash of the points, computed once on first use. It reads the whole
+  // data set
+  ull GetContentHash(void) const;
+
+  /**
+   * same hash, kept in a sidecar file in cache_directory along with the
+   * path, size and modification time of the data file. The data is hashed
+   * again only when one of them changed, the hash alone keys the index
+   * cache so copies of the data on other hosts share their index files
+   */
+  ull GetContentHash(const std::string& cache_directory) const;
+
+  /**
+   * geometry of an index in index_directory built from the data file as it
+   * is now, read from the header of the index. The data file itself has no
+   * header, its DATA_HASH_ file tells the hash and # of dims it was indexed
+   * with
+   * @return false if the data file isn't indexed there
+   */
+  static bool GetIndexedGeometry(const std::string& index_directory,
+                                 const std::string& data_set_path, Geometry& geometry);
+
   // Get a string representation for debugging
   friend std::ostream &operator<<(std::ostream &os, const DataSet &dataset);
 
@@ -71,7 +119,22 @@ class DataSet{
   // Cluster Type
   ClusterType cluster_type;
 
-  std::vector<Point> points;
+  bool Map(void);
+
+  void Read(std::istream& input_stream);
+
+  // either mapped_data or the heap
+  Point* points = nullptr;
+
+  std::vector<Point> heap_points;
+
+  char* mapped_data = nullptr;
+
+  ul mapped_size = 0;
+
+  mutable ull content_hash = 0;
+
+  mutable bool content_hash_ready = false;
 
   // dumped file path
   std::string force_rebuild;
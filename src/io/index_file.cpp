@@ -0,0 +1,514 @@
+#include "io/index_file.h"
+
+#include "common/config.h"
+#include "common/hash.h"
+#include "common/logger.h"
+#include "common/macro.h"
+#include "common/thread_pool.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstdlib>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace ursus {
+namespace io {
+
+namespace {
+
+const char index_file_magic[8] = {'U','R','S','U','S','I','D','X'};
+
+// layout of the beginning of the file, followed by level_node_count and
+// GetNumberOfMAXIndexSections() section entries
+struct IndexHeader {
+  char magic[8];
+  ui version;
+  ui number_of_dims;
+  ui leaf_node_degrees;
+  ui upper_tree_degrees;
+  int tree_type;
+  int cluster_type;
+  ui number_of_partition;
+  ui height;
+  ui number_of_levels;
+  ui number_of_sections;
+  ull data_hash;
+  // of the header with this field zeroed, the level node counts and the
+  // section table
+  ull header_checksum;
+};
+
+inline ul AlignUp(ul offset, ul alignment) {
+  return (offset+alignment-1)/alignment*alignment;
+}
+
+ull GetHeaderChecksum(IndexHeader header, const std::vector<ui>& level_node_count,
+                      const void* sections, ul sections_size) {
+  header.header_checksum = 0;
+  ull checksum = HashBlock(&header, sizeof(IndexHeader));
+  checksum = CombineHash(checksum, HashBlock(level_node_count.data(),
+                                             sizeof(ui)*level_node_count.size()));
+  return CombineHash(checksum, HashBlock(sections, sections_size));
+}
+
+} // End of anonymous namespace
+
+std::string GetDefaultIndexDirectory(void) {
+  auto cache_home = getenv("XDG_CACHE_HOME");
+  if(cache_home && *cache_home) {
+    return std::string(cache_home)+"/ursus/index_files/";
+  }
+  auto home = getenv("HOME");
+  if(home && *home) {
+    return std::string(home)+"/.cache/ursus/index_files/";
+  }
+  return "index_files/";
+}
+
+void MakeParentDirectories(const std::string& file_name) {
+  for(auto position = file_name.find('/', 1); position != std::string::npos;
+      position = file_name.find('/', position+1)) {
+    mkdir(file_name.substr(0, position).c_str(), 0755);
+  }
+}
+
+IndexFile::IndexFile() {}
+
+IndexFile::~IndexFile() {
+  if(file != nullptr) {
+    fclose(file);
+    file = nullptr;
+  }
+  if(mapped_fd != -1) {
+    close(mapped_fd);
+    mapped_fd = -1;
+  }
+  // a dump that wasn't committed never shows up under its name
+  if(!temp_file_name.empty()) {
+    unlink(temp_file_name.c_str());
+  }
+  if(mapped_data != nullptr) {
+    munmap(mapped_data, file_size);
+    mapped_data = nullptr;
+  }
+}
+
+//===--------------------------------------------------------------------===//
+// Read
+//===--------------------------------------------------------------------===//
+
+/**
+ * @brief open an index file
+ * @param file_name
+ * @param load_type falls back to LOAD_TYPE_READ if the file can't be mapped
+ * @return false if the file doesn't exist or its header doesn't match
+ */
+bool IndexFile::Open(std::string file_name, LoadType load_type) {
+  this->file_name = file_name;
+  this->load_type = load_type;
+
+  if(load_type == LOAD_TYPE_MMAP || load_type == LOAD_TYPE_POPULATE) {
+    if(Map(file_name)) {
+      return ReadHeader();
+    }
+    this->load_type = LOAD_TYPE_READ;
+  }
+
+  file = fopen(file_name.c_str(),"rb");
+  if(file == nullptr) {
+    return false;
+  }
+
+  fseek(file, 0, SEEK_END);
+  file_size = ftell(file);
+  return ReadHeader();
+}
+
+bool IndexFile::ReadGeometry(std::string file_name, Geometry& geometry, ull& data_hash) {
+  IndexHeader header;
+  auto file = fopen(file_name.c_str(), "rb");
+  if(file == nullptr) {
+    return false;
+  }
+  bool ret = fread(&header, sizeof(IndexHeader), 1, file) == 1;
+  fclose(file);
+
+  if(!ret || memcmp(header.magic, index_file_magic, sizeof(index_file_magic)) != 0 ||
+     header.version != GetIndexFileVersion()) {
+    return false;
+  }
+  geometry = {header.number_of_dims, header.leaf_node_degrees, header.upper_tree_degrees};
+  data_hash = header.data_hash;
+  return true;
+}
+
+bool IndexFile::Map(std::string file_name) {
+  int fd = open(file_name.c_str(), O_RDONLY);
+  if(fd == -1) {
+    return false;
+  }
+
+  struct stat file_stat;
+  if(fstat(fd, &file_stat) == -1 || file_stat.st_size == 0) {
+    close(fd);
+    return false;
+  }
+  file_size = file_stat.st_size;
+
+  // private and writable so that nodes stay usable through non-const
+  // pointers, clean pages are still shared with other processes
+  int flags = MAP_PRIVATE;
+#ifdef MAP_POPULATE
+  if(load_type == LOAD_TYPE_POPULATE) {
+    flags |= MAP_POPULATE;
+  }
+#endif
+
+  void* data = mmap(nullptr, file_size, PROT_READ|PROT_WRITE, flags, fd, 0);
+  if(data == MAP_FAILED) {
+    LOG_INFO("Failed to map an index file(%s), read it instead", file_name.c_str());
+    close(fd);
+    file_size = 0;
+    return false;
+  }
+  mapped_data = static_cast<char*>(data);
+  mapped_fd = fd;
+
+  // searches jump around the tree, so read ahead only when everything
+  // is going to be touched anyway
+  if(load_type == LOAD_TYPE_POPULATE) {
+    madvise(mapped_data, file_size, MADV_WILLNEED);
+  } else {
+    madvise(mapped_data, file_size, MADV_RANDOM);
+  }
+
+  return true;
+}
+
+bool IndexFile::ReadHeader(void) {
+  IndexHeader header;
+  if(!ReadAt(&header, 0, sizeof(IndexHeader)) ||
+     memcmp(header.magic, index_file_magic, sizeof(index_file_magic)) != 0) {
+    LOG_INFO("%s is not an index file or its dump didn't finish", file_name.c_str());
+    return false;
+  }
+
+  if(header.version != GetIndexFileVersion()) {
+    LOG_INFO("%s has version %u, expected %u", file_name.c_str(),
+             header.version, GetIndexFileVersion());
+    return false;
+  }
+
+  // the tables are sized by the header, bound them before reading them
+  ul header_size = sizeof(IndexHeader)+sizeof(ui)*header.number_of_levels+
+                   sizeof(Section)*header.number_of_sections;
+  if(header.number_of_levels > GetNumberOfMAXIndexLevels() ||
+     header.number_of_sections > GetNumberOfMAXIndexSections() ||
+     header_size > file_size) {
+    LOG_INFO("%s has a corrupted header", file_name.c_str());
+    return false;
+  }
+
+  metadata.level_node_count.resize(header.number_of_levels);
+  ul offset = sizeof(IndexHeader);
+  if(!ReadAt(metadata.level_node_count.data(), offset, sizeof(ui)*header.number_of_levels)) {
+    return false;
+  }
+  offset += sizeof(ui)*header.number_of_levels;
+
+  sections.resize(header.number_of_sections);
+  if(!ReadAt(sections.data(), offset, sizeof(Section)*header.number_of_sections)) {
+    return false;
+  }
+
+  if(GetHeaderChecksum(header, metadata.level_node_count, sections.data(),
+                       sizeof(Section)*sections.size()) != header.header_checksum) {
+    LOG_INFO("Checksum mismatch in the header of %s", file_name.c_str());
+    return false;
+  }
+
+  if(header.number_of_dims != GetNumberOfDims() ||
+     header.leaf_node_degrees != GetNumberOfLeafNodeDegrees() ||
+     header.upper_tree_degrees != GetNumberOfUpperTreeDegrees()) {
+    LOG_INFO("%s is built with %u dims and %u/%u degrees, expected %u dims and %u/%u degrees",
+             file_name.c_str(), header.number_of_dims, header.leaf_node_degrees,
+             header.upper_tree_degrees, GetNumberOfDims(),
+             GetNumberOfLeafNodeDegrees(), GetNumberOfUpperTreeDegrees());
+    return false;
+  }
+
+  metadata.tree_type = (TreeType)header.tree_type;
+  metadata.cluster_type = (ClusterType)header.cluster_type;
+  metadata.number_of_partition = header.number_of_partition;
+  metadata.height = header.height;
+  metadata.data_hash = header.data_hash;
+
+  for(auto& section : sections) {
+    if(section.offset%GetIndexSectionAlignment() != 0 ||
+       section.offset+section.size > file_size) {
+      LOG_INFO("%s is truncated", file_name.c_str());
+      return false;
+    }
+  }
+
+  return true;
+}
+
+bool IndexFile::ReadAt(void* buffer, ul offset, ul size) {
+  if(offset+size > file_size) {
+    return false;
+  }
+
+  if(mapped_data != nullptr) {
+    memcpy(buffer, mapped_data+offset, size);
+    return true;
+  }
+
+  if(file == nullptr || fseek(file, offset, SEEK_SET) != 0) {
+    return false;
+  }
+  return fread(buffer, 1, size, file) == size;
+}
+
+const IndexFile::Section* IndexFile::FindSection(IndexSectionType section_type,
+                                                 ui element_size) const {
+  for(auto& section : sections) {
+    if(section.section_type != (ui)section_type) {
+      continue;
+    }
+
+    // the node layout changed without a version bump
+    if(section.element_size != element_size) {
+      LOG_INFO("%s has %u byte elements in section %u, expected %u bytes",
+               file_name.c_str(), section.element_size, section.section_type,
+               element_size);
+      return nullptr;
+    }
+    return &section;
+  }
+
+  LOG_INFO("%s has no section %u", file_name.c_str(), (ui)section_type);
+  return nullptr;
+}
+
+/**
+ * @brief compare the checksum of data with the one stored for the section
+ */
+bool IndexFile::VerifySection(const void* data, const Section& section) {
+  // checking sections used in place would fault in the whole file
+  // and defeat lazy loading, they are checked in the background on Close
+  if(load_type == LOAD_TYPE_MMAP && IsMapped(data) && !verify_mapped) {
+    unverified_sections.emplace_back(section);
+    return true;
+  }
+
+  auto section_checksum = HashInParallel(data, section.size);
+  if(section_checksum != section.checksum) {
+    LOG_INFO("Checksum mismatch in section %u of %s", section.section_type, file_name.c_str());
+    return false;
+  }
+  return true;
+}
+
+/**
+ * @brief check the sections taken in place unchecked on a worker of the
+ *        thread pool. They are read from the file rather than the mapping,
+ *        so pages of the mapping stay lazy and nodes changed in place don't
+ *        count as corrupted. A mismatch can only be reported by then
+ */
+void IndexFile::VerifyMappedInBackground(void) {
+  if(unverified_sections.empty() || mapped_fd == -1) {
+    return;
+  }
+
+  auto fd = mapped_fd;
+  auto name = file_name;
+  auto pending_sections = unverified_sections;
+  mapped_fd = -1;
+  unverified_sections.clear();
+
+  ThreadPool::GetInstance().RunInBackground([fd, name, pending_sections]() {
+    std::vector<char> block(GetHashBlockSize());
+    for(auto& section : pending_sections) {
+      ull section_checksum = 0;
+      for(ul range(offset, 0, section.size, GetHashBlockSize())) {
+        auto length = std::min(GetHashBlockSize(), section.size-offset);
+        if(pread(fd, block.data(), length, section.offset+offset) != (ssize_t)length) {
+          section_checksum = ~section.checksum;
+          break;
+        }
+        section_checksum = CombineHash(section_checksum, HashBlock(block.data(), length));
+      }
+
+      if(section_checksum != section.checksum) {
+        LOG_INFO("Checksum mismatch in section %u of %s, which is in use. Remove it to rebuild it",
+                 section.section_type, name.c_str());
+      }
+    }
+    close(fd);
+  });
+}
+
+//===--------------------------------------------------------------------===//
+// Write
+//===--------------------------------------------------------------------===//
+
+bool IndexFile::Create(std::string file_name, const IndexMetadata& metadata) {
+  this->file_name = file_name;
+  this->metadata = metadata;
+
+  // write next to the index and rename it when done, so that readers
+  // (possibly other processes) see either the old index or the whole new one
+  temp_file_name = file_name+".tmp."+std::to_string(getpid());
+  file = fopen(temp_file_name.c_str(),"wb");
+  if(file == nullptr) {
+    MakeParentDirectories(temp_file_name);
+    file = fopen(temp_file_name.c_str(),"wb");
+  }
+  if(file == nullptr) {
+    LOG_INFO("Failed to create an index file(%s)", file_name.c_str());
+    temp_file_name.clear();
+    return false;
+  }
+
+  // leave room for the header, it is written once the sections are known
+  position = 0;
+  WriteZeros(sizeof(IndexHeader)+sizeof(ui)*metadata.level_node_count.size()+
+             sizeof(Section)*GetNumberOfMAXIndexSections());
+  return true;
+}
+
+void IndexFile::BeginSection(IndexSectionType section_type, ui element_size) {
+  assert(sections.size() < GetNumberOfMAXIndexSections());
+  WriteZeros(AlignUp(position, GetIndexSectionAlignment())-position);
+
+  Section section;
+  section.section_type = section_type;
+  section.element_size = element_size;
+  section.offset = position;
+  section.size = 0;
+  section.checksum = 0;
+  sections.emplace_back(section);
+
+  checksum = 0;
+  block.reserve(GetHashBlockSize());
+}
+
+void IndexFile::Write(const void* data, ul size) {
+  auto bytes = static_cast<const char*>(data);
+  while(size) {
+    auto length = std::min(size, GetHashBlockSize()-block.size());
+    block.insert(block.end(), bytes, bytes+length);
+    bytes += length;
+    size -= length;
+
+    if(block.size() == GetHashBlockSize()) {
+      FlushBlock();
+    }
+  }
+}
+
+void IndexFile::EndSection(void) {
+  if(!block.empty()) {
+    FlushBlock();
+  }
+  sections.back().size = position-sections.back().offset;
+  sections.back().checksum = checksum;
+}
+
+void IndexFile::FlushBlock(void) {
+  checksum = CombineHash(checksum, HashBlock(block.data(), block.size()));
+  if(fwrite(block.data(), 1, block.size(), file) != block.size()) {
+    write_failed = true;
+  }
+  position += block.size();
+  block.clear();
+}
+
+void IndexFile::WriteZeros(ul size) {
+  std::vector<char> padding(size, 0);
+  if(fwrite(padding.data(), 1, padding.size(), file) != padding.size()) {
+    write_failed = true;
+  }
+  position += padding.size();
+}
+
+bool IndexFile::Commit(void) {
+  IndexHeader header;
+  memset(&header, 0, sizeof(IndexHeader));
+  memcpy(header.magic, index_file_magic, sizeof(index_file_magic));
+  header.version = GetIndexFileVersion();
+  header.number_of_dims = GetNumberOfDims();
+  header.leaf_node_degrees = GetNumberOfLeafNodeDegrees();
+  header.upper_tree_degrees = GetNumberOfUpperTreeDegrees();
+  header.tree_type = metadata.tree_type;
+  header.cluster_type = metadata.cluster_type;
+  header.number_of_partition = metadata.number_of_partition;
+  header.height = metadata.height;
+  header.number_of_levels = metadata.level_node_count.size();
+  header.number_of_sections = sections.size();
+  header.data_hash = metadata.data_hash;
+  header.header_checksum = GetHeaderChecksum(header, metadata.level_node_count, sections.data(),
+                                             sizeof(Section)*sections.size());
+
+  // make sure the sections hit the file before the header does
+  if(fflush(file) != 0 || fseek(file, 0, SEEK_SET) != 0) {
+    write_failed = true;
+  }
+  fwrite(&header, sizeof(IndexHeader), 1, file);
+  fwrite(metadata.level_node_count.data(), sizeof(ui), metadata.level_node_count.size(), file);
+  fwrite(sections.data(), sizeof(Section), sections.size(), file);
+
+  if(ferror(file) || fflush(file) != 0 || fsync(fileno(file)) != 0) {
+    write_failed = true;
+  }
+  if(fclose(file) != 0) {
+    write_failed = true;
+  }
+  file = nullptr;
+
+  if(write_failed || rename(temp_file_name.c_str(), file_name.c_str()) != 0) {
+    LOG_INFO("Failed to write an index file(%s)", file_name.c_str());
+    return false;
+  }
+  temp_file_name.clear();
+  return true;
+}
+
+void IndexFile::Close(void) {
+  if(file != nullptr) {
+    fclose(file);
+    file = nullptr;
+  }
+  VerifyMappedInBackground();
+}
+
+//===--------------------------------------------------------------------===//
+// Accessor
+//===--------------------------------------------------------------------===//
+
+const IndexMetadata& IndexFile::GetMetadata(void) const {
+  return metadata;
+}
+
+LoadType IndexFile::GetLoadType(void) const {
+  return load_type;
+}
+
+void IndexFile::SetVerifyMapped(bool _verify_mapped) {
+  verify_mapped = _verify_mapped;
+}
+
+bool IndexFile::IsMapped(const void* ptr) const {
+  auto address = static_cast<const char*>(ptr);
+  return mapped_data != nullptr &&
+         address >= mapped_data && address < mapped_data+file_size;
+}
+
+} // End of io namespace
+} // End of ursus namespace
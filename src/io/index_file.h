@@ -0,0 +1,266 @@
+#pragma once
+
+#include "common/geometry.h"
+#include "common/types.h"
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+namespace ursus {
+namespace io {
+
+// bumped whenever the layout of the file or of the nodes changes
+constexpr ui GetIndexFileVersion() { return 4; }
+
+// sections start on a page so they can be used in place when mapped
+constexpr ul GetIndexSectionAlignment() { return 4096; }
+
+constexpr ui GetNumberOfMAXIndexSections() { return 4; }
+
+// far more levels than a tree of 2^32 nodes can have
+constexpr ui GetNumberOfMAXIndexLevels() { return 64; }
+
+enum IndexSectionType {
+  INDEX_SECTION_TYPE_INVALID = 0,
+  INDEX_SECTION_TYPE_NODE = 1,
+  INDEX_SECTION_TYPE_NODE_SOA = 2,
+  INDEX_SECTION_TYPE_ROOT_OFFSET = 3,
+  INDEX_SECTION_TYPE_QUANTIZED_NODE_SOA = 4,
+  INDEX_SECTION_TYPE_DATA_OFFSET = 5,
+  INDEX_SECTION_TYPE_POINT_NODE_SOA = 6
+};
+
+// what an index is built from, stored in the header of its file
+struct IndexMetadata {
+  TreeType tree_type = TREE_TYPE_INVALID;
+
+  ClusterType cluster_type = CLUSTER_TYPE_INVALID;
+
+  ui number_of_partition = 1;
+
+  ui height = 0;
+
+  std::vector<ui> level_node_count;
+
+  // DataSet::GetContentHash of the data set, 0 if unknown
+  ull data_hash = 0;
+};
+
+// directory of the index files unless one is given, ursus/index_files under
+// $XDG_CACHE_HOME or ~/.cache, or index_files in the working directory
+std::string GetDefaultIndexDirectory(void);
+
+// mkdir -p of the directory holding file_name
+void MakeParentDirectories(const std::string& file_name);
+
+/**
+ * Index file container.
+ * A header records the magic, version, build constants (dims and degrees)
+ * and the IndexMetadata, followed by a table of sections. Each section holds
+ * one array, starts on GetIndexSectionAlignment() and carries a checksum.
+ * The header, level node counts and section table carry one more.
+ * A dump goes to a temporary file that is renamed over the index once it
+ * is complete, and the header is written last, so a dump that was cut off
+ * is never loaded.
+ *
+ * With LOAD_TYPE_READ sections are read with fread into the heap.
+ * Otherwise the whole file is mapped copy-on-write, so node arrays can be
+ * used in place and processes loading the same index share its pages in the
+ * page cache. Pages are faulted in lazily unless LOAD_TYPE_POPULATE is given.
+ * Checksums of sections used in place with LOAD_TYPE_MMAP are not checked
+ * while loading, as that would fault in the whole file, unless
+ * SetVerifyMapped is set. They are checked in the background once the
+ * file is closed instead
+ */
+class IndexFile {
+ public:
+ //===--------------------------------------------------------------------===//
+ // Consteructor/Destructor
+ //===--------------------------------------------------------------------===//
+  IndexFile();
+
+  IndexFile(const IndexFile &) = delete;
+  IndexFile &operator=(const IndexFile &) = delete;
+  IndexFile(IndexFile &&) = delete;
+  IndexFile &operator=(IndexFile &&) = delete;
+
+  // unmaps the file, sections taken in place are gone after this
+  ~IndexFile();
+
+ //===--------------------------------------------------------------------===//
+ // Read
+ //===--------------------------------------------------------------------===//
+  /**
+   * open an index file and check its header against the constants of this
+   * build, false if it doesn't exist or is not usable
+   */
+  bool Open(std::string file_name, LoadType load_type);
+
+  /**
+   * geometry and data hash in the header of an index file, whatever the
+   * geometry of this build
+   * @return false if it's not an index file of this version
+   */
+  static bool ReadGeometry(std::string file_name, Geometry& geometry, ull& data_hash);
+
+  /**
+   * elements of a section, in place if the file is mapped, otherwise copied
+   * into a new T[count]. Use IsMapped to tell which one needs to be deleted.
+   * nullptr if the section is missing, of another type or corrupted
+   */
+  template <typename T>
+  T* GetSection(IndexSectionType section_type, ul& count);
+
+  // copy a section of exactly count elements into buffer
+  template <typename T>
+  bool CopySection(IndexSectionType section_type, T* buffer, ul count);
+
+ //===--------------------------------------------------------------------===//
+ // Write
+ //===--------------------------------------------------------------------===//
+  bool Create(std::string file_name, const IndexMetadata& metadata);
+
+  // sections are written one after another between these two
+  void BeginSection(IndexSectionType section_type, ui element_size);
+
+  void Write(const void* data, ul size);
+
+  void EndSection(void);
+
+  // a section from a contiguous array
+  template <typename T>
+  void WriteSection(IndexSectionType section_type, const T* data, ul count);
+
+  // write the section table and the header, then move the file in place
+  bool Commit(void);
+
+  // release the FILE, a mapping is kept for the sections taken in place.
+  // The ones that weren't checked are checked on the thread pool from here
+  void Close(void);
+
+ //===--------------------------------------------------------------------===//
+ // Accessor
+ //===--------------------------------------------------------------------===//
+  const IndexMetadata& GetMetadata(void) const;
+
+  LoadType GetLoadType(void) const;
+
+  // check the sections used in place with LOAD_TYPE_MMAP as well, set before
+  // they are taken
+  void SetVerifyMapped(bool verify_mapped);
+
+  // true if ptr points into the mapped file
+  bool IsMapped(const void* ptr) const;
+
+ //===--------------------------------------------------------------------===//
+ // Members
+ //===--------------------------------------------------------------------===//
+ private:
+  struct Section {
+    ui section_type;
+    ui element_size;
+    ul offset;
+    ul size;
+    ull checksum;
+  };
+
+  bool Map(std::string file_name);
+
+  bool ReadHeader(void);
+
+  bool ReadAt(void* buffer, ul offset, ul size);
+
+  const Section* FindSection(IndexSectionType section_type, ui element_size) const;
+
+  bool VerifySection(const void* data, const Section& section);
+
+  void VerifyMappedInBackground(void);
+
+  void FlushBlock(void);
+
+  void WriteZeros(ul size);
+
+  std::string file_name;
+
+  // where a dump is written until it is committed
+  std::string temp_file_name;
+
+  LoadType load_type = LOAD_TYPE_READ;
+
+  bool verify_mapped = false;
+
+  FILE* file = nullptr;
+
+  char* mapped_data = nullptr;
+
+  // the mapped file, kept open to check the sections taken in place
+  // unchecked, even if the file is replaced by then
+  int mapped_fd = -1;
+
+  std::vector<Section> unverified_sections;
+
+  ul file_size = 0;
+
+  IndexMetadata metadata;
+
+  std::vector<Section> sections;
+
+  // offset where the next write goes
+  ul position = 0;
+
+  // the current block of the section being written and its checksum so far
+  std::vector<char> block;
+
+  ull checksum = 0;
+
+  bool write_failed = false;
+};
+
+template <typename T>
+T* IndexFile::GetSection(IndexSectionType section_type, ul& count) {
+  auto section = FindSection(section_type, sizeof(T));
+  if(section == nullptr) {
+    return nullptr;
+  }
+  count = section->size/sizeof(T);
+
+  T* array;
+  if(mapped_data != nullptr) {
+    array = reinterpret_cast<T*>(mapped_data+section->offset);
+  } else {
+    array = new T[count];
+    if(!ReadAt(array, section->offset, section->size)) {
+      delete[] array;
+      return nullptr;
+    }
+  }
+
+  if(!VerifySection(array, *section)) {
+    if(!IsMapped(array)) {
+      delete[] array;
+    }
+    return nullptr;
+  }
+  return array;
+}
+
+template <typename T>
+bool IndexFile::CopySection(IndexSectionType section_type, T* buffer, ul count) {
+  auto section = FindSection(section_type, sizeof(T));
+  if(section == nullptr || section->size != sizeof(T)*count) {
+    return false;
+  }
+  return ReadAt(buffer, section->offset, section->size) &&
+         VerifySection(buffer, *section);
+}
+
+template <typename T>
+void IndexFile::WriteSection(IndexSectionType section_type, const T* data, ul count) {
+  BeginSection(section_type, sizeof(T));
+  Write(data, sizeof(T)*count);
+  EndSection();
+}
+
+} // End of io namespace
+} // End of ursus namespace
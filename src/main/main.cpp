@@ -1,7 +1,13 @@
+#include "common/geometry.h"
 #include "evaluator/evaluator.h"
 
 int main(int argc, char** argv){
 
+  // hand over to the binary of another geometry if it is asked for
+  if( !ursus::DispatchGeometry(argc, argv)) {
+    return -1;
+  }
+
   auto& evaluator = ursus::evaluator::Evaluator::GetInstance();
 
   // Initialize evaluator which will build the indexing structure and measure
@@ -16,5 +22,13 @@ int main(int argc, char** argv){
   evaluator.PrintMemoryUsageOftheGPU();
 
   evaluator.Search();
+
+  if(evaluator.GetNumberOfMismatches()) {
+    return 2;
+  }
+
+  if(!evaluator.CompareWithBaseline()) {
+    return 1;
+  }
   return 0;
 }
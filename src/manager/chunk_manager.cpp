@@ -16,7 +16,7 @@ ChunkManager& ChunkManager::GetInstance(){
 bool ChunkManager::Init(size_t size) {
   printf("Try to allocate %zd (MB) in device memory\n", size/1000000);
   cudaErrCheck(cudaMalloc((void**) &d_node_soa_ptr, size));
-  global_SetRootNode<<<1,1>>>(d_node_soa_ptr);
+  LaunchKernel(global_SetRootNode, 1, 1, d_node_soa_ptr);
   cudaDeviceSynchronize();
   return true;
 }
@@ -24,7 +24,7 @@ bool ChunkManager::Init(size_t size) {
 // Allocate in Pinned Memory
 bool ChunkManager::InitInPinnedMemory(size_t size) {
   cudaErrCheck(cudaMallocHost((void**) &d_node_soa_ptr, size));
-  global_SetRootNode<<<1,1>>>(d_node_soa_ptr);
+  LaunchKernel(global_SetRootNode, 1, 1, d_node_soa_ptr);
   cudaDeviceSynchronize();
   return true;
 }
@@ -39,16 +39,73 @@ bool ChunkManager::CopyNode(node::Node_SOA* node_soa_ptr, ll offset, ui number_o
   return true;
 }
 
+bool ChunkManager::CopyQuantizedLeafNodes(const node::QuantizedNode_SOA* quantized_node_soa_ptr,
+                                          ui number_of_nodes, const ui* data_offsets,
+                                          ul number_of_branches, const Point* points,
+                                          ul number_of_data) {
+  auto size = sizeof(node::QuantizedNode_SOA)*number_of_nodes+
+              sizeof(ui)*number_of_branches+sizeof(Point)*GetNumberOfDims()*number_of_data;
+  printf("Try to allocate %zd (MB) in device memory, %.1f bytes per branch with its data offset and point\n", 
+         size/1000000, (double)size/number_of_branches);
+
+  cudaErrCheck(cudaMalloc((void**) &d_quantized_node_soa_ptr, sizeof(node::QuantizedNode_SOA)*number_of_nodes));
+  cudaErrCheck(cudaMalloc((void**) &d_data_offsets, sizeof(ui)*number_of_branches));
+  cudaErrCheck(cudaMalloc((void**) &d_points, sizeof(Point)*GetNumberOfDims()*number_of_data));
+
+  cudaErrCheck(cudaMemcpy(d_quantized_node_soa_ptr, quantized_node_soa_ptr, 
+               sizeof(node::QuantizedNode_SOA)*number_of_nodes, cudaMemcpyHostToDevice));
+  cudaErrCheck(cudaMemcpy(d_data_offsets, data_offsets, 
+               sizeof(ui)*number_of_branches, cudaMemcpyHostToDevice));
+  cudaErrCheck(cudaMemcpy(d_points, points, 
+               sizeof(Point)*GetNumberOfDims()*number_of_data, cudaMemcpyHostToDevice));
+
+  LaunchKernel(global_SetQuantizedLeafNodes, 1, 1, d_quantized_node_soa_ptr, d_data_offsets, d_points);
+  cudaDeviceSynchronize();
+  return true;
+}
+
+bool ChunkManager::CopyPointLeafNodes(const node::PointNode_SOA* point_node_soa_ptr,
+                                      ui number_of_nodes) {
+  auto size = sizeof(node::PointNode_SOA)*number_of_nodes;
+  printf("Try to allocate %zd (MB) in device memory\n", size/1000000);
+
+  cudaErrCheck(cudaMalloc((void**) &d_point_node_soa_ptr, size));
+  cudaErrCheck(cudaMemcpy(d_point_node_soa_ptr, point_node_soa_ptr, size, cudaMemcpyHostToDevice));
+
+  LaunchKernel(global_SetPointLeafNodes, 1, 1, d_point_node_soa_ptr);
+  cudaDeviceSynchronize();
+  return true;
+}
+
 //===--------------------------------------------------------------------===//
 // Cuda Variable & Function 
 //===--------------------------------------------------------------------===//
 __device__ node::Node_SOA* g_node_soa_ptr;
 
+__device__ node::QuantizedNode_SOA* g_quantized_node_soa_ptr;
+__device__ ui* g_data_offsets;
+__device__ Point* g_points;
+
+__device__ node::PointNode_SOA* g_point_node_soa_ptr;
+
 __global__ 
 void global_SetRootNode(node::Node_SOA* d_node_soa_ptr) { 
   g_node_soa_ptr = d_node_soa_ptr;
 }
 
+__global__ 
+void global_SetQuantizedLeafNodes(node::QuantizedNode_SOA* d_quantized_node_soa_ptr,
+                                  ui* d_data_offsets, Point* d_points) { 
+  g_quantized_node_soa_ptr = d_quantized_node_soa_ptr;
+  g_data_offsets = d_data_offsets;
+  g_points = d_points;
+}
+
+__global__ 
+void global_SetPointLeafNodes(node::PointNode_SOA* d_point_node_soa_ptr) { 
+  g_point_node_soa_ptr = d_point_node_soa_ptr;
+}
+
 } // End of manager namespace
 } // End of ursus namespace
 
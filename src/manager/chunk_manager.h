@@ -3,6 +3,8 @@
 #include "common/types.h"
 #include "node/node.h"
 #include "node/node_soa.h"
+#include "node/point_node_soa.h"
+#include "node/quantized_node_soa.h"
 
 namespace ursus {
 namespace manager {
@@ -26,12 +28,33 @@ class ChunkManager {
 
   bool CopyNode(node::Node_SOA* node_soa_ptr, ll offset, ui number_of_nodes);
 
+  /**
+   * copy quantized leaf nodes to the GPU in place of the leaf Node_SOAs,
+   * with the data points their boundary branches are tested on
+   * @return true if success otherwise false
+   */
+  bool CopyQuantizedLeafNodes(const node::QuantizedNode_SOA* quantized_node_soa_ptr,
+                              ui number_of_nodes, const ui* data_offsets,
+                              ul number_of_branches, const Point* points,
+                              ul number_of_data);
+
+  /**
+   * copy point leaf nodes to the GPU in place of the leaf Node_SOAs
+   * @return true if success otherwise false
+   */
+  bool CopyPointLeafNodes(const node::PointNode_SOA* point_node_soa_ptr,
+                          ui number_of_nodes);
+
   //===--------------------------------------------------------------------===//
   // Members
   //===--------------------------------------------------------------------===//
   private:
   ChunkManager() {}
   node::Node_SOA* d_node_soa_ptr;
+  node::QuantizedNode_SOA* d_quantized_node_soa_ptr;
+  ui* d_data_offsets;
+  Point* d_points;
+  node::PointNode_SOA* d_point_node_soa_ptr;
 
 };
 
@@ -41,9 +64,24 @@ class ChunkManager {
 
 extern __device__ node::Node_SOA* g_node_soa_ptr;
 
+// quantized leaf nodes, offsets in the data set of the leaf level and the
+// data points
+extern __device__ node::QuantizedNode_SOA* g_quantized_node_soa_ptr;
+extern __device__ ui* g_data_offsets;
+extern __device__ Point* g_points;
+
+extern __device__ node::PointNode_SOA* g_point_node_soa_ptr;
+
 __global__ 
 void global_SetRootNode(node::Node_SOA* d_node_soa_ptr);
 
+__global__ 
+void global_SetQuantizedLeafNodes(node::QuantizedNode_SOA* d_quantized_node_soa_ptr,
+                                  ui* d_data_offsets, Point* d_points);
+
+__global__ 
+void global_SetPointLeafNodes(node::PointNode_SOA* d_point_node_soa_ptr);
+
 
 } // End of manager namespace
 } // End of ursus namespace
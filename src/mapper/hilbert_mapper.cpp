@@ -3,6 +3,8 @@
 
 #include "common/macro.h"
 
+#include <algorithm>
+
 namespace ursus {
 namespace mapper {
 
@@ -67,6 +69,179 @@ HilbertMapper::MappingIntoSingle(ui number_of_dimensions,
   }
 }
 
+//===--------------------------------------------------------------------===//
+// Batch Mapping
+//===--------------------------------------------------------------------===//
+namespace {
+
+// widest curve with a table, (n+1)*n states of 2^n entries each
+constexpr ui GetMaxTableDimensions() { return 8; }
+
+/**
+ * The rotation loop of MappingIntoSingle as a state machine. A state is
+ * (flipBit, rotation), one entry per state and n-bit digit holds the
+ * output digit in the low byte and the next state in the high byte.
+ * spread puts the 8 bits of a byte n bits apart to interleave the
+ * coordinates
+ */
+struct HilbertTable {
+  ull spread[256];
+  std::vector<unsigned short> transition;
+};
+
+HilbertTable BuildHilbertTable(ui number_of_dimensions) {
+  HilbertTable table;
+  ul const ndOnes = ones(ul,number_of_dimensions);
+  ul const nd1Ones= ndOnes >> 1; /* for adjust_rotation */
+
+  for(ui range(byte, 0, 256)) {
+    table.spread[byte] = 0;
+    for(ui range(bit, 0, 8)) {
+      table.spread[byte] |= (ull)((byte >> bit) & 1) << (bit*number_of_dimensions);
+    }
+  }
+
+  // state (flip, rotation), flip 0 means flipBit is 0 otherwise 1<<(flip-1)
+  ui number_of_states = (number_of_dimensions+1)*number_of_dimensions;
+  table.transition.resize(number_of_states << number_of_dimensions);
+
+  for(ui range(flip, 0, number_of_dimensions+1)) {
+    for(ui range(state_rotation, 0, number_of_dimensions)) {
+      ui state = flip*number_of_dimensions+state_rotation;
+      ul flipBit = (flip) ? (ul)1 << (flip-1) : 0;
+
+      for(ul range(digit, 0, (ul)1 << number_of_dimensions)) {
+        ui rotation = state_rotation;
+        ul bits = rotateRight(flipBit ^ digit, rotation, number_of_dimensions);
+        ul output = bits;
+        ui next_flip = rotation+1;
+        adjust_rotation(rotation,number_of_dimensions,bits);
+
+        table.transition[(state << number_of_dimensions) | digit] =
+          (unsigned short)(output | ((next_flip*number_of_dimensions+rotation) << 8));
+      }
+    }
+  }
+  return table;
+}
+
+// built once on first use, index is the number of dimensions
+const std::vector<HilbertTable>& GetHilbertTables(void) {
+  static const std::vector<HilbertTable> tables = [] {
+    std::vector<HilbertTable> tables(GetMaxTableDimensions()+1);
+    for(ui range(dims, 2, GetMaxTableDimensions()+1)) {
+      tables[dims] = BuildHilbertTable(dims);
+    }
+    return tables;
+  }();
+  return tables;
+}
+
+} // End of anonymous namespace
+
+bool
+HilbertMapper::IsBatchMappingSupported(ui number_of_dimensions,
+                                        ui number_of_bits) {
+  return number_of_dimensions >= 2 &&
+         number_of_dimensions <= GetMaxTableDimensions() &&
+         number_of_bits >= 2 &&
+         number_of_dimensions*number_of_bits < 64;
+}
+
+/**
+ * @brief table driven encoder, same result as MappingIntoSingle for
+ *        coordinates that fit in number_of_bits bits
+ */
+void
+HilbertMapper::BatchMapping(ui number_of_dimensions,
+                            ui number_of_bits,
+                            const Point* points,
+                            ul number_of_points,
+                            ll* indexes) {
+  auto& table = GetHilbertTables()[number_of_dimensions];
+  ui const number_of_dimensionsBits = number_of_dimensions*number_of_bits;
+  ul const ndOnes = ones(ul,number_of_dimensions);
+  ll const nthbits = ones(ll,number_of_dimensionsBits) / ndOnes;
+  ll const coord_limit = (ll)1 << number_of_bits;
+
+  for(ul range(point_itr, 0, number_of_points)) {
+    const Point* point = points+point_itr*number_of_dimensions;
+
+    // interleave the coordinates, bit b of dimension d goes to b*n+d
+    ull coords = 0;
+    bool in_range = true;
+    for(ui range(d, 0, number_of_dimensions)) {
+      ll coord = (ll) (1000000*point[d]);
+      if(coord < 0 || coord >= coord_limit) {
+        in_range = false;
+        break;
+      }
+      ull spread = 0;
+      for(ui byte_itr = 0; byte_itr*8 < number_of_bits; byte_itr++) {
+        spread |= table.spread[(coord >> (byte_itr*8)) & 0xFF] 
+                   << (byte_itr*8*number_of_dimensions);
+      }
+      coords |= spread << d;
+    }
+
+    // overlapping fields are packed differently, leave them to the original
+    if(!in_range) {
+      std::vector<Point> point_vec(point, point+number_of_dimensions);
+      indexes[point_itr] = MappingIntoSingle(number_of_dimensions,
+                                             number_of_bits, point_vec);
+      continue;
+    }
+
+    coords ^= coords >> number_of_dimensions;
+
+    ll index = 0;
+    ui state = 0;
+    ui b = number_of_dimensionsBits;
+    do {
+      ul digit = (coords >> (b-=number_of_dimensions)) & ndOnes;
+      auto entry = table.transition[(state << number_of_dimensions) | digit];
+      index <<= number_of_dimensions;
+      index |= entry & 0xFF;
+      state = entry >> 8;
+    } while (b);
+    index ^= nthbits >> 1;
+
+    for (ui d = 1; d < number_of_dimensionsBits; d *= 2) {
+      index ^= index >> d;
+    }
+
+    indexes[point_itr] = index;
+  }
+}
+
+/**
+ * @brief Convert a batch of points to their indexes on a Hilbert curve.
+ *        Same result as calling MappingIntoSingle for each point
+ * @param points : number_of_points points, number_of_dimensions
+ *                 coordinates each, one after another
+ * @param indexes : number_of_points indexes are written here
+ */
+void
+HilbertMapper::MappingIntoSingle(ui number_of_dimensions,
+                                  ui number_of_bits,
+                                  const Point* points,
+                                  ul number_of_points,
+                                  ll* indexes) {
+  if(IsBatchMappingSupported(number_of_dimensions, number_of_bits)) {
+    BatchMapping(number_of_dimensions, number_of_bits, points,
+                 number_of_points, indexes);
+    return;
+  }
+
+  std::vector<Point> point_vec(number_of_dimensions);
+  for(ul range(point_itr, 0, number_of_points)) {
+    std::copy(points+point_itr*number_of_dimensions,
+              points+(point_itr+1)*number_of_dimensions, point_vec.begin());
+    indexes[point_itr] = MappingIntoSingle(number_of_dimensions,
+                                           number_of_bits, point_vec);
+  }
+}
+
 /**
  * @brief Convert an index into a Hilbert curve to a set of points.
  * @param number_of_dimensions : number of coordinate axes.
@@ -9,14 +9,38 @@ namespace mapper {
 
 class HilbertMapper {
  public:
+ // bits per coordinate so that an index of every dimension fits in 63 bits,
+ // 20 bits up to 3 dims as before
+ static constexpr ui GetNumberOfBits(ui number_of_dimensions) {
+   return (number_of_dimensions>2) ? ((63/number_of_dimensions < 20) ? 63/number_of_dimensions : 20) : 31;
+ }
+
  static ll MappingIntoSingle(ui number_of_dimensions,
                               ui number_of_bits,
                               std::vector<Point> points);
 
+ static void MappingIntoSingle(ui number_of_dimensions,
+                               ui number_of_bits,
+                               const Point* points,
+                               ul number_of_points,
+                               ll* indexes);
+
  static std::vector<Point> MappingIntoMulti(ui number_of_dimensions,
                                             ui number_of_bits,
                                             ll index);
+
+ // the table driven encoder behind the batched MappingIntoSingle, public so
+ // that tests/hilbert_mapper_test can check it against the original one
+ static bool IsBatchMappingSupported(ui number_of_dimensions,
+                                     ui number_of_bits);
+
+ static void BatchMapping(ui number_of_dimensions,
+                          ui number_of_bits,
+                          const Point* points,
+                          ul number_of_points,
+                          ll* indexes);
  private:
+
   static ll bitTranspose(ui number_of_dimensions, 
                           ui number_of_bits, 
                           ll inCoords);
@@ -6,6 +6,7 @@
 #include "kmeans_macro.h"
 #include "kmeans_mapper.h"
 
+#include <cstring>
 #include <vector>
 
 namespace ursus {
@@ -113,22 +114,22 @@ KmeansMapper::cuda_kmeans(const std::vector<node::Branch> &objects,
     //			numClusterBlocks, numThreadsPerClusterBlock,clusterBlockSharedDataSize);
     if ( numClusterBlocks > 62500 ) {
       for ( int offset = 0; offset < numClusterBlocks; offset += 62500 ) {
-        find_nearest_cluster
-          <<< 62500, numThreadsPerClusterBlock, clusterBlockSharedDataSize >>>
-          (number_of_dims, numObjs, number_of_clusters,
-           deviceObjects, deviceClusters, deviceMembership, deviceIntermediates, offset);
+        LaunchKernelWithSharedMemory(find_nearest_cluster,
+          62500, numThreadsPerClusterBlock, clusterBlockSharedDataSize,
+          number_of_dims, numObjs, number_of_clusters,
+          deviceObjects, deviceClusters, deviceMembership, deviceIntermediates, offset);
       }
     } else {
-      find_nearest_cluster
-        <<< numClusterBlocks, numThreadsPerClusterBlock, clusterBlockSharedDataSize >>>
-        (number_of_dims, numObjs, number_of_clusters,
-         deviceObjects, deviceClusters, deviceMembership, deviceIntermediates, 0);
+      LaunchKernelWithSharedMemory(find_nearest_cluster,
+        numClusterBlocks, numThreadsPerClusterBlock, clusterBlockSharedDataSize,
+        number_of_dims, numObjs, number_of_clusters,
+        deviceObjects, deviceClusters, deviceMembership, deviceIntermediates, 0);
     }
 
     cudaDeviceSynchronize(); 
 
-    compute_delta <<< 1, 1024, 1024 * sizeof(int) >>>
-      (deviceIntermediates, numClusterBlocks, 1024);
+    LaunchKernelWithSharedMemory(compute_delta, 1, 1024, 1024 * sizeof(int),
+      deviceIntermediates, numClusterBlocks, 1024);
     //printf("compute delta executed\n");
     //printf("numReductionThreads=%d, reductionBlockSharedDataSize=%d\n", numReductionThreads, reductionBlockSharedDataSize);
 
@@ -204,6 +205,12 @@ KmeansMapper::cuda_kmeans(const std::vector<node::Branch> &objects,
 bool KmeansMapper::ClusteringBranches(std::vector<node::Branch> &branches, 
                                       const ui number_of_dims){
 
+  // there is no host version of the clustering yet
+  if(!backend::IsDeviceAvailable()) {
+    LOG_INFO("K-means clustering needs a CUDA device, use the Hilbert clustering instead");
+    return false;
+  }
+
   int* clusterIDs = new int[branches.size()]; // cluster id for each data 
 
   std::vector<node::Branch> clusters = cuda_kmeans(branches, number_of_dims, 
@@ -218,7 +225,7 @@ bool KmeansMapper::ClusteringBranches(std::vector<node::Branch> &branches,
       points[dim] = clusters[i].GetPoint(dim);
     }
 
-    ui number_of_bits = (number_of_dims>2) ? 20:31;
+    ui number_of_bits = HilbertMapper::GetNumberOfBits(number_of_dims);
     clusters[i].SetIndex(HilbertMapper::MappingIntoSingle(number_of_dims, number_of_bits, points ));
     clusters[i].SetChildOffset(i); // keep cluters' order
   }
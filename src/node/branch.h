@@ -18,6 +18,9 @@ class Branch {
 
  __both__ Branch(const Branch& branch);
 
+ // memberwise, same as the copy constructor
+ Branch& operator=(const Branch& branch) = default;
+
  //===--------------------------------------------------------------------===//
  // Accessors
  //===--------------------------------------------------------------------===//
@@ -0,0 +1,402 @@
+#include "node/leaf_scanner.h"
+
+#include "common/macro.h"
+
+#include <algorithm>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define LEAF_SCANNER_X86
+#include <immintrin.h>
+#endif
+
+namespace ursus {
+namespace node {
+
+namespace {
+
+typedef ui (*ScanFunction)(const Point*, ui, const Point*, ull*);
+
+/**
+ * @brief pick the widest instruction set supported by this machine
+ */
+ScanFunction GetScanFunction(void) {
+#ifdef LEAF_SCANNER_X86
+  __builtin_cpu_init();
+  if(__builtin_cpu_supports("avx512f")) {
+    return &LeafScanner::ScanAVX512;
+  }
+  if(__builtin_cpu_supports("avx2")) {
+    return &LeafScanner::ScanAVX2;
+  }
+#endif
+  return &LeafScanner::ScanScalar;
+}
+
+const ScanFunction scan_function = GetScanFunction();
+
+// points are scanned with the same instruction set
+ScanFunction GetPointScanFunction(void) {
+  if(scan_function == &LeafScanner::ScanAVX512) {
+    return &LeafScanner::ScanPointsAVX512;
+  }
+  if(scan_function == &LeafScanner::ScanAVX2) {
+    return &LeafScanner::ScanPointsAVX2;
+  }
+  return &LeafScanner::ScanPointsScalar;
+}
+
+const ScanFunction point_scan_function = GetPointScanFunction();
+
+typedef void (*DistanceFunction)(const Point*, ui, const Point*, Point*);
+
+DistanceFunction GetDistanceFunction(void) {
+  if(scan_function == &LeafScanner::ScanAVX512) {
+    return &LeafScanner::DistanceAVX512;
+  }
+  if(scan_function == &LeafScanner::ScanAVX2) {
+    return &LeafScanner::DistanceAVX2;
+  }
+  return &LeafScanner::DistanceScalar;
+}
+
+const DistanceFunction distance_function = GetDistanceFunction();
+
+inline void ClearMask(ull* mask) {
+  for(ui range(word_itr, 0, GetNumberOfMaskWords())) {
+    mask[word_itr] = 0;
+  }
+}
+
+inline ui CountMask(const ull* mask) {
+  ui hit = 0;
+  for(ui range(word_itr, 0, GetNumberOfMaskWords())) {
+    hit += __builtin_popcountll(mask[word_itr]);
+  }
+  return hit;
+}
+
+// same test as Node_SOA::IsOverlap, written with negated compares so that
+// the vector versions can use the unordered predicates and agree on NaNs
+inline void ScanRemainder(const Point* points, ui start_offset, ui branch_count,
+                          const Point* query, ull* mask) {
+  for(ui range(branch_itr, start_offset, branch_count)) {
+    bool overlap = true;
+    for(ui range(lower_boundary, 0, GetNumberOfDims())) {
+      ui upper_boundary = lower_boundary+GetNumberOfDims();
+      if(query[lower_boundary] > points[upper_boundary*GetNumberOfLeafNodeDegrees()+branch_itr] ||
+         query[upper_boundary] < points[lower_boundary*GetNumberOfLeafNodeDegrees()+branch_itr]) {
+        overlap = false;
+        break;
+      }
+    }
+    if(overlap) {
+      mask[branch_itr/64] |= (1ull << (branch_itr%64));
+    }
+  }
+}
+
+// ScanRemainder of branches whose lower and upper boundaries are the point
+inline void ScanPointsRemainder(const Point* points, ui start_offset, ui branch_count,
+                                const Point* query, ull* mask) {
+  for(ui range(branch_itr, start_offset, branch_count)) {
+    bool overlap = true;
+    for(ui range(dim, 0, GetNumberOfDims())) {
+      auto point = points[dim*GetNumberOfLeafNodeDegrees()+branch_itr];
+      if(query[dim] > point || query[dim+GetNumberOfDims()] < point) {
+        overlap = false;
+        break;
+      }
+    }
+    if(overlap) {
+      mask[branch_itr/64] |= (1ull << (branch_itr%64));
+    }
+  }
+}
+
+// squared distance from the point to the box in each dimension is summed in
+// dimension order by all the versions, so that they agree on the results
+inline void DistanceRemainder(const Point* points, ui start_offset, ui branch_count,
+                              const Point* point, Point* distances) {
+  for(ui range(branch_itr, start_offset, branch_count)) {
+    Point distance = 0;
+    for(ui range(dim, 0, GetNumberOfDims())) {
+      auto lower = points[dim*GetNumberOfLeafNodeDegrees()+branch_itr];
+      auto upper = points[(dim+GetNumberOfDims())*GetNumberOfLeafNodeDegrees()+branch_itr];
+      Point gap = std::max(std::max(lower-point[dim], point[dim]-upper), (Point)0);
+      distance += gap*gap;
+    }
+    distances[branch_itr] = distance;
+  }
+}
+
+} // End of anonymous namespace
+
+ui LeafScanner::Scan(const Point* points, ui branch_count,
+                     const Point* query, ull* mask) {
+  return scan_function(points, branch_count, query, mask);
+}
+
+ui LeafScanner::ScanPoints(const Point* points, ui branch_count,
+                           const Point* query, ull* mask) {
+  return point_scan_function(points, branch_count, query, mask);
+}
+
+ui LeafScanner::ScanScalar(const Point* points, ui branch_count,
+                           const Point* query, ull* mask) {
+  ClearMask(mask);
+  ScanRemainder(points, 0, branch_count, query, mask);
+  return CountMask(mask);
+}
+
+ui LeafScanner::ScanPointsScalar(const Point* points, ui branch_count,
+                                 const Point* query, ull* mask) {
+  ClearMask(mask);
+  ScanPointsRemainder(points, 0, branch_count, query, mask);
+  return CountMask(mask);
+}
+
+void LeafScanner::Distance(const Point* points, ui branch_count,
+                           const Point* point, Point* distances) {
+  distance_function(points, branch_count, point, distances);
+}
+
+void LeafScanner::DistanceScalar(const Point* points, ui branch_count,
+                                 const Point* point, Point* distances) {
+  DistanceRemainder(points, 0, branch_count, point, distances);
+}
+
+#ifdef LEAF_SCANNER_X86
+
+__attribute__((target("avx2")))
+ui LeafScanner::ScanAVX2(const Point* points, ui branch_count,
+                         const Point* query, ull* mask) {
+  ClearMask(mask);
+
+  __m256 query_lower[GetNumberOfDims()];
+  __m256 query_upper[GetNumberOfDims()];
+  for(ui range(dim, 0, GetNumberOfDims())) {
+    query_lower[dim] = _mm256_set1_ps(query[dim]);
+    query_upper[dim] = _mm256_set1_ps(query[dim+GetNumberOfDims()]);
+  }
+
+  // 8 branches at a time
+  ui branch_itr = 0;
+  for(; branch_itr+8 <= branch_count; branch_itr+=8) {
+    __m256 overlap = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+
+    for(ui range(dim, 0, GetNumberOfDims())) {
+      __m256 lower = _mm256_loadu_ps(&points[dim*GetNumberOfLeafNodeDegrees()+branch_itr]);
+      __m256 upper = _mm256_loadu_ps(&points[(dim+GetNumberOfDims())*GetNumberOfLeafNodeDegrees()+branch_itr]);
+
+      overlap = _mm256_and_ps(overlap, _mm256_cmp_ps(query_lower[dim], upper, _CMP_NGT_UQ));
+      overlap = _mm256_and_ps(overlap, _mm256_cmp_ps(query_upper[dim], lower, _CMP_NLT_UQ));
+    }
+
+    ull bits = (ull)_mm256_movemask_ps(overlap);
+    mask[branch_itr/64] |= (bits << (branch_itr%64));
+  }
+
+  ScanRemainder(points, branch_itr, branch_count, query, mask);
+  return CountMask(mask);
+}
+
+__attribute__((target("avx512f")))
+ui LeafScanner::ScanAVX512(const Point* points, ui branch_count,
+                           const Point* query, ull* mask) {
+  ClearMask(mask);
+
+  __m512 query_lower[GetNumberOfDims()];
+  __m512 query_upper[GetNumberOfDims()];
+  for(ui range(dim, 0, GetNumberOfDims())) {
+    query_lower[dim] = _mm512_set1_ps(query[dim]);
+    query_upper[dim] = _mm512_set1_ps(query[dim+GetNumberOfDims()]);
+  }
+
+  // 16 branches at a time
+  ui branch_itr = 0;
+  for(; branch_itr+16 <= branch_count; branch_itr+=16) {
+    __mmask16 overlap = 0xFFFF;
+
+    for(ui range(dim, 0, GetNumberOfDims())) {
+      __m512 lower = _mm512_loadu_ps(&points[dim*GetNumberOfLeafNodeDegrees()+branch_itr]);
+      __m512 upper = _mm512_loadu_ps(&points[(dim+GetNumberOfDims())*GetNumberOfLeafNodeDegrees()+branch_itr]);
+
+      overlap = _mm512_mask_cmp_ps_mask(overlap, query_lower[dim], upper, _CMP_NGT_UQ);
+      overlap = _mm512_mask_cmp_ps_mask(overlap, query_upper[dim], lower, _CMP_NLT_UQ);
+    }
+
+    ull bits = (ull)overlap;
+    mask[branch_itr/64] |= (bits << (branch_itr%64));
+  }
+
+  ScanRemainder(points, branch_itr, branch_count, query, mask);
+  return CountMask(mask);
+}
+
+__attribute__((target("avx2")))
+ui LeafScanner::ScanPointsAVX2(const Point* points, ui branch_count,
+                               const Point* query, ull* mask) {
+  ClearMask(mask);
+
+  __m256 query_lower[GetNumberOfDims()];
+  __m256 query_upper[GetNumberOfDims()];
+  for(ui range(dim, 0, GetNumberOfDims())) {
+    query_lower[dim] = _mm256_set1_ps(query[dim]);
+    query_upper[dim] = _mm256_set1_ps(query[dim+GetNumberOfDims()]);
+  }
+
+  // 8 points at a time, one load per dimension
+  ui branch_itr = 0;
+  for(; branch_itr+8 <= branch_count; branch_itr+=8) {
+    __m256 overlap = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+
+    for(ui range(dim, 0, GetNumberOfDims())) {
+      __m256 point = _mm256_loadu_ps(&points[dim*GetNumberOfLeafNodeDegrees()+branch_itr]);
+
+      overlap = _mm256_and_ps(overlap, _mm256_cmp_ps(query_lower[dim], point, _CMP_NGT_UQ));
+      overlap = _mm256_and_ps(overlap, _mm256_cmp_ps(query_upper[dim], point, _CMP_NLT_UQ));
+    }
+
+    ull bits = (ull)_mm256_movemask_ps(overlap);
+    mask[branch_itr/64] |= (bits << (branch_itr%64));
+  }
+
+  ScanPointsRemainder(points, branch_itr, branch_count, query, mask);
+  return CountMask(mask);
+}
+
+__attribute__((target("avx512f")))
+ui LeafScanner::ScanPointsAVX512(const Point* points, ui branch_count,
+                                 const Point* query, ull* mask) {
+  ClearMask(mask);
+
+  __m512 query_lower[GetNumberOfDims()];
+  __m512 query_upper[GetNumberOfDims()];
+  for(ui range(dim, 0, GetNumberOfDims())) {
+    query_lower[dim] = _mm512_set1_ps(query[dim]);
+    query_upper[dim] = _mm512_set1_ps(query[dim+GetNumberOfDims()]);
+  }
+
+  // 16 points at a time, one load per dimension
+  ui branch_itr = 0;
+  for(; branch_itr+16 <= branch_count; branch_itr+=16) {
+    __mmask16 overlap = 0xFFFF;
+
+    for(ui range(dim, 0, GetNumberOfDims())) {
+      __m512 point = _mm512_loadu_ps(&points[dim*GetNumberOfLeafNodeDegrees()+branch_itr]);
+
+      overlap = _mm512_mask_cmp_ps_mask(overlap, query_lower[dim], point, _CMP_NGT_UQ);
+      overlap = _mm512_mask_cmp_ps_mask(overlap, query_upper[dim], point, _CMP_NLT_UQ);
+    }
+
+    ull bits = (ull)overlap;
+    mask[branch_itr/64] |= (bits << (branch_itr%64));
+  }
+
+  ScanPointsRemainder(points, branch_itr, branch_count, query, mask);
+  return CountMask(mask);
+}
+
+__attribute__((target("avx2")))
+void LeafScanner::DistanceAVX2(const Point* points, ui branch_count,
+                               const Point* point, Point* distances) {
+  __m256 query_point[GetNumberOfDims()];
+  for(ui range(dim, 0, GetNumberOfDims())) {
+    query_point[dim] = _mm256_set1_ps(point[dim]);
+  }
+  const __m256 zero = _mm256_setzero_ps();
+
+  // 8 branches at a time
+  ui branch_itr = 0;
+  for(; branch_itr+8 <= branch_count; branch_itr+=8) {
+    __m256 distance = zero;
+
+    for(ui range(dim, 0, GetNumberOfDims())) {
+      __m256 lower = _mm256_loadu_ps(&points[dim*GetNumberOfLeafNodeDegrees()+branch_itr]);
+      __m256 upper = _mm256_loadu_ps(&points[(dim+GetNumberOfDims())*GetNumberOfLeafNodeDegrees()+branch_itr]);
+
+      __m256 gap = _mm256_max_ps(_mm256_max_ps(_mm256_sub_ps(lower, query_point[dim]),
+                                               _mm256_sub_ps(query_point[dim], upper)), zero);
+      distance = _mm256_add_ps(distance, _mm256_mul_ps(gap, gap));
+    }
+
+    _mm256_storeu_ps(&distances[branch_itr], distance);
+  }
+
+  DistanceRemainder(points, branch_itr, branch_count, point, distances);
+}
+
+__attribute__((target("avx512f")))
+void LeafScanner::DistanceAVX512(const Point* points, ui branch_count,
+                                 const Point* point, Point* distances) {
+  __m512 query_point[GetNumberOfDims()];
+  for(ui range(dim, 0, GetNumberOfDims())) {
+    query_point[dim] = _mm512_set1_ps(point[dim]);
+  }
+  const __m512 zero = _mm512_setzero_ps();
+
+  // 16 branches at a time
+  ui branch_itr = 0;
+  for(; branch_itr+16 <= branch_count; branch_itr+=16) {
+    __m512 distance = zero;
+
+    for(ui range(dim, 0, GetNumberOfDims())) {
+      __m512 lower = _mm512_loadu_ps(&points[dim*GetNumberOfLeafNodeDegrees()+branch_itr]);
+      __m512 upper = _mm512_loadu_ps(&points[(dim+GetNumberOfDims())*GetNumberOfLeafNodeDegrees()+branch_itr]);
+
+      __m512 gap = _mm512_max_ps(_mm512_max_ps(_mm512_sub_ps(lower, query_point[dim]),
+                                               _mm512_sub_ps(query_point[dim], upper)), zero);
+      distance = _mm512_add_ps(distance, _mm512_mul_ps(gap, gap));
+    }
+
+    _mm512_storeu_ps(&distances[branch_itr], distance);
+  }
+
+  DistanceRemainder(points, branch_itr, branch_count, point, distances);
+}
+
+#else
+
+ui LeafScanner::ScanAVX2(const Point* points, ui branch_count,
+                         const Point* query, ull* mask) {
+  return ScanScalar(points, branch_count, query, mask);
+}
+
+ui LeafScanner::ScanAVX512(const Point* points, ui branch_count,
+                           const Point* query, ull* mask) {
+  return ScanScalar(points, branch_count, query, mask);
+}
+
+ui LeafScanner::ScanPointsAVX2(const Point* points, ui branch_count,
+                               const Point* query, ull* mask) {
+  return ScanPointsScalar(points, branch_count, query, mask);
+}
+
+ui LeafScanner::ScanPointsAVX512(const Point* points, ui branch_count,
+                                 const Point* query, ull* mask) {
+  return ScanPointsScalar(points, branch_count, query, mask);
+}
+
+void LeafScanner::DistanceAVX2(const Point* points, ui branch_count,
+                               const Point* point, Point* distances) {
+  DistanceScalar(points, branch_count, point, distances);
+}
+
+void LeafScanner::DistanceAVX512(const Point* points, ui branch_count,
+                                 const Point* point, Point* distances) {
+  DistanceScalar(points, branch_count, point, distances);
+}
+
+#endif
+
+std::string LeafScanner::GetISAName(void) {
+  if(scan_function == &LeafScanner::ScanAVX512) {
+    return "AVX-512";
+  } else if(scan_function == &LeafScanner::ScanAVX2) {
+    return "AVX2";
+  }
+  return "SCALAR";
+}
+
+} // End of node namespace
+} // End of ursus namespace
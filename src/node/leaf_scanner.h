@@ -0,0 +1,90 @@
+#pragma once
+
+#include "common/config.h"
+#include "common/types.h"
+
+#include <string>
+
+namespace ursus {
+namespace node {
+
+// # of 64-bit words to hold one bit per branch of a node
+constexpr ui GetNumberOfMaskWords() { return (GetNumberOfLeafNodeDegrees()+63)/64; }
+
+//===--------------------------------------------------------------------===//
+// Leaf Scanner
+//===--------------------------------------------------------------------===//
+// Tests all the branches of a node in SOA fashion against a query on the CPU
+// using packed float compares. Instruction set is chosen at runtime, AVX-512
+// first, then AVX2, otherwise a scalar loop
+class LeafScanner {
+ public:
+ //===--------------------------------------------------------------------===//
+ // Consteructor/Destructor
+ //===--------------------------------------------------------------------===//
+  LeafScanner(const LeafScanner &) = delete;
+  LeafScanner &operator=(const LeafScanner &) = delete;
+  LeafScanner(LeafScanner &&) = delete;
+  LeafScanner &operator=(LeafScanner &&) = delete;
+
+ //===--------------------------------------------------------------------===//
+ // Scan Function
+ //===--------------------------------------------------------------------===//
+  /**
+   * points are laid out as points[dim*GetNumberOfLeafNodeDegrees()+branch].
+   * i-th bit of mask is set if i-th branch overlaps the query,
+   * returns number of overlapping branches
+   */
+  static ui Scan(const Point* points, ui branch_count,
+                 const Point* query, ull* mask);
+
+  static ui ScanScalar(const Point* points, ui branch_count,
+                       const Point* query, ull* mask);
+
+  static ui ScanAVX2(const Point* points, ui branch_count,
+                     const Point* query, ull* mask);
+
+  static ui ScanAVX512(const Point* points, ui branch_count,
+                       const Point* query, ull* mask);
+
+  /**
+   * same as Scan for branches that are points, laid out as
+   * points[dim*GetNumberOfLeafNodeDegrees()+branch], tests containment
+   */
+  static ui ScanPoints(const Point* points, ui branch_count,
+                       const Point* query, ull* mask);
+
+  static ui ScanPointsScalar(const Point* points, ui branch_count,
+                             const Point* query, ull* mask);
+
+  static ui ScanPointsAVX2(const Point* points, ui branch_count,
+                           const Point* query, ull* mask);
+
+  static ui ScanPointsAVX512(const Point* points, ui branch_count,
+                             const Point* query, ull* mask);
+
+  /**
+   * squared MINDIST from the point to each branch laid out as in Scan,
+   * distances must have room for branch_count values
+   */
+  static void Distance(const Point* points, ui branch_count,
+                       const Point* point, Point* distances);
+
+  static void DistanceScalar(const Point* points, ui branch_count,
+                             const Point* point, Point* distances);
+
+  static void DistanceAVX2(const Point* points, ui branch_count,
+                           const Point* point, Point* distances);
+
+  static void DistanceAVX512(const Point* points, ui branch_count,
+                             const Point* point, Point* distances);
+
+  // name of the instruction set used by Scan
+  static std::string GetISAName(void);
+
+ private:
+  LeafScanner() {};
+};
+
+} // End of node namespace
+} // End of ursus namespace
@@ -3,6 +3,7 @@
 #include "common/macro.h"
 #include "node/branch.h"
 
+#include <algorithm>
 #include <cassert>
 
 namespace ursus {
@@ -182,6 +183,19 @@ bool Node::IsOverlap(ui branch_offset, ui branch_offset2) {
   return true;
 }
 
+// summed in dimension order as LeafScanner::Distance does
+Point Node::GetDistance(Point* point, ui branch_offset) const {
+  Point distance = 0;
+  for(ui range(lower_boundary, 0, GetNumberOfDims())) {
+    ui upper_boundary = lower_boundary+GetNumberOfDims();
+    Point gap = std::max(std::max(branches[branch_offset].GetPoint(lower_boundary)-point[lower_boundary],
+                                  point[lower_boundary]-branches[branch_offset].GetPoint(upper_boundary)),
+                         (Point)0);
+    distance += gap*gap;
+  }
+  return distance;
+}
+
 // Get a string representation
 std::ostream &operator<<(std::ostream &os, const Node &node) {
   os << " Node : " << std::endl;
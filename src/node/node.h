@@ -36,6 +36,9 @@ class Node {
  bool IsOverlap(Point* query, ui branch_offset);
  bool IsOverlap(ui branch_offset, ui branch_offset2);
 
+ // squared MINDIST from the point to the branch
+ Point GetDistance(Point* point, ui branch_offset) const;
+
   // Get a string representation for debugging
   friend std::ostream &operator<<(std::ostream &os, const Node &node);
  //===--------------------------------------------------------------------===//
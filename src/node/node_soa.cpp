@@ -1,5 +1,6 @@
 #include "common/macro.h"
 #include "node/node_soa.h"
+#include "node/leaf_scanner.h"
 
 #include <cassert>
 #include <iomanip>
@@ -112,6 +113,27 @@ bool Node_SOA::IsOverlap(Point* query, ui child_offset) {
   return true; 
 }
 
+/**
+ * @brief test all the branches with the query on the CPU using packed compares
+ * @param query
+ * @param overlap bitmask, i-th bit is set if i-th branch overlaps the query,
+ *        it must have room for GetNumberOfMaskWords() words
+ * @return number of branches overlapping the query
+ */
+ui Node_SOA::ScanOverlap(Point* query, ull* overlap) const {
+  return LeafScanner::Scan(points, branch_count, query, overlap);
+}
+
+/**
+ * @brief squared MINDIST from the point to all the branches on the CPU using
+ *        packed arithmetic
+ * @param point
+ * @param distances it must have room for the branches
+ */
+void Node_SOA::GetDistances(Point* point, Point* distances) const {
+  LeafScanner::Distance(points, branch_count, point, distances);
+}
+
 // Get a string representation
 std::ostream &operator<<(std::ostream &os, const Node_SOA &node_soa) {
   os << std::fixed << std::setprecision(6);
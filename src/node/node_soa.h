@@ -34,6 +34,11 @@ class Node_SOA{
 
  __both__  bool IsOverlap(Point* query, ui child_offset);
 
+ ui ScanOverlap(Point* query, ull* overlap) const;
+
+ // squared MINDIST from the point to every branch
+ void GetDistances(Point* point, Point* distances) const;
+
  friend std::ostream &operator<<(std::ostream &os, const Node_SOA &node_soa);
  //===--------------------------------------------------------------------===//
  // Members
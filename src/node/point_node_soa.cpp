@@ -0,0 +1,78 @@
+#include "common/macro.h"
+#include "node/point_node_soa.h"
+#include "node/leaf_scanner.h"
+
+#include <algorithm>
+#include <cassert>
+
+namespace ursus {
+namespace node {
+
+__both__
+ui PointNode_SOA::GetBranchCount(void) const {
+  return branch_count;
+}
+
+__both__
+ll PointNode_SOA::GetIndex(ui offset) const {
+  assert(offset < branch_count);
+  return first_index+offset;
+}
+
+Point PointNode_SOA::GetBranchPoint(ui branch_offset, ui dim) const {
+  assert(branch_offset < branch_count && dim < GetNumberOfDims());
+  return points[dim*GetNumberOfLeafNodeDegrees()+branch_offset];
+}
+
+bool PointNode_SOA::Encode(Node_SOA* node_soa) {
+  branch_count = node_soa->GetBranchCount();
+  first_index = node_soa->GetIndex(0);
+
+  for(ui range(branch_itr, 0, branch_count)) {
+    if(node_soa->GetIndex(branch_itr) != first_index+branch_itr) {
+      return false;
+    }
+    for(ui range(dim, 0, GetNumberOfDims())) {
+      auto lower = node_soa->GetBranchPoint(branch_itr, dim);
+      auto upper = node_soa->GetBranchPoint(branch_itr, dim+GetNumberOfDims());
+      // NaNs never compare equal, such boxes are kept as they are
+      if(lower != upper) {
+        return false;
+      }
+      points[dim*GetNumberOfLeafNodeDegrees()+branch_itr] = lower;
+    }
+  }
+
+  return true;
+}
+
+__both__
+bool PointNode_SOA::IsOverlap(Point* query, ui branch_offset) const {
+  for(ui range(dim, 0, GetNumberOfDims())) {
+    auto point = points[dim*GetNumberOfLeafNodeDegrees()+branch_offset];
+    if(query[dim] > point || query[dim+GetNumberOfDims()] < point) {
+      return false;
+    }
+  }
+  return true;
+}
+
+ui PointNode_SOA::ScanOverlap(Point* query, ull* overlap) const {
+  return LeafScanner::ScanPoints(points, branch_count, query, overlap);
+}
+
+void PointNode_SOA::GetDistances(Point* point, Point* distances) const {
+  for(ui range(branch_itr, 0, branch_count)) {
+    Point distance = 0;
+    for(ui range(dim, 0, GetNumberOfDims())) {
+      // same arithmetic as LeafScanner::Distance on the box of the point
+      auto branch_point = points[dim*GetNumberOfLeafNodeDegrees()+branch_itr];
+      Point gap = std::max(std::max(branch_point-point[dim], point[dim]-branch_point), (Point)0);
+      distance += gap*gap;
+    }
+    distances[branch_itr] = distance;
+  }
+}
+
+} // End of node namespace
+} // End of ursus namespace
@@ -0,0 +1,66 @@
+#pragma once
+
+#include "common/config.h"
+#include "common/types.h"
+#include "node/node_soa.h"
+
+namespace ursus {
+namespace node {
+
+//===--------------------------------------------------------------------===//
+// Point Node_SOA
+//===--------------------------------------------------------------------===//
+// Layout of a leaf node whose branches are points(lower == upper), kept in
+// place of the leaf Node_SOA of the Hybrid tree. The MPHR tree can't use it,
+// its restart scan leaves a leaf node through its first child offset, which
+// isn't kept here. One coordinate per dimension in SOA fashion and
+// the indexes as an implicit run from the first one. The leaf scan tests
+// containment in the query, half the loads of the box test, and the node is
+// less than a third of a Node_SOA
+class PointNode_SOA{
+ public:
+ //===--------------------------------------------------------------------===//
+ // Accessor
+ //===--------------------------------------------------------------------===//
+
+  __both__ ui GetBranchCount(void) const;
+  __both__ ll GetIndex(ui offset) const;
+  Point GetBranchPoint(ui branch_offset, ui dim) const;
+
+  /**
+   * copy the leaf node, false if a branch isn't a point or its indexes are
+   * not a run
+   */
+  bool Encode(Node_SOA* node_soa);
+
+  /**
+   * test a point with the query, as Node_SOA::IsOverlap tests the box of
+   * the point
+   */
+  __both__ bool IsOverlap(Point* query, ui branch_offset) const;
+
+  /**
+   * test all the points with the query on the CPU using packed compares,
+   * overlap must have room for GetNumberOfMaskWords() words
+   * @return number of points in the query
+   */
+  ui ScanOverlap(Point* query, ull* overlap) const;
+
+  // squared distance from the point to every branch
+  void GetDistances(Point* point, Point* distances) const;
+
+ private:
+ //===--------------------------------------------------------------------===//
+ // Members
+ //===--------------------------------------------------------------------===//
+  // points[dim*GetNumberOfLeafNodeDegrees()+branch]
+  Point points[GetNumberOfDims()*GetNumberOfLeafNodeDegrees()];
+
+  // index of the first branch, the others follow it
+  ll first_index;
+
+  ui branch_count;
+};
+
+} // End of node namespace
+} // End of ursus namespace
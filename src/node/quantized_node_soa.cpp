@@ -0,0 +1,183 @@
+#include "common/macro.h"
+#include "node/quantized_node_soa.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <limits>
+
+namespace ursus {
+namespace node {
+
+__both__
+ui QuantizedNode_SOA::GetBranchCount(void) const {
+  return branch_count;
+}
+
+__both__
+ll QuantizedNode_SOA::GetIndex(ui offset) const {
+  assert(offset < branch_count);
+  return first_index+offset;
+}
+
+__both__
+LeafCode QuantizedNode_SOA::GetCode(Point point, ui dim, LeafCode nan_code) const {
+  if(point != point) {
+    return nan_code;
+  }
+  // a flat node has a single cell
+  if(!scale[dim]) {
+    return 0;
+  }
+
+  // subtraction, multiplication and truncation never reverse the order of
+  // two points, so neither do the cells
+  Point cell = (point-base[dim])*scale[dim];
+  if(cell < 1) {
+    return 0;
+  }
+  if(cell >= GetMaxLeafCode()) {
+    return GetMaxLeafCode();
+  }
+  return (LeafCode)cell;
+}
+
+__both__
+const Point* QuantizedNode_SOA::GetDataPoint(ui branch_offset, const Point* points,
+                                             const ui* data_offsets) const {
+  // indexes are positions in the leaf level from 1
+  return &points[(ul)data_offsets[first_index-1+branch_offset]*GetNumberOfDims()];
+}
+
+bool QuantizedNode_SOA::Encode(Node_SOA* node_soa) {
+  branch_count = node_soa->GetBranchCount();
+  first_index = node_soa->GetIndex(0);
+
+  for(ui range(branch_itr, 1, branch_count)) {
+    if(node_soa->GetIndex(branch_itr) != first_index+branch_itr) {
+      return false;
+    }
+  }
+
+  for(ui range(dim, 0, GetNumberOfDims())) {
+    Point lower = std::numeric_limits<Point>::infinity();
+    Point upper = -std::numeric_limits<Point>::infinity();
+    for(ui range(branch_itr, 0, branch_count)) {
+      lower = std::min(lower, node_soa->GetBranchPoint(branch_itr, dim));
+      upper = std::max(upper, node_soa->GetBranchPoint(branch_itr, dim+GetNumberOfDims()));
+    }
+
+    // nodes of no finite extent have a single cell
+    base[dim] = std::isfinite(lower) ? lower : 0;
+    scale[dim] = GetMaxLeafCode()/(upper-lower);
+    if(!std::isfinite(scale[dim]) || !std::isfinite(lower) || scale[dim] <= 0) {
+      scale[dim] = 0;
+    }
+  }
+
+  std::fill(nan_mask, nan_mask+GetNumberOfMaskWords(), 0);
+  for(ui range(dim, 0, GetNumberOfDims())) {
+    ui upper_dim = dim+GetNumberOfDims();
+    for(ui range(branch_itr, 0, branch_count)) {
+      auto lower = node_soa->GetBranchPoint(branch_itr, dim);
+      auto upper = node_soa->GetBranchPoint(branch_itr, upper_dim);
+      points[dim*GetNumberOfLeafNodeDegrees()+branch_itr] = GetCode(lower, dim, 0);
+      points[upper_dim*GetNumberOfLeafNodeDegrees()+branch_itr] = GetCode(upper, dim, GetMaxLeafCode());
+      if(lower != lower || upper != upper) {
+        nan_mask[branch_itr/64] |= (1ull << (branch_itr%64));
+      }
+    }
+  }
+
+  return true;
+}
+
+/**
+ * @brief a branch is out if the query ends in a cell before it starts or
+ *        starts in a cell after it ends, it's in if the query strictly
+ *        covers its cells, and it's tested on its data point otherwise, as
+ *        Node_SOA::IsOverlap tests the box of the point
+ */
+__both__
+bool QuantizedNode_SOA::IsOverlap(Point* query, ui branch_offset,
+                                  const Point* points, const ui* data_offsets) const {
+  bool exact = (nan_mask[branch_offset/64] >> (branch_offset%64)) & 1;
+
+  for(ui range(dim, 0, GetNumberOfDims())) {
+    LeafCode query_lower = GetCode(query[dim], dim, 0);
+    LeafCode query_upper = GetCode(query[dim+GetNumberOfDims()], dim, GetMaxLeafCode());
+    LeafCode lower = this->points[dim*GetNumberOfLeafNodeDegrees()+branch_offset];
+    LeafCode upper = this->points[(dim+GetNumberOfDims())*GetNumberOfLeafNodeDegrees()+branch_offset];
+
+    // NaN bounds have the outermost cells, they are never out on cells
+    if(upper < query_lower || lower > query_upper) {
+      return false;
+    }
+    exact |= (upper == query_lower) || (lower == query_upper);
+  }
+
+  if(!exact) {
+    return true;
+  }
+
+  auto point = GetDataPoint(branch_offset, points, data_offsets);
+  for(ui range(dim, 0, GetNumberOfDims())) {
+    if(query[dim] > point[dim] || query[dim+GetNumberOfDims()] < point[dim]) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/**
+ * @brief same test as IsOverlap on all the branches at once, the cells in a
+ *        row per dimension
+ */
+ui QuantizedNode_SOA::ScanOverlap(Point* query, const Point* points, const ui* data_offsets,
+                                  ull* overlap) const {
+  unsigned char candidate[GetNumberOfLeafNodeDegrees()];
+  unsigned char boundary[GetNumberOfLeafNodeDegrees()];
+  std::fill(candidate, candidate+branch_count, 1);
+  std::fill(boundary, boundary+branch_count, 0);
+
+  for(ui range(dim, 0, GetNumberOfDims())) {
+    LeafCode query_lower = GetCode(query[dim], dim, 0);
+    LeafCode query_upper = GetCode(query[dim+GetNumberOfDims()], dim, GetMaxLeafCode());
+    auto lowers = &this->points[dim*GetNumberOfLeafNodeDegrees()];
+    auto uppers = &this->points[(dim+GetNumberOfDims())*GetNumberOfLeafNodeDegrees()];
+
+    for(ui range(branch_itr, 0, branch_count)) {
+      candidate[branch_itr] &= (uppers[branch_itr] >= query_lower) & (lowers[branch_itr] <= query_upper);
+      boundary[branch_itr] |= (uppers[branch_itr] == query_lower) | (lowers[branch_itr] == query_upper);
+    }
+  }
+
+  std::fill(overlap, overlap+GetNumberOfMaskWords(), 0);
+  ui hit = 0;
+  for(ui range(branch_itr, 0, branch_count)) {
+    bool nan_bound = (nan_mask[branch_itr/64] >> (branch_itr%64)) & 1;
+    if(candidate[branch_itr] &&
+       ((!boundary[branch_itr] && !nan_bound) || IsOverlap(query, branch_itr, points, data_offsets))) {
+      overlap[branch_itr/64] |= (1ull << (branch_itr%64));
+      hit++;
+    }
+  }
+  return hit;
+}
+
+void QuantizedNode_SOA::GetDistances(Point* point, const Point* points, const ui* data_offsets,
+                                     Point* distances) const {
+  for(ui range(branch_itr, 0, branch_count)) {
+    auto data_point = GetDataPoint(branch_itr, points, data_offsets);
+    Point distance = 0;
+    for(ui range(dim, 0, GetNumberOfDims())) {
+      // same arithmetic as LeafScanner::Distance on the box of the point
+      Point gap = std::max(std::max(data_point[dim]-point[dim], point[dim]-data_point[dim]), (Point)0);
+      distance += gap*gap;
+    }
+    distances[branch_itr] = distance;
+  }
+}
+
+} // End of node namespace
+} // End of ursus namespace
@@ -0,0 +1,100 @@
+#pragma once
+
+#include "common/config.h"
+#include "common/types.h"
+#include "node/leaf_scanner.h"
+#include "node/node_soa.h"
+
+#include <cstdint>
+
+namespace ursus {
+namespace node {
+
+#if URSUS_LEAF_CODE_BITS == 8
+typedef uint8_t LeafCode;
+#else
+typedef uint16_t LeafCode;
+#endif
+
+__both__ constexpr ui GetMaxLeafCode() { return (1u << (8*sizeof(LeafCode)))-1; }
+
+//===--------------------------------------------------------------------===//
+// Quantized Node_SOA
+//===--------------------------------------------------------------------===//
+// Compact layout of a leaf node, kept in place of the leaf Node_SOA. Each
+// coordinate is stored as the cell of the node MBB it falls in, in the same
+// SOA layout, and the indexes are an implicit run from the first one, which
+// is what leaves of packed branches hold. With 16-bit cells it is about a
+// third of a Node_SOA, but the boundary test below also needs a 4-byte data
+// offset per branch and, on the GPU, a copy of the data points, so a 3d
+// branch takes 16 bytes on the CPU and 28 on the GPU against 40.
+// Coordinates and queries are mapped to cells by the same monotone function,
+// so a branch overlapping the query overlaps it in cells too. Branches
+// sharing a boundary cell with the query, and branches with a NaN bound, are
+// tested on their data points, found through data_offsets, the offset in
+// the data set of the branch at each position of the leaf level
+class QuantizedNode_SOA{
+ public:
+ //===--------------------------------------------------------------------===//
+ // Accessor
+ //===--------------------------------------------------------------------===//
+
+  __both__ ui GetBranchCount(void) const;
+  __both__ ll GetIndex(ui offset) const;
+
+  /**
+   * quantize the leaf node, false if its indexes are not a run
+   */
+  bool Encode(Node_SOA* node_soa);
+
+  /**
+   * test a branch with the query on its cells, and on its data point if
+   * that doesn't tell
+   */
+  __both__ bool IsOverlap(Point* query, ui branch_offset,
+                          const Point* points, const ui* data_offsets) const;
+
+  /**
+   * test all the branches with the query on their cells, the ones it
+   * doesn't tell on their data points. overlap must have room for
+   * GetNumberOfMaskWords() words
+   * @return number of branches overlapping the query
+   */
+  ui ScanOverlap(Point* query, const Point* points, const ui* data_offsets,
+                 ull* overlap) const;
+
+  // squared distance from the point to the data point of every branch
+  void GetDistances(Point* point, const Point* points, const ui* data_offsets,
+                    Point* distances) const;
+
+ private:
+  // cell of the point in dim, nan_code for NaN which never bounds the
+  // overlap test
+  __both__ LeafCode GetCode(Point point, ui dim, LeafCode nan_code) const;
+
+  // data point of the branch in the data set
+  __both__ const Point* GetDataPoint(ui branch_offset, const Point* points,
+                                     const ui* data_offsets) const;
+
+ //===--------------------------------------------------------------------===//
+ // Members
+ //===--------------------------------------------------------------------===//
+  // lower corner of the node MBB and cells per unit in each dimension
+  Point base[GetNumberOfDims()];
+  Point scale[GetNumberOfDims()];
+
+  // cells of the branches, points[dim*GetNumberOfLeafNodeDegrees()+branch]
+  LeafCode points[GetNumberOfDims()*2*GetNumberOfLeafNodeDegrees()];
+
+  // i-th bit is set if i-th branch has a NaN bound, it's always tested on
+  // its data point
+  ull nan_mask[GetNumberOfMaskWords()];
+
+  // index of the first branch, the others follow it
+  ll first_index;
+
+  ui branch_count;
+};
+
+} // End of node namespace
+} // End of ursus namespace
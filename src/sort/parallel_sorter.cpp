@@ -1,51 +1,37 @@
 #include "sort/parallel_sorter.h"
 
 #include "common/logger.h"
+#include "common/thread_pool.h"
 #include "evaluator/recorder.h"
 
 #include <algorithm>  
-#include <thread>
-#include <functional>
 #include "tbb/parallel_sort.h"
 
 namespace ursus {
 namespace sort {
 
 void Thread_Assign(std::vector<node::Branch> &branches, 
-                   ui tid, ui number_of_threads) {
+                   ui start_offset, ui end_offset) {
 
-  for(ui offset = tid; offset < branches.size() ; offset+=number_of_threads) {
+  for(ui offset = start_offset; offset < end_offset; offset++) {
     branches[offset].SetIndex(offset+1);
   }
 }
 
 bool Parallel_Sorter::Sort(std::vector<node::Branch> &branches) {
 
-  auto& recorder = evaluator::Recorder::GetInstance();
-  recorder.TimeRecordStart();
+  evaluator::TimeScope time_scope(STAGE_TYPE_SORT);
 
   tbb::parallel_sort(branches.begin(), branches.end());
 
-  const size_t number_of_threads = std::thread::hardware_concurrency();
-
-  // parallel for loop using c++ std 11 
-  {
-    std::vector<std::thread> threads;
-
-    //Launch a group of threads
-    for (ui thread_itr = 0; thread_itr<number_of_threads; thread_itr++){
-      threads.push_back(std::thread(Thread_Assign, std::ref(branches), thread_itr, number_of_threads));
-    }
-
-    //Join the threads with the main thread
-    for(auto &thread : threads){
-      thread.join();
-    }
-  }
+  auto& thread_pool = ThreadPool::GetInstance();
+  thread_pool.ParallelFor(0, branches.size(), [&](ul start_offset, ul end_offset) {
+    Thread_Assign(branches, start_offset, end_offset);
+  });
 
   // print out sorting time on the CPU
-  auto elapsed_time = recorder.TimeRecordEnd();
-  LOG_INFO("Sort Time on CPU (%zu threads) = %.6fs", number_of_threads, elapsed_time/1000.0f);
+  auto elapsed_time = time_scope.End();
+  LOG_INFO("Sort Time on CPU (%u threads) = %.6fs", thread_pool.GetNumberOfThreads(), elapsed_time/1000.0f);
 
   return true;
 }
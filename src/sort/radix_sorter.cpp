@@ -0,0 +1,201 @@
+#include "sort/radix_sorter.h"
+
+#include "common/logger.h"
+#include "common/macro.h"
+#include "common/thread_pool.h"
+#include "evaluator/recorder.h"
+
+#include <algorithm>
+#include <cassert>
+#include <climits>
+
+namespace ursus {
+namespace sort {
+
+// flip the sign bit so that signed indexes keep their order as unsigned keys
+inline ull GetRadixKey(const node::Branch& branch) {
+  return ((ull)branch.GetIndex())^(1ull<<63);
+}
+
+inline ui GetDigit(ull key, ui pass) {
+  return (key >> (pass*GetNumberOfRadixBits())) & (GetNumberOfRadixBuckets()-1);
+}
+
+// fill keys and positions, and count the digits of every pass at once since
+// the digits don't depend on the order of the keys
+void Thread_ExtractKeys(std::vector<node::Branch> &branches,
+                        std::vector<ull> &keys, std::vector<ui> &positions,
+                        std::vector<ui> &histogram,
+                        ui start_offset, ui end_offset) {
+  for(ui range(offset, start_offset, end_offset)) {
+    auto key = GetRadixKey(branches[offset]);
+    keys[offset] = key;
+    positions[offset] = offset;
+
+    for(ui range(pass, 0, GetNumberOfRadixPasses())) {
+      histogram[pass*GetNumberOfRadixBuckets()+GetDigit(key, pass)]++;
+    }
+  }
+}
+
+void Thread_CountDigits(std::vector<ull> &keys, ui pass, ui* histogram,
+                        ui start_offset, ui end_offset) {
+  for(ui range(offset, start_offset, end_offset)) {
+    histogram[GetDigit(keys[offset], pass)]++;
+  }
+}
+
+// histogram holds the first destination of each digit of this chunk
+void Thread_ScatterKeys(std::vector<ull> &keys, std::vector<ui> &positions,
+                        std::vector<ull> &sorted_keys, std::vector<ui> &sorted_positions,
+                        ui pass, ui* histogram, ui start_offset, ui end_offset) {
+  for(ui range(offset, start_offset, end_offset)) {
+    auto destination = histogram[GetDigit(keys[offset], pass)]++;
+    sorted_keys[destination] = keys[offset];
+    sorted_positions[destination] = positions[offset];
+  }
+}
+
+// the last pass moves the branches and reassigns the indexes on the way
+void Thread_ScatterBranches(std::vector<node::Branch> &branches,
+                            std::vector<node::Branch> &sorted_branches,
+                            std::vector<ull> &keys, std::vector<ui> &positions,
+                            ui pass, ui* histogram, ui start_offset, ui end_offset) {
+  for(ui range(offset, start_offset, end_offset)) {
+    auto destination = histogram[GetDigit(keys[offset], pass)]++;
+    sorted_branches[destination] = branches[positions[offset]];
+    sorted_branches[destination].SetIndex(destination+1);
+  }
+}
+
+/**
+ * @brief sort branches by their index and reassign indexes from 1 in the
+ *        sorted order, same result as Parallel_Sorter
+ * @param branches
+ * @return true if success to sort otherwise false
+ */
+bool Radix_Sorter::Sort(std::vector<node::Branch> &branches) {
+  evaluator::TimeScope time_scope(STAGE_TYPE_SORT);
+
+  auto& thread_pool = ThreadPool::GetInstance();
+
+  // positions are kept in 32 bits
+  assert(branches.size() <= UINT_MAX);
+  ui number_of_data = branches.size();
+
+  // every pass uses the same chunks so a chunk can find its own histogram
+  auto grain_size = thread_pool.GetGrainSize(number_of_data);
+  auto number_of_chunks = thread_pool.GetNumberOfChunks(number_of_data, grain_size);
+
+  std::vector<ull> keys(number_of_data);
+  std::vector<ui> positions(number_of_data);
+
+  //===--------------------------------------------------------------------===//
+  // Extract Keys
+  //===--------------------------------------------------------------------===//
+  std::vector<ui> histogram = thread_pool.ParallelReduce<std::vector<ui>>(
+    0, number_of_data,
+    std::vector<ui>(GetNumberOfRadixPasses()*GetNumberOfRadixBuckets(), 0),
+    [&](ul start_offset, ul end_offset) {
+      std::vector<ui> chunk_histogram(GetNumberOfRadixPasses()*GetNumberOfRadixBuckets(), 0);
+      Thread_ExtractKeys(branches, keys, positions, chunk_histogram,
+                         start_offset, end_offset);
+      return chunk_histogram;
+    },
+    [](const std::vector<ui>& lhs, const std::vector<ui>& rhs) {
+      std::vector<ui> sum(lhs);
+      for(ui range(bucket_itr, 0, sum.size())) {
+        sum[bucket_itr] += rhs[bucket_itr];
+      }
+      return sum;
+    }, 0, grain_size);
+
+  // a pass is needed only if its digit differs among the keys
+  std::vector<ui> passes;
+  for(ui range(pass, 0, GetNumberOfRadixPasses())) {
+    bool all_same_digit = false;
+    for(ui range(bucket_itr, 0, GetNumberOfRadixBuckets())) {
+      if(histogram[pass*GetNumberOfRadixBuckets()+bucket_itr] == number_of_data) {
+        all_same_digit = true;
+        break;
+      }
+    }
+    if(!all_same_digit) {
+      passes.emplace_back(pass);
+    }
+  }
+
+  //===--------------------------------------------------------------------===//
+  // Radix Passes
+  //===--------------------------------------------------------------------===//
+  std::vector<ull> sorted_keys;
+  std::vector<ui> sorted_positions;
+  if(passes.size() > 1) {
+    sorted_keys.resize(number_of_data);
+    sorted_positions.resize(number_of_data);
+  }
+
+  std::vector<ui> chunk_histogram(number_of_chunks*GetNumberOfRadixBuckets());
+
+  for(ui range(pass_itr, 0, passes.size())) {
+    auto pass = passes[pass_itr];
+    std::fill(chunk_histogram.begin(), chunk_histogram.end(), 0);
+
+    thread_pool.ParallelFor(0, number_of_data, [&](ul start_offset, ul end_offset) {
+      auto chunk_itr = start_offset/grain_size;
+      Thread_CountDigits(keys, pass, &chunk_histogram[chunk_itr*GetNumberOfRadixBuckets()],
+                         start_offset, end_offset);
+    }, 0, grain_size);
+
+    // exclusive prefix sum in (digit, chunk) order keeps every pass stable
+    ui offset = 0;
+    for(ui range(bucket_itr, 0, GetNumberOfRadixBuckets())) {
+      for(ui range(chunk_itr, 0, number_of_chunks)) {
+        auto count = chunk_histogram[chunk_itr*GetNumberOfRadixBuckets()+bucket_itr];
+        chunk_histogram[chunk_itr*GetNumberOfRadixBuckets()+bucket_itr] = offset;
+        offset += count;
+      }
+    }
+
+    if(pass_itr+1 < passes.size()) {
+      thread_pool.ParallelFor(0, number_of_data, [&](ul start_offset, ul end_offset) {
+        auto chunk_itr = start_offset/grain_size;
+        Thread_ScatterKeys(keys, positions, sorted_keys, sorted_positions, pass,
+                           &chunk_histogram[chunk_itr*GetNumberOfRadixBuckets()],
+                           start_offset, end_offset);
+      }, 0, grain_size);
+
+      keys.swap(sorted_keys);
+      positions.swap(sorted_positions);
+    } else {
+      std::vector<node::Branch> sorted_branches(number_of_data);
+      thread_pool.ParallelFor(0, number_of_data, [&](ul start_offset, ul end_offset) {
+        auto chunk_itr = start_offset/grain_size;
+        Thread_ScatterBranches(branches, sorted_branches, keys, positions, pass,
+                               &chunk_histogram[chunk_itr*GetNumberOfRadixBuckets()],
+                               start_offset, end_offset);
+      }, 0, grain_size);
+
+      branches.swap(sorted_branches);
+    }
+  }
+
+  // all keys are the same, the branches are in order already
+  if(passes.empty()) {
+    thread_pool.ParallelFor(0, number_of_data, [&](ul start_offset, ul end_offset) {
+      for(ui range(offset, start_offset, end_offset)) {
+        branches[offset].SetIndex(offset+1);
+      }
+    });
+  }
+
+  // print out sorting time on the CPU
+  auto elapsed_time = time_scope.End();
+  LOG_INFO("Radix Sort Time on CPU (%u threads, %zu passes) = %.6fs",
+           thread_pool.GetNumberOfThreads(), passes.size(), elapsed_time/1000.0f);
+
+  return true;
+}
+
+} // End of sort namespace
+} // End of ursus namespace
@@ -0,0 +1,37 @@
+#pragma once
+
+#include "node/branch.h"
+
+#include <vector>
+
+namespace ursus {
+namespace sort {
+
+// # of key bits sorted in a pass, 2^bits buckets per pass
+constexpr ui GetNumberOfRadixBits() { return 11; }
+
+constexpr ui GetNumberOfRadixBuckets() { return 1u << GetNumberOfRadixBits(); }
+
+// 64-bit keys
+constexpr ui GetNumberOfRadixPasses() { return (64+GetNumberOfRadixBits()-1)/GetNumberOfRadixBits(); }
+
+/**
+ * LSD radix sort of branches on their Hilbert index.
+ * Only (key, position) pairs move between passes, a pass whose digit is the
+ * same for every key is skipped, and the last pass moves the branches
+ * themselves and reassigns their indexes at the same time
+ */
+class Radix_Sorter{
+ public:
+ //===--------------------------------------------------------------------===//
+ // Main Function
+ //===--------------------------------------------------------------------===//
+
+  /**
+   * Sort the data
+   */
+  static bool Sort(std::vector<node::Branch> &branches);
+};
+
+} // End of sort namespace
+} // End of ursus namespace
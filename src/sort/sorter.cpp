@@ -2,8 +2,13 @@
 
 #include "common/logger.h"
 #include "evaluator/evaluator.h"
-#include "sort/thrust_sorter.h"
 #include "sort/parallel_sorter.h"
+#include "sort/radix_sorter.h"
+
+// thrust comes with the CUDA toolkit
+#ifdef __CUDACC__
+#include "sort/thrust_sorter.h"
+#endif
 
 namespace ursus {
 namespace sort {
@@ -18,11 +23,13 @@ bool Sorter::Sort(std::vector<node::Branch> &branches) {
   size_t used = evaluator::Evaluator::GetUsedMem();
   size_t total = evaluator::Evaluator::GetTotalMem();
 
-  // if device doesn't have enough space, sort the data on CPU
-  if( (used+size_for_branch)/(double)total > 0.5) {
-    ret = Parallel_Sorter::Sort(branches);
+  // if there is no device or it doesn't have enough space, sort the data on CPU
+  if( !backend::IsDeviceAvailable() || (used+size_for_branch)/(double)total > 0.5) {
+    ret = Radix_Sorter::Sort(branches);
   } else { 
+#ifdef __CUDACC__
     ret = Thrust_Sorter::Sort(branches);
+#endif
   }
 
   return ret;
@@ -0,0 +1,131 @@
+#include "sort/str_sorter.h"
+
+#include "common/logger.h"
+#include "common/macro.h"
+#include "common/thread_pool.h"
+#include "evaluator/recorder.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+namespace ursus {
+namespace sort {
+
+// smallest number of slabs whose number_of_dims-th power covers the tiles
+static ul GetNumberOfSlabs(ul number_of_tiles, ui number_of_dims) {
+  ul number_of_slabs = std::max(1.0, std::floor(std::pow((double)number_of_tiles,
+                                                         1.0/number_of_dims)));
+  auto covers = [&](ul slabs) {
+    ul product = 1;
+    for(ui range(dim, 0, number_of_dims)) {
+      product *= slabs;
+      if(product >= number_of_tiles) {
+        return true;
+      }
+    }
+    return false;
+  };
+  while(!covers(number_of_slabs)) {
+    number_of_slabs++;
+  }
+  return number_of_slabs;
+}
+
+/**
+ * @brief stable sort of branches [start_offset, end_offset) on the center of
+ *        dim, chunks are sorted in parallel and merged pairwise in rounds
+ */
+void STR_Sorter::SortOnCenter(std::vector<node::Branch> &branches, ul start_offset,
+                              ul end_offset, ui dim, bool descending) {
+  auto compare = [dim, descending](const node::Branch& lhs, const node::Branch& rhs) {
+    // twice the center, no need to halve it for a comparison
+    auto lhs_center = lhs.GetPoint(dim)+lhs.GetPoint(dim+GetNumberOfDims());
+    auto rhs_center = rhs.GetPoint(dim)+rhs.GetPoint(dim+GetNumberOfDims());
+    return descending ? rhs_center < lhs_center : lhs_center < rhs_center;
+  };
+
+  auto& thread_pool = ThreadPool::GetInstance();
+  auto begin = branches.begin();
+  ul number_of_branches = end_offset-start_offset;
+  auto grain_size = thread_pool.GetGrainSize(number_of_branches);
+
+  thread_pool.ParallelFor(start_offset, end_offset, [&](ul chunk_start, ul chunk_end) {
+    std::stable_sort(begin+chunk_start, begin+chunk_end, compare);
+  }, 0, grain_size);
+
+  for(ul width = grain_size; width < number_of_branches; width *= 2) {
+    ul number_of_merges = (number_of_branches+2*width-1)/(2*width);
+    thread_pool.ParallelFor(0, number_of_merges, [&](ul start_merge, ul end_merge) {
+      for(ul range(merge_itr, start_merge, end_merge)) {
+        ul left = start_offset+merge_itr*2*width;
+        ul middle = std::min(left+width, end_offset);
+        ul right = std::min(left+2*width, end_offset);
+        if(middle < right) {
+          std::inplace_merge(begin+left, begin+middle, begin+right, compare);
+        }
+      }
+    }, 0, 1);
+  }
+}
+
+/**
+ * @brief sort branches [start_offset, end_offset) on dim and tile them on the
+ *        remaining dimensions, start_offset is always at a tile boundary
+ */
+void STR_Sorter::Tile(std::vector<node::Branch> &branches, ul start_offset,
+                      ul end_offset, ui dim, bool descending, ui tile_size) {
+  SortOnCenter(branches, start_offset, end_offset, dim, descending);
+
+  // runs of the last dimension are the tiles
+  if(dim+1 == GetNumberOfDims()) {
+    return;
+  }
+
+  // slabs hold whole tiles so that tiles never span two slabs
+  ul number_of_tiles = (end_offset-start_offset+tile_size-1)/tile_size;
+  ul number_of_slabs = GetNumberOfSlabs(number_of_tiles, GetNumberOfDims()-dim);
+  ul slab_size = ((number_of_tiles+number_of_slabs-1)/number_of_slabs)*tile_size;
+  number_of_slabs = (end_offset-start_offset+slab_size-1)/slab_size;
+
+  // slabs don't share branches, they are tiled in parallel
+  auto& thread_pool = ThreadPool::GetInstance();
+  thread_pool.ParallelFor(0, number_of_slabs, [&](ul start_slab, ul end_slab) {
+    for(ul range(slab_itr, start_slab, end_slab)) {
+      ul slab_start = start_offset+slab_itr*slab_size;
+      ul slab_end = std::min(slab_start+slab_size, end_offset);
+      Tile(branches, slab_start, slab_end, dim+1, slab_itr%2, tile_size);
+    }
+  }, 0, 1);
+}
+
+/**
+ * @brief pack branches in STR tiles and reassign indexes from 1 in the packed
+ *        order
+ * @param branches
+ * @param tile_size # of branches in a leaf node
+ * @return true if success to sort otherwise false
+ */
+bool STR_Sorter::Sort(std::vector<node::Branch> &branches, ui tile_size) {
+  evaluator::TimeScope time_scope(STAGE_TYPE_SORT);
+  assert(tile_size);
+
+  auto& thread_pool = ThreadPool::GetInstance();
+
+  Tile(branches, 0, branches.size(), 0, false, tile_size);
+
+  thread_pool.ParallelFor(0, branches.size(), [&](ul start_offset, ul end_offset) {
+    for(ul range(offset, start_offset, end_offset)) {
+      branches[offset].SetIndex(offset+1);
+    }
+  });
+
+  auto elapsed_time = time_scope.End();
+  LOG_INFO("STR Sort Time on CPU (%u threads, %u per tile) = %.6fs",
+           thread_pool.GetNumberOfThreads(), tile_size, elapsed_time/1000.0f);
+
+  return true;
+}
+
+} // End of sort namespace
+} // End of ursus namespace
@@ -0,0 +1,44 @@
+#pragma once
+
+#include "node/branch.h"
+
+#include <vector>
+
+namespace ursus {
+namespace sort {
+
+/**
+ * Sort-Tile-Recursive packing of Leutenegger et al.
+ * The branches are sorted on the center of the first dimension and cut into
+ * slabs of whole tiles, each slab is sorted on the next dimension and cut
+ * again, down to the last dimension whose runs of tile_size branches become
+ * the leaves. Every other slab is sorted backwards so that neighbouring
+ * leaves, which bottom-up builds group into parents, stay close in space
+ */
+class STR_Sorter{
+ public:
+ //===--------------------------------------------------------------------===//
+ // Consteructor/Destructor
+ //===--------------------------------------------------------------------===//
+  STR_Sorter();
+
+ //===--------------------------------------------------------------------===//
+ // Main Function
+ //===--------------------------------------------------------------------===//
+
+  /**
+   * order the branches in STR tiles of tile_size branches and reassign
+   * indexes from 1 in that order, the same contract as Sorter::Sort
+   */
+  static bool Sort(std::vector<node::Branch> &branches, ui tile_size);
+
+ private:
+  static void Tile(std::vector<node::Branch> &branches, ul start_offset,
+                   ul end_offset, ui dim, bool descending, ui tile_size);
+
+  static void SortOnCenter(std::vector<node::Branch> &branches, ul start_offset,
+                           ul end_offset, ui dim, bool descending);
+};
+
+} // End of sort namespace
+} // End of ursus namespace
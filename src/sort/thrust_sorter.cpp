@@ -10,8 +10,7 @@ namespace ursus {
 namespace sort {
 
 bool Thrust_Sorter::Sort(std::vector<node::Branch> &branches) {
-  auto& recorder = evaluator::Recorder::GetInstance();
-  recorder.TimeRecordStart();
+  evaluator::TimeScope time_scope(STAGE_TYPE_SORT);
 
   // copy host to device
   thrust::device_vector<node::Branch> d_branches = branches;
@@ -27,7 +26,7 @@ bool Thrust_Sorter::Sort(std::vector<node::Branch> &branches) {
   thrust::copy(d_branches.begin(), d_branches.end(), branches.begin());
 
   // print out sorting time on the GPU
-  auto elapsed_time = recorder.TimeRecordEnd();
+  auto elapsed_time = time_scope.End();
   LOG_INFO("Sort Time on GPU = %.6fs", elapsed_time/1000.0f);
 
   return true;
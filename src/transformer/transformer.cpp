@@ -2,11 +2,10 @@
 
 #include "common/macro.h"
 #include "common/logger.h"
+#include "common/thread_pool.h"
 #include "evaluator/recorder.h"
 #include "node/branch.h"
 
-#include <thread>
-
 namespace ursus {
 namespace transformer {
 
@@ -51,38 +50,17 @@ void Thread_Transform(node::LeafNode *node, node::Node_SOA *node_soa,
  */
 node::Node_SOA* Transformer::Transform(node::LeafNode* node,
                                         ui number_of_nodes) {
-  auto& recorder = evaluator::Recorder::GetInstance();
-  recorder.TimeRecordStart();
+  evaluator::TimeScope time_scope(STAGE_TYPE_TRANSFORM);
 
   node::Node_SOA* node_soa = new node::Node_SOA[number_of_nodes];
 
-  const size_t number_of_threads = std::thread::hardware_concurrency();
-
-  // parallel for loop using c++ std 11 
-  {
-    std::vector<std::thread> threads;
-
-    auto chunk_size = number_of_nodes/number_of_threads;
-    auto start_offset = 0 ;
-    auto end_offset = start_offset + chunk_size + number_of_nodes%number_of_threads;
-      
-    //Launch a group of threads
-    for (ui range(thread_itr, 0, number_of_threads)) {
-      threads.push_back(std::thread(Thread_Transform, std::ref(node), 
-                        std::ref(node_soa), start_offset, end_offset));
-
-      start_offset = end_offset;
-      end_offset += chunk_size;
-    }
-
-    //Join the threads with the main thread
-    for(auto &thread : threads){
-      thread.join();
-    }
-  }
+  auto& thread_pool = ThreadPool::GetInstance();
+  thread_pool.ParallelFor(0, number_of_nodes, [&](ul start_offset, ul end_offset) {
+    Thread_Transform(node, node_soa, start_offset, end_offset);
+  });
 
-  auto elapsed_time = recorder.TimeRecordEnd();
-  LOG_INFO("Transform Time on the CPU (%zu threads) = %.6fs", number_of_threads, elapsed_time/1000.0f);
+  auto elapsed_time = time_scope.End();
+  LOG_INFO("Transform Time on the CPU (%u threads) = %.6fs", thread_pool.GetNumberOfThreads(), elapsed_time/1000.0f);
 
   return node_soa;
 }
@@ -2,11 +2,12 @@
 
 #include "common/macro.h"
 #include "common/logger.h"
+#include "common/thread_pool.h"
 #include "evaluator/recorder.h"
 #include "sort/sorter.h"
+#include "sort/str_sorter.h"
 
 #include <cassert>
-#include <queue>
 #include <thread>
 #include <algorithm>
 
@@ -29,23 +30,26 @@ bool BVH::Build(std::shared_ptr<io::DataSet> input_data_set){
 
   // Load an index from file it exists
   // otherwise, build an index and dump it to file
+  SetDataSet(input_data_set);
   auto index_name = GetIndexName(input_data_set);
   if(input_data_set->IsRebuild() || !DumpFromFile(index_name))  {
-    //===--------------------------------------------------------------------===//
-    // Create branches
-    //===--------------------------------------------------------------------===//
-    std::vector<node::Branch> branches = CreateBranches(input_data_set);
+    bool use_str = input_data_set->GetClusterType() == CLUSTER_TYPE_STR;
 
     //===--------------------------------------------------------------------===//
-    // Assign Hilbert Ids to branches
+    // Create branches and assign Hilbert Ids to them
     //===--------------------------------------------------------------------===//
-    ret = AssignHilbertIndexToBranches(branches);
-    assert(ret);
+    std::vector<node::Branch> branches = CreateBranches(input_data_set, !use_str);
 
     //===--------------------------------------------------------------------===//
-    // Sort the branches either CPU or GPU depending on the size
+    // Sort the branches either CPU or GPU depending on the size, or pack them
+    // in STR tiles of a leaf node each, the same order as the upper tree of
+    // the Hybrid tree which shares the index file
     //===--------------------------------------------------------------------===//
-    ret = sort::Sorter::Sort(branches);
+    if(use_str) {
+      ret = sort::STR_Sorter::Sort(branches, GetNumberOfLeafNodeDegrees());
+    } else {
+      ret = sort::Sorter::Sort(branches);
+    }
     assert(ret);
 
     //===--------------------------------------------------------------------===//
@@ -64,109 +68,68 @@ bool BVH::Build(std::shared_ptr<io::DataSet> input_data_set){
 
 bool BVH::DumpFromFile(std::string index_name) {
 
-  FILE* index_file = OpenIndexFile(index_name);
+  auto index_file = OpenIndexFile(index_name, tree_type);
   if(index_file == nullptr) {
     return false;
   }
-  auto& recorder = evaluator::Recorder::GetInstance();
-  recorder.TimeRecordStart();
-
-  //===--------------------------------------------------------------------===//
-  // Node counts
-  //===--------------------------------------------------------------------===//
-  // read total node count
-  fread(&host_node_count, sizeof(ui), 1, index_file);
+  evaluator::TimeScope time_scope(STAGE_TYPE_LOAD);
 
   //===--------------------------------------------------------------------===//
   // Internal nodes
   //===--------------------------------------------------------------------===//
-  node_ptr = new node::Node[host_node_count];
-  fread(node_ptr, sizeof(node::Node), host_node_count, index_file);
+  ul node_count;
+  auto nodes = index_file->GetSection<node::Node>(io::INDEX_SECTION_TYPE_NODE, node_count);
+  if(nodes == nullptr) {
+    return false;
+  }
+
+  // total node count
+  host_node_count = node_count;
+  node_ptr = nodes;
 
-  fclose(index_file);
+  index_file->Close();
 
-  auto elapsed_time = recorder.TimeRecordEnd();
+  auto elapsed_time = time_scope.End();
   LOG_INFO("Done, time = %.6fs", elapsed_time/1000.0f);
 
   return true;
 }
 
 bool BVH::DumpToFile(std::string index_name) {
-  auto& recorder = evaluator::Recorder::GetInstance();
   LOG_INFO("Dump an index into file (%s)...", index_name.c_str());
 
-  recorder.TimeRecordStart();
-  // NOTE :: Use fwrite since it is fast
-  FILE* index_file;
-  index_file = fopen(index_name.c_str(),"wb");
-
-  //===--------------------------------------------------------------------===//
-  // Node counts
-  //===--------------------------------------------------------------------===//
-  // write total node count
-  fwrite(&host_node_count, sizeof(ui), 1, index_file);
+  evaluator::TimeScope time_scope(STAGE_TYPE_DUMP);
+  io::IndexFile index_file;
+  if(!index_file.Create(index_name, GetIndexMetadata(tree_type))) {
+    return false;
+  }
 
   //===--------------------------------------------------------------------===//
   // Internal nodes
   //===--------------------------------------------------------------------===//
 
-  // Unlike dump function in MPHR class, we use the queue structure to dump the
-  // tree onto an index file since the nodes are allocated here and there in a
-  // Top-Down fashion
-  std::queue<node::Node*> bfs_queue;
-  std::vector<ll> original_child_offset; // for backup
-
-  // push the root node
-  bfs_queue.emplace(node_ptr);
-
-  // if the queue is not empty,
-  while(!bfs_queue.empty()) {
-    // pop the first element 
-    node::Node* node = bfs_queue.front();
-    bfs_queue.pop();
-
-    // NOTE : Backup the child offsets in order to recover node's child offset later
-    // I believe accessing memory is faster than accesing disk,
-    // I don't use another fwrite for this job.
-    if( node->GetNodeType() == NODE_TYPE_INTERNAL) {
-      for(ui range(child_itr, 0, node->GetBranchCount())) {
-        node::Node* child_node = node->GetBranchChildNode(child_itr);
-        bfs_queue.emplace(child_node);
-
-        // backup current child offset
-        original_child_offset.emplace_back(node->GetBranchChildOffset(child_itr));
-
-        // reassign child offset
-        ll child_offset = (ll)bfs_queue.size()*(ll)sizeof(node::Node);
-        node->SetBranchChildOffset(child_itr, child_offset);
-      }
-    }
+  // top-down builds allocate the nodes in one array in BFS order, the layout
+  // of the index file, so the array is written as it is
+  index_file.WriteSection(io::INDEX_SECTION_TYPE_NODE, node_ptr, host_node_count);
 
-    // write an internal node on disk
-    fwrite(node, sizeof(node::Node), 1, index_file);
+  bool ret = index_file.Commit();
 
-    // Recover child offset
-    if( node->GetNodeType() == NODE_TYPE_INTERNAL) {
-      for(ui range(child_itr, 0, node->GetBranchCount())) {
-        // reassign child offset
-        node->SetBranchChildOffset(child_itr, original_child_offset[child_itr]);
-      }
-    }
-    original_child_offset.clear();
-  }
+  auto elapsed_time = time_scope.End();
+  LOG_INFO("Done, time = %.6fs", elapsed_time/1000.0f);
+  return ret;
+}
 
-  fclose(index_file);
+std::string BVH::GetSearchParameters(void) const {
+  return "CPU_THREADS_"+std::to_string(number_of_cpu_threads);
+}
 
-  auto elapsed_time = recorder.TimeRecordEnd();
-  LOG_INFO("Done, time = %.6fs", elapsed_time/1000.0f);
-  return true;
+node::Node* BVH::GetKNNRoot(void) const {
+  return node_ptr;
 }
 
 int BVH::Search(std::shared_ptr<io::DataSet> query_data_set, 
                    ui number_of_search, ui number_of_repeat){
 
-  auto& recorder = evaluator::Recorder::GetInstance();
-
   //===--------------------------------------------------------------------===//
   // Read Query 
   //===--------------------------------------------------------------------===//
@@ -179,9 +142,24 @@ int BVH::Search(std::shared_ptr<io::DataSet> query_data_set,
     //===--------------------------------------------------------------------===//
     // Prepare Multi-thread Query Processing
     //===--------------------------------------------------------------------===//
-    std::vector<std::thread> threads;
-    ui thread_hit[number_of_cpu_threads];
-    ui thread_node_visit_count[number_of_cpu_threads];
+    auto& thread_pool = ThreadPool::GetInstance();
+    auto grain_size = thread_pool.GetGrainSize(number_of_search, number_of_cpu_threads);
+    auto number_of_chunks = thread_pool.GetNumberOfChunks(number_of_search, grain_size);
+
+    std::vector<ui> chunk_hit(number_of_chunks, 0);
+    std::vector<ui> chunk_node_visit_count(number_of_chunks, 0);
+
+    // per-chunk append buffers, only used to materialize the results
+    std::vector<ResultBuffer> chunk_result;
+    if(materialize_result) {
+      chunk_result.resize(number_of_chunks);
+    }
+
+    // per-chunk query stats, only used to record each query
+    std::vector<evaluator::QueryStats> chunk_query_stats;
+    if(record_query_stats) {
+      chunk_query_stats.resize(number_of_chunks);
+    }
     
     ui total_hit=0;
     ui total_node_visit_count=0;
@@ -189,43 +167,50 @@ int BVH::Search(std::shared_ptr<io::DataSet> query_data_set,
     //===--------------------------------------------------------------------===//
     // Execute Search Function
     //===--------------------------------------------------------------------===//
-    recorder.TimeRecordStart();
+    evaluator::TimeScope time_scope(STAGE_TYPE_SEARCH);
   
-    // parallel for loop using c++ std 11 
+    // queries are handed out in chunks to the thread pool
     {
-      auto search_chunk_size = number_of_search/number_of_cpu_threads;
-      auto start_offset = 0 ;
-      auto end_offset = start_offset + search_chunk_size + number_of_search%number_of_cpu_threads;
-  
-      for (ui range(thread_itr, 0, number_of_cpu_threads)) {
-        threads.push_back(std::thread(&BVH::Thread_Search, this, 
-                          std::ref(query), thread_itr,  
-                          std::ref(thread_hit[thread_itr]), 
-                          std::ref(thread_node_visit_count[thread_itr]),
-                          start_offset, end_offset));
+      thread_pool.ParallelFor(0, number_of_search, [&](ul start_offset, ul end_offset) {
+        auto chunk_itr = start_offset/grain_size;
+        // count on the stack, neighbouring chunks share cache lines
+        ui hit, node_visit_count;
+        Thread_Search(query, thread_pool.GetThreadId(),
+                      hit, node_visit_count,
+                      (materialize_result)?&chunk_result[chunk_itr]:nullptr,
+                      (record_query_stats)?&chunk_query_stats[chunk_itr]:nullptr,
+                      start_offset, end_offset);
+        chunk_hit[chunk_itr] = hit;
+        chunk_node_visit_count[chunk_itr] = node_visit_count;
+      }, number_of_cpu_threads, grain_size);
   
-        start_offset = end_offset;
-        end_offset += search_chunk_size;
+      for(ui range(chunk_itr, 0, number_of_chunks)) {
+        total_hit += chunk_hit[chunk_itr];
+        total_node_visit_count += chunk_node_visit_count[chunk_itr];
       }
-  
-      //Join the threads with the main thread
-      for(auto &thread : threads){
-        thread.join();
+
+      if(record_query_stats) {
+        for(auto& chunk_stats : chunk_query_stats) {
+          query_stats.Merge(chunk_stats);
+        }
       }
-  
-      for(ui range(thread_itr, 0, number_of_cpu_threads)) {
-        total_hit += thread_hit[thread_itr];
-        total_node_visit_count += thread_node_visit_count[thread_itr];
+
+      // compact the per-chunk buffers into a single result array
+      if(materialize_result) {
+        search_result.Compact(chunk_result, number_of_search);
       }
     }
   
-    auto elapsed_time = recorder.TimeRecordEnd();
+    auto elapsed_time = time_scope.End();
     LOG_INFO("%u threads processing queries concurrently", number_of_cpu_threads);
   
     //===--------------------------------------------------------------------===//
     // Show Results
     //===--------------------------------------------------------------------===//
     LOG_INFO("Hit : %u", total_hit);
+    if(materialize_result) {
+      LOG_INFO("Materialized Results : %lu", search_result.GetNumberOfResults());
+    }
     LOG_INFO("Avg. Search Time on the CPU (ms)\n%.6f", elapsed_time/(float)number_of_search);
     LOG_INFO("Total Search Time on the CPU (ms)%.6f", elapsed_time);
     LOG_INFO("Avg. Node visit count : %f", total_node_visit_count/(float)number_of_search);
@@ -240,21 +225,33 @@ void BVH::SetNumberOfCPUThreads(ui _number_of_cpu_threads) {
   assert(number_of_cpu_threads);
 }
 
-void BVH::Thread_Search(std::vector<Point>& query, ui tid,
-                           ui& hit, ui& node_visit_count, ui start_offset, ui end_offset) {
+void BVH::Thread_Search(Point* query, ui tid,
+                           ui& hit, ui& node_visit_count, 
+                           ResultBuffer* result_buffer, evaluator::QueryStats* chunk_stats,
+                           ui start_offset, ui end_offset) {
   hit = 0;
   node_visit_count = 0;
 
+  if(result_buffer) {
+    result_buffer->Reset(start_offset);
+  }
+
   ui query_offset = start_offset*GetNumberOfDims()*2;
 
   for(ui range(query_itr, start_offset, end_offset)) {
-    hit += TraverseInternalNodes(node_ptr, &query[query_offset], &node_visit_count);
+    evaluator::QueryTimer query_timer(chunk_stats, hit, node_visit_count);
+    hit += TraverseInternalNodes(node_ptr, &query[query_offset], 
+                                 &node_visit_count, result_buffer);
+    if(result_buffer) {
+      result_buffer->CloseQuery();
+    }
     query_offset += GetNumberOfDims()*2;
   }
 }
 
 ui BVH::TraverseInternalNodes(node::Node *node_ptr, Point* query, 
-                                 ui *node_visit_count) {
+                                 ui *node_visit_count, 
+                                 ResultBuffer* result_buffer) {
   ui hit = 0;
   (*node_visit_count)++;
 
@@ -263,13 +260,16 @@ ui BVH::TraverseInternalNodes(node::Node *node_ptr, Point* query,
     for(ui range(branch_itr, 0, node_ptr->GetBranchCount())) {
       if( node_ptr->IsOverlap(query, branch_itr)) {
         hit += TraverseInternalNodes(node_ptr->GetBranchChildNode(branch_itr), 
-                                     query, node_visit_count);
+                                     query, node_visit_count, result_buffer);
       }
     }
   } // leaf nodes
   else {
     for(ui range(branch_itr, 0, node_ptr->GetBranchCount())) {
       if( node_ptr->IsOverlap(query, branch_itr)) {
+        if(result_buffer) {
+          result_buffer->Append(node_ptr->GetBranchIndex(branch_itr));
+        }
         hit++;
       }
     }
@@ -32,14 +32,19 @@ class BVH : public Tree {
   int Search(std::shared_ptr<io::DataSet> query_data_set, 
              ui number_of_search, ui number_of_repeat);
 
-  void Thread_Search(std::vector<Point>&query, 
+  std::string GetSearchParameters(void) const;
+
+  node::Node* GetKNNRoot(void) const;
+
+  void Thread_Search(Point* query, 
                      ui tid, ui& hit, ui& node_visit_count, 
+                     ResultBuffer* result_buffer, evaluator::QueryStats* chunk_stats,
                      ui start_offset, ui end_offset) ;
 
   void SetNumberOfCPUThreads(ui number_of_cpu_threads);
 
   ui TraverseInternalNodes(node::Node *node_ptr, Point* query, 
-                           ui *node_visit_count);
+                           ui *node_visit_count, ResultBuffer* result_buffer);
 
   //===--------------------------------------------------------------------===//
   // Members
@@ -2,17 +2,22 @@
 
 #include "common/macro.h"
 #include "common/logger.h"
+#include "common/thread_pool.h"
 #include "evaluator/recorder.h"
+#include "mapper/hilbert_mapper.h"
+#include "node/leaf_scanner.h"
 #include "sort/sorter.h"
+#include "sort/str_sorter.h"
 #include "transformer/transformer.h"
 #include "manager/chunk_manager.h"
 
+#include <atomic>
 #include <cassert>
 #include <thread>
 #include <algorithm>
 #include <chrono> // for sleep
+#include <numeric>
 
-#include "cuda_profiler_api.h"
 
 namespace ursus {
 namespace tree {
@@ -35,21 +40,31 @@ bool Hybrid::Build(std::shared_ptr<io::DataSet> input_data_set) {
 
   // Load an index from file it exists
   // otherwise, build an index and dump it to file
+  SetDataSet(input_data_set);
   auto index_name = GetIndexName(input_data_set);
   if(input_data_set->IsRebuild() || !DumpFromFile(index_name)) {
+    bool use_hilbert = input_data_set->GetClusterType() == CLUSTER_TYPE_HILBERT ||
+                       input_data_set->GetClusterType() == CLUSTER_TYPE_KMEANSHILBERT;
+
     //===--------------------------------------------------------------------===//
-    // Create branches
+    // Create branches and assign Hilbert Ids to them
     //===--------------------------------------------------------------------===//
-    std::vector<node::Branch> branches = CreateBranches(input_data_set);
-
-    if( input_data_set->GetClusterType() == CLUSTER_TYPE_HILBERT ||
-        input_data_set->GetClusterType() == CLUSTER_TYPE_KMEANSHILBERT){
-      //===--------------------------------------------------------------------===//
-      // Assign Hilbert Ids to branches
-      //===--------------------------------------------------------------------===//
-      ret = AssignHilbertIndexToBranches(branches);
-      assert(ret);
+    std::vector<node::Branch> branches = CreateBranches(input_data_set, use_hilbert);
+
+    // quantized leaf nodes test the branches on a query boundary on their
+    // data points, the child offsets carry the offsets in the data set
+    // through the sort
+    bool quantize = quantize_leaf_nodes && !flat_array_exists;
+    auto& thread_pool = ThreadPool::GetInstance();
+    if(quantize) {
+      thread_pool.ParallelFor(0, branches.size(), [&](ul start_offset, ul end_offset) {
+        for(ul range(offset, start_offset, end_offset)) {
+          branches[offset].SetChildOffset(offset);
+        }
+      });
+    }
 
+    if(use_hilbert){
       //===--------------------------------------------------------------------===//
       // Sort the branches either CPU or GPU depending on the size
       //===--------------------------------------------------------------------===//
@@ -66,6 +81,22 @@ bool Hybrid::Build(std::shared_ptr<io::DataSet> input_data_set) {
         ret = sort::Sorter::Sort(branches);
         assert(ret);
       }
+    } else if( input_data_set->GetClusterType() == CLUSTER_TYPE_STR){
+      //===--------------------------------------------------------------------===//
+      // Pack the branches in STR tiles of a leaf node each
+      //===--------------------------------------------------------------------===//
+      ret = sort::STR_Sorter::Sort(branches, GetNumberOfLeafNodeDegrees());
+      assert(ret);
+    }
+
+    if(quantize) {
+      data_offsets.resize(branches.size());
+      thread_pool.ParallelFor(0, branches.size(), [&](ul start_offset, ul end_offset) {
+        for(ul range(offset, start_offset, end_offset)) {
+          data_offsets[offset] = branches[offset].GetChildOffset();
+          branches[offset].SetChildOffset(0);
+        }
+      });
     }
 
     //===--------------------------------------------------------------------===//
@@ -92,17 +123,44 @@ bool Hybrid::Build(std::shared_ptr<io::DataSet> input_data_set) {
       assert(node_soa_ptr);
 
       delete b_node_ptr;
+
+      //===--------------------------------------------------------------------===//
+      // Keep the leaf nodes quantized in place of the leaf Node_SOAs
+      //===--------------------------------------------------------------------===//
+      if(quantize) {
+        QuantizeLeafNodes();
+      } else if(!quantize_leaf_nodes) {
+        EncodePointLeafNodes();
+      }
     }
 
     // Dump an index to the file
     DumpToFile(index_name);
   } 
+  data_set = input_data_set;
+
+  // leaf nodes are scanned on the CPU without a device
+  if(!backend::IsDeviceAvailable()) {
+    return true;
+  }
 
   //===--------------------------------------------------------------------===//
   // Move Trees to the GPU in advance
   //===--------------------------------------------------------------------===//
   auto& chunk_manager = manager::ChunkManager::GetInstance();
 
+  // the quantized leaf nodes are scanned in place of the leaf Node_SOAs
+  if(!quantized_leaf_nodes.empty()) {
+    chunk_manager.CopyQuantizedLeafNodes(quantized_leaf_nodes.data(), quantized_leaf_nodes.size(),
+                                         data_offsets.data(), data_offsets.size(),
+                                         data_set->GetPoints(), data_set->GetNumberOfData());
+    return true;
+  }
+  if(!point_leaf_nodes.empty()) {
+    chunk_manager.CopyPointLeafNodes(point_leaf_nodes.data(), point_leaf_nodes.size());
+    return true;
+  }
+
   ui offset = 0;
   ui count = 0;
 
@@ -121,11 +179,11 @@ bool Hybrid::Build(std::shared_ptr<io::DataSet> input_data_set) {
 }
 
 void Hybrid::Thread_BuildExtendLeafNodeOnCPU(ul current_offset, ul parent_offset, 
-                                             ui number_of_node, ui tid, ui number_of_threads) {
+                                             ui start_offset, ui end_offset) {
   node::Node_SOA* current_node;
   node::Node_SOA* parent_node;
 
-  for(ui range(node_offset, tid, number_of_node, number_of_threads)) {
+  for(ui range(node_offset, start_offset, end_offset)) {
     current_node = node_soa_ptr+current_offset+node_offset;
     parent_node = node_soa_ptr+parent_offset+(ul)(node_offset/GetNumberOfLeafNodeDegrees());
 
@@ -168,51 +226,39 @@ void Hybrid::Thread_BuildExtendLeafNodeOnCPU(ul current_offset, ul parent_offset
       parent_node->SetBranchPoint( (node_offset % GetNumberOfLeafNodeDegrees()), upper_boundary[0], high_dim);
     }
   }
+}
+
+bool Hybrid::BuildExtendLeafNodeOnCPU() {
+  ul current_offset = GetNumberOfExtendLeafNodeSOA();
+  ul parent_offset = 0;
+  ui number_of_node = GetNumberOfLeafNodeSOA();
+
+  auto& thread_pool = ThreadPool::GetInstance();
+  thread_pool.ParallelFor(0, number_of_node, [&](ul start_offset, ul end_offset) {
+    Thread_BuildExtendLeafNodeOnCPU(current_offset, parent_offset, 
+                                    start_offset, end_offset);
+  });
 
   //last node in each level
   if(  number_of_node % GetNumberOfLeafNodeDegrees() ){
-    parent_node = node_soa_ptr + current_offset - 1;
+    auto parent_node = node_soa_ptr + current_offset - 1;
     if( number_of_node < GetNumberOfLeafNodeDegrees() ) {
       parent_node->SetBranchCount(number_of_node);
     }else{
       parent_node->SetBranchCount(number_of_node%GetNumberOfLeafNodeDegrees());
     }
   }
-}
-
-bool Hybrid::BuildExtendLeafNodeOnCPU() {
-
-  const size_t number_of_threads = std::thread::hardware_concurrency();
-
-  // parallel for loop using c++ std 11 
-  {
-    std::vector<std::thread> threads;
-    ul current_offset = GetNumberOfExtendLeafNodeSOA();
-    ul parent_offset = 0;
-
-    for (ui range(thread_itr, 0, number_of_threads)) {
-      threads.push_back(std::thread(&Hybrid::Thread_BuildExtendLeafNodeOnCPU, 
-                        this, current_offset, parent_offset, 
-                        GetNumberOfLeafNodeSOA(), thread_itr, number_of_threads));
-    }
-    //Join the threads with the main thread
-    for(auto &thread : threads){
-      thread.join();
-    }
-    threads.clear();
-  }
 
   return true;
 }
 
 bool Hybrid::DumpFromFile(std::string index_name) {
-  auto& recorder = evaluator::Recorder::GetInstance();
-  recorder.TimeRecordStart();
+  evaluator::TimeScope time_scope(STAGE_TYPE_LOAD);
 
   // naming
   std::string upper_tree_name = index_name;
   std::string flat_array_name = index_name;
-  auto pos = upper_tree_name.find("HYBRID");
+  auto pos = upper_tree_name.rfind("HYBRID");
 
   switch(UPPER_TREE_TYPE){
     case TREE_TYPE_BVH:{
@@ -229,67 +275,54 @@ bool Hybrid::DumpFromFile(std::string index_name) {
   }
 
 
-  FILE* upper_tree_index_file=nullptr;
-  FILE* flat_array_index_file=nullptr;
-
   // check file exists
-  if(IsExist(upper_tree_name)){
-    upper_tree_exists = true;
-    upper_tree_index_file = OpenIndexFile(upper_tree_name);
-  }
-  if(IsExist(flat_array_name)){
-    flat_array_exists = true;
-    flat_array_index_file = OpenIndexFile(flat_array_name);
-  }
-
-
-  //===--------------------------------------------------------------------===//
-  // Node counts
-  //===--------------------------------------------------------------------===//
-  // read host node count
-  if(upper_tree_exists){
-    fread(&host_node_count, sizeof(ui), 1, upper_tree_index_file);
-  }
-
-  // read device count for GPU
-  if(flat_array_exists){
-    fread(&device_node_count, sizeof(ui), 1, flat_array_index_file);
-
-    ui height;
-    fread(&height, sizeof(ui), 1, flat_array_index_file);
-    level_node_count.resize(height);
-
-    for(ui range(i, 0, height)){
-      fread(&level_node_count[i], sizeof(ui), 1, flat_array_index_file);
-    }
-  }
+  std::shared_ptr<io::IndexFile> upper_tree_index_file = OpenIndexFile(upper_tree_name, UPPER_TREE_TYPE);
+  std::shared_ptr<io::IndexFile> flat_array_index_file = OpenIndexFile(flat_array_name, tree_type);
 
   //===--------------------------------------------------------------------===//
   // Nodes for CPU
   //===--------------------------------------------------------------------===//
-  if(upper_tree_exists){
-    node_ptr = new node::Node[host_node_count];
-    fread(node_ptr, sizeof(node::Node), host_node_count, upper_tree_index_file);
+  if(upper_tree_index_file){
+    ul node_count;
+    auto nodes = upper_tree_index_file->GetSection<node::Node>(io::INDEX_SECTION_TYPE_NODE, node_count);
+    if(nodes != nullptr) {
+      // host node count
+      host_node_count = node_count;
+      node_ptr = nodes;
+      upper_tree_exists = true;
+    }
+    LOG_INFO("DumpFromFile %s", upper_tree_name.c_str());
+    upper_tree_index_file->Close();
   }
 
   //===--------------------------------------------------------------------===//
   // Nodes for GPU
   //===--------------------------------------------------------------------===//
-  if(flat_array_exists){
-    node_soa_ptr = new node::Node_SOA[device_node_count];
-    fread(node_soa_ptr, sizeof(node::Node_SOA), device_node_count, flat_array_index_file);
-  }
-
-  if(upper_tree_index_file) {
-    LOG_INFO("DumpFromFile %s", upper_tree_name.c_str());
-    fclose(upper_tree_index_file);
-  }
-  if(flat_array_index_file) {
+  if(flat_array_index_file){
+    ul node_count;
+    auto nodes = flat_array_index_file->GetSection<node::Node_SOA>(io::INDEX_SECTION_TYPE_NODE_SOA, node_count);
+    if(nodes != nullptr) {
+      // device count for GPU
+      level_node_count = flat_array_index_file->GetMetadata().level_node_count;
+      device_node_count = std::accumulate(level_node_count.begin(), level_node_count.end(), 0u);
+
+      // leaf nodes are quantized or points if they are not Node_SOAs
+      if(node_count == device_node_count ||
+         (node_count == device_node_count-GetNumberOfLeafNodeSOA() &&
+          (ReadQuantizedLeafNodes(flat_array_index_file) ||
+           ReadPointLeafNodes(flat_array_index_file)))) {
+        node_soa_ptr = nodes;
+        flat_array_exists = true;
+      } else {
+        device_node_count = 0;
+        level_node_count.clear();
+      }
+    }
     LOG_INFO("DumpFromFile %s", flat_array_name.c_str());
-    fclose(flat_array_index_file);
+    flat_array_index_file->Close();
   }
 
-  auto elapsed_time = recorder.TimeRecordEnd();
+  auto elapsed_time = time_scope.End();
 
    LOG_INFO("Done, time = %.6fs", elapsed_time/1000.0f);
 
@@ -303,13 +336,12 @@ bool Hybrid::DumpFromFile(std::string index_name) {
 }
 
 bool Hybrid::DumpToFile(std::string index_name) {
-  auto& recorder = evaluator::Recorder::GetInstance();
-  recorder.TimeRecordStart();
+  evaluator::TimeScope time_scope(STAGE_TYPE_DUMP);
 
   // naming
   std::string upper_tree_name = index_name;
   std::string flat_array_name = index_name;
-  auto pos = upper_tree_name.find("HYBRID");
+  auto pos = upper_tree_name.rfind("HYBRID");
 
   switch(UPPER_TREE_TYPE){
     case TREE_TYPE_BVH:{
@@ -325,108 +357,92 @@ bool Hybrid::DumpToFile(std::string index_name) {
       break;
   }
 
-  // NOTE :: Use fwrite as it is fast
-
-  FILE* upper_tree_index_file;
-  FILE* flat_array_index_file;
-  if(!upper_tree_exists){
-    upper_tree_index_file = fopen(upper_tree_name.c_str(),"wb");
-  }
-  if(!flat_array_exists){
-    flat_array_index_file = fopen(flat_array_name.c_str(),"wb");
-  }
+  bool ret = true;
 
   //===--------------------------------------------------------------------===//
-  // Node counts
+  // Internal nodes
   //===--------------------------------------------------------------------===//
-  // write node count for CPU
-  if(!upper_tree_exists){
-    fwrite(&host_node_count, sizeof(ui), 1, upper_tree_index_file);
-  }
-
-  // write node count for GPU
-  if(!flat_array_exists){
-    fwrite(&device_node_count, sizeof(ui), 1, flat_array_index_file);
 
-    ui height = level_node_count.size();
-    fwrite(&height, sizeof(ui), 1, flat_array_index_file);
+  // top-down builds allocate the nodes in one array in BFS order, the layout
+  // of the index file, so the array is written as it is
+  if(!upper_tree_exists){
+    io::IndexFile upper_tree_index_file;
+    if(upper_tree_index_file.Create(upper_tree_name, GetIndexMetadata(UPPER_TREE_TYPE))) {
+      upper_tree_index_file.WriteSection(io::INDEX_SECTION_TYPE_NODE, node_ptr, host_node_count);
 
-    for(auto node_count : level_node_count){
-      fwrite(&node_count, sizeof(ui), 1, flat_array_index_file);
+      ret &= upper_tree_index_file.Commit();
+    } else {
+      ret = false;
     }
+    LOG_INFO("DumpToFile %s", upper_tree_name.c_str());
   }
 
   //===--------------------------------------------------------------------===//
-  // Internal nodes
+  // Extend & leaf nodes
   //===--------------------------------------------------------------------===//
-
-  // Unlike dump function in MPHR class, we use the queue structure to dump the
-  // tree onto an index file since the nodes are allocated here and there in a
-  // Top-Down fashion
-  if(!upper_tree_exists){
-    std::queue<node::Node*> bfs_queue;
-    std::vector<ll> original_child_offset; // for backup
-
-    // push the root node
-    bfs_queue.emplace(node_ptr);
-
-    // if the queue is not empty,
-    while(!bfs_queue.empty()) {
-      // pop the first element 
-      node::Node* node = bfs_queue.front();
-      bfs_queue.pop();
-
-      // NOTE : Backup the child offsets in order to recover node's child offset later
-      // I believe accessing memory is faster than accesing disk,
-      // I don't use another fwrite for this job.
-      if( node->GetNodeType() == NODE_TYPE_INTERNAL) {
-        for(ui range(child_itr, 0, node->GetBranchCount())) {
-          node::Node* child_node = node->GetBranchChildNode(child_itr);
-          bfs_queue.emplace(child_node);
-
-          // backup current child offset
-          original_child_offset.emplace_back(node->GetBranchChildOffset(child_itr));
-
-          // reassign child offset
-          ll child_offset = (ll)bfs_queue.size()*(ll)sizeof(node::Node);
-          node->SetBranchChildOffset(child_itr, child_offset);
-        }
+  if(!flat_array_exists){
+    // level node counts go into the header
+    auto metadata = GetIndexMetadata(tree_type);
+    metadata.height = level_node_count.size();
+    metadata.level_node_count = level_node_count;
+
+    io::IndexFile flat_array_index_file;
+    if(flat_array_index_file.Create(flat_array_name, metadata)) {
+      ui number_of_node_soa = GetNumberOfNodeSOA();
+      if(!IsLeafNodeSOA()) {
+        number_of_node_soa -= GetNumberOfLeafNodeSOA();
       }
+      flat_array_index_file.WriteSection(io::INDEX_SECTION_TYPE_NODE_SOA, node_soa_ptr, number_of_node_soa);
 
-      // write an internal node on disk
-      fwrite(node, sizeof(node::Node), 1, upper_tree_index_file);
-
-      // Recover child offset
-      if( node->GetNodeType() == NODE_TYPE_INTERNAL) {
-        for(ui range(child_itr, 0, node->GetBranchCount())) {
-          // reassign child offset
-          node->SetBranchChildOffset(child_itr, original_child_offset[child_itr]);
-        }
+      if(!quantized_leaf_nodes.empty()) {
+        flat_array_index_file.WriteSection(io::INDEX_SECTION_TYPE_QUANTIZED_NODE_SOA,
+                                           quantized_leaf_nodes.data(), quantized_leaf_nodes.size());
+        flat_array_index_file.WriteSection(io::INDEX_SECTION_TYPE_DATA_OFFSET,
+                                           data_offsets.data(), data_offsets.size());
+      }
+      if(!point_leaf_nodes.empty()) {
+        flat_array_index_file.WriteSection(io::INDEX_SECTION_TYPE_POINT_NODE_SOA,
+                                           point_leaf_nodes.data(), point_leaf_nodes.size());
       }
-      original_child_offset.clear();
+      ret &= flat_array_index_file.Commit();
+    } else {
+      ret = false;
     }
+    LOG_INFO("DumpToFile %s", flat_array_name.c_str());
   }
 
-  //===--------------------------------------------------------------------===//
-  // Extend & leaf nodes
-  //===--------------------------------------------------------------------===//
-  if(!flat_array_exists){
-    fwrite(node_soa_ptr, sizeof(node::Node_SOA), GetNumberOfNodeSOA(), flat_array_index_file);
+  auto elapsed_time = time_scope.End();
+  LOG_INFO("Done, time = %.6fs", elapsed_time/1000.0f);
+  return ret;
+}
+
+bool Hybrid::ReadQuantizedLeafNodes(std::shared_ptr<io::IndexFile> index_file) {
+  quantized_leaf_nodes.resize(GetNumberOfLeafNodeSOA());
+  if(index_file->CopySection(io::INDEX_SECTION_TYPE_QUANTIZED_NODE_SOA,
+                             quantized_leaf_nodes.data(), quantized_leaf_nodes.size())) {
+    // indexes run from 1 through the leaf level
+    auto& last_node = quantized_leaf_nodes.back();
+    data_offsets.resize(last_node.GetIndex(last_node.GetBranchCount()-1));
+    if(index_file->CopySection(io::INDEX_SECTION_TYPE_DATA_OFFSET,
+                               data_offsets.data(), data_offsets.size())) {
+      return true;
+    }
   }
 
+  quantized_leaf_nodes.clear();
+  data_offsets.clear();
+  return false;
+}
 
-  if(upper_tree_index_file){
-    LOG_INFO("DumpToFile %s", upper_tree_name.c_str());
-    fclose(upper_tree_index_file);
-  }
-  if(flat_array_index_file){
-    LOG_INFO("DumpToFile %s", flat_array_name.c_str());
-    fclose(flat_array_index_file);
+bool Hybrid::ReadPointLeafNodes(std::shared_ptr<io::IndexFile> index_file) {
+  point_leaf_nodes.resize(GetNumberOfLeafNodeSOA());
+  if(index_file->CopySection(io::INDEX_SECTION_TYPE_POINT_NODE_SOA,
+                             point_leaf_nodes.data(), point_leaf_nodes.size())) {
+    return true;
   }
 
-  auto elapsed_time = recorder.TimeRecordEnd();
-  LOG_INFO("Done, time = %.6fs", elapsed_time/1000.0f);
-  return true;
+  point_leaf_nodes.clear();
+  return false;
 }
 
 ui Hybrid::GetNumberOfNodeSOA() const{
@@ -448,16 +464,150 @@ ui Hybrid::GetNumberOfExtendLeafNodeSOA() const {
 //#define STATIC
 
 
+std::string Hybrid::GetBuildParameters(void) const {
+  return (quantize_leaf_nodes) ? "LEAF_CODE_BITS_"+std::to_string(URSUS_LEAF_CODE_BITS) : "";
+}
+
+std::string Hybrid::GetSearchParameters(void) const {
+  return "CPU_THREADS_"+std::to_string(number_of_cpu_threads)+
+         "_CUDA_BLOCKS_"+std::to_string(number_of_cuda_blocks)+
+         "_CHUNK_SIZE_"+std::to_string(chunk_size)+"_SCAN_LEVEL_"+std::to_string(scan_level)+
+         (quantized_leaf_nodes.empty() ? "" : "_LEAF_CODE_BITS_"+std::to_string(URSUS_LEAF_CODE_BITS))+
+         ((query_batch_size > 0) ? "_QUERY_BATCH_"+std::to_string(query_batch_size) : "");
+}
+
+std::vector<node::Node_SOA*> Hybrid::GetKNNNodeSOARoots(void) const {
+  std::vector<node::Node_SOA*> roots;
+  if(node_soa_ptr) {
+    roots.emplace_back(node_soa_ptr);
+  }
+  return roots;
+}
+
+// encode every leaf node into its copy in parallel, none are kept if one of
+// them can't be
+template<typename EncodedNode>
+static bool EncodeLeafNodes(node::Node_SOA* leaf_node_soa_ptr, ui number_of_nodes,
+                            std::vector<EncodedNode>& encoded_nodes) {
+  encoded_nodes.resize(number_of_nodes);
+
+  std::atomic<bool> encoded(true);
+  auto& thread_pool = ThreadPool::GetInstance();
+  thread_pool.ParallelFor(0, number_of_nodes, [&](ul start_offset, ul end_offset) {
+    for(ul range(node_itr, start_offset, end_offset)) {
+      if(!encoded_nodes[node_itr].Encode(&leaf_node_soa_ptr[node_itr])) {
+        encoded = false;
+      }
+    }
+  });
+
+  if(!encoded) {
+    encoded_nodes.clear();
+  }
+  return encoded;
+}
+
+/**
+ * @brief encode the leaf nodes into quantized leaf nodes, kept in place of
+ *        them on the CPU, the GPU and in the index file. Branches on a query
+ *        boundary are tested on their data points through data_offsets
+ * @return true if all of them are encoded otherwise false
+ */
+bool Hybrid::QuantizeLeafNodes(void) {
+  evaluator::TimeScope time_scope(STAGE_TYPE_TRANSFORM);
+
+  // a single leaf node is the root of the Node_SOAs
+  if(level_node_count.size() < 2) {
+    LOG_INFO("A single leaf node is kept as it is");
+    data_offsets.clear();
+    return false;
+  }
+
+  auto number_of_nodes = GetNumberOfLeafNodeSOA();
+  node::Node_SOA* leaf_node_soa_ptr = node_soa_ptr + 
+                                      (GetNumberOfNodeSOA()-number_of_nodes);
+
+  // indexes of a leaf node must be a run
+  if(!EncodeLeafNodes(leaf_node_soa_ptr, number_of_nodes, quantized_leaf_nodes)) {
+    LOG_INFO("Leaf nodes can't be quantized, their indexes are not runs");
+    data_offsets.clear();
+    return false;
+  }
+
+  ReleaseLeafNodeSOA();
+
+  auto elapsed_time = time_scope.End();
+
+  // boundary branches are tested on their data points, so every branch
+  // takes its data offset too and the GPU a copy of its point
+  double number_of_branches = data_offsets.size();
+  double bytes_per_branch = (sizeof(node::QuantizedNode_SOA)*number_of_nodes+
+                             sizeof(ui)*data_offsets.size())/number_of_branches;
+  LOG_INFO("Quantize Leaf Nodes (%u bits, %.1f bytes per branch on the CPU, %.1f on the GPU, instead of %.1f) = %.6fs",
+           URSUS_LEAF_CODE_BITS, bytes_per_branch, 
+           bytes_per_branch+sizeof(Point)*GetNumberOfDims(),
+           sizeof(node::Node_SOA)*number_of_nodes/number_of_branches, elapsed_time/1000.0f);
+  return true;
+}
+
+bool Hybrid::IsLeafNodeSOA(void) const {
+  return quantized_leaf_nodes.empty() && point_leaf_nodes.empty();
+}
+
+void Hybrid::ReleaseLeafNodeSOA(void) {
+  auto number_of_nodes = GetNumberOfNodeSOA()-GetNumberOfLeafNodeSOA();
+  auto upper_node_soa_ptr = new node::Node_SOA[number_of_nodes];
+  std::copy(node_soa_ptr, node_soa_ptr+number_of_nodes, upper_node_soa_ptr);
+
+  delete[] node_soa_ptr;
+  node_soa_ptr = upper_node_soa_ptr;
+}
+
+/**
+ * @brief encode the leaf nodes of point data into point leaf nodes, kept in
+ *        place of them on the CPU, the GPU and in the index file
+ * @return true if all of them are points otherwise false
+ */
+bool Hybrid::EncodePointLeafNodes(void) {
+  evaluator::TimeScope time_scope(STAGE_TYPE_TRANSFORM);
+
+  // a single leaf node is the root of the Node_SOAs
+  if(level_node_count.size() < 2) {
+    return false;
+  }
+
+  auto number_of_nodes = GetNumberOfLeafNodeSOA();
+  node::Node_SOA* leaf_node_soa_ptr = node_soa_ptr + 
+                                      (GetNumberOfNodeSOA()-number_of_nodes);
+
+  if(!EncodeLeafNodes(leaf_node_soa_ptr, number_of_nodes, point_leaf_nodes)) {
+    LOG_INFO("Leaf nodes hold boxes, they are scanned as they are");
+    return false;
+  }
+
+  ReleaseLeafNodeSOA();
+
+  auto elapsed_time = time_scope.End();
+  LOG_INFO("Point Leaf Nodes (%zu bytes per node instead of %zu) = %.6fs",
+           sizeof(node::PointNode_SOA), sizeof(node::Node_SOA), elapsed_time/1000.0f);
+  return true;
+}
+
 int Hybrid::Search(std::shared_ptr<io::DataSet> query_data_set, 
                    ui number_of_search, ui number_of_repeat){
 
-  auto& recorder = evaluator::Recorder::GetInstance();
-
   //===--------------------------------------------------------------------===//
   // Read Query 
   //===--------------------------------------------------------------------===//
   auto query = query_data_set->GetPoints();
-  auto d_query = query_data_set->GetDeviceQuery(number_of_search);
+
+  // the GPU only counts hits, so leaf nodes are scanned on the CPU to
+  // materialize the results, and without a device
+  bool scan_on_device = !materialize_result && backend::IsDeviceAvailable();
+  Point* d_query = nullptr;
+  if(scan_on_device) {
+    d_query = query_data_set->GetDeviceQuery(number_of_search);
+  }
 
   //===--------------------------------------------------------------------===//
   // Set # of threads and Chunk Size
@@ -483,22 +633,40 @@ int Hybrid::Search(std::shared_ptr<io::DataSet> query_data_set,
     ui total_node_visit_count_cpu = 0;
     ui total_node_visit_count_gpu = 0;
 
-    ui* d_hit;
-    cudaErrCheck(cudaMalloc((void**) &d_hit, sizeof(ui)*GetNumberOfBlocks()));
-    ui* d_node_visit_count;
-    cudaErrCheck(cudaMalloc((void**) &d_node_visit_count, sizeof(ui)*GetNumberOfBlocks()));
+    ui* d_hit = nullptr;
+    ui* d_node_visit_count = nullptr;
+    if(scan_on_device) {
+      cudaErrCheck(cudaMalloc((void**) &d_hit, sizeof(ui)*GetNumberOfBlocks()));
+      cudaErrCheck(cudaMalloc((void**) &d_node_visit_count, sizeof(ui)*GetNumberOfBlocks()));
 
-    // initialize hit and node visit variables to zero
-    global_SetHitCount<<<GetNumberOfMAXCPUThreads(),GetNumberOfMAXBlocks()/*FIXME*/>>>(0);
-    cudaDeviceSynchronize();
+      // initialize hit and node visit variables to zero
+      LaunchKernel(global_SetHitCount, GetNumberOfMAXCPUThreads(), GetNumberOfMAXBlocks()/*FIXME*/, 0);
+      cudaDeviceSynchronize();
+    }
 
     //===--------------------------------------------------------------------===//
     // Prepare Multi-thread Query Processing
     //===--------------------------------------------------------------------===//
-    std::vector<std::thread> threads;
-    ui thread_jump_count[number_of_cpu_threads];
-    std::vector<ui> thread_launched_block[number_of_cpu_threads];
-    ui thread_node_visit_count_cpu[number_of_cpu_threads];
+    auto& thread_pool = ThreadPool::GetInstance();
+    auto grain_size = thread_pool.GetGrainSize(number_of_search, number_of_cpu_threads);
+    auto number_of_chunks = thread_pool.GetNumberOfChunks(number_of_search, grain_size);
+
+    std::vector<ui> chunk_hit(number_of_chunks, 0);
+    std::vector<ui> chunk_jump_count(number_of_chunks, 0);
+    std::vector<std::vector<ui>> chunk_launched_block(number_of_chunks);
+    std::vector<ui> chunk_node_visit_count_cpu(number_of_chunks, 0);
+
+    // per-chunk append buffers, only used to materialize the results
+    std::vector<ResultBuffer> chunk_result;
+    if(materialize_result) {
+      chunk_result.resize(number_of_chunks);
+    }
+
+    // per-chunk query stats, only used to record each query
+    std::vector<evaluator::QueryStats> chunk_query_stats;
+    if(record_query_stats) {
+      chunk_query_stats.resize(number_of_chunks);
+    }
 
     //===--------------------------------------------------------------------===//
     // Execute Search Function
@@ -508,39 +676,50 @@ int Hybrid::Search(std::shared_ptr<io::DataSet> query_data_set,
     // launch the thread for monitoring as a background
     //std::thread m_thread(&Hybrid::Thread_Monitoring, this, 0);
 
-    recorder.TimeRecordStart();
-
-    // parallel for loop using c++ std 11 
-    {
-      auto search_chunk_size = number_of_search/number_of_cpu_threads;
-      auto start_offset = 0 ;
-      auto end_offset = start_offset + search_chunk_size + number_of_search%number_of_cpu_threads;
-
-      for (ui range(thread_itr, 0, number_of_cpu_threads)) {
-        threads.push_back(std::thread(&Hybrid::Thread_Search, this, 
-              std::ref(query), d_query, 
-              thread_itr, std::ref(thread_jump_count[thread_itr]), 
-              std::ref(thread_launched_block[thread_itr]), 
-              std::ref(thread_node_visit_count_cpu[thread_itr]),
-              number_of_cpu_threads,
-              start_offset, end_offset));
-
-        start_offset = end_offset;
-        end_offset += search_chunk_size;
-      }
+    evaluator::TimeScope time_scope(STAGE_TYPE_SEARCH);
 
-      //Join the threads with the main thread
-      for(auto &thread : threads){
-        thread.join();
+    // queries are handed out in chunks to the thread pool, the thread id
+    // picks the slice of CUDA blocks the chunk is scanned with. Batches of
+    // neighbouring queries are handed out instead if leaf nodes are scanned
+    // on the CPU in batches, a batch size of 1 walks the same leaf nodes
+    // one query at a time
+    if(d_query == nullptr && query_batch_size > 0) {
+      BatchSearch(query, number_of_search, total_hit, total_node_visit_count_cpu);
+    } else {
+      thread_pool.ParallelFor(0, number_of_search, [&](ul start_offset, ul end_offset) {
+        auto chunk_itr = start_offset/grain_size;
+        ui hit, jump_count, node_visit_count;
+        Thread_Search(query, d_query, 
+                      thread_pool.GetThreadId(), 
+                      hit, jump_count, chunk_launched_block[chunk_itr], 
+                      node_visit_count, number_of_cpu_threads,
+                      (materialize_result)?&chunk_result[chunk_itr]:nullptr,
+                      (record_query_stats)?&chunk_query_stats[chunk_itr]:nullptr,
+                      start_offset, end_offset);
+        chunk_hit[chunk_itr] = hit;
+        chunk_jump_count[chunk_itr] = jump_count;
+        chunk_node_visit_count_cpu[chunk_itr] = node_visit_count;
+      }, number_of_cpu_threads, grain_size);
+
+      for(ui range(chunk_itr, 0, number_of_chunks)) {
+        total_hit += chunk_hit[chunk_itr];
+        total_jump_count += chunk_jump_count[chunk_itr];
+        total_node_visit_count_cpu += chunk_node_visit_count_cpu[chunk_itr];
+        for(ui range(i,0, chunk_launched_block[chunk_itr].size())){
+          total_launched_block[i] += chunk_launched_block[chunk_itr][i];
+        }
       }
 
-      for(ui range(thread_itr, 0, number_of_cpu_threads)) {
-        total_jump_count += thread_jump_count[thread_itr];
-        total_node_visit_count_cpu += thread_node_visit_count_cpu[thread_itr];
-        for(ui range(i,0, thread_launched_block[thread_itr].size())){
-          total_launched_block[i] += thread_launched_block[thread_itr][i];
+      if(record_query_stats) {
+        for(auto& chunk_stats : chunk_query_stats) {
+          query_stats.Merge(chunk_stats);
         }
       }
+
+      // compact the per-chunk buffers into a single result array
+      if(materialize_result) {
+        search_result.Compact(chunk_result, number_of_search);
+      }
     }
     LOG_INFO("Avg. Jump Count \n%f", total_jump_count/(float)number_of_search);
     LOG_INFO("Total Jump Count %u", total_jump_count);
@@ -548,13 +727,15 @@ int Hybrid::Search(std::shared_ptr<io::DataSet> query_data_set,
     // A problem with using host-device synchronization points, such as
     // cudaDeviceSynchronize(), is that they stall the GPU pipeline
     cudaDeviceSynchronize();
-    auto elapsed_time = recorder.TimeRecordEnd();
-
-    global_GetHitCount<<<GetNumberOfMAXCPUThreads(),GetNumberOfMAXBlocks()>>>(d_hit, d_node_visit_count);
-    cudaMemcpy(h_hit, d_hit, sizeof(ui), cudaMemcpyDeviceToHost);
-    cudaMemcpy(h_node_visit_count, d_node_visit_count, sizeof(ui), cudaMemcpyDeviceToHost);
-    total_hit = h_hit[0];
-    total_node_visit_count_gpu = h_node_visit_count[0];
+    auto elapsed_time = time_scope.End();
+
+    if(scan_on_device) {
+      LaunchKernel(global_GetHitCount, GetNumberOfMAXCPUThreads(), GetNumberOfMAXBlocks(), d_hit, d_node_visit_count);
+      cudaMemcpy(h_hit, d_hit, sizeof(ui), cudaMemcpyDeviceToHost);
+      cudaMemcpy(h_node_visit_count, d_node_visit_count, sizeof(ui), cudaMemcpyDeviceToHost);
+      total_hit = h_hit[0];
+      total_node_visit_count_gpu = h_node_visit_count[0];
+    }
 
 
     // terminate the monitoring
@@ -620,7 +801,7 @@ void Hybrid::Thread_Monitoring(ui update_interval){
 //      if(chunk_updated) continue;
 
       // get the monitoring hits
-      global_GetMonitor<<<1,GetNumberOfBlocks()>>>(d_monitor);
+      LaunchKernel(global_GetMonitor, 1, GetNumberOfBlocks(), d_monitor);
       cudaMemcpy(h_monitor, d_monitor, sizeof(ui)*GetNumberOfBlocks(), cudaMemcpyDeviceToHost);
 
 /*
@@ -668,14 +849,22 @@ void Hybrid::Thread_Monitoring(ui update_interval){
     }
 }
 
-void Hybrid::Thread_Search(std::vector<Point>& query, Point* d_query, ui tid,
+void Hybrid::Thread_Search(Point* query, Point* d_query, ui tid, ui& hit,
                            ui& jump_count, std::vector<ui>& launched_block, 
                            ui& node_visit_count, ui number_of_cpu_threads,
+                           ResultBuffer* result_buffer, evaluator::QueryStats* chunk_stats,
                            ui start_offset, ui end_offset) {
+  hit = 0;
   jump_count = 0;
   launched_block.resize(GetNumberOfMAXBlocks()+1);
   node_visit_count = 0;
 
+  if(result_buffer) {
+    result_buffer->Reset(start_offset);
+  }
+
+  // the slice of CUDA blocks of this thread
+  assert(tid < number_of_cpu_threads);
   const ui bid_offset = tid*GetNumberOfMAXBlocks();
   ui query_offset = start_offset*GetNumberOfDims()*2;
 
@@ -693,6 +882,7 @@ void Hybrid::Thread_Search(std::vector<Point>& query, Point* d_query, ui tid,
   auto number_of_nodes = GetNumberOfLeafNodeSOA();
 
   for(ui range(query_itr, start_offset, end_offset)) {
+    evaluator::QueryTimer query_timer(chunk_stats, hit, node_visit_count, d_query != nullptr);
     ll visited_leafIndex = 0;
 
 #ifdef STATIC
@@ -739,9 +929,24 @@ t_chunk_size=t_nBlocks*4;
       //===--------------------------------------------------------------------===//
       // Parallel Scanning Leaf Nodes on the GPU 
       //===--------------------------------------------------------------------===//
-      global_ParallelScan_Leafnodes<<<t_nBlocks,GetNumberOfThreads()>>>
-                                     (&d_query[query_offset], start_node_offset,
-                                     t_chunk_size, bid_offset, t_nBlocks);
+      if(d_query == nullptr) {
+        // scan the same chunk on the CPU instead
+        for(ui range(node_itr, 0, t_chunk_size)) {
+          hit += ScanLeafNode(start_node_offset+node_itr, &query[query_offset], result_buffer);
+        }
+      } else if(!quantized_leaf_nodes.empty()) {
+        LaunchKernel(global_ParallelScan_QuantizedLeafnodes, t_nBlocks, GetNumberOfThreads(),
+                     &d_query[query_offset], start_node_offset,
+                     t_chunk_size, bid_offset, t_nBlocks);
+      } else if(!point_leaf_nodes.empty()) {
+        LaunchKernel(global_ParallelScan_PointLeafnodes, t_nBlocks, GetNumberOfThreads(),
+                     &d_query[query_offset], start_node_offset,
+                     t_chunk_size, bid_offset, t_nBlocks);
+      } else {
+        LaunchKernel(global_ParallelScan_Leafnodes, t_nBlocks, GetNumberOfThreads(),
+                     &d_query[query_offset], start_node_offset,
+                     t_chunk_size, bid_offset, t_nBlocks);
+      }
       visited_leafIndex = (start_node_offset+t_chunk_size)*GetNumberOfLeafNodeDegrees();
       jump_count++;
 
@@ -755,14 +960,228 @@ t_chunk_size=t_nBlocks*4;
 #endif
 
     }
+    if(result_buffer) {
+      result_buffer->CloseQuery();
+    }
     query_offset += GetNumberOfDims()*2;
   }
 }
 
+/**
+ * @brief search the queries in batches on the CPU. Queries are ordered by the
+ *        Hilbert index of their centers, so that the queries of a batch are
+ *        close to each other and share most of their leaf nodes. Each leaf node
+ *        is then scanned once for all the queries of a batch on it. There
+ *        are no jumps, only the overlapping leaf nodes are scanned
+ */
+void Hybrid::BatchSearch(Point* query, ui number_of_search, ui& hit,
+                         ui& node_visit_count) {
+  std::vector<Point> centers(number_of_search*GetNumberOfDims());
+  for(ui range(query_itr, 0, number_of_search)) {
+    auto query_box = &query[query_itr*GetNumberOfDims()*2];
+    for(ui range(dim, 0, GetNumberOfDims())) {
+      centers[query_itr*GetNumberOfDims()+dim] = (query_box[dim]+query_box[dim+GetNumberOfDims()])/2;
+    }
+  }
+
+  // same bits as Tree::Thread_Mapping
+  std::vector<ll> hilbert_indexes(number_of_search);
+  mapper::HilbertMapper::MappingIntoSingle(GetNumberOfDims(),
+                                           mapper::HilbertMapper::GetNumberOfBits(GetNumberOfDims()),
+                                           centers.data(), number_of_search,
+                                           hilbert_indexes.data());
+
+  std::vector<ui> query_order(number_of_search);
+  for(ui range(query_itr, 0, number_of_search)) {
+    query_order[query_itr] = query_itr;
+  }
+  std::stable_sort(query_order.begin(), query_order.end(), [&](ui lhs, ui rhs) {
+    return hilbert_indexes[lhs] < hilbert_indexes[rhs];
+  });
+
+  ui number_of_batches = (number_of_search+query_batch_size-1)/query_batch_size;
+  auto& thread_pool = ThreadPool::GetInstance();
+  auto grain_size = thread_pool.GetGrainSize(number_of_batches, number_of_cpu_threads);
+  auto number_of_chunks = thread_pool.GetNumberOfChunks(number_of_batches, grain_size);
+
+  std::vector<ui> chunk_hit(number_of_chunks, 0);
+  std::vector<ui> chunk_node_visit_count(number_of_chunks, 0);
+
+  // a buffer per query since the queries of a batch are scattered, buffers
+  // of disjoint queries are compacted in any order
+  std::vector<ResultBuffer> query_result;
+  if(materialize_result) {
+    query_result.resize(number_of_search);
+  }
+
+  std::vector<evaluator::QueryStats> chunk_query_stats;
+  if(record_query_stats) {
+    chunk_query_stats.resize(number_of_chunks);
+  }
+
+  thread_pool.ParallelFor(0, number_of_batches, [&](ul start_batch, ul end_batch) {
+    auto chunk_itr = start_batch/grain_size;
+    for(ul range(batch_itr, start_batch, end_batch)) {
+      ui start_query = batch_itr*query_batch_size;
+      ui end_query = std::min(start_query+query_batch_size, number_of_search);
+      Thread_BatchSearch(query, &query_order[start_query], end_query-start_query,
+                         chunk_hit[chunk_itr], chunk_node_visit_count[chunk_itr],
+                         (materialize_result)?query_result.data():nullptr,
+                         (record_query_stats)?&chunk_query_stats[chunk_itr]:nullptr);
+    }
+  }, number_of_cpu_threads, grain_size);
+
+  for(ui range(chunk_itr, 0, number_of_chunks)) {
+    hit += chunk_hit[chunk_itr];
+    node_visit_count += chunk_node_visit_count[chunk_itr];
+  }
+
+  if(record_query_stats) {
+    for(auto& chunk_stats : chunk_query_stats) {
+      query_stats.Merge(chunk_stats);
+    }
+  }
+
+  if(materialize_result) {
+    search_result.Compact(query_result, number_of_search);
+  }
+}
+
+/**
+ * @brief collect the leaf nodes each query of the batch overlaps in the
+ *        Node_SOA tree, then scan them in leaf node order. The queries on a leaf node
+ *        are scanned in a row while it's in cache, and each query still
+ *        meets its leaf nodes in order, so are its results. Every query of
+ *        the batch is answered when the batch is, which is its latency
+ */
+void Hybrid::Thread_BatchSearch(Point* query, const ui* queries, ui number_of_queries,
+                                ui& hit, ui& node_visit_count,
+                                ResultBuffer* query_result, evaluator::QueryStats* chunk_stats) {
+  auto start_time = std::chrono::steady_clock::now();
+
+  // leaf node offset and query of the batch of each scan
+  std::vector<std::pair<ll, ui>> scans;
+  std::vector<ui> query_hit(number_of_queries, 0);
+  std::vector<ui> query_node_visit_count(number_of_queries, 0);
+
+  for(ui range(batch_query_itr, 0, number_of_queries)) {
+    CollectLeafNodes(node_soa_ptr, &query[queries[batch_query_itr]*GetNumberOfDims()*2],
+                     batch_query_itr, scans, &query_node_visit_count[batch_query_itr]);
+  }
+
+  std::sort(scans.begin(), scans.end());
+
+  if(query_result) {
+    for(ui range(batch_query_itr, 0, number_of_queries)) {
+      query_result[queries[batch_query_itr]].Reset(queries[batch_query_itr]);
+    }
+  }
+
+  for(auto& scan : scans) {
+    auto query_itr = queries[scan.second];
+    query_hit[scan.second] += ScanLeafNode(scan.first, &query[query_itr*GetNumberOfDims()*2],
+                                           (query_result)?&query_result[query_itr]:nullptr);
+  }
+
+  auto elapsed = std::chrono::steady_clock::now()-start_time;
+  for(ui range(batch_query_itr, 0, number_of_queries)) {
+    if(query_result) {
+      query_result[queries[batch_query_itr]].CloseQuery();
+    }
+    if(chunk_stats) {
+      chunk_stats->latency.Record(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+      chunk_stats->node_visit_count.Record(query_node_visit_count[batch_query_itr]);
+      chunk_stats->hit.Record(query_hit[batch_query_itr]);
+    }
+    hit += query_hit[batch_query_itr];
+    node_visit_count += query_node_visit_count[batch_query_itr];
+  }
+}
+
+void Hybrid::CollectLeafNodes(node::Node_SOA* node_soa, Point* query, ui batch_query_itr,
+                              std::vector<std::pair<ll, ui>>& scans, ui* node_visit_count) {
+  // leaf Node_SOAs are the last level of the array
+  node::Node_SOA* leaf_node_soa_ptr = node_soa_ptr + 
+                                      (GetNumberOfNodeSOA()-GetNumberOfLeafNodeSOA());
+  if(IsLeafNodeSOA() && node_soa >= leaf_node_soa_ptr) {
+    scans.emplace_back(node_soa-leaf_node_soa_ptr, batch_query_itr);
+    return;
+  }
+  (*node_visit_count)++;
+
+  ull overlap[node::GetNumberOfMaskWords()];
+  if(!node_soa->ScanOverlap(query, overlap)) {
+    return;
+  }
+  for(ui range(word_itr, 0, node::GetNumberOfMaskWords())) {
+    for(ull bits = overlap[word_itr]; bits; bits &= bits-1) {
+      ui branch_itr = word_itr*64 + __builtin_ctzll(bits);
+      auto leaf_node_offset = GetLeafNodeOffset(node_soa, branch_itr);
+      if(leaf_node_offset < 0) {
+        CollectLeafNodes(node_soa->GetChildNode(branch_itr), query, batch_query_itr,
+                         scans, node_visit_count);
+      } else {
+        scans.emplace_back(leaf_node_offset, batch_query_itr);
+      }
+    }
+  }
+}
+
+ll Hybrid::GetLeafNodeOffset(node::Node_SOA* node_soa, ui branch_itr) const {
+  if(IsLeafNodeSOA()) {
+    return -1;
+  }
+
+  // children of the last level of the array are the leaf nodes in order
+  node::Node_SOA* extend_leaf_node_soa_ptr = node_soa_ptr + (GetNumberOfNodeSOA()-
+                                             GetNumberOfLeafNodeSOA()-GetNumberOfExtendLeafNodeSOA());
+  if(node_soa < extend_leaf_node_soa_ptr) {
+    return -1;
+  }
+  return (node_soa-extend_leaf_node_soa_ptr)*GetNumberOfLeafNodeDegrees()+branch_itr;
+}
+
+ll Hybrid::GetLeafNodeDistances(ll leaf_node_offset, Point* point,
+                                Point* distances, ui& branch_count) const {
+  if(!point_leaf_nodes.empty()) {
+    auto& point_node_soa = point_leaf_nodes[leaf_node_offset];
+    point_node_soa.GetDistances(point, distances);
+    branch_count = point_node_soa.GetBranchCount();
+    return point_node_soa.GetIndex(0);
+  }
+
+  auto& quantized_node_soa = quantized_leaf_nodes[leaf_node_offset];
+  quantized_node_soa.GetDistances(point, data_set->GetPoints(), data_offsets.data(), distances);
+  branch_count = quantized_node_soa.GetBranchCount();
+  return quantized_node_soa.GetIndex(0);
+}
+
+ui Hybrid::ScanLeafNode(ll node_offset, Point* query, ResultBuffer* result_buffer) {
+  if(!quantized_leaf_nodes.empty()) {
+    return ScanNodeSOA(&quantized_leaf_nodes[node_offset], data_set->GetPoints(),
+                       data_offsets.data(), query, result_buffer);
+  }
+  if(!point_leaf_nodes.empty()) {
+    return ScanNodeSOA(&point_leaf_nodes[node_offset], query, result_buffer);
+  }
+
+  node::Node_SOA* leaf_node_soa_ptr = node_soa_ptr + 
+                                      (GetNumberOfNodeSOA()-GetNumberOfLeafNodeSOA());
+  return ScanNodeSOA(&leaf_node_soa_ptr[node_offset], query, result_buffer);
+}
+
 ui Hybrid::GetChunkSize() const{
   return chunk_size;
 }
 
+void Hybrid::SetQuantizeLeafNodes(bool _quantize_leaf_nodes){
+  quantize_leaf_nodes = _quantize_leaf_nodes;
+}
+
+void Hybrid::SetQueryBatchSize(ui _query_batch_size){
+  query_batch_size = _query_batch_size;
+}
+
 void Hybrid::SetUpperTreeType(TreeType _UPPER_TREE_TYPE){
   UPPER_TREE_TYPE = _UPPER_TREE_TYPE;
   assert(UPPER_TREE_TYPE);
@@ -1081,6 +1500,113 @@ void global_ParallelScan_Leafnodes(Point* _query, ll start_node_offset,
   }
 }
 
+__global__ 
+void global_ParallelScan_QuantizedLeafnodes(Point* _query, ll start_node_offset, 
+                                            ui chunk_size, ui bid_offset, 
+                                            ui number_of_blocks_per_cpu) {
+  int bid = blockIdx.x;
+  int tid = threadIdx.x;
+
+  __shared__ ui t_hit[GetNumberOfThreads2()]; 
+  __shared__ Point query[GetNumberOfDims()*2];
+
+  if(tid < GetNumberOfDims()*2) {
+    query[tid] = _query[tid];
+  }
+
+  t_hit[tid] = 0;
+  if(tid<GetNumberOfThreads2()-GetNumberOfThreads()){
+    t_hit[tid+GetNumberOfThreads2()-GetNumberOfThreads()] = 0;
+  }
+  
+  node::QuantizedNode_SOA* node_ptr = manager::g_quantized_node_soa_ptr/*first leaf node*/ + start_node_offset + bid;
+  __syncthreads();
+
+  //===--------------------------------------------------------------------===//
+  // Leaf Nodes
+  //===--------------------------------------------------------------------===//
+
+  for(ui range(node_itr, bid, chunk_size, number_of_blocks_per_cpu)) {
+
+    MasterThreadOnly {
+      g_node_visit_count[bid_offset+bid]++;
+    }
+
+    // branches on a query boundary read their data points
+    if(tid < node_ptr->GetBranchCount()) {
+      if(node_ptr->IsOverlap(query, tid, manager::g_points, manager::g_data_offsets)) {
+        t_hit[tid]++;
+      }
+    }
+    __syncthreads();
+
+    node_ptr+=number_of_blocks_per_cpu;
+  }
+  __syncthreads();
+
+  //===--------------------------------------------------------------------===//
+  // Parallel Reduction 
+  //===--------------------------------------------------------------------===//
+  ParallelReduction(t_hit, GetNumberOfThreads2());
+
+  MasterThreadOnly {
+      g_hit[bid+bid_offset] += (t_hit[0] + t_hit[1]);
+  }
+}
+
+__global__ 
+void global_ParallelScan_PointLeafnodes(Point* _query, ll start_node_offset, 
+                                        ui chunk_size, ui bid_offset, 
+                                        ui number_of_blocks_per_cpu) {
+  int bid = blockIdx.x;
+  int tid = threadIdx.x;
+
+  __shared__ ui t_hit[GetNumberOfThreads2()]; 
+  __shared__ Point query[GetNumberOfDims()*2];
+
+  if(tid < GetNumberOfDims()*2) {
+    query[tid] = _query[tid];
+  }
+
+  t_hit[tid] = 0;
+  if(tid<GetNumberOfThreads2()-GetNumberOfThreads()){
+    t_hit[tid+GetNumberOfThreads2()-GetNumberOfThreads()] = 0;
+  }
+  
+  node::PointNode_SOA* node_ptr = manager::g_point_node_soa_ptr/*first leaf node*/ + start_node_offset + bid;
+  __syncthreads();
+
+  //===--------------------------------------------------------------------===//
+  // Leaf Nodes
+  //===--------------------------------------------------------------------===//
+
+  for(ui range(node_itr, bid, chunk_size, number_of_blocks_per_cpu)) {
+
+    MasterThreadOnly {
+      g_node_visit_count[bid_offset+bid]++;
+    }
+
+    if(tid < node_ptr->GetBranchCount()) {
+      if(node_ptr->IsOverlap(query, tid)) {
+        t_hit[tid]++;
+      }
+    }
+    __syncthreads();
+
+    node_ptr+=number_of_blocks_per_cpu;
+  }
+  __syncthreads();
+
+  //===--------------------------------------------------------------------===//
+  // Parallel Reduction 
+  //===--------------------------------------------------------------------===//
+  ParallelReduction(t_hit, GetNumberOfThreads2());
+
+  MasterThreadOnly {
+      g_hit[bid+bid_offset] += (t_hit[0] + t_hit[1]);
+  }
+}
+
 } // End of tree namespace
 } // End of ursus namespace
 
@@ -31,7 +31,7 @@ class Hybrid : public Tree {
   bool BuildExtendLeafNodeOnCPU();
 
   void Thread_BuildExtendLeafNodeOnCPU(ul current_offset, ul parent_offset, 
-                                       ui number_of_node, ui tid, ui number_of_threads);
+                                       ui start_offset, ui end_offset);
 
   ui GetNumberOfNodeSOA() const;
 
@@ -41,17 +41,51 @@ class Hybrid : public Tree {
 
   ui GetChunkSize() const;
 
+  // leaf nodes are quantized with -h, they are in other index files
+  std::string GetBuildParameters(void) const;
+
   /**
    * Search the data 
    */
   int Search(std::shared_ptr<io::DataSet> query_data_set, 
              ui number_of_search, ui number_of_repeat);
 
-  void Thread_Search(std::vector<Point>&query, Point* d_query, 
-                     ui tid, ui& jump_count, std::vector<ui> &launched_block,
+  std::string GetSearchParameters(void) const;
+
+  // the bottom-up tree of the leaf nodes is searched
+  std::vector<node::Node_SOA*> GetKNNNodeSOARoots(void) const;
+
+  // leaf nodes are scanned on the CPU if d_query is null, their hits are
+  // counted in hit
+  void Thread_Search(Point* query, Point* d_query, 
+                     ui tid, ui& hit, ui& jump_count, std::vector<ui> &launched_block,
                      ui& node_visit_count, ui number_of_cpu_threads,
+                     ResultBuffer* result_buffer, evaluator::QueryStats* chunk_stats,
                      ui start_offset, ui end_offset) ;
 
+  // leaf nodes are scanned on the CPU for batches of neighbouring queries
+  void BatchSearch(Point* query, ui number_of_search, ui& hit,
+                   ui& node_visit_count);
+
+  // queries are offsets of the batch in the query set, results of each are
+  // appended to its buffer in query_result
+  void Thread_BatchSearch(Point* query, const ui* queries, ui number_of_queries,
+                          ui& hit, ui& node_visit_count,
+                          ResultBuffer* query_result, evaluator::QueryStats* chunk_stats);
+
+  // append (leaf node offset, batch_query_itr) of every leaf node the query
+  // overlaps under node_soa, in leaf node order
+  void CollectLeafNodes(node::Node_SOA* node_soa, Point* query, ui batch_query_itr,
+                        std::vector<std::pair<ll, ui>>& scans, ui* node_visit_count);
+
+  // scan the leaf node at node_offset in the layout it's kept in on the CPU
+  ui ScanLeafNode(ll node_offset, Point* query, ResultBuffer* result_buffer);
+
+  ll GetLeafNodeOffset(node::Node_SOA* node_soa, ui branch_itr) const;
+
+  ll GetLeafNodeDistances(ll leaf_node_offset, Point* point,
+                          Point* distances, ui& branch_count) const;
+
   void SetChunkSize(ui chunk_size);
 
   void SetChunkUpdated(bool updated);
@@ -66,6 +100,31 @@ class Hybrid : public Tree {
 
   void SetNumberOfCUDABlocks(ui number_of_cuda_blocks);
 
+  // keep the leaf nodes quantized in place of the leaf Node_SOAs
+  void SetQuantizeLeafNodes(bool quantize_leaf_nodes);
+
+  // # of queries scanned together when leaf nodes are scanned on the CPU,
+  // 0 or 1 to scan them one at a time
+  void SetQueryBatchSize(ui query_batch_size);
+
+  bool QuantizeLeafNodes(void);
+
+  // false if the leaf nodes are kept in another layout, the Node_SOAs of the
+  // upper levels are all there is then
+  bool IsLeafNodeSOA(void) const;
+
+  // move the Node_SOAs of the upper levels into an array of their own
+  void ReleaseLeafNodeSOA(void);
+
+  // the quantized leaf nodes and the data offsets of an index file
+  bool ReadQuantizedLeafNodes(std::shared_ptr<io::IndexFile> index_file);
+
+  // keep point leaf nodes in place of the leaf Node_SOAs if they hold points
+  bool EncodePointLeafNodes(void);
+
+  // the point leaf nodes of an index file
+  bool ReadPointLeafNodes(std::shared_ptr<io::IndexFile> index_file);
+
   ll TraverseInternalNodes(node::Node *node_ptr, Point* query, 
                            ll passed_hIndex, ui *node_visit_count,
                            const ui number_of_cpu_threads, ui& t_nBlocks);
@@ -98,6 +157,26 @@ class Hybrid : public Tree {
 
   TreeType UPPER_TREE_TYPE;
 
+  bool quantize_leaf_nodes=false;
+
+  ui query_batch_size=0;
+
+  // quantized leaf nodes in the order of the leaf Node_SOAs, empty unless
+  // they are kept in place of them
+  std::vector<node::QuantizedNode_SOA> quantized_leaf_nodes;
+
+  // offset in the data set of the branch at each position of the leaf
+  // level, the data points of quantized leaf nodes
+  std::vector<ui> data_offsets;
+
+  // data set the index is built from
+  std::shared_ptr<io::DataSet> data_set;
+
+  // point leaf nodes in the order of the leaf Node_SOAs, empty unless they
+  // are kept in place of them, when the leaf nodes hold points and aren't
+  // quantized
+  std::vector<node::PointNode_SOA> point_leaf_nodes;
+
   ll total_index_diff=0;
   int index_diff_cnt=0;
   ui total_launched_block=0;
@@ -124,6 +203,18 @@ __global__
 void global_ParallelScan_Leafnodes(Point* _query, ll start_node_offset, 
                                    ui chunk_size, ui bid_offset,
                                    ui number_of_blocks_per_cpu);
+
+// same as above on the quantized leaf nodes
+__global__ 
+void global_ParallelScan_QuantizedLeafnodes(Point* _query, ll start_node_offset, 
+                                            ui chunk_size, ui bid_offset,
+                                            ui number_of_blocks_per_cpu);
+
+// same as above on the point leaf nodes
+__global__ 
+void global_ParallelScan_PointLeafnodes(Point* _query, ll start_node_offset, 
+                                        ui chunk_size, ui bid_offset,
+                                        ui number_of_blocks_per_cpu);
  
 } // End of tree namespace
 } // End of ursus namespace
@@ -2,14 +2,19 @@
 
 #include "common/macro.h"
 #include "common/logger.h"
+#include "common/thread_pool.h"
 #include "evaluator/recorder.h"
 #include "sort/sorter.h"
+#include "sort/str_sorter.h"
 #include "transformer/transformer.h"
 #include "manager/chunk_manager.h"
+#include "node/leaf_scanner.h"
 
 #include <cassert>
+#include <chrono>
+#include <cstring>
+#include <thread>
 
-#include "cuda_profiler_api.h"
 
 namespace ursus {
 namespace tree {
@@ -22,7 +27,7 @@ MPHR::~MPHR() {
   if( b_node_ptr != nullptr) {
     delete b_node_ptr;
   }
-  if( node_soa_ptr != nullptr) {
+  if( node_soa_ptr != nullptr && !IsMapped(node_soa_ptr)) {
     delete node_soa_ptr;
   }
 }
@@ -38,23 +43,25 @@ bool MPHR::Build(std::shared_ptr<io::DataSet> input_data_set) {
 
   // Load an index from file it exists
   // otherwise, build an index and dump it to file
+  SetDataSet(input_data_set);
   auto index_name = GetIndexName(input_data_set);
   if(input_data_set->IsRebuild() || !DumpFromFile(index_name))  {
-    //===--------------------------------------------------------------------===//
-    // Create branches
-    //===--------------------------------------------------------------------===//
-    std::vector<node::Branch> branches = CreateBranches(input_data_set);
+    bool use_str = input_data_set->GetClusterType() == CLUSTER_TYPE_STR;
 
     //===--------------------------------------------------------------------===//
-    // Assign Hilbert Ids to branches
+    // Create branches and assign Hilbert Ids to them
     //===--------------------------------------------------------------------===//
-    ret = AssignHilbertIndexToBranches(branches);
-    assert(ret);
+    std::vector<node::Branch> branches = CreateBranches(input_data_set, !use_str);
 
     //===--------------------------------------------------------------------===//
-    // Sort the branches either CPU or GPU depending on the size
+    // Sort the branches either CPU or GPU depending on the size, or pack them
+    // in STR tiles of a leaf node each
     //===--------------------------------------------------------------------===//
-    ret = sort::Sorter::Sort(branches);
+    if(use_str) {
+      ret = sort::STR_Sorter::Sort(branches, GetNumberOfLeafNodeDegrees());
+    } else {
+      ret = sort::Sorter::Sort(branches);
+    }
     assert(ret);
 
     node::Node_SOA* node_soa_ptr_backup[number_of_partition];
@@ -78,6 +85,8 @@ bool MPHR::Build(std::shared_ptr<io::DataSet> input_data_set) {
       //===--------------------------------------------------------------------===//
       // TODO We may pass TREE_TYPE so that we can set the child offset to some
       // useful data in leaf nodes 
+      // node count of this partition, partitions may differ in size
+      device_node_count = 0;
       ret = Bottom_Up(partitioned_branches/*, tree_type*/);
       assert(ret);
 
@@ -110,6 +119,16 @@ bool MPHR::Build(std::shared_ptr<io::DataSet> input_data_set) {
     DumpToFile(index_name);
   }
 
+  if(search_device == DEVICE_TYPE_GPU && !backend::IsDeviceAvailable()) {
+    LOG_INFO("No CUDA device is available, search on the CPU");
+    search_device = DEVICE_TYPE_CPU;
+  }
+
+  // keep the tree on the host and search it there
+  if(search_device == DEVICE_TYPE_CPU) {
+    return true;
+  }
+
   //===--------------------------------------------------------------------===//
   // Set Root Offset per Each CUDA Block
   //===--------------------------------------------------------------------===//
@@ -117,7 +136,7 @@ bool MPHR::Build(std::shared_ptr<io::DataSet> input_data_set) {
   cudaErrCheck(cudaMalloc((void**) &d_root_offset, sizeof(ll)*GetNumberOfBlocks()));
   cudaErrCheck(cudaMemcpy(d_root_offset, root_offset, 
                           sizeof(ll)*GetNumberOfBlocks(), cudaMemcpyHostToDevice));
-  global_SetRootOffset<<<1,GetNumberOfBlocks()>>>(d_root_offset);
+  LaunchKernel(global_SetRootOffset, 1, GetNumberOfBlocks(), d_root_offset);
 
   //===--------------------------------------------------------------------===//
   // Move Tree to the GPU in advance
@@ -128,75 +147,108 @@ bool MPHR::Build(std::shared_ptr<io::DataSet> input_data_set) {
   chunk_manager.Init(sizeof(node::Node_SOA)*device_node_count);
   chunk_manager.CopyNode(node_soa_ptr, 0, device_node_count);
 
-    // deallocate tree on the host
-  delete node_soa_ptr;
-  node_soa_ptr = nullptr;
+  // deallocate tree on the host unless the results are materialized on the CPU
+  if(!materialize_result) {
+    if(!IsMapped(node_soa_ptr)) {
+      delete node_soa_ptr;
+    }
+    node_soa_ptr = nullptr;
+  }
 
   return true;
 }
 
 bool MPHR::DumpFromFile(std::string index_name){
 
-  FILE* index_file = OpenIndexFile(index_name);
+  auto index_file = OpenIndexFile(index_name, tree_type);
   if(index_file == nullptr) {
     return false;
   }
 
-  auto& recorder = evaluator::Recorder::GetInstance();
-  recorder.TimeRecordStart();
+  evaluator::TimeScope time_scope(STAGE_TYPE_LOAD);
 
   // read number of partition
-  fread(&number_of_partition, sizeof(ui), 1, index_file);
+  auto partitions = index_file->GetMetadata().number_of_partition;
+  if(partitions == 0 || partitions > GetNumberOfMAXBlocks()) {
+    return false;
+  }
 
   // read root offset
-  fread(&root_offset, sizeof(ll), number_of_partition, index_file);
-
-  // read total node count
-  fread(&device_node_count, sizeof(ui), 1, index_file);
+  if(!index_file->CopySection(io::INDEX_SECTION_TYPE_ROOT_OFFSET, root_offset, partitions)) {
+    return false;
+  }
 
-  node_soa_ptr = new node::Node_SOA[device_node_count];
   // read nodes
-  fread(node_soa_ptr, sizeof(node::Node_SOA), device_node_count, index_file);
+  ul node_count;
+  auto nodes = index_file->GetSection<node::Node_SOA>(io::INDEX_SECTION_TYPE_NODE_SOA, node_count);
+  if(nodes == nullptr) {
+    return false;
+  }
 
-  fclose(index_file);
+  number_of_partition = partitions;
+  device_node_count = node_count;
+  node_soa_ptr = nodes;
 
-  auto elapsed_time = recorder.TimeRecordEnd();
+  index_file->Close();
+
+  auto elapsed_time = time_scope.End();
   LOG_INFO("Done, time = %.6fs", elapsed_time/1000.0f);
 
   return true;
 }
 
 bool MPHR::DumpToFile(std::string index_name) {
-  auto& recorder = evaluator::Recorder::GetInstance();
-  recorder.TimeRecordStart();
+  evaluator::TimeScope time_scope(STAGE_TYPE_DUMP);
   LOG_INFO("Dump an index into file (%s)...", index_name.c_str());
 
-  // NOTE :: Use fwrite since it is fast
-  FILE* index_file;
-  index_file = fopen(index_name.c_str(),"wb");
+  auto metadata = GetIndexMetadata(tree_type);
+  metadata.number_of_partition = number_of_partition;
 
-  // write number of partition
-  fwrite(&number_of_partition, sizeof(ui), 1, index_file);
+  io::IndexFile index_file;
+  if(!index_file.Create(index_name, metadata)) {
+    return false;
+  }
 
   // write root offset
-  fwrite(&root_offset, sizeof(ll), number_of_partition, index_file);
-
-  // write total node count
-  fwrite(&device_node_count, sizeof(ui), 1, index_file);
+  index_file.WriteSection(io::INDEX_SECTION_TYPE_ROOT_OFFSET, root_offset, number_of_partition);
 
   // write nodes
-  fwrite(node_soa_ptr, sizeof(node::Node_SOA), device_node_count, index_file);
-  fclose(index_file);
+  index_file.WriteSection(io::INDEX_SECTION_TYPE_NODE_SOA, node_soa_ptr, device_node_count);
+
+  bool ret = index_file.Commit();
 
-  auto elapsed_time = recorder.TimeRecordEnd();
+  auto elapsed_time = time_scope.End();
   LOG_INFO("Done, time = %.6fs", elapsed_time/1000.0f);
-  return true;
+  return ret;
+}
+
+std::string MPHR::GetBuildParameters(void) const {
+  return "PARTITION_"+std::to_string(number_of_partition);
+}
+
+std::string MPHR::GetSearchParameters(void) const {
+  return DeviceTypeToString(search_device)+"_CPU_THREADS_"+std::to_string(number_of_cpu_threads)+
+         "_CUDA_BLOCKS_"+std::to_string(number_of_cuda_blocks);
+}
+
+std::vector<node::Node_SOA*> MPHR::GetKNNNodeSOARoots(void) const {
+  std::vector<node::Node_SOA*> roots;
+  if(node_soa_ptr) {
+    for(ui range(partition_itr, 0, number_of_partition)) {
+      roots.emplace_back(node_soa_ptr+root_offset[partition_itr]);
+    }
+  }
+  return roots;
 }
 
 int MPHR::Search(std::shared_ptr<io::DataSet> query_data_set, 
                    ui number_of_search, ui number_of_repeat) {
+  // the kernel only counts hits, so materialize the results on the CPU
+  if(search_device == DEVICE_TYPE_CPU || materialize_result) {
+    return SearchOnCPU(query_data_set, number_of_search, number_of_repeat);
+  }
+
 cudaProfilerStart();
-  auto& recorder = evaluator::Recorder::GetInstance();
 
   //===--------------------------------------------------------------------===//
   // Read Query 
@@ -226,7 +278,7 @@ cudaProfilerStart();
     //===--------------------------------------------------------------------===//
     // Execute Search Function
     //===--------------------------------------------------------------------===//
-    recorder.TimeRecordStart();
+    evaluator::TimeScope time_scope(STAGE_TYPE_SEARCH);
 
     ui number_of_batch = GetNumberOfBlocks();
     for(ui range(query_itr, 0, number_of_search,0)) {
@@ -238,9 +290,10 @@ cudaProfilerStart();
         number_of_batch = number_of_search - query_itr;
       }
 
-      global_RestartScanning_and_ParentCheck<<<number_of_batch,GetNumberOfThreads()>>>
-        (&d_query[query_itr*GetNumberOfDims()*2], number_of_partition, d_hit, 
-         d_root_visit_count, d_node_visit_count);
+      auto batch_start_time = std::chrono::steady_clock::now();
+      LaunchKernel(global_RestartScanning_and_ParentCheck, number_of_batch, GetNumberOfThreads(),
+                   &d_query[query_itr*GetNumberOfDims()*2], number_of_partition, d_hit, 
+                   d_root_visit_count, d_node_visit_count);
       cudaMemcpy(h_hit, d_hit, sizeof(ui)*number_of_batch, cudaMemcpyDeviceToHost);
       cudaMemcpy(h_root_visit_count, d_root_visit_count, sizeof(ui)*number_of_batch, cudaMemcpyDeviceToHost);
       cudaMemcpy(h_node_visit_count, d_node_visit_count, sizeof(ui)*number_of_batch, cudaMemcpyDeviceToHost);
@@ -250,13 +303,37 @@ cudaProfilerStart();
         total_root_visit_count += h_root_visit_count[i];
         total_node_visit_count += h_node_visit_count[i];
       }
+
+      // a block searches a query, or a partition of the same query, and
+      // every query of the batch is done when the copies above return
+      if(record_query_stats) {
+        auto batch_latency = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                             std::chrono::steady_clock::now()-batch_start_time).count();
+        if(number_of_partition == 1) {
+          for(ui range(i, 0, number_of_batch)) {
+            query_stats.latency.Record(batch_latency);
+            query_stats.node_visit_count.Record(h_node_visit_count[i]);
+            query_stats.hit.Record(h_hit[i]);
+          }
+        } else {
+          ui batch_hit = 0, batch_node_visit_count = 0;
+          for(ui range(i, 0, number_of_batch)) {
+            batch_hit += h_hit[i];
+            batch_node_visit_count += h_node_visit_count[i];
+          }
+          query_stats.latency.Record(batch_latency);
+          query_stats.node_visit_count.Record(batch_node_visit_count);
+          query_stats.hit.Record(batch_hit);
+        }
+      }
+
       if(number_of_partition == 1) {
         query_itr += GetNumberOfBlocks(); 
       } else {
         query_itr += 1;
       }
     }
-    auto elapsed_time = recorder.TimeRecordEnd();
+    auto elapsed_time = time_scope.End();
 cudaProfilerStop();
 
     //===--------------------------------------------------------------------===//
@@ -271,11 +348,229 @@ cudaProfilerStop();
   return true;
 }
 
+int MPHR::SearchOnCPU(std::shared_ptr<io::DataSet> query_data_set, 
+                      ui number_of_search, ui number_of_repeat) {
+  assert(node_soa_ptr);
+
+  //===--------------------------------------------------------------------===//
+  // Read Query 
+  //===--------------------------------------------------------------------===//
+  auto query = query_data_set->GetPoints();
+
+  for(ui range(repeat_itr, 0, number_of_repeat)) {
+    LOG_INFO("#%u) Evaluation", repeat_itr+1);
+    //===--------------------------------------------------------------------===//
+    // Prepare Multi-thread Query Processing
+    //===--------------------------------------------------------------------===//
+    auto& thread_pool = ThreadPool::GetInstance();
+    auto grain_size = thread_pool.GetGrainSize(number_of_search, number_of_cpu_threads);
+    auto number_of_chunks = thread_pool.GetNumberOfChunks(number_of_search, grain_size);
+
+    std::vector<ui> chunk_hit(number_of_chunks, 0);
+    std::vector<ui> chunk_root_visit_count(number_of_chunks, 0);
+    std::vector<ui> chunk_node_visit_count(number_of_chunks, 0);
+
+    // per-chunk append buffers, only used to materialize the results
+    std::vector<ResultBuffer> chunk_result;
+    if(materialize_result) {
+      chunk_result.resize(number_of_chunks);
+    }
+
+    // per-chunk query stats, only used to record each query
+    std::vector<evaluator::QueryStats> chunk_query_stats;
+    if(record_query_stats) {
+      chunk_query_stats.resize(number_of_chunks);
+    }
+
+    ui total_hit = 0;
+    ui total_root_visit_count = 0;
+    ui total_node_visit_count = 0;
+
+    //===--------------------------------------------------------------------===//
+    // Execute Search Function
+    //===--------------------------------------------------------------------===//
+    evaluator::TimeScope time_scope(STAGE_TYPE_SEARCH);
+
+    // queries are handed out in chunks to the thread pool
+    {
+      thread_pool.ParallelFor(0, number_of_search, [&](ul start_offset, ul end_offset) {
+        auto chunk_itr = start_offset/grain_size;
+        // count on the stack, neighbouring chunks share cache lines
+        ui hit, root_visit_count, node_visit_count;
+        Thread_Search(query, thread_pool.GetThreadId(),
+                      hit, root_visit_count, node_visit_count,
+                      (materialize_result)?&chunk_result[chunk_itr]:nullptr,
+                      (record_query_stats)?&chunk_query_stats[chunk_itr]:nullptr,
+                      start_offset, end_offset);
+        chunk_hit[chunk_itr] = hit;
+        chunk_root_visit_count[chunk_itr] = root_visit_count;
+        chunk_node_visit_count[chunk_itr] = node_visit_count;
+      }, number_of_cpu_threads, grain_size);
+
+      for(ui range(chunk_itr, 0, number_of_chunks)) {
+        total_hit += chunk_hit[chunk_itr];
+        total_root_visit_count += chunk_root_visit_count[chunk_itr];
+        total_node_visit_count += chunk_node_visit_count[chunk_itr];
+      }
+
+      if(record_query_stats) {
+        for(auto& chunk_stats : chunk_query_stats) {
+          query_stats.Merge(chunk_stats);
+        }
+      }
+
+      // compact the per-chunk buffers into a single result array
+      if(materialize_result) {
+        search_result.Compact(chunk_result, number_of_search);
+      }
+    }
+
+    auto elapsed_time = time_scope.End();
+    LOG_INFO("%u threads processing queries concurrently", number_of_cpu_threads);
+
+    //===--------------------------------------------------------------------===//
+    // Show Results
+    //===--------------------------------------------------------------------===//
+    LOG_INFO("Hit : %u", total_hit);
+    if(materialize_result) {
+      LOG_INFO("Materialized Results : %lu", search_result.GetNumberOfResults());
+    }
+    LOG_INFO("Avg. Search Time on the CPU(ms) = \n%.6f", elapsed_time/(float)number_of_search);
+    LOG_INFO("Avg. Root visit count : \n%f", total_root_visit_count/(float)number_of_search);
+    LOG_INFO("Avg. Node visit count : \n%f\n", total_node_visit_count/(float)number_of_search);
+  }
+
+  return true;
+}
+
+void MPHR::Thread_Search(Point* query, ui tid, ui& hit,
+                         ui& root_visit_count, ui& node_visit_count, 
+                         ResultBuffer* result_buffer, evaluator::QueryStats* chunk_stats,
+                         ui start_offset, ui end_offset) {
+  hit = 0;
+  root_visit_count = 0;
+  node_visit_count = 0;
+
+  if(result_buffer) {
+    result_buffer->Reset(start_offset);
+  }
+
+  ui query_offset = start_offset*GetNumberOfDims()*2;
+
+  for(ui range(query_itr, start_offset, end_offset)) {
+    evaluator::QueryTimer query_timer(chunk_stats, hit, node_visit_count);
+    // every partition is searched with the same query
+    for(ui range(partition_itr, 0, number_of_partition)) {
+      hit += RestartScanning(&query[query_offset], 
+                             node_soa_ptr+root_offset[partition_itr],
+                             &root_visit_count, &node_visit_count, result_buffer);
+    }
+    if(result_buffer) {
+      result_buffer->CloseQuery();
+    }
+    query_offset += GetNumberOfDims()*2;
+  }
+}
+
+/**
+ * @brief execute MPRS algorithm on the CPU, it follows the same path as
+ *        global_RestartScanning_and_ParentCheck 
+ * @param query
+ * @param root root node of a partition
+ * @param result_buffer matching indexes are appended if it's not null
+ * @return number of hits
+ */
+ui MPHR::RestartScanning(Point* query, node::Node_SOA* root, 
+                         ui* root_visit_count, ui* node_visit_count,
+                         ResultBuffer* result_buffer) {
+  ui hit = 0;
+  node::Node_SOA* node_soa_ptr = root;
+
+  ll visited_leafIndex = 0;
+  ll last_leafIndex = root->GetLastIndex();
+
+  (*root_visit_count)++;
+
+  // overlap bitmask of the branches, filled in for all lanes at once
+  ull overlap[node::GetNumberOfMaskWords()];
+
+  while( visited_leafIndex < last_leafIndex ) {
+
+    //look over the left most child node before reaching leaf node level
+    while( node_soa_ptr->GetNodeType() != NODE_TYPE_LEAF ) { 
+      ui child_itr = node_soa_ptr->GetBranchCount();
+      if( node_soa_ptr->ScanOverlap(query, overlap)) {
+        // find the leftmost overlapping branch not visited yet
+        for(ui range(word_itr, 0, node::GetNumberOfMaskWords())) {
+          for(ull bits = overlap[word_itr]; bits; bits &= bits-1) {
+            ui branch_itr = word_itr*64 + __builtin_ctzll(bits);
+            if( node_soa_ptr->GetIndex(branch_itr) > visited_leafIndex) {
+              child_itr = branch_itr;
+              break;
+            }
+          }
+          if( child_itr != node_soa_ptr->GetBranchCount()) {
+            break;
+          }
+        }
+      }
+
+      // none of the branches overlapped the query
+      if( child_itr == node_soa_ptr->GetBranchCount()) {
+        visited_leafIndex = node_soa_ptr->GetLastIndex();
+        node_soa_ptr = root;
+        (*root_visit_count)++;
+        break;
+      }
+      // there exists some overlapped node
+      else{
+        node_soa_ptr = node_soa_ptr->GetChildNode(child_itr);
+        (*node_visit_count)++;
+      }
+    } // end of while loop for internal nodes
+
+    while(node_soa_ptr->GetNodeType() == NODE_TYPE_LEAF) {
+      auto leaf_hit = ScanNodeSOA(node_soa_ptr, query, result_buffer);
+      hit += leaf_hit;
+
+      visited_leafIndex = node_soa_ptr->GetLastIndex();
+
+      // current node is the last leaf node, terminate search function
+      if(node_soa_ptr->GetLastIndex() == last_leafIndex ) {
+        break;
+      } else if( leaf_hit ) { // continue searching function by jumping next leaf node
+        node_soa_ptr++;
+        (*node_visit_count)++;
+      } else { 
+        // go back to the parent node through the first child offset
+        node_soa_ptr = node_soa_ptr->GetChildNode(0);
+        if( node_soa_ptr == root){
+          (*root_visit_count)++;
+        }else{
+          (*node_visit_count)++; 
+        }
+      }
+    } // end of leaf node checking
+  }
+
+  return hit;
+}
+
 void MPHR::SetNumberOfCUDABlocks(ui _number_of_cuda_blocks){
   number_of_cuda_blocks = _number_of_cuda_blocks;
   assert(number_of_cuda_blocks);
 }
 
+void MPHR::SetNumberOfCPUThreads(ui _number_of_cpu_threads) {
+  number_of_cpu_threads = _number_of_cpu_threads;
+  assert(number_of_cpu_threads);
+}
+
+void MPHR::SetSearchDevice(DeviceType _search_device) {
+  search_device = _search_device;
+  assert(search_device != DEVICE_TYPE_INVALID);
+}
+
 void MPHR::SetNumberOfPartition(ui _number_of_partition){
   number_of_partition = _number_of_partition;
   if( number_of_partition > 1) {
@@ -284,6 +579,10 @@ void MPHR::SetNumberOfPartition(ui _number_of_partition){
   assert(number_of_partition);
 }
 
+ui MPHR::GetNumberOfPartition(void) const{
+  return number_of_partition;
+}
+
 //===--------------------------------------------------------------------===//
 // Cuda Function 
 //===--------------------------------------------------------------------===//
@@ -307,7 +606,7 @@ void global_RestartScanning_and_ParentCheck(Point* _query, ui number_of_partitio
   int bid = blockIdx.x;
   int tid = threadIdx.x;
 
-  __shared__ ui childOverlap[GetNumberOfLeafNodeDegrees()];
+  __shared__ ui childOverlap[GetNumberOfThreads2()];
   __shared__ ui t_hit[GetNumberOfThreads2()]; 
   __shared__ bool isHit;
 
@@ -327,6 +626,7 @@ void global_RestartScanning_and_ParentCheck(Point* _query, ui number_of_partitio
   t_hit[tid] = 0;
   if(tid<GetNumberOfThreads2()-GetNumberOfThreads()){
     t_hit[tid+GetNumberOfThreads2()-GetNumberOfThreads()] = 0;
+    childOverlap[tid+GetNumberOfThreads2()-GetNumberOfThreads()] = GetNumberOfThreads()+1;
   }
  
 
@@ -351,17 +651,17 @@ void global_RestartScanning_and_ParentCheck(Point* _query, ui number_of_partitio
           (node_soa_ptr->IsOverlap(query, tid))) {
         childOverlap[tid] = tid;
       } else {
-        childOverlap[tid] = GetNumberOfLeafNodeDegrees()+1;
+        childOverlap[tid] = GetNumberOfThreads()+1;
       }
       __syncthreads();
 
 
       // check if I am the leftmost
       // Gather the Overlap idex and compare
-      FindMinOnGPU(childOverlap, GetNumberOfLeafNodeDegrees());
+      FindMinOnGPU(childOverlap, GetNumberOfThreads2());
 
       // none of the branches overlapped the query
-      if( childOverlap[0] == ( GetNumberOfLeafNodeDegrees()+1)) {
+      if( childOverlap[0] == ( GetNumberOfThreads()+1)) {
 
         visited_leafIndex = node_soa_ptr->GetLastIndex();
         node_soa_ptr = root;
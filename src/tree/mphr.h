@@ -27,21 +27,57 @@ class MPHR : public Tree {
 
   bool DumpToFile(std::string index_name);
 
+  // the tree is split into number_of_partition trees
+  std::string GetBuildParameters(void) const;
+
+  std::string GetSearchParameters(void) const;
+
+  // root of each partition, the tree is kept on the host only if it's
+  // searched on the CPU or the results are materialized
+  std::vector<node::Node_SOA*> GetKNNNodeSOARoots(void) const;
+
   /**
    * Search the data 
    */
   int Search(std::shared_ptr<io::DataSet> query_data_set, 
              ui number_of_search, ui number_of_repeat);
 
+  /**
+   * Run the MPRS algorithm on the CPU over the host copy of the tree,
+   * each cpu thread processes one query at a time
+   */
+  int SearchOnCPU(std::shared_ptr<io::DataSet> query_data_set, 
+                  ui number_of_search, ui number_of_repeat);
+
+  void Thread_Search(Point* query, ui tid, ui& hit, 
+                     ui& root_visit_count, ui& node_visit_count, 
+                     ResultBuffer* result_buffer, evaluator::QueryStats* chunk_stats,
+                     ui start_offset, ui end_offset);
+
+  ui RestartScanning(Point* query, node::Node_SOA* root, 
+                     ui* root_visit_count, ui* node_visit_count,
+                     ResultBuffer* result_buffer);
+
   void SetNumberOfCUDABlocks(ui number_of_cuda_blocks);
 
   void SetNumberOfPartition(ui number_of_partition);
 
+  ui GetNumberOfPartition(void) const;
+
+  void SetNumberOfCPUThreads(ui number_of_cpu_threads);
+
+  // device to run the MPRS algorithm on
+  void SetSearchDevice(DeviceType search_device);
+
   //===--------------------------------------------------------------------===//
   // Members
   //===--------------------------------------------------------------------===//
   ui number_of_partition = 1;
 
+  ui number_of_cpu_threads = 1;
+
+  DeviceType search_device = DEVICE_TYPE_GPU;
+
   ll root_offset[GetNumberOfMAXBlocks()] = {0};
 };
 
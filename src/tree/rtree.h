@@ -204,7 +204,8 @@ public:
 
         for(int child_itr=0; child_itr<node->m_count; child_itr++){
           node_ptr[node_count].SetBranchChildOffset(child_itr, 0);
-          node_ptr[node_count].SetBranchIndex(child_itr, 0);
+          // leaf entries hold the id they were inserted with, from 1
+          node_ptr[node_count].SetBranchIndex(child_itr, (ll)node->m_branch[child_itr].m_data+1);
 
           for(int d=0; d<GetNumberOfDims(); d++){
             node_ptr[node_count].SetBranchPoint(child_itr,  node->m_branch[child_itr].m_rect.m_min[d], d);
@@ -247,7 +248,8 @@ public:
             struct Node* child_node = node->m_branch[child_itr].m_child;
             for(int inner_child_itr=0; inner_child_itr< child_node->m_count; inner_child_itr++){
               b_node_ptr[b_node_count].SetBranchChildOffset(child_offset, 0);
-              b_node_ptr[b_node_count].SetBranchIndex(child_offset, 0);
+              // leaf entries hold the id they were inserted with, from 1
+              b_node_ptr[b_node_count].SetBranchIndex(child_offset, (ll)child_node->m_branch[inner_child_itr].m_data+1);
 
               for(int d=0; d<GetNumberOfDims(); d++){
                 b_node_ptr[b_node_count].SetBranchPoint(child_offset,  child_node->m_branch[inner_child_itr].m_rect.m_min[d], d);
@@ -1841,14 +1843,19 @@ class RTree : public Tree {
   int Search(std::shared_ptr<io::DataSet> query_data_set, 
              ui number_of_search, ui number_of_repeat);
 
-  void Thread_Search(std::vector<Point>&query, 
+  std::string GetSearchParameters(void) const;
+
+  node::Node* GetKNNRoot(void) const;
+
+  void Thread_Search(Point* query, 
                      ui tid, ui& hit, ui& node_visit_count, 
+                     ResultBuffer* result_buffer, evaluator::QueryStats* chunk_stats,
                      ui start_offset, ui end_offset) ;
 
   void SetNumberOfCPUThreads(ui number_of_cpu_threads);
 
   ui TraverseInternalNodes(node::Node *node_ptr, Point* query, 
-                           ui *node_visit_count);
+                           ui *node_visit_count, ResultBuffer* result_buffer);
 
   //===--------------------------------------------------------------------===//
   // Members
@@ -2,6 +2,7 @@
 
 #include "common/macro.h"
 #include "common/logger.h"
+#include "common/thread_pool.h"
 #include "evaluator/recorder.h"
 #include "sort/sorter.h"
 #include "transformer/transformer.h"
@@ -12,7 +13,6 @@
 #include <algorithm>
 #include <chrono> // for sleep
 
-#include "cuda_profiler_api.h"
 
 namespace ursus {
 namespace tree {
@@ -33,6 +33,7 @@ bool RTree_LS::Build(std::shared_ptr<io::DataSet> input_data_set) {
 
   // Load an index from file it exists
   // otherwise, build an index and dump it to file
+  SetDataSet(input_data_set);
   auto index_name = GetIndexName(input_data_set);
   if(input_data_set->IsRebuild() || !DumpFromFile(index_name)) {
     //===--------------------------------------------------------------------===//
@@ -55,6 +56,11 @@ bool RTree_LS::Build(std::shared_ptr<io::DataSet> input_data_set) {
     DumpToFile(index_name);
   } 
 
+  // leaf nodes are scanned on the CPU without a device
+  if(!backend::IsDeviceAvailable()) {
+    return true;
+  }
+
   //===--------------------------------------------------------------------===//
   // Move Trees to the GPU in advance
   //===--------------------------------------------------------------------===//
@@ -72,13 +78,12 @@ bool RTree_LS::Build(std::shared_ptr<io::DataSet> input_data_set) {
 }
 
 bool RTree_LS::DumpFromFile(std::string index_name) {
-  auto& recorder = evaluator::Recorder::GetInstance();
-  recorder.TimeRecordStart();
+  evaluator::TimeScope time_scope(STAGE_TYPE_LOAD);
 
   // naming
   std::string upper_tree_name = index_name;
   std::string flat_array_name = index_name;
-  auto pos = upper_tree_name.find("RTREE_LS");
+  auto pos = upper_tree_name.rfind("RTREE_LS");
 
   switch(UPPER_TREE_TYPE){
     case TREE_TYPE_RTREE:{
@@ -91,62 +96,50 @@ bool RTree_LS::DumpFromFile(std::string index_name) {
   }
 
 
-  FILE* upper_tree_index_file=nullptr;
-  FILE* flat_array_index_file=nullptr;
-
   // check file exists
-  if(IsExist(upper_tree_name)){
-    upper_tree_exists = true;
-    upper_tree_index_file = OpenIndexFile(upper_tree_name);
-  }
-  if(IsExist(flat_array_name)){
-    flat_array_exists = true;
-    flat_array_index_file = OpenIndexFile(flat_array_name);
-  }
-
-
-  //===--------------------------------------------------------------------===//
-  // Node counts
-  //===--------------------------------------------------------------------===//
-  // read host node count
-  if(upper_tree_exists){
-    fread(&host_node_count, sizeof(ui), 1, upper_tree_index_file);
-    fread(&host_height, sizeof(ui), 1, upper_tree_index_file);
-    assert(host_height);
-  }
-
-  // read device count for GPU
-  if(flat_array_exists){
-    fread(&device_node_count, sizeof(ui), 1, flat_array_index_file);
-  }
+  std::shared_ptr<io::IndexFile> upper_tree_index_file = OpenIndexFile(upper_tree_name, tree_type);
+  std::shared_ptr<io::IndexFile> flat_array_index_file = OpenIndexFile(flat_array_name, tree_type);
 
   //===--------------------------------------------------------------------===//
   // Nodes for CPU
   //===--------------------------------------------------------------------===//
-  if(upper_tree_exists) {
-    node_ptr = new node::Node[host_node_count];
-    fread(node_ptr, sizeof(node::Node), host_node_count, upper_tree_index_file);
+  if(upper_tree_index_file) {
+    ul node_count;
+    auto nodes = upper_tree_index_file->GetSection<node::Node>(io::INDEX_SECTION_TYPE_NODE, node_count);
+    if(nodes != nullptr && upper_tree_index_file->GetMetadata().height) {
+      // host node count
+      host_node_count = node_count;
+      host_height = upper_tree_index_file->GetMetadata().height;
+      node_ptr = nodes;
+      upper_tree_exists = true;
+    }
   }
 
   //===--------------------------------------------------------------------===//
   // Nodes for GPU
   //===--------------------------------------------------------------------===//
-  if(flat_array_exists){
-    node_soa_ptr = new node::Node_SOA[device_node_count];
-    fread(node_soa_ptr, sizeof(node::Node_SOA), device_node_count, flat_array_index_file);
+  if(flat_array_index_file){
+    ul node_count;
+    auto nodes = flat_array_index_file->GetSection<node::Node_SOA>(io::INDEX_SECTION_TYPE_NODE_SOA, node_count);
+    if(nodes != nullptr) {
+      // device count for GPU
+      device_node_count = node_count;
+      node_soa_ptr = nodes;
+      flat_array_exists = true;
+    }
   }
 
-  auto elapsed_time = recorder.TimeRecordEnd();
+  auto elapsed_time = time_scope.End();
 
   if(upper_tree_index_file) {
     LOG_INFO("DumpFromFile %s", upper_tree_name.c_str());
     LOG_INFO("Done, time = %.6fs", elapsed_time/1000.0f);
-    fclose(upper_tree_index_file);
+    upper_tree_index_file->Close();
   }
   if(flat_array_index_file) {
     LOG_INFO("DumpFromFile %s", flat_array_name.c_str());
     LOG_INFO("Done, time = %.6fs", elapsed_time/1000.0f);
-    fclose(flat_array_index_file);
+    flat_array_index_file->Close();
   }
 
   // return true all of them exist
@@ -159,13 +152,12 @@ bool RTree_LS::DumpFromFile(std::string index_name) {
 }
 
 bool RTree_LS::DumpToFile(std::string index_name) {
-  auto& recorder = evaluator::Recorder::GetInstance();
-  recorder.TimeRecordStart();
+  evaluator::TimeScope time_scope(STAGE_TYPE_DUMP);
 
   // naming
   std::string upper_tree_name = index_name;
   std::string flat_array_name = index_name;
-  auto pos = upper_tree_name.find("RTREE_LS");
+  auto pos = upper_tree_name.rfind("RTREE_LS");
 
   switch(UPPER_TREE_TYPE){
     case TREE_TYPE_RTREE:{
@@ -177,106 +169,47 @@ bool RTree_LS::DumpToFile(std::string index_name) {
       break;
   }
 
-  // NOTE :: Use fwrite as it is fast
-
-  FILE* upper_tree_index_file;
-  FILE* flat_array_index_file;
-  if(!upper_tree_exists){
-    upper_tree_index_file = fopen(upper_tree_name.c_str(),"wb");
-  }
-  if(!flat_array_exists){
-    flat_array_index_file = fopen(flat_array_name.c_str(),"wb");
-  }
-
-  //===--------------------------------------------------------------------===//
-  // Node counts
-  //===--------------------------------------------------------------------===//
-  // write node count for CPU
-  if(!upper_tree_exists){
-    fwrite(&host_node_count, sizeof(ui), 1, upper_tree_index_file);
-    fwrite(&host_height, sizeof(ui), 1, upper_tree_index_file);
-  }
-
-  // write node count for GPU
-  if(!flat_array_exists){
-    fwrite(&device_node_count, sizeof(ui), 1, flat_array_index_file);
-  }
+  bool ret = true;
 
   //===--------------------------------------------------------------------===//
   // Internal nodes
   //===--------------------------------------------------------------------===//
 
-  // Unlike dump function in MPHR class, we use the queue structure to dump the
-  // tree onto an index file since the nodes are allocated here and there in a
-  // Top-Down fashion
+  // top-down builds allocate the nodes in one array in BFS order, the layout
+  // of the index file, so the array is written as it is
   if(!upper_tree_exists){
-    std::queue<node::Node*> bfs_queue;
-    std::vector<ll> original_child_offset; // for backup
-
-    // push the root node
-    bfs_queue.emplace(node_ptr);
-
-    // if the queue is not empty,
-    while(!bfs_queue.empty()) {
-      // pop the first element 
-      node::Node* node = bfs_queue.front();
-      bfs_queue.pop();
-
-      // NOTE : Backup the child offsets in order to recover node's child offset later
-      // I believe accessing memory is faster than accesing disk,
-      // I don't use another fwrite for this job.
-      if( node->GetNodeType() == NODE_TYPE_INTERNAL) {
-        for(ui range(child_itr, 0, node->GetBranchCount())) {
-          if(node->GetLevel() < (host_height-1)){ // lowest internal node
-            node::Node* child_node = node->GetBranchChildNode(child_itr);
-            bfs_queue.emplace(child_node);
-
-            // backup current child offset
-            original_child_offset.emplace_back(node->GetBranchChildOffset(child_itr));
-
-            // reassign child offset
-            ll child_offset = (ll)bfs_queue.size()*(ll)sizeof(node::Node);
-            node->SetBranchChildOffset(child_itr, child_offset);
-          }
-        }
-      }
+    // height of the upper tree goes into the header
+    auto metadata = GetIndexMetadata(tree_type);
+    metadata.height = host_height;
 
-      // write an internal node on disk
-      fwrite(node, sizeof(node::Node), 1, upper_tree_index_file);
+    io::IndexFile upper_tree_index_file;
+    if(upper_tree_index_file.Create(upper_tree_name, metadata)) {
+      upper_tree_index_file.WriteSection(io::INDEX_SECTION_TYPE_NODE, node_ptr, host_node_count);
 
-      // Recover child offset
-      if( node->GetNodeType() == NODE_TYPE_INTERNAL) {
-        if(node->GetLevel() < (host_height-1)){
-          for(ui range(child_itr, 0, node->GetBranchCount())) {
-            // reassign child offset
-            node->SetBranchChildOffset(child_itr, original_child_offset[child_itr]);
-          }
-        }
-      }
-      original_child_offset.clear();
+      ret &= upper_tree_index_file.Commit();
+    } else {
+      ret = false;
     }
+    LOG_INFO("DumpToFile %s", upper_tree_name.c_str());
   }
 
   //===--------------------------------------------------------------------===//
   // Extend & leaf nodes
   //===--------------------------------------------------------------------===//
   if(!flat_array_exists){
-    fwrite(node_soa_ptr, sizeof(node::Node_SOA), GetNumberOfNodeSOA(), flat_array_index_file);
-  }
-
-
-  if(upper_tree_index_file){
-    LOG_INFO("DumpToFile %s", upper_tree_name.c_str());
-    fclose(upper_tree_index_file);
-  }
-  if(flat_array_index_file){
+    io::IndexFile flat_array_index_file;
+    if(flat_array_index_file.Create(flat_array_name, GetIndexMetadata(tree_type))) {
+      flat_array_index_file.WriteSection(io::INDEX_SECTION_TYPE_NODE_SOA, node_soa_ptr, GetNumberOfNodeSOA());
+      ret &= flat_array_index_file.Commit();
+    } else {
+      ret = false;
+    }
     LOG_INFO("DumpToFile %s", flat_array_name.c_str());
-    fclose(flat_array_index_file);
   }
 
-  auto elapsed_time = recorder.TimeRecordEnd();
+  auto elapsed_time = time_scope.End();
   LOG_INFO("Done, time = %.6fs", elapsed_time/1000.0f);
-  return true;
+  return ret;
 }
 
 ui RTree_LS::GetNumberOfNodeSOA() const{
@@ -284,16 +217,27 @@ ui RTree_LS::GetNumberOfNodeSOA() const{
   return device_node_count;
 }
 
+std::string RTree_LS::GetSearchParameters(void) const {
+  return "CPU_THREADS_"+std::to_string(number_of_cpu_threads)+
+         "_CUDA_BLOCKS_"+std::to_string(number_of_cuda_blocks)+
+         "_CHUNK_SIZE_"+std::to_string(chunk_size);
+}
+
 int RTree_LS::Search(std::shared_ptr<io::DataSet> query_data_set, 
                    ui number_of_search, ui number_of_repeat){
 
-  auto& recorder = evaluator::Recorder::GetInstance();
-
   //===--------------------------------------------------------------------===//
   // Read Query 
   //===--------------------------------------------------------------------===//
   auto query = query_data_set->GetPoints();
-  auto d_query = query_data_set->GetDeviceQuery(number_of_search);
+
+  // the GPU only counts hits, so leaf nodes are scanned on the CPU to
+  // materialize the results, and without a device
+  bool scan_on_device = !materialize_result && backend::IsDeviceAvailable();
+  Point* d_query = nullptr;
+  if(scan_on_device) {
+    d_query = query_data_set->GetDeviceQuery(number_of_search);
+  }
 
   //===--------------------------------------------------------------------===//
   // Set # of threads and Chunk Size
@@ -313,20 +257,38 @@ int RTree_LS::Search(std::shared_ptr<io::DataSet> query_data_set,
     ui total_node_visit_count_cpu = 0;
     ui total_node_visit_count_gpu = 0;
 
-    ui* d_hit;
-    cudaErrCheck(cudaMalloc((void**) &d_hit, sizeof(ui)*GetNumberOfBlocks()));
-    ui* d_node_visit_count;
-    cudaErrCheck(cudaMalloc((void**) &d_node_visit_count, sizeof(ui)*GetNumberOfBlocks()));
+    ui* d_hit = nullptr;
+    ui* d_node_visit_count = nullptr;
+    if(scan_on_device) {
+      cudaErrCheck(cudaMalloc((void**) &d_hit, sizeof(ui)*GetNumberOfBlocks()));
+      cudaErrCheck(cudaMalloc((void**) &d_node_visit_count, sizeof(ui)*GetNumberOfBlocks()));
 
-    // initialize hit and node visit variables to zero
-    global_SetHitCount2<<<1,GetNumberOfBlocks()>>>(0);
-    cudaDeviceSynchronize();
+      // initialize hit and node visit variables to zero
+      LaunchKernel(global_SetHitCount2, 1, GetNumberOfBlocks(), 0);
+      cudaDeviceSynchronize();
+    }
 
     //===--------------------------------------------------------------------===//
     // Prepare Multi-thread Query Processing
     //===--------------------------------------------------------------------===//
-    std::vector<std::thread> threads;
-    ui thread_node_visit_count_cpu[number_of_cpu_threads];
+    auto& thread_pool = ThreadPool::GetInstance();
+    auto grain_size = thread_pool.GetGrainSize(number_of_search, number_of_cpu_threads);
+    auto number_of_chunks = thread_pool.GetNumberOfChunks(number_of_search, grain_size);
+
+    std::vector<ui> chunk_hit(number_of_chunks, 0);
+    std::vector<ui> chunk_node_visit_count_cpu(number_of_chunks, 0);
+
+    // per-chunk append buffers, only used to materialize the results
+    std::vector<ResultBuffer> chunk_result;
+    if(materialize_result) {
+      chunk_result.resize(number_of_chunks);
+    }
+
+    // per-chunk query stats, only used to record each query
+    std::vector<evaluator::QueryStats> chunk_query_stats;
+    if(record_query_stats) {
+      chunk_query_stats.resize(number_of_chunks);
+    }
 
     //===--------------------------------------------------------------------===//
     // Execute Search Function
@@ -334,32 +296,38 @@ int RTree_LS::Search(std::shared_ptr<io::DataSet> query_data_set,
     cudaProfilerStart();
 
     // launch the thread for monitoring as a background
-    recorder.TimeRecordStart();
+    evaluator::TimeScope time_scope(STAGE_TYPE_SEARCH);
 
-    // parallel for loop using c++ std 11 
+    // queries are handed out in chunks to the thread pool, the thread id
+    // picks the slice of CUDA blocks the chunk is scanned with
     {
-      auto search_chunk_size = number_of_search/number_of_cpu_threads;
-      auto start_offset = 0 ;
-      auto end_offset = start_offset + search_chunk_size + number_of_search%number_of_cpu_threads;
-
-      for (ui range(thread_itr, 0, number_of_cpu_threads)) {
-        threads.push_back(std::thread(&RTree_LS::Thread_Search, 
-              this, std::ref(query), d_query, 
-              thread_itr, number_of_blocks_per_cpu, 
-              std::ref(thread_node_visit_count_cpu[thread_itr]),
-              start_offset, end_offset));
-
-        start_offset = end_offset;
-        end_offset += search_chunk_size;
+      thread_pool.ParallelFor(0, number_of_search, [&](ul start_offset, ul end_offset) {
+        auto chunk_itr = start_offset/grain_size;
+        ui hit, node_visit_count;
+        Thread_Search(query, d_query, 
+                      thread_pool.GetThreadId(), 
+                      number_of_blocks_per_cpu, hit, node_visit_count,
+                      (materialize_result)?&chunk_result[chunk_itr]:nullptr,
+                      (record_query_stats)?&chunk_query_stats[chunk_itr]:nullptr,
+                      start_offset, end_offset);
+        chunk_hit[chunk_itr] = hit;
+        chunk_node_visit_count_cpu[chunk_itr] = node_visit_count;
+      }, number_of_cpu_threads, grain_size);
+
+      for(ui range(chunk_itr, 0, number_of_chunks)) {
+        total_hit += chunk_hit[chunk_itr];
+        total_node_visit_count_cpu += chunk_node_visit_count_cpu[chunk_itr];
       }
 
-      //Join the threads with the main thread
-      for(auto &thread : threads){
-        thread.join();
+      if(record_query_stats) {
+        for(auto& chunk_stats : chunk_query_stats) {
+          query_stats.Merge(chunk_stats);
+        }
       }
 
-      for(ui range(thread_itr, 0, number_of_cpu_threads)) {
-        total_node_visit_count_cpu += thread_node_visit_count_cpu[thread_itr];
+      // compact the per-chunk buffers into a single result array
+      if(materialize_result) {
+        search_result.Compact(chunk_result, number_of_search);
       }
     }
 
@@ -367,17 +335,19 @@ int RTree_LS::Search(std::shared_ptr<io::DataSet> query_data_set,
     // cudaDeviceSynchronize(), is that they stall the GPU pipeline
     cudaDeviceSynchronize();
 
-    global_GetHitCount2<<<1,GetNumberOfBlocks()>>>(d_hit, d_node_visit_count);
-    cudaMemcpy(h_hit, d_hit, sizeof(ui)*GetNumberOfBlocks(), cudaMemcpyDeviceToHost);
-    cudaMemcpy(h_node_visit_count, d_node_visit_count, sizeof(ui)*GetNumberOfBlocks(), 
-               cudaMemcpyDeviceToHost);
+    if(scan_on_device) {
+      LaunchKernel(global_GetHitCount2, 1, GetNumberOfBlocks(), d_hit, d_node_visit_count);
+      cudaMemcpy(h_hit, d_hit, sizeof(ui)*GetNumberOfBlocks(), cudaMemcpyDeviceToHost);
+      cudaMemcpy(h_node_visit_count, d_node_visit_count, sizeof(ui)*GetNumberOfBlocks(), 
+                 cudaMemcpyDeviceToHost);
 
-    for(ui range(i, 0, GetNumberOfBlocks())) {
-      total_hit += h_hit[i];
-      total_node_visit_count_gpu += h_node_visit_count[i];
+      for(ui range(i, 0, GetNumberOfBlocks())) {
+        total_hit += h_hit[i];
+        total_node_visit_count_gpu += h_node_visit_count[i];
+      }
     }
 
-    auto elapsed_time = recorder.TimeRecordEnd();
+    auto elapsed_time = time_scope.End();
 
     // terminate the monitoring
     search_finish = true;
@@ -400,17 +370,29 @@ int RTree_LS::Search(std::shared_ptr<io::DataSet> query_data_set,
   return 1;
 }
 
-void RTree_LS::Thread_Search(std::vector<Point>& query, Point* d_query, ui tid,
-                           ui number_of_blocks_per_cpu, ui& node_visit_count, 
+void RTree_LS::Thread_Search(Point* query, Point* d_query, ui tid,
+                           ui number_of_blocks_per_cpu, ui& hit, ui& node_visit_count, 
+                           ResultBuffer* result_buffer, evaluator::QueryStats* chunk_stats,
                            ui start_offset, ui end_offset) {
+  hit = 0;
   node_visit_count = 0;
   ui query_offset = start_offset*GetNumberOfDims()*2;
+  // the slice of CUDA blocks of this thread
+  assert(tid < number_of_cpu_threads);
   const ui bid_offset = tid*number_of_blocks_per_cpu;
 
+  if(result_buffer) {
+    result_buffer->Reset(start_offset);
+  }
+
   for(ui range(query_itr, start_offset, end_offset)) {
-      RTree_LS_Search(node_ptr, &query[query_offset], d_query, // FIXME do not pass the query offset...
+      evaluator::QueryTimer query_timer(chunk_stats, hit, node_visit_count, d_query != nullptr);
+      hit += RTree_LS_Search(node_ptr, &query[query_offset], d_query, // FIXME do not pass the query offset...
                       query_offset, bid_offset, number_of_blocks_per_cpu, 
-                      &node_visit_count);
+                      &node_visit_count, result_buffer);
+      if(result_buffer) {
+        result_buffer->CloseQuery();
+      }
       query_offset += GetNumberOfDims()*2;
   }
 }
@@ -448,9 +430,10 @@ void RTree_LS::SetNumberOfCUDABlocks(ui _number_of_cuda_blocks){
   assert(number_of_cuda_blocks);
 }
 
-void RTree_LS::RTree_LS_Search(node::Node *node_ptr, Point* query, Point* d_query,
+ui RTree_LS::RTree_LS_Search(node::Node *node_ptr, Point* query, Point* d_query,
     ui query_offset, ui bid_offset, ui number_of_blocks_per_cpu, 
-    ui *node_visit_count) {
+    ui *node_visit_count, ResultBuffer* result_buffer) {
+  ui hit = 0;
   (*node_visit_count)++;
 
   for(ui range(branch_itr, 0, node_ptr->GetBranchCount())){
@@ -458,15 +441,22 @@ void RTree_LS::RTree_LS_Search(node::Node *node_ptr, Point* query, Point* d_quer
       // if child node is leaf, scan on the GPU
       if(node_ptr->GetLevel() == (host_height-1)){
         auto start_node_offset = node_ptr->GetBranchChildOffset(branch_itr);
-        global_RTree_LeafNode_Scan<<<number_of_blocks_per_cpu,GetNumberOfThreads()>>> 
-               (&d_query[query_offset], start_node_offset,
-                bid_offset, number_of_blocks_per_cpu );
+        if(d_query == nullptr) {
+          // scan the leaf node on the CPU instead
+          hit += ScanNodeSOA(&node_soa_ptr[start_node_offset], query, result_buffer);
+        } else {
+          LaunchKernel(global_RTree_LeafNode_Scan, number_of_blocks_per_cpu, GetNumberOfThreads(),
+                       &d_query[query_offset], start_node_offset,
+                       bid_offset, number_of_blocks_per_cpu);
+        }
       } else {
-        RTree_LS_Search(node_ptr->GetBranchChildNode(branch_itr), query, d_query,
-            query_offset, bid_offset, number_of_blocks_per_cpu, node_visit_count);
+        hit += RTree_LS_Search(node_ptr->GetBranchChildNode(branch_itr), query, d_query,
+            query_offset, bid_offset, number_of_blocks_per_cpu, node_visit_count,
+            result_buffer);
       }
     }
   }
+  return hit;
 }
 
 //===--------------------------------------------------------------------===//
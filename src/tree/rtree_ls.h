@@ -42,9 +42,14 @@ class RTree_LS : public Tree {
   int Search(std::shared_ptr<io::DataSet> query_data_set, 
              ui number_of_search, ui number_of_repeat);
 
-  void Thread_Search(std::vector<Point>&query, Point* d_query, 
-                     ui tid, ui number_of_blocks_per_cpu, 
-                     ui& node_visit_count, 
+  std::string GetSearchParameters(void) const;
+
+  // leaf nodes are scanned on the CPU if d_query is null, their hits are
+  // counted in hit
+  void Thread_Search(Point* query, Point* d_query, 
+                     ui tid, ui number_of_blocks_per_cpu, ui& hit,
+                     ui& node_visit_count, ResultBuffer* result_buffer,
+                     evaluator::QueryStats* chunk_stats,
                      ui start_offset, ui end_offset) ;
 
   void SetChunkSize(ui chunk_size);
@@ -57,9 +62,10 @@ class RTree_LS : public Tree {
 
   void SetNumberOfCUDABlocks(ui number_of_cuda_blocks);
 
-  void RTree_LS_Search(node::Node *node_ptr, Point* query, Point* d_query,
+  // returns the hits of leaf nodes scanned on the CPU
+  ui RTree_LS_Search(node::Node *node_ptr, Point* query, Point* d_query,
                        ui query_offset, ui bid_offset, ui number_of_blocks_per_cpu, 
-                       ui *node_visit_count);
+                       ui *node_visit_count, ResultBuffer* result_buffer);
 
   //===--------------------------------------------------------------------===//
   // Members
@@ -0,0 +1,122 @@
+#include "tree/search_result.h"
+
+#include "common/macro.h"
+#include "common/thread_pool.h"
+
+#include <cassert>
+#include <cstring>
+
+namespace ursus {
+namespace tree {
+
+//===--------------------------------------------------------------------===//
+// Result Buffer
+//===--------------------------------------------------------------------===//
+void ResultBuffer::Reset(ui _start_query) {
+  start_query = _start_query;
+  counts.clear();
+  indexes.clear();
+  query_begin = 0;
+}
+
+void ResultBuffer::CloseQuery(void) {
+  counts.emplace_back(indexes.size()-query_begin);
+  query_begin = indexes.size();
+}
+
+ui ResultBuffer::GetStartQuery(void) const {
+  return start_query;
+}
+
+ui ResultBuffer::GetNumberOfQueries(void) const {
+  return counts.size();
+}
+
+ul ResultBuffer::GetNumberOfResults(void) const {
+  return indexes.size();
+}
+
+//===--------------------------------------------------------------------===//
+// Search Result
+//===--------------------------------------------------------------------===//
+
+/**
+ * @brief merge per-thread buffers into one contiguous result array.
+ *        per-query counts are turned into offsets with a prefix sum, then
+ *        every buffer is copied into its own slice concurrently
+ * @param result_buffers per-thread buffers covering disjoint query ranges
+ * @param number_of_search number of queries in this batch
+ * @return true if success to compact otherwise false
+ */
+bool SearchResult::Compact(std::vector<ResultBuffer>& result_buffers,
+                           ui number_of_search) {
+  offsets.assign(number_of_search+1, 0);
+
+  for(auto& result_buffer : result_buffers) {
+    assert(result_buffer.start_query+result_buffer.counts.size() <= number_of_search);
+    for(ui range(query_itr, 0, result_buffer.counts.size())) {
+      offsets[result_buffer.start_query+query_itr+1] = result_buffer.counts[query_itr];
+    }
+  }
+
+  // exclusive prefix sum over the counts
+  for(ui range(query_itr, 0, number_of_search)) {
+    offsets[query_itr+1] += offsets[query_itr];
+  }
+
+  indexes.resize(offsets.back());
+
+  // one buffer at a time, buffers differ a lot in size
+  ThreadPool::GetInstance().ParallelFor(0, result_buffers.size(),
+                                        [&](ul start_offset, ul end_offset) {
+    for(ul range(buffer_itr, start_offset, end_offset)) {
+      Thread_Copy(result_buffers[buffer_itr]);
+    }
+  }, 0, 1);
+
+  return true;
+}
+
+void SearchResult::Thread_Copy(ResultBuffer& result_buffer) {
+  if(result_buffer.indexes.empty()) {
+    return;
+  }
+  auto offset = offsets[result_buffer.start_query];
+  assert(offset+result_buffer.indexes.size() <= indexes.size());
+  memcpy(&indexes[offset], result_buffer.indexes.data(),
+         sizeof(ll)*result_buffer.indexes.size());
+}
+
+void SearchResult::Clear(void) {
+  offsets.clear();
+  indexes.clear();
+}
+
+ui SearchResult::GetNumberOfQueries(void) const {
+  return offsets.empty() ? 0 : offsets.size()-1;
+}
+
+ul SearchResult::GetNumberOfResults(void) const {
+  return indexes.size();
+}
+
+ul SearchResult::GetNumberOfResults(ui query) const {
+  assert(query < GetNumberOfQueries());
+  return offsets[query+1]-offsets[query];
+}
+
+const ll* SearchResult::GetResults(ui query) const {
+  assert(query < GetNumberOfQueries());
+  return indexes.data()+offsets[query];
+}
+
+const std::vector<ul>& SearchResult::GetOffsets(void) const {
+  return offsets;
+}
+
+const std::vector<ll>& SearchResult::GetIndexes(void) const {
+  return indexes;
+}
+
+} // End of tree namespace
+} // End of ursus namespace
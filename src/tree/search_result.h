@@ -0,0 +1,95 @@
+#pragma once
+
+#include "common/types.h"
+
+#include <vector>
+
+namespace ursus {
+namespace tree {
+
+/**
+ * Append buffer owned by a single search thread. A thread processes a
+ * contiguous range of queries, so the indexes of its queries are appended
+ * one query after another without any synchronization.
+ */
+class ResultBuffer {
+ public:
+ //===--------------------------------------------------------------------===//
+ // Main Function
+ //===--------------------------------------------------------------------===//
+  void Reset(ui start_query);
+
+  void Append(ll index) { indexes.emplace_back(index); }
+
+  // close the current query and record how many indexes were appended for it
+  void CloseQuery(void);
+
+ //===--------------------------------------------------------------------===//
+ // Accessor
+ //===--------------------------------------------------------------------===//
+  ui GetStartQuery(void) const;
+
+  ui GetNumberOfQueries(void) const;
+
+  ul GetNumberOfResults(void) const;
+
+ //===--------------------------------------------------------------------===//
+ // Members
+ //===--------------------------------------------------------------------===//
+ private:
+  friend class SearchResult;
+
+  // first query handled by this buffer
+  ui start_query = 0;
+
+  // # of indexes of each closed query
+  std::vector<ui> counts;
+
+  // matching (Hilbert ordered) indexes of all closed queries
+  std::vector<ll> indexes;
+
+  // size of indexes when the current query started
+  ul query_begin = 0;
+};
+
+/**
+ * Contiguous result array of a batch of queries.
+ * Indexes of the i-th query are stored in [offsets[i], offsets[i+1])
+ */
+class SearchResult {
+ public:
+ //===--------------------------------------------------------------------===//
+ // Main Function
+ //===--------------------------------------------------------------------===//
+  bool Compact(std::vector<ResultBuffer>& result_buffers, ui number_of_search);
+
+  void Clear(void);
+
+ //===--------------------------------------------------------------------===//
+ // Accessor
+ //===--------------------------------------------------------------------===//
+  ui GetNumberOfQueries(void) const;
+
+  ul GetNumberOfResults(void) const;
+
+  ul GetNumberOfResults(ui query) const;
+
+  const ll* GetResults(ui query) const;
+
+  const std::vector<ul>& GetOffsets(void) const;
+
+  const std::vector<ll>& GetIndexes(void) const;
+
+ //===--------------------------------------------------------------------===//
+ // Members
+ //===--------------------------------------------------------------------===//
+ private:
+  void Thread_Copy(ResultBuffer& result_buffer);
+
+  std::vector<ul> offsets;
+
+  std::vector<ll> indexes;
+};
+
+} // End of tree namespace
+} // End of ursus namespace
@@ -1,18 +1,20 @@
 #include "tree/tree.h"
 
 #include "tree/rtree.h"
+#include "common/hash.h"
 #include "common/macro.h"
 #include "common/logger.h"
+#include "common/thread_pool.h"
 #include "evaluator/evaluator.h"
 #include "evaluator/recorder.h"
 #include "mapper/hilbert_mapper.h"
 #include "mapper/kmeans_mapper.h"
+#include "node/leaf_scanner.h"
 
 #include <algorithm>
 #include <cmath>
 #include <cassert>
 #include <functional>
-#include <thread>
 #include <utility>
 #include <queue>
 #include <sys/stat.h>
@@ -34,7 +36,7 @@ TreeType Tree::GetTreeType() const {
  * @param : input_data_set
  * @return : index name
  */
-std::string Tree::GetIndexName(std::shared_ptr<io::DataSet> input_data_set){
+std::string Tree::GetIndexName(std::shared_ptr<io::DataSet> input_data_set) const {
 
   auto data_type = input_data_set->GetDataType();
   auto cluster_type = input_data_set->GetClusterType();
@@ -52,29 +54,90 @@ std::string Tree::GetIndexName(std::shared_ptr<io::DataSet> input_data_set){
     number_of_data_str=std::to_string(number_of_data)+"M";
   }
 
+  // the key covers what the index is built from rather than where the data
+  // file is, so a cached index is never used for other data or settings.
+  // The data is told apart by the hash of all of it, kept next to the index
+  // files until the data file changes
+  auto build_parameters = DataTypeToString(data_type)+"_"+ClusterTypeToString(cluster_type)+"_"+
+    std::to_string(dimensions)+"_"+std::to_string(input_data_set->GetNumberOfData())+"_"+
+    std::to_string(leaf_degrees)+"_"+std::to_string(internal_degrees)+"_"+
+    std::to_string(io::GetIndexFileVersion())+"_"+GetBuildParameters();
+  std::string index_directory_path = index_directory;
+  if(!index_directory_path.empty() && index_directory_path.back() != '/') {
+    index_directory_path += "/";
+  }
+
+  auto index_key = CombineHash(input_data_set->GetContentHash(index_directory_path),
+                               HashString(build_parameters));
+
   std::string index_name =
-  "/scratch/jwkim/index_files/"+DataTypeToString(data_type)+"_"+DataSetTypeToString(dataset_type)+
+  index_directory_path+DataTypeToString(data_type)+"_"+DataSetTypeToString(dataset_type)+
   "_DATA_"+ClusterTypeToString(cluster_type)+"_" +
   std::to_string(dimensions)+"DIMS_"+number_of_data_str+"_"+
   TreeTypeToString(tree_type)+"_"+std::to_string(leaf_degrees)+"_DEGREES_"
-  +std::to_string(internal_degrees)+"_DEGREES2";
+  +std::to_string(internal_degrees)+"_DEGREES2_"+HashToString(index_key);
 
   return index_name;
 }
 
-FILE* Tree::OpenIndexFile(std::string index_name){
-  FILE* index_file = nullptr;
-  index_file = fopen(index_name.c_str(),"rb");
+std::string Tree::GetBuildParameters(void) const {
+  return "";
+}
+
+std::string Tree::GetSearchParameters(void) const {
+  return "";
+}
+
+void Tree::SetIndexDirectory(std::string _index_directory) {
+  index_directory = _index_directory;
+}
+
+void Tree::SetDataSet(std::shared_ptr<io::DataSet> input_data_set) {
+  cluster_type = input_data_set->GetClusterType();
+  data_hash = input_data_set->GetContentHash(index_directory);
+}
 
-  if(!index_file) {
+std::shared_ptr<io::IndexFile> Tree::OpenIndexFile(std::string index_name,
+                                                   TreeType index_tree_type){
+  if(!IsExist(index_name)) {
     LOG_INFO("An index file(%s) doesn't exist", index_name.c_str());
     return nullptr;
   }
 
-  LOG_INFO("Load an index file (%s)", index_name.c_str());
+  auto index_file = std::make_shared<io::IndexFile>();
+  index_file->SetVerifyMapped(verify_index);
+  if(!index_file->Open(index_name, load_type)) {
+    LOG_INFO("Ignore an index file(%s)", index_name.c_str());
+    return nullptr;
+  }
+
+  auto& metadata = index_file->GetMetadata();
+  if(metadata.tree_type != index_tree_type ||
+     (cluster_type != CLUSTER_TYPE_INVALID && metadata.cluster_type != cluster_type) ||
+     (data_hash && metadata.data_hash != data_hash)) {
+    LOG_INFO("Ignore an index file(%s) of %s with %s", index_name.c_str(),
+             TreeTypeToString(metadata.tree_type).c_str(),
+             ClusterTypeToString(metadata.cluster_type).c_str());
+    return nullptr;
+  }
+
+  LOG_INFO("Load an index file (%s) with %s", index_name.c_str(),
+           LoadTypeToString(index_file->GetLoadType()).c_str());
+
+  if(index_file->GetLoadType() != LOAD_TYPE_READ) {
+    index_files.emplace_back(index_file);
+  }
   return index_file;
 }
 
+io::IndexMetadata Tree::GetIndexMetadata(TreeType index_tree_type) const {
+  io::IndexMetadata metadata;
+  metadata.tree_type = index_tree_type;
+  metadata.cluster_type = cluster_type;
+  metadata.data_hash = data_hash;
+  return metadata;
+}
+
 // check is file existing or not
 bool Tree::IsExist (const std::string& name) {
   struct stat buffer;   
@@ -82,6 +145,51 @@ bool Tree::IsExist (const std::string& name) {
 }
 
 
+void Tree::SetMaterializeResult(bool _materialize_result) {
+  materialize_result = _materialize_result;
+}
+
+bool Tree::IsMaterializeResult(void) const {
+  return materialize_result;
+}
+
+const SearchResult& Tree::GetSearchResult(void) const {
+  return search_result;
+}
+
+void Tree::SetRecordQueryStats(bool _record_query_stats) {
+  record_query_stats = _record_query_stats;
+}
+
+bool Tree::IsRecordQueryStats(void) const {
+  return record_query_stats;
+}
+
+evaluator::QueryStats& Tree::GetQueryStats(void) {
+  return query_stats;
+}
+
+void Tree::SetLoadType(LoadType _load_type) {
+  load_type = _load_type;
+}
+
+LoadType Tree::GetLoadType(void) const {
+  return load_type;
+}
+
+void Tree::SetVerifyIndex(bool _verify_index) {
+  verify_index = _verify_index;
+}
+
+bool Tree::IsMapped(const void* ptr) const {
+  for(auto& index_file : index_files) {
+    if(index_file->IsMapped(ptr)) {
+      return true;
+    }
+  }
+  return false;
+}
+
 //TODO add comment this function
 bool Tree::Top_Down(std::vector<node::Branch> &branches, 
                     TreeType tree_type) {
@@ -107,34 +215,36 @@ bool Tree::Top_Down(std::vector<node::Branch> &branches,
 
 bool Tree::BVH_Top_Down(std::vector<node::Branch> &branches) {
   std::vector<ui> level_node_count;
-  auto& recorder = evaluator::Recorder::GetInstance();
-  recorder.TimeRecordStart();
+  evaluator::TimeScope time_scope(STAGE_TYPE_TOP_DOWN);
 
-  node_ptr = CreateNode(branches, 0, branches.size()-1, 0, level_node_count);
+  node_ptr = CreateNode(branches, 0, branches.size()-1, level_node_count);
 
+  host_node_count=0;
   for(ui range( level_itr, 0, level_node_count.size() )) {
     LOG_INFO("Level[%u] %u", level_itr, level_node_count[level_itr]);
+    host_node_count += level_node_count[level_itr];
   }
 
   host_height = level_node_count.size();
 
-  auto elapsed_time = recorder.TimeRecordEnd();
+  auto elapsed_time = time_scope.End();
   LOG_INFO("Top-Down Construction Time on the CPU = %.6fs", elapsed_time/1000.0f);
+  return true;
 }
- 
+
 
 bool Tree::RTree_Top_Down(std::vector<node::Branch> &branches) {
   std::vector<ui> level_node_count;
-  auto& recorder = evaluator::Recorder::GetInstance();
-  recorder.TimeRecordStart();
+  evaluator::TimeScope top_down_scope(STAGE_TYPE_TOP_DOWN);
 
-  typedef ursus::RTree<float, float, GetNumberOfDims(), float, GetNumberOfUpperTreeDegrees()> RTrees;
+  // the position of a branch is its id, the index of its leaf entry
+  typedef ursus::RTree<ll, float, GetNumberOfDims(), float, GetNumberOfUpperTreeDegrees()> RTrees;
   RTrees tree;
 
   float min[GetNumberOfDims()];
   float max[GetNumberOfDims()];
 
-  int i=0;
+  ll i=0;
   for(auto branch : branches){
     for(int d=0; d<GetNumberOfDims(); d++){
       min[d] = branch.GetPoint(d);
@@ -142,10 +252,10 @@ bool Tree::RTree_Top_Down(std::vector<node::Branch> &branches) {
     }
     tree.Insert(min, max, i++); // Note, all values including zero are fine in this version
   }
-  auto elapsed_time = recorder.TimeRecordEnd();
+  auto elapsed_time = top_down_scope.End();
   LOG_INFO("Top-Down Construction Time on the CPU = %.6fs", elapsed_time/1000.0f);
 
-  recorder.TimeRecordStart();
+  evaluator::TimeScope transpose_scope(STAGE_TYPE_TRANSFORM);
 
   level_node_count = tree.GetNodeCount();
   host_node_count=0;
@@ -159,9 +269,6 @@ bool Tree::RTree_Top_Down(std::vector<node::Branch> &branches) {
 
   tree.Transpose(node_ptr);
 
-  long node_index = 1;
-  SetNodeIndex(node_ptr, node_index);
-
 
   // rearrange branches here
   auto leaf_node_count = level_node_count.back();
@@ -178,7 +285,7 @@ bool Tree::RTree_Top_Down(std::vector<node::Branch> &branches) {
 
   host_height = level_node_count.size();
 
-  elapsed_time = recorder.TimeRecordEnd();
+  elapsed_time = transpose_scope.End();
   LOG_INFO("Transpose Time on the CPU = %.6fs", elapsed_time/1000.0f);
 
   return true;
@@ -186,12 +293,15 @@ bool Tree::RTree_Top_Down(std::vector<node::Branch> &branches) {
 
 bool Tree::RTree_LS_Top_Down(std::vector<node::Branch> &branches) {
   std::vector<ui> level_node_count;
-  auto& recorder = evaluator::Recorder::GetInstance();
-  recorder.TimeRecordStart();
+  evaluator::TimeScope top_down_scope(STAGE_TYPE_TOP_DOWN);
 
 #define RTree_LS
-  typedef ursus::RTree<float, float, GetNumberOfDims(), float, 
-  (GetNumberOfLeafNodeDegrees()/GetNumberOfUpperTreeDegrees()), 
+  // nodes hold up to GetNumberOfUpperTreeDegrees() branches when internal,
+  // AddBranch splits leaves of the ratio of the degrees
+  // the position of a branch is its id, the index of its leaf entry
+  typedef ursus::RTree<ll, float, GetNumberOfDims(), float, 
+  ((GetNumberOfLeafNodeDegrees()/GetNumberOfUpperTreeDegrees() > GetNumberOfUpperTreeDegrees()) ?
+   GetNumberOfLeafNodeDegrees()/GetNumberOfUpperTreeDegrees() : GetNumberOfUpperTreeDegrees()), 
   (GetNumberOfLeafNodeDegrees()/(2*GetNumberOfUpperTreeDegrees())),
   true/* enable large leaf node*/> RTrees; // TODO make it more readable...
   RTrees tree;
@@ -199,7 +309,7 @@ bool Tree::RTree_LS_Top_Down(std::vector<node::Branch> &branches) {
   float min[GetNumberOfDims()];
   float max[GetNumberOfDims()];
 
-  int i=0;
+  ll i=0;
   for(auto branch : branches){
     for(int d=0; d<GetNumberOfDims(); d++){
       min[d] = branch.GetPoint(d);
@@ -207,10 +317,10 @@ bool Tree::RTree_LS_Top_Down(std::vector<node::Branch> &branches) {
     }
     tree.Insert(min, max, i++); // Note, all values including zero are fine in this version
   }
-  auto elapsed_time = recorder.TimeRecordEnd();
+  auto elapsed_time = top_down_scope.End();
   LOG_INFO("Top-Down Construction Time on the CPU = %.6fs", elapsed_time/1000.0f);
 
-  recorder.TimeRecordStart();
+  evaluator::TimeScope transpose_scope(STAGE_TYPE_TRANSFORM);
 
   level_node_count = tree.GetNodeCount();
   host_node_count=0;
@@ -235,26 +345,12 @@ bool Tree::RTree_LS_Top_Down(std::vector<node::Branch> &branches) {
   host_height-=2;
   assert(host_height);
 
-  elapsed_time = recorder.TimeRecordEnd();
+  elapsed_time = transpose_scope.End();
   LOG_INFO("Transpose Time on the CPU = %.6fs", elapsed_time/1000.0f);
 
   return true;
 }
 
-void Tree::SetNodeIndex(node::Node *node, long& node_index){
-  if(node->GetNodeType() == NODE_TYPE_INTERNAL ) {
-    for(ui range(branch_itr, 0, node->GetBranchCount())) {
-      SetNodeIndex(node->GetBranchChildNode(branch_itr), node_index); 
-      --node_index;
-      node->SetBranchIndex(branch_itr, node_index++);
-    }
-  } else {
-    for(ui range(branch_itr, 0, node->GetBranchCount())) {
-      node->SetBranchIndex(branch_itr, node_index++);
-    }
-  }
-}
-
 
 /**
  * @brief : find the split position between start/end offsets base on the
@@ -349,45 +445,113 @@ std::vector<ui> Tree::GetSplitPosition(std::vector<node::Branch> &branches,
   return split_position;
 }
 
+/**
+ * @brief : build a top-down tree over branches [start_offset, end_offset]
+ *          into one array of nodes in BFS order, the same layout as the index
+ *          file so that it can be dumped as it is
+ * @ param : branches
+ * @ param : start_offset
+ * @ param : end_offset
+ * @ param : level_node_count, # of nodes in each level
+ * @ return : root node, the first node of the array
+ */
 node::Node* Tree::CreateNode(std::vector<node::Branch> &branches, 
-                             ui start_offset, ui end_offset, int level, 
+                             ui start_offset, ui end_offset,
                              std::vector<ui>& level_node_count) {
+  auto& thread_pool = ThreadPool::GetInstance();
 
-  node::Node* node = new node::Node();
-  // increase node counts
-  host_node_count++;
+  //===--------------------------------------------------------------------===//
+  // Lay out the nodes level by level
+  //===--------------------------------------------------------------------===//
+  // children of a node are appended to the level below in the order of their
+  // parents, so the index of a node in the layout is its position in BFS
+  std::vector<NodeLayout> node_layout;
+  node_layout.push_back({start_offset, end_offset, 0, 0, 0});
+  level_node_count.clear();
+
+  ul level_start = 0;
+  for(int level=0; level_start < node_layout.size(); level++) {
+    ul level_end = node_layout.size();
+    ul number_of_nodes = level_end-level_start;
+    level_node_count.emplace_back(number_of_nodes);
+
+    // subtrees don't share branches, so the nodes of a level are split in
+    // parallel and each of them keeps its split positions in its own slot
+    std::vector<std::vector<ui>> split_positions(number_of_nodes);
+    thread_pool.ParallelFor(level_start, level_end, [&](ul start_node, ul end_node) {
+      for(ul range(node_itr, start_node, end_node)) {
+        auto& layout = node_layout[node_itr];
+        auto number_of_data = (layout.end_offset-layout.start_offset)+1;
+        // leaf node
+        if( number_of_data <= GetNumberOfUpperTreeDegrees() )  {
+          continue;
+        }
+        split_positions[node_itr-level_start] = GetSplitPosition(branches, layout.start_offset,
+                                                                 layout.end_offset);
+      }
+    }, 0, GetTopDownGrainSize(number_of_nodes));
 
-  if( level_node_count.size() <= level ) {
-    level_node_count.emplace_back(1);
-  } else {
-    level_node_count[level]++;
+    // then the children are given their place in the array in parent order
+    for(ul range(node_itr, level_start, level_end)) {
+      auto& split_position = split_positions[node_itr-level_start];
+      if( split_position.empty() ) {
+        continue;
+      }
+
+      node_layout[node_itr].child_index = node_layout.size();
+      node_layout[node_itr].child_count = split_position.size()-1;
+
+      for(ui range(child_itr, 0, split_position.size()-1)) {
+        node_layout.push_back({split_position[child_itr], split_position[child_itr+1],
+                               level+1, 0, 0});
+        split_position[child_itr+1] += 1;
+      }
+    }
+    level_start = level_end;
   }
 
   //===--------------------------------------------------------------------===//
-  // Create a leaf node
+  // Fill the nodes from the bottom
   //===--------------------------------------------------------------------===//
-  auto number_of_data = (end_offset-start_offset)+1;
-  if( number_of_data <= GetNumberOfUpperTreeDegrees() )  {
+  node::Node* nodes = new node::Node[node_layout.size()];
+
+  // a level only reads the level below, its nodes are filled in parallel
+  level_start = node_layout.size();
+  for(ui level_itr = level_node_count.size(); level_itr-- > 0; ) {
+    ul number_of_nodes = level_node_count[level_itr];
+    level_start -= number_of_nodes;
+
+    thread_pool.ParallelFor(level_start, level_start+number_of_nodes, [&](ul start_node, ul end_node) {
+      for(ul range(node_itr, start_node, end_node)) {
+        FillNode(branches, node_layout[node_itr], nodes, &nodes[node_itr]);
+      }
+    }, 0, GetTopDownGrainSize(number_of_nodes));
+  }
+
+  return nodes;
+}
+
+void Tree::FillNode(std::vector<node::Branch> &branches, const NodeLayout& layout,
+                    node::Node* nodes, node::Node* node) {
+  if( !layout.child_count ) {
+    //===--------------------------------------------------------------------===//
+    // Create a leaf node
+    //===--------------------------------------------------------------------===//
+    auto number_of_data = (layout.end_offset-layout.start_offset)+1;
     for(ui range(branch_itr, 0, number_of_data)) {
-      auto offset = start_offset+branch_itr;
+      auto offset = layout.start_offset+branch_itr;
       node->SetBranch(branches[offset], branch_itr);
       node->SetBranchIndex(branch_itr, branches[offset].GetIndex());
       node->SetBranchChildOffset(branch_itr, 0);
     }
     node->SetBranchCount(number_of_data);
     node->SetNodeType(NODE_TYPE_LEAF);
-    node->SetLevel(level);
-
   } else {
     //===--------------------------------------------------------------------===//
     // Create an internal node
     //===--------------------------------------------------------------------===//
-    auto split_position = GetSplitPosition(branches, start_offset, end_offset);
-
-    for(ui range(child_itr, 0, split_position.size()-1)) {
-      auto child_node = CreateNode(branches, split_position[child_itr], split_position[child_itr+1], 
-                                   level+1, level_node_count);
-      split_position[child_itr+1] += 1;
+    for(ui range(child_itr, 0, layout.child_count)) {
+      auto child_node = &nodes[layout.child_index+child_itr];
 
       // calculate child node's MBB and set it 
       auto points = child_node->GetMBB();
@@ -399,17 +563,19 @@ node::Node* Tree::CreateNode(std::vector<node::Branch> &branches,
       ll child_offset = (ll)child_node-(ll)node;
       node->SetBranchChildOffset(child_itr, child_offset);
     }
-    node->SetBranchCount(split_position.size()-1);
+    node->SetBranchCount(layout.child_count);
     node->SetNodeType(NODE_TYPE_INTERNAL);
-    node->SetLevel(level);
   }
+  node->SetLevel(layout.level);
+}
 
-  return node;
+ul Tree::GetTopDownGrainSize(ul number_of_nodes) const {
+  return std::max(ThreadPool::GetInstance().GetGrainSize(number_of_nodes),
+                  (ul)GetNumberOfTopDownNodesPerChunk());
 }
 
 bool Tree::Bottom_Up(std::vector<node::Branch> &branches) {
-  auto& recorder = evaluator::Recorder::GetInstance();
-  recorder.TimeRecordStart();
+  evaluator::TimeScope time_scope(STAGE_TYPE_BOTTOM_UP);
 
   std::string device_type = "GPU";
 
@@ -439,33 +605,34 @@ bool Tree::Bottom_Up(std::vector<node::Branch> &branches) {
   auto total = evaluator::Evaluator::GetTotalMem();
   auto used = evaluator::Evaluator::GetUsedMem();
 
-  // if an index is larger than device memory
-  if( (index_size+used)/(double)total > 1.0) {
+  // if there is no device or an index is larger than device memory
+  if( !backend::IsDeviceAvailable() || (index_size+used)/(double)total > 1.0) {
     device_type = "CPU";
-    const size_t number_of_threads = std::thread::hardware_concurrency();
-
-    // parallel for loop using c++ std 11 
-    {
-      std::vector<std::thread> threads;
-      ul current_offset = device_node_count;
-
-      //Launch a group of threads
-      for( ui level_itr=tree_height-1; level_itr >0; level_itr--) {
-        current_offset -= level_node_count[level_itr];
-        ul parent_offset = (current_offset-level_node_count[level_itr-1]);
-
-        for (ui range(thread_itr, 0, number_of_threads)) {
-          threads.push_back(std::thread(&Tree::BottomUpBuildonCPU, this, current_offset, 
-                parent_offset, level_node_count[level_itr], std::ref(b_node_ptr), thread_itr, 
-                number_of_threads));
-        }
-        //Join the threads with the main thread
-        for(auto &thread : threads){
-          thread.join();
+    auto& thread_pool = ThreadPool::GetInstance();
+
+    ul current_offset = device_node_count;
+
+    // one level at a time, parents are built from the level below
+    for( ui level_itr=tree_height-1; level_itr >0; level_itr--) {
+      current_offset -= level_node_count[level_itr];
+      ul parent_offset = (current_offset-level_node_count[level_itr-1]);
+      ui number_of_node = level_node_count[level_itr];
+
+      thread_pool.ParallelFor(0, number_of_node, [&](ul start_offset, ul end_offset) {
+        BottomUpBuildonCPU(current_offset, parent_offset, b_node_ptr,
+                           start_offset, end_offset);
+      });
+
+      //last node in each level
+      if(  number_of_node % GetNumberOfLeafNodeDegrees() ){
+        auto parent_node = b_node_ptr + current_offset - 1;
+        if( number_of_node < GetNumberOfLeafNodeDegrees() ) {
+          parent_node->SetBranchCount(number_of_node);
+        }else{
+          parent_node->SetBranchCount(number_of_node%GetNumberOfLeafNodeDegrees());
         }
-        threads.clear();
       }
-   }
+    }
   } else {
     //===--------------------------------------------------------------------===//
     // Copy the leaf nodes to the GPU
@@ -488,7 +655,7 @@ bool Tree::Bottom_Up(std::vector<node::Branch> &branches) {
   }
   
   // print out bottom up construction time
-  auto elapsed_time = recorder.TimeRecordEnd();
+  auto elapsed_time = time_scope.End();
   LOG_INFO("Bottom-Up Construction Time on the %s = %.6fs", device_type.c_str(), elapsed_time/1000.0f);
 
   return true;
@@ -541,7 +708,7 @@ void Tree::PrintTreeInSOA(ui offset, ui count) {
   }
 }
 
-void Tree::Thread_SetRect(std::vector<node::Branch> &branches, std::vector<Point>& points, 
+void Tree::Thread_SetRect(std::vector<node::Branch> &branches, Point* points, 
                                                          ui start_offset, ui end_offset) {
   for(ui range(offset, start_offset, end_offset)) {
     branches[offset].SetRect(&points[offset*GetNumberOfDims()]);
@@ -552,9 +719,9 @@ void Tree::Thread_SetRect(std::vector<node::Branch> &branches, std::vector<Point
 /**
  *@brief creating branches
  */
-std::vector<node::Branch> Tree::CreateBranches(std::shared_ptr<io::DataSet> input_data_set) {
-  auto& recorder = evaluator::Recorder::GetInstance();
-  recorder.TimeRecordStart();
+std::vector<node::Branch> Tree::CreateBranches(std::shared_ptr<io::DataSet> input_data_set,
+                                               bool assign_hilbert_index) {
+  evaluator::TimeScope time_scope(STAGE_TYPE_BRANCH_CREATION);
 
   auto number_of_data = input_data_set->GetNumberOfData();
   auto points = input_data_set->GetPoints();
@@ -562,90 +729,74 @@ std::vector<node::Branch> Tree::CreateBranches(std::shared_ptr<io::DataSet> inpu
   // create branches
   std::vector<node::Branch> branches(number_of_data);
 
-  const size_t number_of_threads = std::thread::hardware_concurrency();
-
-  // parallel for loop using c++ std 11 
-  {
-    std::vector<std::thread> threads;
-
-    auto chunk_size = branches.size()/number_of_threads;
-    auto start_offset = 0 ;
-    auto end_offset = start_offset + chunk_size + branches.size()%number_of_threads;
-
-    //Launch a group of threads
-    for (ui range(thread_itr, 0, number_of_threads)) {
-      threads.push_back(std::thread(&Tree::Thread_SetRect, this, 
-                                    std::ref(branches), std::ref(points), start_offset, end_offset));
-
-      start_offset = end_offset;
-      end_offset += chunk_size;
-    }
+  // the points of a chunk are still in cache when they are mapped
+  auto& thread_pool = ThreadPool::GetInstance();
+  input_data_set->ForEachChunk([&](ul chunk_start, ul chunk_end) {
+    thread_pool.ParallelFor(chunk_start, chunk_end, [&](ul start_offset, ul end_offset) {
+      Thread_SetRect(branches, points, start_offset, end_offset);
+      if(assign_hilbert_index) {
+        Thread_Mapping(branches, start_offset, end_offset);
+      }
+    });
+  });
 
-    //Join the threads with the main thread
-    for(auto &thread : threads){
-      thread.join();
-    }
+  auto elapsed_time = time_scope.End();
+  if(assign_hilbert_index) {
+    LOG_INFO("Create Branche and Assign Hilbert Index Time on CPU (%u threads) = %.6fs",
+             thread_pool.GetNumberOfThreads(), elapsed_time/1000.0f);
+  } else {
+    LOG_INFO("Create Branche Time on CPU (%u threads) = %.6fs", thread_pool.GetNumberOfThreads(), elapsed_time/1000.0f);
   }
 
-  auto elapsed_time = recorder.TimeRecordEnd();
-  LOG_INFO("Create Branche Time on CPU (%zu threads) = %.6fs", number_of_threads, elapsed_time/1000.0f);
-
   return branches;
 }
 
 void Tree::Thread_Mapping(std::vector<node::Branch> &branches, ui start_offset, ui end_offset) {
-  ui number_of_bits = (GetNumberOfDims()>2) ? 20:31;
-
-  for(ui range(offset, start_offset, end_offset)) {
-    auto points = branches[offset].GetPoints();
-    auto hilbert_index = mapper::HilbertMapper::MappingIntoSingle(GetNumberOfDims(),
-                                                                   number_of_bits, points);
-    branches[offset].SetIndex(hilbert_index);
-  }
-}
-
-bool Tree::AssignHilbertIndexToBranches(std::vector<node::Branch> &branches) {
-  auto& recorder = evaluator::Recorder::GetInstance();
-  recorder.TimeRecordStart();
+  ui number_of_bits = mapper::HilbertMapper::GetNumberOfBits(GetNumberOfDims());
 
-  const size_t number_of_threads = std::thread::hardware_concurrency();
+  // lower corners of a batch of branches are mapped together
+  const ui batch_size = 1024;
+  Point points[batch_size*GetNumberOfDims()];
+  ll hilbert_indexes[batch_size];
 
-  // parallel for loop using c++ std 11 
-  {
-    std::vector<std::thread> threads;
-
-    auto chunk_size = branches.size()/number_of_threads;
-    auto start_offset = 0 ;
-    auto end_offset = start_offset + chunk_size + branches.size()%number_of_threads;
+  for(ui range(batch_offset, start_offset, end_offset, batch_size)) {
+    ui number_of_points = std::min(batch_size, end_offset-batch_offset);
 
-    //Launch a group of threads
-    for (ui range(thread_itr, 0, number_of_threads)) {
-      threads.push_back(std::thread(&Tree::Thread_Mapping, this, 
-                                    std::ref(branches), start_offset, end_offset));
-
-      start_offset = end_offset;
-      end_offset += chunk_size;
+    for(ui range(point_itr, 0, number_of_points)) {
+      for(ui range(dim, 0, GetNumberOfDims())) {
+        points[point_itr*GetNumberOfDims()+dim] = branches[batch_offset+point_itr].GetPoint(dim);
+      }
     }
 
-    //Join the threads with the main thread
-    for(auto &thread : threads){
-      thread.join();
+    mapper::HilbertMapper::MappingIntoSingle(GetNumberOfDims(), number_of_bits,
+                                             points, number_of_points, hilbert_indexes);
+
+    for(ui range(point_itr, 0, number_of_points)) {
+      branches[batch_offset+point_itr].SetIndex(hilbert_indexes[point_itr]);
     }
   }
+}
+
+bool Tree::AssignHilbertIndexToBranches(std::vector<node::Branch> &branches) {
+  evaluator::TimeScope time_scope(STAGE_TYPE_MAPPING);
 
-  auto elapsed_time = recorder.TimeRecordEnd();
-  LOG_INFO("Assign Hilbert Index Time on CPU (%zu threads)= %.6fs", number_of_threads, elapsed_time/1000.0f);
+  auto& thread_pool = ThreadPool::GetInstance();
+  thread_pool.ParallelFor(0, branches.size(), [&](ul start_offset, ul end_offset) {
+    Thread_Mapping(branches, start_offset, end_offset);
+  });
+
+  auto elapsed_time = time_scope.End();
+  LOG_INFO("Assign Hilbert Index Time on CPU (%u threads)= %.6fs", thread_pool.GetNumberOfThreads(), elapsed_time/1000.0f);
   return true;
 }
 
 bool Tree::ClusterBrancheUsingKmeans(std::vector<node::Branch> &branches) {
-  auto& recorder = evaluator::Recorder::GetInstance();
-  recorder.TimeRecordStart();
+  evaluator::TimeScope time_scope(STAGE_TYPE_MAPPING);
 
   auto ret = mapper::KmeansMapper::ClusteringBranches(branches, GetNumberOfDims());
   assert(ret);
 
-  auto elapsed_time = recorder.TimeRecordEnd();
+  auto elapsed_time = time_scope.End();
   LOG_INFO("Clustering branches using K-means&Hilbert Curve = %.6fs", elapsed_time/1000.0f);
   return true;
 }
@@ -702,43 +853,22 @@ void Tree::Thread_CopyBranchToLeafNode(std::vector<node::Branch> &branches,
 bool Tree::CopyBranchToLeafNode(std::vector<node::Branch> &branches, NodeType node_type,
                             int level, ui leaf_node_offset, node::LeafNode* _node_ptr) {
 
-  auto& recorder = evaluator::Recorder::GetInstance();
-  recorder.TimeRecordStart();
-
-  const size_t number_of_threads = std::thread::hardware_concurrency();
-
-  // parallel for loop using c++ std 11 
-  {
-    std::vector<std::thread> threads;
+  evaluator::TimeScope time_scope(STAGE_TYPE_BOTTOM_UP);
 
-    auto chunk_size = branches.size()/number_of_threads;
-    auto start_offset = 0 ;
-    auto end_offset = start_offset + chunk_size + branches.size()%number_of_threads;
-
-    //Launch a group of threads
-    for (ui range(thread_itr, 0, number_of_threads)) {
-      threads.push_back(std::thread(&Tree::Thread_CopyBranchToLeafNode, this, 
-                        std::ref(branches), std::ref(_node_ptr), node_type, level, 
-                        leaf_node_offset, start_offset, end_offset));
-
-      start_offset = end_offset;
-      end_offset += chunk_size;
-    }
+  auto& thread_pool = ThreadPool::GetInstance();
+  thread_pool.ParallelFor(0, branches.size(), [&](ul start_offset, ul end_offset) {
+    Thread_CopyBranchToLeafNode(branches, _node_ptr, node_type, level, 
+                                leaf_node_offset, start_offset, end_offset);
+  });
 
-    //Join the threads with the main thread
-    for(auto &thread : threads){
-      thread.join();
-    }
-
-    if(branches.size()%GetNumberOfLeafNodeDegrees()) {
-      ui last_node_offset = leaf_node_offset + branches.size()/GetNumberOfLeafNodeDegrees();
-      _node_ptr[last_node_offset].SetNodeType(node_type);
-      _node_ptr[last_node_offset].SetLevel(level);
-      _node_ptr[last_node_offset].SetBranchCount(branches.size()%GetNumberOfLeafNodeDegrees());
-    }
+  if(branches.size()%GetNumberOfLeafNodeDegrees()) {
+    ui last_node_offset = leaf_node_offset + branches.size()/GetNumberOfLeafNodeDegrees();
+    _node_ptr[last_node_offset].SetNodeType(node_type);
+    _node_ptr[last_node_offset].SetLevel(level);
+    _node_ptr[last_node_offset].SetBranchCount(branches.size()%GetNumberOfLeafNodeDegrees());
   }
 
-  auto elapsed_time = recorder.TimeRecordEnd();
+  auto elapsed_time = time_scope.End();
   LOG_INFO("Copy Branch To Node Time on the CPU = %.6fs", elapsed_time/1000.0f);
 
   return true;
@@ -785,41 +915,19 @@ void Tree::Thread_CopyBranchToNodeSOA(std::vector<node::Branch> &branches,
 bool Tree::CopyBranchToNodeSOA(std::vector<node::Branch> &branches, 
                                NodeType node_type, int level, ui node_offset) {
 
-  auto& recorder = evaluator::Recorder::GetInstance();
-  recorder.TimeRecordStart();
-
-  const size_t number_of_threads = std::thread::hardware_concurrency();
-
-  // parallel for loop using c++ std 11 
-  {
-    std::vector<std::thread> threads;
-
-    auto chunk_size = branches.size()/number_of_threads;
-    auto start_offset = 0 ;
-    auto end_offset = start_offset + chunk_size + branches.size()%number_of_threads;
-
-    //Launch a group of threads
-    for (ui range(thread_itr, 0, number_of_threads)) {
-      threads.push_back(std::thread(&Tree::Thread_CopyBranchToNodeSOA, this, 
-                        std::ref(branches), node_type, level, node_offset, 
-                        start_offset, end_offset));
-
-      start_offset = end_offset;
-      end_offset += chunk_size;
-    }
-
-    //Join the threads with the main thread
-    for(auto &thread : threads){
-      thread.join();
-    }
-  }
+  evaluator::TimeScope time_scope(STAGE_TYPE_BOTTOM_UP);
 
+  auto& thread_pool = ThreadPool::GetInstance();
+  thread_pool.ParallelFor(0, branches.size(), [&](ul start_offset, ul end_offset) {
+    Thread_CopyBranchToNodeSOA(branches, node_type, level, node_offset, 
+                               start_offset, end_offset);
+  });
 
   if(branches.size()%GetNumberOfLeafNodeDegrees()) {
     node_soa_ptr[node_offset+(branches.size()/GetNumberOfLeafNodeDegrees())].SetBranchCount(branches.size()%GetNumberOfLeafNodeDegrees());
   }
 
-  auto elapsed_time = recorder.TimeRecordEnd();
+  auto elapsed_time = time_scope.End();
   LOG_INFO("Copy Branch To NodeSOA Time on the CPU = %.6fs", elapsed_time/1000.0f);
 
   return true;
@@ -829,20 +937,20 @@ bool Tree::CopyBranchToNodeSOA(std::vector<node::Branch> &branches,
 
 void Tree::BottomUpBuild_ILP(ul current_offset, ul parent_offset, 
                              ui number_of_node, node::LeafNode* root) {
-  global_BottomUpBuild_ILP<<<GetNumberOfBlocks(), GetNumberOfThreads()>>>
-                          (current_offset, parent_offset, number_of_node, 
-                          root, number_of_cuda_blocks);
+  LaunchKernel(global_BottomUpBuild_ILP, GetNumberOfBlocks(), GetNumberOfThreads(),
+               current_offset, parent_offset, number_of_node, 
+               root, number_of_cuda_blocks);
 }
 
 
 
 void Tree::BottomUpBuildonCPU(ul current_offset, ul parent_offset, 
-                              ui number_of_node, node::LeafNode* root, ui tid, ui number_of_threads) {
+                              node::LeafNode* root, ui start_offset, ui end_offset) {
 
   node::LeafNode* current_node;
   node::LeafNode* parent_node;
 
-  for(ui range(node_offset, tid, number_of_node, number_of_threads)) {
+  for(ui range(node_offset, start_offset, end_offset)) {
     current_node = root+current_offset+node_offset;
     parent_node = root+parent_offset+(ul)(node_offset/GetNumberOfLeafNodeDegrees());
 
@@ -915,57 +1023,35 @@ void Tree::BottomUpBuildonCPU(ul current_offset, ul parent_offset,
       parent_node->SetBranchPoint( (node_offset % GetNumberOfLeafNodeDegrees()), upper_boundary[0], high_dim);
     }
   }
-
-  //last node in each level
-  if(  number_of_node % GetNumberOfLeafNodeDegrees() ){
-    parent_node = root + current_offset - 1;
-    if( number_of_node < GetNumberOfLeafNodeDegrees() ) {
-      parent_node->SetBranchCount(number_of_node);
-    }else{
-      parent_node->SetBranchCount(number_of_node%GetNumberOfLeafNodeDegrees());
-    }
-  }
 }
 
 ui Tree::BruteForceSearchOnCPU(Point* query) {
 
-  auto& recorder = evaluator::Recorder::GetInstance();
-  const size_t number_of_cpu_threads = std::thread::hardware_concurrency();
+  evaluator::TimeScope time_scope(STAGE_TYPE_SEARCH);
+  auto& thread_pool = ThreadPool::GetInstance();
 
   std::vector<ll> start_node_offset;
   ui hit=0;
 
-  // parallel for loop using c++ std 11 
   {
-    std::vector<std::thread> threads;
-    std::vector<ll> thread_start_node_offset[number_of_cpu_threads];
-    ui thread_hit[number_of_cpu_threads];
-
-    auto chunk_size = device_node_count/number_of_cpu_threads;
-    auto start_offset = 0 ;
-    auto end_offset = start_offset + chunk_size + device_node_count%number_of_cpu_threads;
-
-    //Launch a group of threads
-    for (ui range(thread_itr, 0, number_of_cpu_threads)) {
-      threads.push_back(std::thread(&Tree::Thread_BruteForce, this, 
-                        query, std::ref(thread_start_node_offset[thread_itr]), 
-                        std::ref(thread_hit[thread_itr]),
-                        start_offset, end_offset));
-
-      start_offset = end_offset;
-      end_offset += chunk_size;
-    }
+    auto grain_size = thread_pool.GetGrainSize(device_node_count);
+    auto number_of_chunks = thread_pool.GetNumberOfChunks(device_node_count, grain_size);
 
-    //Join the threads with the main thread
-    for(auto &thread : threads){
-      thread.join();
-    }
+    // per-chunk outputs, merged in chunk order
+    std::vector<std::vector<ll>> chunk_start_node_offset(number_of_chunks);
+    std::vector<ui> chunk_hit(number_of_chunks, 0);
 
-    for(ui range(thread_itr, 0, number_of_cpu_threads)) {
+    thread_pool.ParallelFor(0, device_node_count, [&](ul start_offset, ul end_offset) {
+      auto chunk_itr = start_offset/grain_size;
+      Thread_BruteForce(query, chunk_start_node_offset[chunk_itr], 
+                        chunk_hit[chunk_itr], start_offset, end_offset);
+    }, 0, grain_size);
+
+    for(ui range(chunk_itr, 0, number_of_chunks)) {
       start_node_offset.insert( start_node_offset.end(), 
-                                thread_start_node_offset[thread_itr].begin(), 
-                                thread_start_node_offset[thread_itr].end()); 
-      hit += thread_hit[thread_itr];
+                                chunk_start_node_offset[chunk_itr].begin(), 
+                                chunk_start_node_offset[chunk_itr].end()); 
+      hit += chunk_hit[chunk_itr];
     }
   }
 
@@ -975,26 +1061,291 @@ ui Tree::BruteForceSearchOnCPU(Point* query) {
   //}
   LOG_INFO("Hit on CPU : %u", hit);
 
-  auto elapsed_time = recorder.TimeRecordEnd();
-  LOG_INFO("BruteForce Scanning on the CPU (%zd threads) = %.6fs", number_of_cpu_threads, elapsed_time/1000.0f);
+  auto elapsed_time = time_scope.End();
+  LOG_INFO("BruteForce Scanning on the CPU (%u threads) = %.6fs", thread_pool.GetNumberOfThreads(), elapsed_time/1000.0f);
 
   return hit;
 }
 
+/**
+ * @brief scan all branches of a Node_SOA on the CPU
+ * @param node_soa node to be scanned
+ * @param query
+ * @param result_buffer matching indexes are appended if it's not null
+ * @return number of branches overlapping the query
+ */
+ui Tree::ScanNodeSOA(node::Node_SOA* node_soa, Point* query,
+                     ResultBuffer* result_buffer) {
+  ull overlap[node::GetNumberOfMaskWords()];
+  ui hit = node_soa->ScanOverlap(query, overlap);
+
+  if(result_buffer && hit) {
+    for(ui range(word_itr, 0, node::GetNumberOfMaskWords())) {
+      // visit the set bits only
+      for(ull bits = overlap[word_itr]; bits; bits &= bits-1) {
+        ui branch_itr = word_itr*64 + __builtin_ctzll(bits);
+        result_buffer->Append(node_soa->GetIndex(branch_itr));
+      }
+    }
+  }
+  return hit;
+}
+
+/**
+ * @brief scan all branches of a quantized Node_SOA on the CPU
+ * @param quantized_node_soa node to be scanned
+ * @param points data points, for branches on the query boundary
+ * @param data_offsets offsets of the data points in the leaf level
+ * @param query
+ * @param result_buffer matching indexes are appended if it's not null
+ * @return number of branches overlapping the query
+ */
+ui Tree::ScanNodeSOA(node::QuantizedNode_SOA* quantized_node_soa, const Point* points,
+                     const ui* data_offsets, Point* query, ResultBuffer* result_buffer) {
+  ull overlap[node::GetNumberOfMaskWords()];
+  ui hit = quantized_node_soa->ScanOverlap(query, points, data_offsets, overlap);
+
+  if(result_buffer && hit) {
+    for(ui range(word_itr, 0, node::GetNumberOfMaskWords())) {
+      for(ull bits = overlap[word_itr]; bits; bits &= bits-1) {
+        ui branch_itr = word_itr*64 + __builtin_ctzll(bits);
+        result_buffer->Append(quantized_node_soa->GetIndex(branch_itr));
+      }
+    }
+  }
+  return hit;
+}
+
+/**
+ * @brief scan all points of a point Node_SOA on the CPU
+ * @param point_node_soa node to be scanned
+ * @param query
+ * @param result_buffer matching indexes are appended if it's not null
+ * @return number of points in the query
+ */
+ui Tree::ScanNodeSOA(node::PointNode_SOA* point_node_soa, Point* query,
+                     ResultBuffer* result_buffer) {
+  ull overlap[node::GetNumberOfMaskWords()];
+  ui hit = point_node_soa->ScanOverlap(query, overlap);
+
+  if(result_buffer && hit) {
+    for(ui range(word_itr, 0, node::GetNumberOfMaskWords())) {
+      for(ull bits = overlap[word_itr]; bits; bits &= bits-1) {
+        ui branch_itr = word_itr*64 + __builtin_ctzll(bits);
+        result_buffer->Append(point_node_soa->GetIndex(branch_itr));
+      }
+    }
+  }
+  return hit;
+}
+
+//===--------------------------------------------------------------------===//
+// k Nearest Neighbour Search
+//===--------------------------------------------------------------------===//
+node::Node* Tree::GetKNNRoot(void) const {
+  return nullptr;
+}
+
+std::vector<node::Node_SOA*> Tree::GetKNNNodeSOARoots(void) const {
+  return std::vector<node::Node_SOA*>();
+}
+
+ll Tree::GetLeafNodeOffset(node::Node_SOA* node_soa, ui branch_itr) const {
+  return -1;
+}
+
+ll Tree::GetLeafNodeDistances(ll leaf_node_offset, Point* point,
+                              Point* distances, ui& branch_count) const {
+  assert(0);
+  return 0;
+}
+
+bool Tree::SearchKNN(std::shared_ptr<io::DataSet> query_data_set,
+                     ui number_of_search, ui k) {
+  auto root = GetKNNRoot();
+  auto node_soa_roots = GetKNNNodeSOARoots();
+  if(root == nullptr && node_soa_roots.empty()) {
+    LOG_INFO("%s doesn't support kNN search", TreeTypeToString(tree_type).c_str());
+    return false;
+  }
+
+  auto query = query_data_set->GetPoints();
+  auto& thread_pool = ThreadPool::GetInstance();
+  auto grain_size = thread_pool.GetGrainSize(number_of_search);
+  auto number_of_chunks = thread_pool.GetNumberOfChunks(number_of_search, grain_size);
+
+  std::vector<ul> chunk_hit(number_of_chunks, 0);
+  std::vector<ul> chunk_node_visit_count(number_of_chunks, 0);
+
+  // per-chunk append buffers, only used to materialize the results
+  std::vector<ResultBuffer> chunk_result;
+  if(materialize_result) {
+    chunk_result.resize(number_of_chunks);
+  }
+
+  evaluator::TimeScope time_scope(STAGE_TYPE_SEARCH);
+
+  thread_pool.ParallelFor(0, number_of_search, [&](ul start_offset, ul end_offset) {
+    auto chunk_itr = start_offset/grain_size;
+    auto result_buffer = (materialize_result)?&chunk_result[chunk_itr]:nullptr;
+    if(result_buffer) {
+      result_buffer->Reset(start_offset);
+    }
+
+    Point point[GetNumberOfDims()];
+    std::vector<Neighbor> neighbors;
+    for(ul range(query_itr, start_offset, end_offset)) {
+      auto query_box = &query[query_itr*GetNumberOfDims()*2];
+      for(ui range(dim, 0, GetNumberOfDims())) {
+        point[dim] = (query_box[dim]+query_box[dim+GetNumberOfDims()])/2;
+      }
+
+      if(node_soa_roots.empty()) {
+        chunk_node_visit_count[chunk_itr] += SearchKNN(root, point, k, neighbors);
+      } else {
+        chunk_node_visit_count[chunk_itr] += SearchKNN(node_soa_roots, point, k, neighbors);
+      }
+      chunk_hit[chunk_itr] += neighbors.size();
+
+      if(result_buffer) {
+        for(auto& neighbor : neighbors) {
+          result_buffer->Append(neighbor.second);
+        }
+        result_buffer->CloseQuery();
+      }
+    }
+  }, 0, grain_size);
+
+  ul total_hit = 0;
+  ul total_node_visit_count = 0;
+  for(ui range(chunk_itr, 0, number_of_chunks)) {
+    total_hit += chunk_hit[chunk_itr];
+    total_node_visit_count += chunk_node_visit_count[chunk_itr];
+  }
+
+  if(materialize_result) {
+    search_result.Compact(chunk_result, number_of_search);
+  }
+  auto elapsed_time = time_scope.End();
+
+  LOG_INFO("Avg. kNN Search Time on the CPU (k = %u) (ms)\n%.6f", k, elapsed_time/(float)number_of_search);
+  LOG_INFO("Total kNN Search Time on the CPU (%u threads) (ms)%.6f", thread_pool.GetNumberOfThreads(), elapsed_time);
+  LOG_INFO("Avg. Node visit count : \n%f", total_node_visit_count/(float)number_of_search);
+  LOG_INFO("Hit : %lu", total_hit);
+  return true;
+}
+
+// keep the k nearest in a max-heap on (distance, index), ties go to the
+// smaller index so that the answer doesn't depend on the visiting order
+static void AddNeighbor(std::vector<Neighbor>& neighbors, ui k, Neighbor neighbor) {
+  if(neighbors.size() < k) {
+    neighbors.emplace_back(neighbor);
+    std::push_heap(neighbors.begin(), neighbors.end());
+  } else if(neighbor < neighbors.front()) {
+    std::pop_heap(neighbors.begin(), neighbors.end());
+    neighbors.back() = neighbor;
+    std::push_heap(neighbors.begin(), neighbors.end());
+  }
+}
+
+/**
+ * @brief nodes are visited in MINDIST order until the nearest one left is
+ *        farther than the k-th neighbour found so far, the branches of a leaf
+ *        are the data
+ */
+ui Tree::SearchKNN(node::Node* root, Point* point, ui k,
+                   std::vector<Neighbor>& neighbors) {
+  typedef std::pair<Point, node::Node*> Entry;
+  std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry>> nodes;
+  nodes.emplace(0, root);
+  neighbors.clear();
+
+  ui node_visit_count = 0;
+  while(!nodes.empty() && k) {
+    auto entry = nodes.top();
+    if(neighbors.size() == k && entry.first > neighbors.front().first) {
+      break;
+    }
+    nodes.pop();
+    node_visit_count++;
+
+    auto node = entry.second;
+    for(ui range(branch_itr, 0, node->GetBranchCount())) {
+      auto distance = node->GetDistance(point, branch_itr);
+      if(node->GetNodeType() == NODE_TYPE_LEAF) {
+        AddNeighbor(neighbors, k, Neighbor(distance, node->GetBranchIndex(branch_itr)));
+      } else if(neighbors.size() < k || distance <= neighbors.front().first) {
+        nodes.emplace(distance, node->GetBranchChildNode(branch_itr));
+      }
+    }
+  }
+
+  std::sort_heap(neighbors.begin(), neighbors.end());
+  return node_visit_count;
+}
+
+/**
+ * @brief same as above on Node_SOA trees, the distances to all the branches
+ *        of a node are computed at once
+ */
+ui Tree::SearchKNN(const std::vector<node::Node_SOA*>& roots, Point* point, ui k,
+                   std::vector<Neighbor>& neighbors) {
+  // (MINDIST, (node, offset of a leaf node kept in another layout))
+  typedef std::pair<Point, std::pair<node::Node_SOA*, ll>> Entry;
+  std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry>> nodes;
+  for(auto root : roots) {
+    nodes.emplace(0, std::make_pair(root, -1));
+  }
+  neighbors.clear();
+
+  Point distances[GetNumberOfLeafNodeDegrees()];
+  ui node_visit_count = 0;
+  while(!nodes.empty() && k) {
+    auto entry = nodes.top();
+    if(neighbors.size() == k && entry.first > neighbors.front().first) {
+      break;
+    }
+    nodes.pop();
+    node_visit_count++;
+
+    auto node_soa = entry.second.first;
+    if(node_soa == nullptr) {
+      ui branch_count;
+      auto first_index = GetLeafNodeDistances(entry.second.second, point, distances, branch_count);
+      for(ui range(branch_itr, 0, branch_count)) {
+        AddNeighbor(neighbors, k, Neighbor(distances[branch_itr], first_index+branch_itr));
+      }
+      continue;
+    }
+
+    node_soa->GetDistances(point, distances);
+    for(ui range(branch_itr, 0, node_soa->GetBranchCount())) {
+      if(node_soa->GetNodeType() == NODE_TYPE_LEAF) {
+        AddNeighbor(neighbors, k, Neighbor(distances[branch_itr], node_soa->GetIndex(branch_itr)));
+      } else if(neighbors.size() < k || distances[branch_itr] <= neighbors.front().first) {
+        auto leaf_node_offset = GetLeafNodeOffset(node_soa, branch_itr);
+        nodes.emplace(distances[branch_itr], 
+                      std::make_pair((leaf_node_offset < 0) ? node_soa->GetChildNode(branch_itr) : nullptr,
+                                     leaf_node_offset));
+      }
+    }
+  }
+
+  std::sort_heap(neighbors.begin(), neighbors.end());
+  return node_visit_count;
+}
+
 void Tree::Thread_BruteForceInSOA(Point* query, std::vector<ll> &start_node_offset,
                              ui &hit, ui start_offset, ui end_offset) {
   hit = 0;
+  ull overlap[node::GetNumberOfMaskWords()];
+
   for(ui range(node_itr, start_offset, end_offset)) {
-    for(ui range(child_itr, 0, node_soa_ptr[node_itr].GetBranchCount())) {
-      if( node_soa_ptr[node_itr].GetNodeType() == NODE_TYPE_LEAF) {
-        if(node_soa_ptr[node_itr].IsOverlap(query, child_itr) ) {
-          start_node_offset.emplace_back(node_itr);
-          hit++;
-        }else{
-          LOG_INFO("node itr %u", node_itr);
-          std::cout<<node_soa_ptr<<std::endl;
-        }
-      }
+    if( node_soa_ptr[node_itr].GetNodeType() == NODE_TYPE_LEAF) {
+      auto node_hit = node_soa_ptr[node_itr].ScanOverlap(query, overlap);
+      // keep one entry per overlapping branch
+      start_node_offset.insert(start_node_offset.end(), node_hit, node_itr);
+      hit += node_hit;
     }
   }
 }
@@ -1008,9 +1359,6 @@ void Tree::Thread_BruteForce(Point* query, std::vector<ll> &start_node_offset,
         if(b_node_ptr[node_itr].IsOverlap(query, child_itr) ) {
           start_node_offset.emplace_back(node_itr);
           hit++;
-        }else{
-          LOG_INFO("node itr %u", node_itr);
-          std::cout<<b_node_ptr<<std::endl;
         }
       }
     }
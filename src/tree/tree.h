@@ -1,17 +1,36 @@
 #pragma once
 
 #include "common/types.h"
+#include "evaluator/histogram.h"
 #include "io/dataset.h"
+#include "io/index_file.h"
 #include "node/node.h"
 #include "node/leaf_node.h"
 #include "node/node_soa.h"
+#include "node/point_node_soa.h"
+#include "node/quantized_node_soa.h"
+#include "tree/search_result.h"
 
 #include <memory>
+#include <utility>
 #include <vector>
 
 namespace ursus {
 namespace tree {
 
+// branches under a node of a top-down tree and where its children are in the
+// node array, a node without children is a leaf
+struct NodeLayout {
+  ui start_offset;
+  ui end_offset;
+  int level;
+  ul child_index;
+  ui child_count;
+};
+
+// squared distance to the query point and index of a neighbour
+typedef std::pair<Point, ll> Neighbor;
+
 class Tree {
  public:
 
@@ -47,6 +66,15 @@ class Tree {
   virtual int Search(std::shared_ptr<io::DataSet> query_data_set, 
                      ui number_of_search, ui number_of_repeat) =0;
 
+  /**
+   * k nearest neighbours of the center of each query on the CPU, best-first
+   * on MINDIST from the roots the tree gives. Indexes of the neighbours are
+   * materialized nearest first if it's on
+   * @return false if the tree has nothing to search from
+   */
+  bool SearchKNN(std::shared_ptr<io::DataSet> query_data_set,
+                 ui number_of_search, ui k);
+
   void PrintTree(ui offset, ui count);
 
   void PrintTreeInSOA(ui offset, ui count);
@@ -56,30 +84,91 @@ class Tree {
  //===--------------------------------------------------------------------===//
   TreeType GetTreeType() const;
 
-  std::string GetIndexName(std::shared_ptr<io::DataSet> input_data_set);
+  /**
+   * path of the index file, the name ends with a key hashed from the
+   * data set(DataSet::GetContentHash) and the build parameters
+   */
+  std::string GetIndexName(std::shared_ptr<io::DataSet> input_data_set) const;
+
+  // parameters other than the data that change the index, part of the key
+  virtual std::string GetBuildParameters(void) const;
+
+  // settings that change how a search runs but not the index
+  virtual std::string GetSearchParameters(void) const;
+
+  // directory of the index files
+  void SetIndexDirectory(std::string index_directory);
+
+  // data set the index is built from, its cluster type and hash are written
+  // into the header of the index file
+  void SetDataSet(std::shared_ptr<io::DataSet> input_data_set);
 
-  FILE* OpenIndexFile(std::string index_name);
+  // nullptr if the index file doesn't exist or doesn't hold a tree of
+  // index_tree_type, mapped files are kept open as long as the tree since
+  // its nodes may live in them
+  std::shared_ptr<io::IndexFile> OpenIndexFile(std::string index_name,
+                                               TreeType index_tree_type);
+
+  // header of the index files dumped by this tree
+  io::IndexMetadata GetIndexMetadata(TreeType index_tree_type) const;
 
   bool IsExist (const std::string& name);
 
+  // collect matching indexes of each query in addition to hit counts
+  void SetMaterializeResult(bool materialize_result);
+
+  bool IsMaterializeResult(void) const;
+
+  const SearchResult& GetSearchResult(void) const;
+
+  // record latency, node visit count and hit count of each query
+  void SetRecordQueryStats(bool record_query_stats);
+
+  bool IsRecordQueryStats(void) const;
+
+  // stats of the queries searched since the last reset
+  evaluator::QueryStats& GetQueryStats(void);
+
+  // load index files with fread or use their nodes in place through mmap
+  void SetLoadType(LoadType load_type);
+
+  LoadType GetLoadType(void) const;
+
+  // check the checksums of mapped index files too, LOAD_TYPE_MMAP skips them
+  void SetVerifyIndex(bool verify_index);
+
+  // true if ptr points into a mapped index file, it must not be deleted then
+  bool IsMapped(const void* ptr) const;
+
  //===--------------------------------------------------------------------===//
  // Utility Function
  //===--------------------------------------------------------------------===//
-  void SetNodeIndex(node::Node *node, long& node_index);
-
-  std::vector<node::Branch> CreateBranches(std::shared_ptr<io::DataSet> input_data_set) ;
+  // branches are created chunk by chunk as the data is read, and given their
+  // Hilbert index on the way if assign_hilbert_index is set
+  std::vector<node::Branch> CreateBranches(std::shared_ptr<io::DataSet> input_data_set,
+                                           bool assign_hilbert_index=false) ;
 
+  // nodes are allocated in one array in BFS order, delete[] the root
   node::Node* CreateNode(std::vector<node::Branch> &branches, 
-                         ui start_offset, ui end_offset, int level,
+                         ui start_offset, ui end_offset,
                          std::vector<ui>& level_node_count);
 
+  void FillNode(std::vector<node::Branch> &branches, const NodeLayout& layout,
+                node::Node* nodes, node::Node* node);
+
+  // chunks of a top-down level hold at least this many nodes, so levels near
+  // the root are built on the calling thread
+  static constexpr ui GetNumberOfTopDownNodesPerChunk() { return 16; }
+
+  ul GetTopDownGrainSize(ul number_of_nodes) const;
+
   ui GetSplitOffset(std::vector<node::Branch> &branches,
                     ui start_offset, ui end_offset);
 
   std::vector<ui> GetSplitPosition(std::vector<node::Branch> &branches, 
                                    ui start_offset, ui end_offset);
 
-  void Thread_SetRect(std::vector<node::Branch> &branches, std::vector<Point>& points, 
+  void Thread_SetRect(std::vector<node::Branch> &branches, Point* points, 
                       ui start_offset, ui end_offset);
 
 
@@ -116,6 +205,40 @@ class Tree {
   void Thread_BruteForce(Point* query, std::vector<ll> &start_node_offset, 
                          ui& hit, ui start_offset, ui end_offset);
 
+  ui ScanNodeSOA(node::Node_SOA* node_soa, Point* query,
+                 ResultBuffer* result_buffer);
+
+  // branches on a query boundary are tested on their data points, see
+  // QuantizedNode_SOA
+  ui ScanNodeSOA(node::QuantizedNode_SOA* quantized_node_soa, const Point* points,
+                 const ui* data_offsets, Point* query, ResultBuffer* result_buffer);
+
+  ui ScanNodeSOA(node::PointNode_SOA* point_node_soa, Point* query,
+                 ResultBuffer* result_buffer);
+
+  // roots of the kNN search, the Node_SOA roots are searched if there are
+  // any and neither is given by trees that don't support it
+  virtual node::Node* GetKNNRoot(void) const;
+
+  virtual std::vector<node::Node_SOA*> GetKNNNodeSOARoots(void) const;
+
+  // offset in the leaf level of the child at branch_itr of node_soa if it's
+  // a leaf node kept in another layout than Node_SOA, otherwise -1
+  virtual ll GetLeafNodeOffset(node::Node_SOA* node_soa, ui branch_itr) const;
+
+  // squared MINDIST from the point to every branch of such a leaf node
+  // @return index of the first branch, the others follow it
+  virtual ll GetLeafNodeDistances(ll leaf_node_offset, Point* point,
+                                  Point* distances, ui& branch_count) const;
+
+  // k nearest neighbours of the point into neighbors, nearest first
+  // @return # of visited nodes
+  ui SearchKNN(node::Node* root, Point* point, ui k,
+               std::vector<Neighbor>& neighbors);
+
+  ui SearchKNN(const std::vector<node::Node_SOA*>& roots, Point* point, ui k,
+               std::vector<Neighbor>& neighbors);
+
   void Thread_BruteForceInSOA(Point* query, std::vector<ll> &start_node_offset,
                              ui &hit, ui start_offset, ui end_offset);
 
@@ -124,8 +247,8 @@ class Tree {
    */
   void BottomUpBuild_ILP(ul offset, ul parent_offset, ui number_of_node, node::LeafNode* root);
 
-  void BottomUpBuildonCPU(ul current_offset, ul parent_offset, ui number_of_node, 
-                         node::LeafNode* root, ui tid, ui number_of_threads);
+  void BottomUpBuildonCPU(ul current_offset, ul parent_offset, 
+                         node::LeafNode* root, ui start_offset, ui end_offset);
 
  //===--------------------------------------------------------------------===//
  // Members
@@ -143,6 +266,12 @@ class Tree {
 
   TreeType tree_type = TREE_TYPE_INVALID;
 
+  // cluster type of the data set the index is built from
+  ClusterType cluster_type = CLUSTER_TYPE_INVALID;
+
+  // DataSet::GetContentHash of the data set the index is built from
+  ull data_hash = 0;
+
   // For BVH and Hybrid trees
   ui host_node_count = 0;
 
@@ -152,6 +281,25 @@ class Tree {
   ui host_height = 0;
 
   ui device_height = 0;
+
+  // if it's on, search functions store matching indexes into search_result
+  bool materialize_result = false;
+
+  SearchResult search_result;
+
+  // if it's on, search functions record each query into query_stats
+  bool record_query_stats = false;
+
+  evaluator::QueryStats query_stats;
+
+  LoadType load_type = LOAD_TYPE_READ;
+
+  bool verify_index = false;
+
+  std::string index_directory = io::GetDefaultIndexDirectory();
+
+  // mapped index files backing node_ptr or node_soa_ptr
+  std::vector<std::shared_ptr<io::IndexFile>> index_files;
 };
 
 //===--------------------------------------------------------------------===//
@@ -0,0 +1,96 @@
+#include "common/macro.h"
+#include "common/types.h"
+#include "mapper/hilbert_mapper.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <vector>
+
+namespace ursus {
+namespace test {
+
+//===--------------------------------------------------------------------===//
+// Hilbert Mapper Test
+//===--------------------------------------------------------------------===//
+// the table driven encoder must give the same indexes as the original one
+// bit by bit, or index files built by either one would not be valid for the
+// other. Every number of dimensions and bits the tables support is checked
+// on pseudo random points, corners and out-of-range coordinates
+
+const ul number_of_samples = 4096;
+
+static std::vector<Point> GetPoints(ui dims, ui number_of_bits) {
+  std::vector<Point> points(number_of_samples*dims);
+  ull seed = 0x9E3779B97F4A7C15ull*(dims*64+number_of_bits);
+  Point max_point = (Point)((((ll)1 << number_of_bits)-1)/1000000.0);
+
+  for(ul range(sample_itr, 0, number_of_samples)) {
+    for(ui range(d, 0, dims)) {
+      seed = seed*6364136223846793005ull + 1442695040888963407ull;
+      Point point = (Point)((seed >> 40)/(double)(1ull << 24))*max_point;
+      // edge values on some of the samples
+      switch(sample_itr%16) {
+        case 0: point = 0.0f; break;
+        case 1: point = max_point; break;
+        case 2: point = (d%2) ? max_point : 0.0f; break;
+        case 3: point = (d%2) ? 1.0f : point; break;
+        case 4: point = (d==0) ? max_point*2.0f+1.0f : point; break;
+        case 5: point = (d==dims-1) ? -point : point; break;
+        case 6: point = 0.000001f; break;
+        case 7: point = max_point-0.000001f; break;
+      }
+      points[sample_itr*dims+d] = point;
+    }
+  }
+  return points;
+}
+
+// returns the number of mismatching indexes
+static ul CompareEncoders(ui dims, ui number_of_bits) {
+  auto points = GetPoints(dims, number_of_bits);
+
+  std::vector<ll> indexes(number_of_samples);
+  mapper::HilbertMapper::BatchMapping(dims, number_of_bits, points.data(),
+                                      number_of_samples, indexes.data());
+
+  ul number_of_mismatches = 0;
+  std::vector<Point> point_vec(dims);
+  for(ul range(sample_itr, 0, number_of_samples)) {
+    std::copy(points.begin()+sample_itr*dims,
+              points.begin()+(sample_itr+1)*dims, point_vec.begin());
+    auto index = mapper::HilbertMapper::MappingIntoSingle(dims, number_of_bits, point_vec);
+    if(indexes[sample_itr] != index) {
+      if(!number_of_mismatches) {
+        printf("%u dims, %u bits, sample %lu : %lld, expected %lld\n",
+               dims, number_of_bits, sample_itr, indexes[sample_itr], index);
+      }
+      number_of_mismatches++;
+    }
+  }
+  return number_of_mismatches;
+}
+
+} // End of test namespace
+} // End of ursus namespace
+
+int main(void) {
+  using namespace ursus;
+
+  ui number_of_settings = 0;
+  ul number_of_mismatches = 0;
+
+  for(ui range(dims, 1, 64)) {
+    for(ui range(number_of_bits, 1, 64)) {
+      if(!mapper::HilbertMapper::IsBatchMappingSupported(dims, number_of_bits)) {
+        continue;
+      }
+      number_of_mismatches += test::CompareEncoders(dims, number_of_bits);
+      number_of_settings++;
+    }
+  }
+
+  printf("Hilbert mapper : %u dims and bits settings, %lu mismatches\n",
+         number_of_settings, number_of_mismatches);
+
+  return (number_of_mismatches || !number_of_settings) ? 1 : 0;
+}
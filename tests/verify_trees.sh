@@ -0,0 +1,27 @@
+#!/bin/bash
+# Searches every tree on generated data sets and checks the results against a
+# brute-force scan(-v). Sizes that fill neither the last leaf node nor the
+# last MPHR partition evenly are included
+#   usage : tests/verify_trees.sh ./bin/host
+set -e
+
+binary=${1:-./bin/host}
+generator=./generator/generator
+work_directory=$(mktemp -d)
+trap 'rm -rf $work_directory' EXIT
+
+for number_of_data in 24577 100000 100001; do
+  data=$work_directory/data_$number_of_data.bin
+  query=$work_directory/query_$number_of_data.bin
+  $generator -d $number_of_data -t clustered -o $data > /dev/null
+  $generator -q 100 -s 0.1 -i $data -o $query > /dev/null
+
+  mkdir -p $work_directory/index_$number_of_data
+  if ! $binary -d $number_of_data -q 100 -k $work_directory/index_$number_of_data \
+               -a $data -g $query -i all -v > $work_directory/log 2>&1; then
+    grep -i "mismatch\|assert\|error" $work_directory/log || tail -n 20 $work_directory/log
+    echo "Verification failed on $number_of_data data"
+    exit 1
+  fi
+  echo "Verified every tree on $number_of_data data"
+done